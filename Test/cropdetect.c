@@ -0,0 +1,410 @@
+//
+//  cropdetect.c
+//  Finds the black borders of letterboxed / pillarboxed content, so later stages only touch the picture
+//
+//  Rows are scanned inwards from the top and the bottom and stop at the first one with picture in it,
+//  so a frame costs its black bars plus one row each side rather than the whole plane. The row sums
+//  are psadbw against zero. Columns are then summed over at most COLUMN_ROWS rows spread over the
+//  picture rows, widened into 32-bit column accumulators.
+//
+#include <libavutil/common.h>
+#include <libavutil/pixdesc.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+
+#include "cropdetect.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define CROPDETECT_X86 1
+#include <immintrin.h>
+#endif
+
+#define COLUMN_ROWS 256
+
+//Return the x they got up to, the rest of the row is left to the scalar code
+typedef int (*RowSumFunc)(const uint8_t *row, int x, int width, uint64_t *sum);
+typedef int (*ColumnAddFunc)(const uint8_t *row, uint32_t *columns, int x, int width);
+
+struct CropDetector
+{
+    int samples, interval, limit;
+    RowSumFunc rowSum;              //8-bit luma
+    ColumnAddFunc columnAdd;
+
+    int fed, sampled, settled;
+    int frameWidth, frameHeight;
+    int log2ChromaW, log2ChromaH;
+    int left, top, right, bottom;   //Union so far, inclusive, left > right while nothing was found
+
+    uint32_t *columns;
+};
+
+static int row_sum_scalar(const uint8_t *row, int x, int width, uint64_t *sum)
+{
+    uint64_t s = 0;
+
+    for(; x < width; x++)
+        s += row[x];
+    *sum += s;
+    return x;
+}
+
+static int column_add_scalar(const uint8_t *row, uint32_t *columns, int x, int width)
+{
+    for(; x < width; x++)
+        columns[x] += row[x];
+    return x;
+}
+
+#ifdef CROPDETECT_X86
+
+__attribute__((target("sse2")))
+static int row_sum_sse2(const uint8_t *row, int x, int width, uint64_t *sum)
+{
+    const __m128i zero = _mm_setzero_si128();
+    __m128i acc = _mm_setzero_si128();
+    uint64_t lanes[2];
+
+    for(; x + 16 <= width; x += 16)
+        acc = _mm_add_epi64(acc, _mm_sad_epu8(_mm_loadu_si128((const __m128i *)(row + x)), zero));
+    _mm_storeu_si128((__m128i *)lanes, acc);
+    *sum += lanes[0] + lanes[1];
+    return x;
+}
+
+__attribute__((target("sse2")))
+static int column_add_sse2(const uint8_t *row, uint32_t *columns, int x, int width)
+{
+    const __m128i zero = _mm_setzero_si128();
+
+    for(; x + 16 <= width; x += 16)
+    {
+        __m128i v = _mm_loadu_si128((const __m128i *)(row + x));
+        __m128i w[2] = { _mm_unpacklo_epi8(v, zero), _mm_unpackhi_epi8(v, zero) };
+        int i;
+
+        for(i = 0; i < 2; i++)
+        {
+            __m128i *c = (__m128i *)(columns + x + 8 * i);
+
+            _mm_storeu_si128(c, _mm_add_epi32(_mm_loadu_si128(c), _mm_unpacklo_epi16(w[i], zero)));
+            _mm_storeu_si128(c + 1, _mm_add_epi32(_mm_loadu_si128(c + 1), _mm_unpackhi_epi16(w[i], zero)));
+        }
+    }
+    return x;
+}
+
+__attribute__((target("avx2")))
+static int row_sum_avx2(const uint8_t *row, int x, int width, uint64_t *sum)
+{
+    const __m256i zero = _mm256_setzero_si256();
+    __m256i acc = _mm256_setzero_si256();
+    uint64_t lanes[4];
+
+    for(; x + 32 <= width; x += 32)
+        acc = _mm256_add_epi64(acc, _mm256_sad_epu8(_mm256_loadu_si256((const __m256i *)(row + x)), zero));
+    _mm256_storeu_si256((__m256i *)lanes, acc);
+    *sum += lanes[0] + lanes[1] + lanes[2] + lanes[3];
+    return x;
+}
+
+__attribute__((target("avx2")))
+static int column_add_avx2(const uint8_t *row, uint32_t *columns, int x, int width)
+{
+    for(; x + 16 <= width; x += 16)
+    {
+        __m128i v = _mm_loadu_si128((const __m128i *)(row + x));
+        __m256i *c = (__m256i *)(columns + x);
+
+        _mm256_storeu_si256(c, _mm256_add_epi32(_mm256_loadu_si256(c), _mm256_cvtepu8_epi32(v)));
+        _mm256_storeu_si256(c + 1, _mm256_add_epi32(_mm256_loadu_si256(c + 1),
+                                                     _mm256_cvtepu8_epi32(_mm_srli_si128(v, 8))));
+    }
+    return x;
+}
+
+#endif
+
+CropDetector *cropdetect_create(int samples, int interval, int limit, Yuv2RgbKernel kernel)
+{
+    CropDetector *detector;
+
+    if(kernel == YUV2RGB_KERNEL_AUTO)
+        kernel = yuv2rgb_best_kernel();
+    else if(!yuv2rgb_kernel_supported(kernel))
+        return NULL;
+
+    detector = calloc(1, sizeof(CropDetector));
+    if(!detector)
+        return NULL;
+    detector->samples = FFMAX(samples, 1);
+    detector->interval = FFMAX(interval, 1);
+    detector->limit = limit;
+    detector->rowSum = row_sum_scalar;
+    detector->columnAdd = column_add_scalar;
+#ifdef CROPDETECT_X86
+    if(kernel == YUV2RGB_KERNEL_SSE41)
+    {
+        detector->rowSum = row_sum_sse2;
+        detector->columnAdd = column_add_sse2;
+    }
+    else if(kernel == YUV2RGB_KERNEL_AVX2 || kernel == YUV2RGB_KERNEL_AVX512)
+    {
+        detector->rowSum = row_sum_avx2;
+        detector->columnAdd = column_add_avx2;
+    }
+#endif
+    return detector;
+}
+
+//Sum of the luma samples of one row, and the same added into the column sums when columns is not NULL
+static uint64_t luma_row(const CropDetector *detector, const AVFrame *frame, const AVPixFmtDescriptor *desc,
+                         int y, uint32_t *columns)
+{
+    const uint8_t *row = frame->data[0] + y * frame->linesize[0];
+    uint64_t sum = 0;
+    int x;
+
+    if(desc->comp[0].step == 1)
+    {
+        if(columns)
+            column_add_scalar(row, columns, detector->columnAdd(row, columns, 0, frame->width), frame->width);
+        row_sum_scalar(row, detector->rowSum(row, 0, frame->width, &sum), frame->width, &sum);
+        return sum;
+    }
+
+    //9 to 16 bits in words, P010 style formats keep them in the high bits
+    for(x = 0; x < frame->width; x++)
+    {
+        int v = ((const uint16_t *)row)[x] >> desc->comp[0].shift;
+
+        sum += v;
+        if(columns)
+            columns[x] += v;
+    }
+    return sum;
+}
+
+//The picture rectangle of one frame, 0 when the frame is black all over
+static int analyze(CropDetector *detector, const AVFrame *frame, const AVPixFmtDescriptor *desc,
+                   int *left, int *top, int *right, int *bottom)
+{
+    int width = frame->width, height = frame->height;
+    uint64_t rowLimit = (uint64_t)(detector->limit << (desc->comp[0].depth - 8)) * width;
+    uint64_t columnLimit;
+    int y, x, step, rows;
+
+    for(y = 0; y < height && luma_row(detector, frame, desc, y, NULL) <= rowLimit; y++)
+        ;
+    if(y == height)
+        return 0;
+    *top = y;
+    for(y = height - 1; y > *top && luma_row(detector, frame, desc, y, NULL) <= rowLimit; y--)
+        ;
+    *bottom = y;
+
+    memset(detector->columns, 0, width * sizeof(uint32_t));
+    step = (*bottom - *top) / COLUMN_ROWS + 1;
+    rows = 0;
+    for(y = *top; y <= *bottom; y += step, rows++)
+        luma_row(detector, frame, desc, y, detector->columns);
+
+    columnLimit = (uint64_t)(detector->limit << (desc->comp[0].depth - 8)) * rows;
+    for(x = 0; x < width && detector->columns[x] <= columnLimit; x++)
+        ;
+    //A lit row is lit somewhere, but the sampled rows may all have missed it
+    if(x == width)
+        return 0;
+    *left = x;
+    for(x = width - 1; x > *left && detector->columns[x] <= columnLimit; x--)
+        ;
+    *right = x;
+    return 1;
+}
+
+//Luma in plane 0, one byte or one word per sample
+static const AVPixFmtDescriptor *luma_desc(enum AVPixelFormat format)
+{
+    const AVPixFmtDescriptor *desc = av_pix_fmt_desc_get(format);
+
+    if(!desc || (desc->flags & (AV_PIX_FMT_FLAG_RGB | AV_PIX_FMT_FLAG_PAL | AV_PIX_FMT_FLAG_BITSTREAM |
+                                AV_PIX_FMT_FLAG_HWACCEL)) || desc->nb_components < 1 || desc->comp[0].plane != 0)
+    {
+        return NULL;
+    }
+    if(desc->comp[0].step == 1 && desc->comp[0].depth == 8)
+        return desc;
+    if(desc->comp[0].step == 2 && desc->comp[0].depth > 8 && !(desc->flags & AV_PIX_FMT_FLAG_BE))
+        return desc;
+    return NULL;
+}
+
+int cropdetect_feed(CropDetector *detector, const AVFrame *frame)
+{
+    const AVPixFmtDescriptor *desc = luma_desc(frame->format);
+    int left, top, right, bottom;
+
+    if(!desc)
+        return -1;
+    if(detector->settled)
+        return 1;
+
+    //A new size makes what was found so far meaningless
+    if(frame->width != detector->frameWidth || frame->height != detector->frameHeight)
+    {
+        uint32_t *columns = av_realloc_array(detector->columns, frame->width, sizeof(uint32_t));
+
+        if(!columns)
+            return -1;
+        detector->columns = columns;
+        detector->frameWidth = frame->width;
+        detector->frameHeight = frame->height;
+        detector->log2ChromaW = desc->log2_chroma_w;
+        detector->log2ChromaH = desc->log2_chroma_h;
+        detector->left = detector->top = INT_MAX;
+        detector->right = detector->bottom = -1;
+        detector->sampled = 0;
+        detector->fed = 0;
+    }
+
+    if(detector->fed++ % detector->interval)
+        return 0;
+    if(!analyze(detector, frame, desc, &left, &top, &right, &bottom))
+        return 0;
+
+    detector->left = FFMIN(detector->left, left);
+    detector->top = FFMIN(detector->top, top);
+    detector->right = FFMAX(detector->right, right);
+    detector->bottom = FFMAX(detector->bottom, bottom);
+    if(++detector->sampled >= detector->samples)
+        detector->settled = 1;
+    return detector->settled;
+}
+
+int cropdetect_result(const CropDetector *detector, CropRect *rect)
+{
+    int alignW = 1 << detector->log2ChromaW;
+    int alignH = 1 << detector->log2ChromaH;
+    int x1, y1;
+
+    if(!detector->frameWidth)
+        return -1;
+
+    rect->frameWidth = detector->frameWidth;
+    rect->frameHeight = detector->frameHeight;
+    if(detector->right < 0)
+    {
+        rect->x = rect->y = 0;
+        rect->width = detector->frameWidth;
+        rect->height = detector->frameHeight;
+        return 0;
+    }
+
+    //Outwards to whole chroma samples
+    rect->x = detector->left & ~(alignW - 1);
+    rect->y = detector->top & ~(alignH - 1);
+    x1 = FFMIN(FFALIGN(detector->right + 1, alignW), detector->frameWidth);
+    y1 = FFMIN(FFALIGN(detector->bottom + 1, alignH), detector->frameHeight);
+    rect->width = x1 - rect->x;
+    rect->height = y1 - rect->y;
+    return 0;
+}
+
+void cropdetect_destroy(CropDetector **detectorPtr)
+{
+    CropDetector *detector = *detectorPtr;
+
+    if(!detector)
+        return;
+    av_free(detector->columns);
+    free(detector);
+    *detectorPtr = NULL;
+}
+
+int cropdetect_is_cropped(const CropRect *rect)
+{
+    return rect->width != rect->frameWidth || rect->height != rect->frameHeight;
+}
+
+int cropdetect_view(AVFrame *view, const AVFrame *src, const CropRect *rect)
+{
+    if(src->width != rect->frameWidth || src->height != rect->frameHeight)
+        return -1;
+
+    *view = *src;
+    view->crop_left = rect->x;
+    view->crop_top = rect->y;
+    view->crop_right = rect->frameWidth - rect->x - rect->width;
+    view->crop_bottom = rect->frameHeight - rect->y - rect->height;
+    //Unaligned: the converters use unaligned loads, and an aligned crop could leave border pixels in
+    return av_frame_apply_cropping(view, AV_FRAME_CROP_UNALIGNED);
+}
+
+//The part of a cache line before the path
+static int file_key(const char *path, long long *mtime, long long *size)
+{
+    struct stat st;
+
+    if(stat(path, &st) != 0)
+        return -1;
+    *mtime = (long long)st.st_mtime;
+    *size = (long long)st.st_size;
+    return 0;
+}
+
+int cropdetect_cache_lookup(const char *path, int frame_width, int frame_height, CropRect *rect)
+{
+    FILE *cache;
+    char line[4096];
+    long long mtime, size;
+    int found = -1;
+
+    if(file_key(path, &mtime, &size) < 0)
+        return -1;
+    cache = fopen(CROPDETECT_CACHE, "r");
+    if(!cache)
+        return -1;
+
+    //mtime size frameWidth frameHeight x y width height path
+    while(found < 0 && fgets(line, sizeof(line), cache))
+    {
+        long long lineMtime, lineSize;
+        CropRect r;
+        int pathStart = 0;
+
+        line[strcspn(line, "\n")] = '\0';
+        if(sscanf(line, "%lld %lld %d %d %d %d %d %d %n", &lineMtime, &lineSize, &r.frameWidth, &r.frameHeight,
+                  &r.x, &r.y, &r.width, &r.height, &pathStart) < 8 || !pathStart)
+        {
+            continue;
+        }
+        if(lineMtime == mtime && lineSize == size && r.frameWidth == frame_width && r.frameHeight == frame_height &&
+           strcmp(line + pathStart, path) == 0)
+        {
+            *rect = r;
+            found = 0;
+        }
+    }
+    fclose(cache);
+    return found;
+}
+
+int cropdetect_cache_store(const char *path, const CropRect *rect)
+{
+    FILE *cache;
+    long long mtime, size;
+    int ret;
+
+    if(file_key(path, &mtime, &size) < 0)
+        return -1;
+    cache = fopen(CROPDETECT_CACHE, "a");
+    if(!cache)
+        return -1;
+    ret = fprintf(cache, "%lld %lld %d %d %d %d %d %d %s\n", mtime, size, rect->frameWidth, rect->frameHeight,
+                  rect->x, rect->y, rect->width, rect->height, path);
+    fclose(cache);
+    return ret < 0 ? -1 : 0;
+}
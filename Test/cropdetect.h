@@ -0,0 +1,56 @@
+//
+//  cropdetect.h
+//  Finds the black borders of letterboxed / pillarboxed content, so later stages only touch the picture
+//
+//  Every sampled frame gives the rectangle of rows and columns whose mean luma is above a limit; the
+//  answer is the union of those over several frames spread over the start of the stream, which keeps
+//  a dark scene from eating into the picture. Frames that are black all over are not counted.
+//  The rectangle is aligned to the chroma subsampling so a cropped frame still has whole chroma samples.
+//
+#ifndef CROPDETECT_H
+#define CROPDETECT_H
+
+#include <libavutil/frame.h>
+
+#include "yuv2rgb.h"
+
+typedef struct CropRect
+{
+    int x, y;
+    int width, height;
+    int frameWidth, frameHeight;    //Size of the frames it was found in
+} CropRect;
+
+typedef struct CropDetector CropDetector;
+
+//Analyzes every interval-th frame fed until samples non-black ones were seen
+//limit is the luma mean (0..255, scaled for deeper formats) a row or column must exceed to count as picture
+//kernel picks the SSE2 (any SSE4.1 or better CPU) / AVX2 row kernels the way yuv2rgb does
+CropDetector *cropdetect_create(int samples, int interval, int limit, Yuv2RgbKernel kernel);
+
+//Returns 1 once the rectangle is settled (further frames are ignored), 0 while it wants more frames,
+//< 0 when the frame's format has no 8-bit or 16-bit luma plane
+int cropdetect_feed(CropDetector *detector, const AVFrame *frame);
+
+//The rectangle found so far, the whole frame when no picture was seen; returns < 0 before any frame was fed
+int cropdetect_result(const CropDetector *detector, CropRect *rect);
+
+void cropdetect_destroy(CropDetector **detector);
+
+//1 when rect leaves something out of its frames
+int cropdetect_is_cropped(const CropRect *rect);
+
+//Makes view a crop of src: same buffers, data pointers moved to rect's corner, rect's size
+//view holds no references of its own, so it is only valid while src is and must never be unref'ed or freed
+//Returns < 0 when src is not the size rect was found for
+int cropdetect_view(AVFrame *view, const AVFrame *src, const CropRect *rect);
+
+//Rectangles found earlier for a file, keyed by its path, size and modification time, in CROPDETECT_CACHE
+#define CROPDETECT_CACHE "cropdetect.cache"
+
+//0 and rect filled when path (at frame_width x frame_height) is in the cache, < 0 otherwise
+int cropdetect_cache_lookup(const char *path, int frame_width, int frame_height, CropRect *rect);
+
+int cropdetect_cache_store(const char *path, const CropRect *rect);
+
+#endif
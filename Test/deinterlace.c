@@ -0,0 +1,444 @@
+//
+//  deinterlace.c
+//  Deinterlacing between decode and display/export, one output frame per input frame
+//
+//  For a missing pixel the adaptive mode works like yadif (with this frame standing in for yadif's
+//  next frame, so there is no frame of latency): d is the mean of the other field in the previous and
+//  this frame, diff how far the picture moved around it, and the spatial guess, the vertical or the
+//  better of the two neighbouring diagonals, is clamped into [d - diff, d + diff]. Still areas
+//  therefore keep the other field's detail and moving ones are interpolated.
+//  The row kernels work in 16-bit lanes with the scalar code's integer steps, so they are bit-exact with it.
+//  Rows are cut into bands that run on the slice pool, every output row depends on input rows only.
+//
+#include <libavutil/common.h>
+#include <libavutil/pixdesc.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "deinterlace.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define DEINTERLACE_X86 1
+#include <immintrin.h>
+#endif
+
+//The lines around a missing line, all at the same x
+typedef struct FieldLines
+{
+    const uint8_t *c, *e;       //Kept field, the line above and the line below
+    const uint8_t *pc, *pe;     //The same two lines in the previous frame
+    const uint8_t *p, *n;       //Other field, this line in the previous frame and in this one
+    const uint8_t *pu, *nu;     //Other field two lines up, previous frame and this one
+    const uint8_t *pd, *nd;     //Other field two lines down
+} FieldLines;
+
+//Return the x they got up to, the rest of the line is left to the scalar code
+typedef int (*BobRowFunc)(const uint8_t *c, const uint8_t *e, uint8_t *dst, int x, int width);
+typedef int (*AdaptiveRowFunc)(const FieldLines *l, uint8_t *dst, int x, int width);
+
+struct Deinterlacer
+{
+    SlicePool *pool;
+    DeinterlaceMode mode;
+    BobRowFunc bobRow;
+    AdaptiveRowFunc adaptiveRow;        //NULL for the scalar kernel
+
+    AVFrame *out;                       //The deinterlaced picture handed back
+    AVFrame *prev;                      //Reference to the previous interlaced frame, adaptive mode only
+
+    //The frame being worked on
+    const AVFrame *cur;
+    int adaptive;                       //0 when there is no usable previous frame
+    int keepBottom;                     //1 for bottom field first, the odd lines are kept
+    int planes;
+    int planeWidth[4], planeHeight[4];
+    int bands;
+
+    unsigned long long deinterlaced, passed;
+};
+
+static int bob_row_scalar(const uint8_t *c, const uint8_t *e, uint8_t *dst, int x, int width)
+{
+    for(; x < width; x++)
+        dst[x] = (uint8_t)((c[x] + e[x] + 1) >> 1);
+    return x;
+}
+
+//Pixels [x, end) of a line width wide, the diagonals are only looked at 2 pixels or more from either edge
+static void adaptive_pixels_scalar(const FieldLines *l, uint8_t *dst, int x, int end, int width)
+{
+    const uint8_t *cl = l->c, *el = l->e;
+
+    for(; x < end; x++)
+    {
+        int c = cl[x], e = el[x];
+        int p = l->p[x], n = l->n[x];
+        int d = (p + n) >> 1;
+        int diff = FFMAX(abs(p - n) >> 1, (abs(l->pc[x] - c) + abs(l->pe[x] - e)) >> 1);
+        int b = (l->pu[x] + l->nu[x]) >> 1;
+        int f = (l->pd[x] + l->nd[x]) >> 1;
+        int hi = FFMAX3(d - e, d - c, FFMIN(b - c, f - e));
+        int lo = FFMIN3(d - e, d - c, FFMAX(b - c, f - e));
+        int spatial = (c + e) >> 1;
+
+        diff = FFMAX3(diff, lo, -hi);
+
+        if(x >= 2 && x + 2 < width)
+        {
+            //Vertical wins ties, as in yadif
+            int best = abs(cl[x - 1] - el[x - 1]) + abs(c - e) + abs(cl[x + 1] - el[x + 1]) - 1;
+            int score = abs(cl[x - 2] - el[x]) + abs(cl[x - 1] - el[x + 1]) + abs(c - el[x + 2]);
+
+            if(score < best)
+            {
+                best = score;
+                spatial = (cl[x - 1] + el[x + 1]) >> 1;
+            }
+            score = abs(c - el[x - 2]) + abs(cl[x + 1] - el[x - 1]) + abs(cl[x + 2] - e);
+            if(score < best)
+                spatial = (cl[x + 1] + el[x - 1]) >> 1;
+        }
+
+        dst[x] = (uint8_t)FFMAX(FFMIN(spatial, d + diff), d - diff);
+    }
+}
+
+#ifdef DEINTERLACE_X86
+
+//One vector of pixels of a missing line, in 16-bit lanes; load(ptr, offset) widens the pixels at x + offset
+#define ADAPTIVE_PIXELS(prefix, load, zero, out)                                                      \
+    do {                                                                                              \
+        __typeof__(out) c_ = load(l->c, 0), e_ = load(l->e, 0);                                       \
+        __typeof__(out) p_ = load(l->p, 0), n_ = load(l->n, 0);                                       \
+        __typeof__(out) d_ = prefix##_srai_epi16(prefix##_add_epi16(p_, n_), 1);                      \
+        __typeof__(out) b_ = prefix##_srai_epi16(prefix##_add_epi16(load(l->pu, 0), load(l->nu, 0)), 1); \
+        __typeof__(out) f_ = prefix##_srai_epi16(prefix##_add_epi16(load(l->pd, 0), load(l->nd, 0)), 1); \
+        __typeof__(out) de_ = prefix##_sub_epi16(d_, e_), dc_ = prefix##_sub_epi16(d_, c_);           \
+        __typeof__(out) bc_ = prefix##_sub_epi16(b_, c_), fe_ = prefix##_sub_epi16(f_, e_);           \
+        __typeof__(out) hi_ = prefix##_max_epi16(prefix##_max_epi16(de_, dc_), prefix##_min_epi16(bc_, fe_)); \
+        __typeof__(out) lo_ = prefix##_min_epi16(prefix##_min_epi16(de_, dc_), prefix##_max_epi16(bc_, fe_)); \
+        __typeof__(out) diff_ = prefix##_max_epi16(                                                   \
+            prefix##_srai_epi16(prefix##_abs_epi16(prefix##_sub_epi16(p_, n_)), 1),                   \
+            prefix##_srai_epi16(prefix##_add_epi16(prefix##_abs_epi16(prefix##_sub_epi16(load(l->pc, 0), c_)), \
+                                                   prefix##_abs_epi16(prefix##_sub_epi16(load(l->pe, 0), e_))), 1)); \
+        __typeof__(out) cl_ = load(l->c, -1), cr_ = load(l->c, 1), el_ = load(l->e, -1), er_ = load(l->e, 1); \
+        __typeof__(out) best_, score_, spatial_;                                                      \
+        diff_ = prefix##_max_epi16(prefix##_max_epi16(diff_, lo_), prefix##_sub_epi16(zero, hi_));    \
+        spatial_ = prefix##_srai_epi16(prefix##_add_epi16(c_, e_), 1);                                \
+        best_ = prefix##_sub_epi16(prefix##_add_epi16(prefix##_add_epi16(                             \
+            prefix##_abs_epi16(prefix##_sub_epi16(cl_, el_)), prefix##_abs_epi16(prefix##_sub_epi16(c_, e_))), \
+            prefix##_abs_epi16(prefix##_sub_epi16(cr_, er_))), prefix##_set1_epi16(1));               \
+        score_ = prefix##_add_epi16(prefix##_add_epi16(                                               \
+            prefix##_abs_epi16(prefix##_sub_epi16(load(l->c, -2), e_)), prefix##_abs_epi16(prefix##_sub_epi16(cl_, er_))), \
+            prefix##_abs_epi16(prefix##_sub_epi16(c_, load(l->e, 2))));                               \
+        {                                                                                             \
+            __typeof__(out) take_ = prefix##_cmpgt_epi16(best_, score_);                              \
+            best_ = prefix##_blendv_epi8(best_, score_, take_);                                       \
+            spatial_ = prefix##_blendv_epi8(spatial_, prefix##_srai_epi16(prefix##_add_epi16(cl_, er_), 1), take_); \
+        }                                                                                             \
+        score_ = prefix##_add_epi16(prefix##_add_epi16(                                               \
+            prefix##_abs_epi16(prefix##_sub_epi16(c_, load(l->e, -2))), prefix##_abs_epi16(prefix##_sub_epi16(cr_, el_))), \
+            prefix##_abs_epi16(prefix##_sub_epi16(load(l->c, 2), e_)));                               \
+        spatial_ = prefix##_blendv_epi8(spatial_, prefix##_srai_epi16(prefix##_add_epi16(cr_, el_), 1), \
+                                        prefix##_cmpgt_epi16(best_, score_));                         \
+        out = prefix##_max_epi16(prefix##_min_epi16(spatial_, prefix##_add_epi16(d_, diff_)),         \
+                                 prefix##_sub_epi16(d_, diff_));                                      \
+    } while(0)
+
+#define LOAD8_SSE41(ptr, offset) _mm_cvtepu8_epi16(_mm_loadl_epi64((const __m128i *)((ptr) + x + (offset))))
+#define LOAD16_AVX2(ptr, offset) _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i *)((ptr) + x + (offset))))
+
+__attribute__((target("sse4.1")))
+static int bob_row_sse41(const uint8_t *c, const uint8_t *e, uint8_t *dst, int x, int width)
+{
+    for(; x + 16 <= width; x += 16)
+    {
+        _mm_storeu_si128((__m128i *)(dst + x), _mm_avg_epu8(_mm_loadu_si128((const __m128i *)(c + x)),
+                                                            _mm_loadu_si128((const __m128i *)(e + x))));
+    }
+    return x;
+}
+
+//8 pixels a step, reads 2 pixels either side
+__attribute__((target("sse4.1")))
+static int adaptive_row_sse41(const FieldLines *l, uint8_t *dst, int x, int width)
+{
+    const __m128i zero = _mm_setzero_si128();
+
+    for(; x + 8 + 2 <= width; x += 8)
+    {
+        __m128i v;
+
+        ADAPTIVE_PIXELS(_mm, LOAD8_SSE41, zero, v);
+        _mm_storel_epi64((__m128i *)(dst + x), _mm_packus_epi16(v, v));
+    }
+    return x;
+}
+
+__attribute__((target("avx2")))
+static int bob_row_avx2(const uint8_t *c, const uint8_t *e, uint8_t *dst, int x, int width)
+{
+    for(; x + 32 <= width; x += 32)
+    {
+        _mm256_storeu_si256((__m256i *)(dst + x), _mm256_avg_epu8(_mm256_loadu_si256((const __m256i *)(c + x)),
+                                                                  _mm256_loadu_si256((const __m256i *)(e + x))));
+    }
+    return x;
+}
+
+//16 pixels a step
+__attribute__((target("avx2")))
+static int adaptive_row_avx2(const FieldLines *l, uint8_t *dst, int x, int width)
+{
+    const __m256i zero = _mm256_setzero_si256();
+
+    for(; x + 16 + 2 <= width; x += 16)
+    {
+        __m256i v;
+
+        ADAPTIVE_PIXELS(_mm256, LOAD16_AVX2, zero, v);
+        v = _mm256_permute4x64_epi64(_mm256_packus_epi16(v, v), 0x08);
+        _mm_storeu_si128((__m128i *)(dst + x), _mm256_castsi256_si128(v));
+    }
+    return x;
+}
+
+#endif
+
+Deinterlacer *deinterlace_create(SlicePool *pool, DeinterlaceMode mode, Yuv2RgbKernel kernel)
+{
+    Deinterlacer *deinterlacer;
+
+    if(kernel == YUV2RGB_KERNEL_AUTO)
+        kernel = yuv2rgb_best_kernel();
+    else if(!yuv2rgb_kernel_supported(kernel))
+        return NULL;
+
+    deinterlacer = calloc(1, sizeof(Deinterlacer));
+    if(!deinterlacer)
+        return NULL;
+    deinterlacer->pool = pool;
+    deinterlacer->mode = mode;
+    deinterlacer->bobRow = bob_row_scalar;
+#ifdef DEINTERLACE_X86
+    if(kernel == YUV2RGB_KERNEL_SSE41)
+    {
+        deinterlacer->bobRow = bob_row_sse41;
+        deinterlacer->adaptiveRow = adaptive_row_sse41;
+    }
+    else if(kernel == YUV2RGB_KERNEL_AVX2 || kernel == YUV2RGB_KERNEL_AVX512)
+    {
+        deinterlacer->bobRow = bob_row_avx2;
+        deinterlacer->adaptiveRow = adaptive_row_avx2;
+    }
+#endif
+    deinterlacer->out = av_frame_alloc();
+    deinterlacer->prev = av_frame_alloc();
+    if(!deinterlacer->out || !deinterlacer->prev)
+    {
+        deinterlace_destroy(&deinterlacer);
+        return NULL;
+    }
+    return deinterlacer;
+}
+
+const char *deinterlace_mode_name(DeinterlaceMode mode)
+{
+    switch(mode)
+    {
+    case DEINTERLACE_BOB:       return "bob";
+    case DEINTERLACE_ADAPTIVE:  return "adaptive";
+    default:                    return "unknown";
+    }
+}
+
+//Planar, one byte per sample: every line of every plane can be worked on on its own
+static int supported_format(enum AVPixelFormat format)
+{
+    const AVPixFmtDescriptor *desc = av_pix_fmt_desc_get(format);
+    int i;
+
+    if(!desc || !(desc->flags & AV_PIX_FMT_FLAG_PLANAR) ||
+       (desc->flags & (AV_PIX_FMT_FLAG_PAL | AV_PIX_FMT_FLAG_BITSTREAM | AV_PIX_FMT_FLAG_HWACCEL)))
+    {
+        return 0;
+    }
+    for(i = 0; i < desc->nb_components; i++)
+    {
+        if(desc->comp[i].depth != 8 || desc->comp[i].step != 1)
+            return 0;
+    }
+    return 1;
+}
+
+static inline const uint8_t *frame_line(const AVFrame *frame, int plane, int y)
+{
+    return frame->data[plane] + y * frame->linesize[plane];
+}
+
+static void deinterlace_line(const Deinterlacer *deinterlacer, int plane, int y, uint8_t *dst)
+{
+    const AVFrame *cur = deinterlacer->cur;
+    const AVFrame *prev = deinterlacer->prev;
+    int width = deinterlacer->planeWidth[plane];
+    int height = deinterlacer->planeHeight[plane];
+    //Kept lines above and below, mirrored at the top and bottom edges
+    int above = y > 0 ? y - 1 : y + 1;
+    int below = y + 1 < height ? y + 1 : y - 1;
+    FieldLines l;
+    int x;
+
+    if(above >= height || below < 0)
+    {
+        memcpy(dst, frame_line(cur, plane, y), width);
+        return;
+    }
+
+    l.c = frame_line(cur, plane, above);
+    l.e = frame_line(cur, plane, below);
+    if(!deinterlacer->adaptive)
+    {
+        bob_row_scalar(l.c, l.e, dst, deinterlacer->bobRow(l.c, l.e, dst, 0, width), width);
+        return;
+    }
+
+    l.pc = frame_line(prev, plane, above);
+    l.pe = frame_line(prev, plane, below);
+    l.p = frame_line(prev, plane, y);
+    l.n = frame_line(cur, plane, y);
+    l.pu = frame_line(prev, plane, y >= 2 ? y - 2 : y);
+    l.nu = frame_line(cur, plane, y >= 2 ? y - 2 : y);
+    l.pd = frame_line(prev, plane, y + 2 < height ? y + 2 : y);
+    l.nd = frame_line(cur, plane, y + 2 < height ? y + 2 : y);
+
+    //The vector kernels start at pixel 2, where the diagonals first fit
+    x = deinterlacer->adaptiveRow ? deinterlacer->adaptiveRow(&l, dst, 2, width) : 2;
+    adaptive_pixels_scalar(&l, dst, 0, FFMIN(2, width), width);
+    adaptive_pixels_scalar(&l, dst, x, width, width);
+}
+
+static void deinterlace_band(void *opaque, int band, int thread)
+{
+    Deinterlacer *deinterlacer = (Deinterlacer *)opaque;
+    const AVFrame *cur = deinterlacer->cur;
+    AVFrame *out = deinterlacer->out;
+    int p, y;
+    
+    (void)thread;   //Bands write straight into out, no per-thread scratch
+
+    for(p = 0; p < deinterlacer->planes; p++)
+    {
+        int height = deinterlacer->planeHeight[p];
+        int first = height * band / deinterlacer->bands;
+        int last = height * (band + 1) / deinterlacer->bands;
+
+        for(y = first; y < last; y++)
+        {
+            uint8_t *dst = out->data[p] + y * out->linesize[p];
+
+            if((y & 1) == deinterlacer->keepBottom)
+                memcpy(dst, frame_line(cur, p, y), deinterlacer->planeWidth[p]);
+            else
+                deinterlace_line(deinterlacer, p, y, dst);
+        }
+    }
+}
+
+//Reallocates the output when the input's size or format changed
+static int prepare_output(Deinterlacer *deinterlacer, const AVFrame *frame)
+{
+    AVFrame *out = deinterlacer->out;
+
+    if(!out->data[0] || out->width != frame->width || out->height != frame->height || out->format != frame->format)
+    {
+        av_frame_unref(out);
+        out->format = frame->format;
+        out->width = frame->width;
+        out->height = frame->height;
+        if(av_frame_get_buffer(out, 32) < 0)
+            return -1;
+    }
+    //copy_props adds to the side data and merges the metadata already there, out is reused so clear both first
+    while(out->nb_side_data)
+        av_frame_remove_side_data(out, out->side_data[0]->type);
+    av_dict_free(&out->metadata);
+    if(av_frame_copy_props(out, frame) < 0)
+        return -1;
+    out->interlaced_frame = 0;
+    out->top_field_first = 0;
+    return 0;
+}
+
+const AVFrame *deinterlace_frame(Deinterlacer *deinterlacer, const AVFrame *frame)
+{
+    const AVPixFmtDescriptor *desc;
+    AVFrame *prev = deinterlacer->prev;
+    int p;
+
+    if(!frame->interlaced_frame || !supported_format(frame->format))
+    {
+        //A previous frame from before a progressive stretch says nothing about the next interlaced one
+        av_frame_unref(prev);
+        deinterlacer->passed++;
+        return frame;
+    }
+
+    if(prepare_output(deinterlacer, frame) < 0)
+        return NULL;
+
+    desc = av_pix_fmt_desc_get(frame->format);
+    deinterlacer->cur = frame;
+    deinterlacer->keepBottom = !frame->top_field_first;
+    deinterlacer->adaptive = deinterlacer->mode == DEINTERLACE_ADAPTIVE && prev->data[0] &&
+                             prev->width == frame->width && prev->height == frame->height &&
+                             prev->format == frame->format;
+    deinterlacer->planes = av_pix_fmt_count_planes(frame->format);
+    for(p = 0; p < deinterlacer->planes; p++)
+    {
+        int chroma = p == 1 || p == 2;
+
+        deinterlacer->planeWidth[p] = chroma ? AV_CEIL_RSHIFT(frame->width, desc->log2_chroma_w) : frame->width;
+        deinterlacer->planeHeight[p] = chroma ? AV_CEIL_RSHIFT(frame->height, desc->log2_chroma_h) : frame->height;
+    }
+
+    if(!deinterlacer->pool || frame->height < 64)
+    {
+        deinterlacer->bands = 1;
+        deinterlace_band(deinterlacer, 0, 0);
+    }
+    else
+    {
+        deinterlacer->bands = FFMIN(slice_pool_threads(deinterlacer->pool) * 2, frame->height / 16);
+        slice_pool_run(deinterlacer->pool, deinterlace_band, deinterlacer, deinterlacer->bands);
+    }
+
+    //A reference, not a copy, for refcounted frames (the players set refcounted_frames): the decoder then
+    //allocates a new buffer rather than write into one still referenced. Other frames are copied whole.
+    if(deinterlacer->mode == DEINTERLACE_ADAPTIVE)
+    {
+        av_frame_unref(prev);
+        if(av_frame_ref(prev, frame) < 0)
+            av_frame_unref(prev);
+    }
+
+    deinterlacer->deinterlaced++;
+    return deinterlacer->out;
+}
+
+void deinterlace_dump(const Deinterlacer *deinterlacer, FILE *out)
+{
+    fprintf(out, "deinterlace(%s): deinterlaced(%llu), passed through(%llu)\n",
+            deinterlace_mode_name(deinterlacer->mode), deinterlacer->deinterlaced, deinterlacer->passed);
+}
+
+void deinterlace_destroy(Deinterlacer **deinterlacerPtr)
+{
+    Deinterlacer *deinterlacer = *deinterlacerPtr;
+
+    if(!deinterlacer)
+        return;
+    av_frame_free(&deinterlacer->out);
+    av_frame_free(&deinterlacer->prev);
+    free(deinterlacer);
+    *deinterlacerPtr = NULL;
+}
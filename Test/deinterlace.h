@@ -0,0 +1,45 @@
+//
+//  deinterlace.h
+//  Deinterlacing between decode and display/export, one output frame per input frame
+//
+//  The field the frame shows first is kept and the other field's lines are rebuilt:
+//  bob interpolates them from the kept lines above and below, adaptive (after yadif) takes the
+//  other field of this frame and the previous one, which straddle the kept field in time, and falls
+//  back to an edge-directed spatial guess where they disagree, i.e. where something moved.
+//  Frames not flagged interlaced_frame are handed back untouched, progressive content pays nothing.
+//
+#ifndef DEINTERLACE_H
+#define DEINTERLACE_H
+
+#include <libavutil/frame.h>
+#include <stdio.h>
+
+#include "slice_pool.h"
+#include "yuv2rgb.h"
+
+typedef enum DeinterlaceMode
+{
+    DEINTERLACE_BOB,
+    DEINTERLACE_ADAPTIVE,   //Needs the previous frame, the first interlaced frame is bobbed
+    DEINTERLACE_MODE_COUNT,
+} DeinterlaceMode;
+
+typedef struct Deinterlacer Deinterlacer;
+
+//pool may be NULL to work on the caller's thread only, kernel picks the SSE4.1 / AVX2 row kernels
+//(AVX-512 uses the AVX2 ones) the way yuv2rgb does
+Deinterlacer *deinterlace_create(SlicePool *pool, DeinterlaceMode mode, Yuv2RgbKernel kernel);
+
+const char *deinterlace_mode_name(DeinterlaceMode mode);
+
+//Returns frame itself when it is progressive or not 8-bit planar, else the deinterlaced picture,
+//which stays valid until the next call. NULL on error.
+//Adaptive mode keeps a reference to frame for the next call; decode with refcounted_frames set, or it keeps a copy.
+const AVFrame *deinterlace_frame(Deinterlacer *deinterlacer, const AVFrame *frame);
+
+//Print how many frames were deinterlaced and how many passed through
+void deinterlace_dump(const Deinterlacer *deinterlacer, FILE *out);
+
+void deinterlace_destroy(Deinterlacer **deinterlacer);
+
+#endif
@@ -0,0 +1,231 @@
+//
+//  frame_display.c
+//  Puts decoded frames on an SDL texture, converting only when the texture can't take them as they are
+//
+//  Frames that need converting are converted straight into the memory SDL_LockTexture hands out,
+//  there is no staging buffer to copy from afterwards. Two planar textures are used in turn, so the
+//  frame being written never locks the texture the previous frame was just presented from.
+//
+#include <libswscale/swscale.h>
+#include <stdlib.h>
+
+#include "frame_display.h"
+#include "sws_cache.h"
+
+struct FrameDisplay
+{
+    SDL_Renderer *renderer;
+    int width, height;
+    SliceScaler *scaler;
+
+    SDL_Texture *planar[2];     //YV12, take YUV420P frames and the converted ones, used in turn
+    int next;                   //planar[next] is the one the next frame goes to
+    SDL_Texture *nv12;          //Created on the first NV12 frame
+
+    //What the next upload sends, or the texture a converted frame was written into (still locked)
+    const uint8_t *planes[3];
+    int pitches[3];
+    SDL_Texture *target;
+    int locked;
+
+    unsigned long long passed, converted;
+};
+
+FrameDisplay *frame_display_create(SDL_Renderer *renderer, int width, int height, SliceScaler *scaler)
+{
+    FrameDisplay *display = calloc(1, sizeof(FrameDisplay));
+
+    if(!display)
+        return NULL;
+    display->renderer = renderer;
+    display->width = width;
+    display->height = height;
+    display->scaler = scaler;
+    display->planar[0] = SDL_CreateTexture(renderer, SDL_PIXELFORMAT_YV12, SDL_TEXTUREACCESS_STREAMING, width, height);
+    display->planar[1] = SDL_CreateTexture(renderer, SDL_PIXELFORMAT_YV12, SDL_TEXTUREACCESS_STREAMING, width, height);
+    if(!display->planar[0] || !display->planar[1])
+    {
+        frame_display_destroy(&display);
+        return NULL;
+    }
+    return display;
+}
+
+//SDL only takes positive pitches, a bottom-up frame has to be converted
+static int positive_linesizes(const AVFrame *frame, int planes)
+{
+    int p;
+
+    for(p = 0; p < planes; p++)
+    {
+        if(frame->linesize[p] <= 0)
+            return 0;
+    }
+    return 1;
+}
+
+static int pass_through(FrameDisplay *display, const AVFrame *frame)
+{
+    int p;
+
+    if(frame->width != display->width || frame->height != display->height)
+        return 0;
+    //Full range would show washed out on a texture that expects limited range
+    if(frame->color_range == AVCOL_RANGE_JPEG)
+        return 0;
+
+    if(frame->format == AV_PIX_FMT_YUV420P && positive_linesizes(frame, 3))
+    {
+        for(p = 0; p < 3; p++)
+        {
+            display->planes[p] = frame->data[p];
+            display->pitches[p] = frame->linesize[p];
+        }
+        display->target = display->planar[display->next];
+        display->next ^= 1;
+        return 1;
+    }
+
+#if SDL_VERSION_ATLEAST(2, 0, 16)
+    if(frame->format == AV_PIX_FMT_NV12 && positive_linesizes(frame, 2))
+    {
+        if(!display->nv12)
+        {
+            display->nv12 = SDL_CreateTexture(display->renderer, SDL_PIXELFORMAT_NV12, SDL_TEXTUREACCESS_STREAMING,
+                                              display->width, display->height);
+            if(!display->nv12)
+                return 0;
+        }
+        display->planes[0] = frame->data[0];
+        display->planes[1] = frame->data[1];
+        display->pitches[0] = frame->linesize[0];
+        display->pitches[1] = frame->linesize[1];
+        display->target = display->nv12;
+        return 1;
+    }
+#endif
+
+    return 0;
+}
+
+//Points dst at the planes of a locked YV12 texture: Y, then V, then U, chroma at half the pitch
+static int lock_planes(SDL_Texture *texture, int height, uint8_t *dst[4], int dstStride[4])
+{
+    void *pixels;
+    int pitch;
+
+    if(SDL_LockTexture(texture, NULL, &pixels, &pitch) < 0)
+        return -1;
+    dst[0] = (uint8_t *)pixels;
+    dst[2] = dst[0] + pitch * height;
+    dst[1] = dst[2] + (pitch + 1) / 2 * ((height + 1) / 2);
+    dst[3] = NULL;
+    dstStride[0] = pitch;
+    dstStride[1] = dstStride[2] = (pitch + 1) / 2;
+    dstStride[3] = 0;
+    return 0;
+}
+
+int frame_display_prepare(FrameDisplay *display, const AVFrame *frame)
+{
+    uint8_t *dst[4];
+    int dstStride[4];
+    int ret;
+
+    //A frame that was converted but never uploaded
+    if(display->locked)
+    {
+        SDL_UnlockTexture(display->target);
+        display->locked = 0;
+    }
+
+    display->target = NULL;
+    if(pass_through(display, frame))
+    {
+        display->passed++;
+        return 1;
+    }
+
+    if(lock_planes(display->planar[display->next], display->height, dst, dstStride) < 0)
+        return -1;
+    display->target = display->planar[display->next];
+    display->locked = 1;
+    display->next ^= 1;
+
+    //The contexts come from the cache, keyed by this frame's own size and format, so a mid-stream change rebuilds them
+    if(display->scaler)
+    {
+        ret = slice_scaler_scale(display->scaler, frame, dst, dstStride,
+                                 display->width, display->height, AV_PIX_FMT_YUV420P, SWS_BILINEAR);
+    }
+    else
+    {
+        ret = sws_cache_scale(frame, dst, dstStride,
+                              display->width, display->height, AV_PIX_FMT_YUV420P, SWS_BILINEAR);
+    }
+    if(ret < 0)
+    {
+        SDL_UnlockTexture(display->target);
+        display->locked = 0;
+        display->target = NULL;
+        return ret;
+    }
+
+    display->converted++;
+    return 0;
+}
+
+SDL_Texture *frame_display_upload(FrameDisplay *display)
+{
+    int ret;
+
+    if(!display->target)
+        return NULL;
+
+    //Converted: the pixels are already in the texture, unlocking hands them to the renderer
+    if(display->locked)
+    {
+        SDL_UnlockTexture(display->target);
+        display->locked = 0;
+        return display->target;
+    }
+
+#if SDL_VERSION_ATLEAST(2, 0, 16)
+    if(display->target == display->nv12)
+    {
+        ret = SDL_UpdateNVTexture(display->nv12, NULL,
+                                  display->planes[0], display->pitches[0],
+                                  display->planes[1], display->pitches[1]);
+        return ret < 0 ? NULL : display->nv12;
+    }
+#endif
+
+    ret = SDL_UpdateYUVTexture(display->target, NULL,
+                               display->planes[0], display->pitches[0],
+                               display->planes[1], display->pitches[1],
+                               display->planes[2], display->pitches[2]);
+    return ret < 0 ? NULL : display->target;
+}
+
+void frame_display_dump(const FrameDisplay *display, FILE *out)
+{
+    fprintf(out, "display: passed through(%llu), converted(%llu)\n", display->passed, display->converted);
+}
+
+void frame_display_destroy(FrameDisplay **displayPtr)
+{
+    FrameDisplay *display = *displayPtr;
+
+    if(!display)
+        return;
+    if(display->locked)
+        SDL_UnlockTexture(display->target);
+    if(display->nv12)
+        SDL_DestroyTexture(display->nv12);
+    if(display->planar[1])
+        SDL_DestroyTexture(display->planar[1]);
+    if(display->planar[0])
+        SDL_DestroyTexture(display->planar[0]);
+    free(display);
+    *displayPtr = NULL;
+}
@@ -0,0 +1,36 @@
+//
+//  frame_display.h
+//  Puts decoded frames on an SDL texture, converting only when the texture can't take them as they are
+//
+//  YUV420P frames (limited range, at the display size) are uploaded straight from the decoder's planes
+//  and linesizes, and so are NV12 frames when SDL has SDL_UpdateNVTexture.
+//  Anything else is converted to YUV420P first, straight into the locked texture.
+//
+#ifndef FRAME_DISPLAY_H
+#define FRAME_DISPLAY_H
+
+#include <libavutil/frame.h>
+#include <SDL2/SDL.h>
+#include <stdio.h>
+
+#include "slice_scale.h"
+
+typedef struct FrameDisplay FrameDisplay;
+
+//scaler converts the frames that need it in bands, NULL converts them with sws_cache_scale on the caller's thread
+FrameDisplay *frame_display_create(SDL_Renderer *renderer, int width, int height, SliceScaler *scaler);
+
+//Picks the planes the next upload sends: the frame's own, or a converted copy
+//frame must stay untouched until frame_display_upload
+//Returns 1 when the frame is passed through, 0 when it was converted, < 0 on error
+int frame_display_prepare(FrameDisplay *display, const AVFrame *frame);
+
+//Uploads what frame_display_prepare picked, returns the texture to render or NULL on error
+SDL_Texture *frame_display_upload(FrameDisplay *display);
+
+//Print how many frames were passed through and how many converted
+void frame_display_dump(const FrameDisplay *display, FILE *out);
+
+void frame_display_destroy(FrameDisplay **display);
+
+#endif
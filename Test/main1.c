@@ -8,15 +8,26 @@
 
 #include <libavcodec/avcodec.h>
 #include <libavformat/avformat.h>
+#include <libavutil/intreadwrite.h>
+#include <libavutil/pixdesc.h>
 #include <libswscale/swscale.h>
 
 #include <stdio.h>
+#include <string.h>
 
-void SaveFrame(AVFrame *pFrame, int width, int height, int iFrame)
+#include "cropdetect.h"
+#include "slice_scale.h"
+#include "deinterlace.h"
+#include "sws_cache.h"
+#include "tonemap.h"
+#include "yuv2rgb.h"
+
+//rgb48 selects a 16-bit PPM (maxval 65535): the frame holds native-endian RGB48, PPM wants big-endian samples
+void SaveFrame(AVFrame *pFrame, int width, int height, int iFrame, int rgb48)
 {
     FILE *pFile;
     char szFilename[32];
-    int y;
+    uint8_t *row = NULL;
     
     //Open file
     sprintf(szFilename, "frame%d.ppm", iFrame);
@@ -25,13 +36,25 @@ void SaveFrame(AVFrame *pFrame, int width, int height, int iFrame)
         return;
     
     //Write header
-    fprintf(pFile, "P6\n%d %d\n255\n", width, height);
+    fprintf(pFile, "P6\n%d %d\n%d\n", width, height, rgb48 ? 65535 : 255);
     
     //Write pixel data
+    if(rgb48)
+        row = av_malloc(width * 6);
     for(int y=0; y<height; y++)
     {
-        fwrite(pFrame->data[0]+y*pFrame->linesize[0], 1, width*3, pFile);
+        const uint8_t *line = pFrame->data[0]+y*pFrame->linesize[0];
+        
+        if(row)
+        {
+            for(int x=0; x<width*3; x++)
+                AV_WB16(row + 2*x, ((const uint16_t *)line)[x]);
+            fwrite(row, 1, width*6, pFile);
+        }
+        else
+            fwrite(line, 1, width*3, pFile);
     }
+    av_free(row);
     
     //Close file
     fclose(pFile);
@@ -102,6 +125,9 @@ int main(int argc, const char * argv[]) {
         fprintf(stderr, "Couldn't copy codec context \n");
         return -1;  //Error copying codec context
     }
+    //Frames we get own a reference to their buffers, so the deinterlacer can hold on to the last one without a copy
+    //Each frame is unref'ed once it has been used
+    pCodecCtx->refcounted_frames = 1;
     //Open codec
     if(avcodec_open2(pCodecCtx, pCodec, NULL) < 0)
         return -1;  //Could not open codec
@@ -115,6 +141,41 @@ int main(int argc, const char * argv[]) {
     
     //Allocate video frame
     pFrame = av_frame_alloc();
+    
+    //Letterboxed / pillarboxed sources are converted and saved without their black borders
+    //The borders are looked for in a few frames from the start, then the file is read again from the top
+    CropRect crop = { 0, 0, pCodecCtx->width, pCodecCtx->height, pCodecCtx->width, pCodecCtx->height };
+    if(cropdetect_cache_lookup(argv[1], pCodecCtx->width, pCodecCtx->height, &crop) < 0)
+    {
+        CropDetector *cropDetector = cropdetect_create(8, 5, 24, YUV2RGB_KERNEL_AUTO);
+        int fed = 0, settled = 0, frameFinished = 0;
+        AVPacket packet;
+        
+        while (cropDetector && !settled && fed < 200 && av_read_frame(pFormatCtx, &packet) >= 0)
+        {
+            if(packet.stream_index == videoStream)
+            {
+                avcodec_decode_video2(pCodecCtx, pFrame, &frameFinished, &packet);
+                if(frameFinished && pFrame->width == pCodecCtx->width && pFrame->height == pCodecCtx->height)
+                {
+                    fed++;
+                    settled = cropdetect_feed(cropDetector, pFrame) != 0;
+                }
+                if(frameFinished)
+                    av_frame_unref(pFrame);
+            }
+            av_free_packet(&packet);
+        }
+        if(cropDetector && cropdetect_result(cropDetector, &crop) == 0)
+            cropdetect_cache_store(argv[1], &crop);
+        cropdetect_destroy(&cropDetector);
+        
+        if(av_seek_frame(pFormatCtx, videoStream, 0, AVSEEK_FLAG_BACKWARD) < 0)
+            fprintf(stderr, "Couldn't seek back to the start, the first frames are skipped \n");
+        avcodec_flush_buffers(pCodecCtx);
+    }
+    fprintf(stderr, "Picture %dx%d at %d,%d in %dx%d\n", crop.width, crop.height, crop.x, crop.y,
+            crop.frameWidth, crop.frameHeight);
     //Allocate an AVFrame structure
     pFrameRGB = av_frame_alloc();
     if(pFrameRGB == NULL)
@@ -122,34 +183,49 @@ int main(int argc, const char * argv[]) {
     //Even though we've allocated the frame, still need a place to put the raw data when convert it
     uint8_t *buffer = NULL;
     int numBytes;
+    //PQ / HLG sources are tone mapped to SDR RGB24, converted as they are they come out washed out
+    int hdr = pCodecCtx->color_trc == AVCOL_TRC_SMPTE2084 || pCodecCtx->color_trc == AVCOL_TRC_ARIB_STD_B67;
+    //Other 10/12-bit sources stay deep: RGB48 all the way to a 16-bit PPM instead of being cut down to 8 bits
+    const AVPixFmtDescriptor *srcDesc = av_pix_fmt_desc_get(pCodecCtx->pix_fmt);
+    int rgb48 = !hdr && srcDesc && srcDesc->comp[0].depth > 8;
+    enum AVPixelFormat rgbFormat = rgb48 ? AV_PIX_FMT_RGB48 : AV_PIX_FMT_RGB24;
     //Determine required buffer size and allocate buffer
-    numBytes = avpicture_get_size(AV_PIX_FMT_RGB24, pCodecCtx->width, pCodecCtx->height);
+    numBytes = avpicture_get_size(rgbFormat, crop.width, crop.height);
     buffer = (uint8_t *)av_malloc(numBytes*sizeof(uint8_t));
     
     /*
      Assign appropriate parts of buffer to image planes in pFrameRGB
     */
      //Note that pFrameRGB is an AVFrame but AVFrame is a superset of AVPicture
-    avpicture_fill((AVPicture *)pFrameRGB, buffer, AV_PIX_FMT_RGB24, pCodecCtx->width, pCodecCtx->height);
+    avpicture_fill((AVPicture *)pFrameRGB, buffer, rgbFormat, crop.width, crop.height);
     
     /*
      Read through the entire video stream by reading in the packet, decoding it into our frame and once our frame is complete, will convert and save it
      */
-    struct SwsContext *sws_ctx = NULL;
     int frameFinished;
     
     AVPacket packet;
-    //Initialize SWS context for software scaling
-    sws_ctx = sws_getContext(pCodecCtx->width,
-                             pCodecCtx->height,
-                             pCodecCtx->pix_fmt,
-                             pCodecCtx->width,
-                             pCodecCtx->height,
-                             AV_PIX_FMT_RGB24,
-                             SWS_BILINEAR,
-                             NULL,
-                             NULL,
-                             NULL);
+    
+    //Converts each frame in horizontal bands on one thread per CPU
+    SlicePool *slicePool = slice_pool_create(0);
+    SliceScaler *scaler = slicePool ? slice_scaler_create(slicePool) : NULL;
+    if(!scaler)
+        return -1;
+    
+    //The optional second argument picks the tone curve: hable, reinhard or bt2390 (the default)
+    ToneCurve toneCurve = TONEMAP_BT2390;
+    for(int c=0; argc > 2 && c<TONEMAP_CURVE_COUNT; c++)
+    {
+        if(strcmp(argv[2], tonemap_curve_name((ToneCurve)c)) == 0)
+            toneCurve = (ToneCurve)c;
+    }
+    ToneMapper *toneMapper = hdr ? tonemap_create(slicePool, toneCurve, YUV2RGB_KERNEL_AUTO) : NULL;
+    
+    //Interlaced frames are deinterlaced before they are converted, progressive ones go straight on
+    Deinterlacer *deinterlacer = deinterlace_create(slicePool, DEINTERLACE_ADAPTIVE, YUV2RGB_KERNEL_AUTO);
+    if(!deinterlacer)
+        return -1;
+    
     int i=0;
     while (av_read_frame(pFormatCtx, &packet) >= 0)
     {
@@ -162,25 +238,54 @@ int main(int argc, const char * argv[]) {
             //Did we get a video frame?
             if(frameFinished)
             {
-                //Convert the image from its native format(pCodecCtx->pix_fmt) to RGB
-                sws_scale(sws_ctx,
-                          (uint8_t const * const *)pFrame->data,
-                          pFrame->linesize,
-                          0,
-                          pCodecCtx->height,
-                          pFrameRGB->data,
-                          pFrameRGB->linesize);
+                const AVFrame *picture = deinterlace_frame(deinterlacer, pFrame);
+                if(!picture)
+                    picture = pFrame;
+                
+                //Only the picture inside the borders goes on, a frame of another size is scaled whole
+                AVFrame view;
+                if(cropdetect_view(&view, picture, &crop) == 0)
+                    picture = &view;
+                
+                //Convert the image from its native format to RGB
+                //YUV420P (or YUV420P10/12, P010 into RGB48) at its own size goes through the SIMD converter,
+                //HDR through the tone mapper, anything else through swscale
+                //The band contexts come from the cache, keyed by this frame's own size and format
+                if(picture->width != crop.width || picture->height != crop.height ||
+                   (toneMapper ? tonemap_frame(toneMapper, picture, pFrameRGB->data[0], pFrameRGB->linesize[0])
+                    : rgb48 ? yuv2rgb_convert_frame16(picture, (uint16_t *)pFrameRGB->data[0], pFrameRGB->linesize[0])
+                    : yuv2rgb_convert_frame(picture, pFrameRGB->data[0], pFrameRGB->linesize[0])) < 0)
+                {
+                    slice_scaler_scale(scaler,
+                                       picture,
+                                       pFrameRGB->data,
+                                       pFrameRGB->linesize,
+                                       crop.width,
+                                       crop.height,
+                                       rgbFormat,
+                                       SWS_BILINEAR);
+                }
                 
                 //Save the frame to disk
                 if(++i <= 5)
                 {
-                    SaveFrame(pFrameRGB, pCodecCtx->width, pCodecCtx->height, i);
+                    SaveFrame(pFrameRGB, crop.width, crop.height, i, rgb48);
                 }
+                
+                av_frame_unref(pFrame);
             }
         }
         
         //Free the packet that was allocated by av_read_frame
         av_free_packet(&packet);
     }
+    
+    deinterlace_dump(deinterlacer, stderr);
+    deinterlace_destroy(&deinterlacer);
+    tonemap_destroy(&toneMapper);
+    slice_scaler_destroy(&scaler);
+    slice_pool_destroy(&slicePool);
+    sws_cache_dump(stderr);
+    sws_cache_clear();
     return 0;
 }
@@ -15,6 +15,12 @@
 
 #include <stdio.h>
 
+#include "deinterlace.h"
+#include "frame_display.h"
+#include "stage_timer.h"
+#include "slice_scale.h"
+#include "sws_cache.h"
+
 int main(int argc, const char * argv[]) {
     SDL_Event event;
     //Registers all available file formats and codecs with the library
@@ -88,6 +94,9 @@ int main(int argc, const char * argv[]) {
         fprintf(stderr, "Couldn't copy codec context \n");
         return -1;  //Error copying codec context
     }
+    //Frames we get own a reference to their buffers, so the deinterlacer can hold on to the last one without a copy
+    //Each frame is unref'ed once it has been used
+    pCodecCtx->refcounted_frames = 1;
     //Open codec
     if(avcodec_open2(pCodecCtx, pCodec, NULL) < 0)
         return -1;  //Could not open codec
@@ -118,117 +127,130 @@ int main(int argc, const char * argv[]) {
         fprintf(stderr, "SDL: could not create renderer - exiting\n");
         return -1;
     }
-    SDL_Texture *texture = SDL_CreateTexture(renderer,
-                                            SDL_PIXELFORMAT_YV12,
-                                            SDL_TEXTUREACCESS_STREAMING,
-                                            pCodecCtx->width,
-                                            pCodecCtx->height);
-    if(!texture)
-    {
-        fprintf(stderr, "SDL: could not create texture - exiting\n");
-        return -1;
-    }
     
     /*
      Read through the entire video stream by reading in the packet, decoding it into our frame and once our frame is complete, will convert and save it
      */
-    struct SwsContext *sws_ctx = NULL;
     int frameFinished;
     
     AVPacket packet;
-    //Initialize SWS context for software scaling
-    sws_ctx = sws_getContext(pCodecCtx->width,
-                             pCodecCtx->height,
-                             pCodecCtx->pix_fmt,
-                             pCodecCtx->width,
-                             pCodecCtx->height,
-                             AV_PIX_FMT_RGB24,
-                             SWS_BILINEAR,
-                             NULL,
-                             NULL,
-                             NULL);
-    
-    //Set up YV12 pixel array(12 bits per pixel)
-    Uint8 *yPlane, *uPlane, *vPlane;
-    size_t yPlaneSz, uvPlaneSz;
-    int uvPitch;
-    
-    yPlaneSz = pCodecCtx->width * pCodecCtx->height;
-    uvPlaneSz = pCodecCtx->width * pCodecCtx->height / 4;
-    yPlane = (Uint8*)malloc(yPlaneSz);
-    uPlane = (Uint8*)malloc(uvPlaneSz);
-    vPlane = (Uint8*)malloc(uvPlaneSz);
-    if(!yPlane || !uPlane || !vPlane)
+    
+    //Converts each frame in horizontal bands on one thread per CPU
+    SlicePool *slicePool = slice_pool_create(0);
+    SliceScaler *scaler = slicePool ? slice_scaler_create(slicePool) : NULL;
+    if(!scaler)
     {
-        fprintf(stderr, "Could not allocate pixel buffers - exiting\n");
-        exit(1);
+        fprintf(stderr, "Could not create the slice scaler - exiting\n");
+        return -1;
     }
     
-    uvPitch = pCodecCtx->width / 2; //Pitch is the term SDL uses to refer to the width of a fiven line of data
+    //Interlaced frames are deinterlaced in bands on the same pool, progressive ones go straight on
+    Deinterlacer *deinterlacer = deinterlace_create(slicePool, DEINTERLACE_ADAPTIVE, YUV2RGB_KERNEL_AUTO);
+    if(!deinterlacer)
+    {
+        fprintf(stderr, "Could not create the deinterlacer - exiting\n");
+        return -1;
+    }
+    
+    //Uploads YUV420P/NV12 frames straight from the decoder, converts the rest to YUV420P in bands first
+    FrameDisplay *display = frame_display_create(renderer, pCodecCtx->width, pCodecCtx->height, scaler);
+    if(!display)
+    {
+        fprintf(stderr, "SDL: could not create texture - exiting\n");
+        return -1;
+    }
     
     int i=0;
+    Uint64 stageStart = stage_timer_start();
     while (av_read_frame(pFormatCtx, &packet) >= 0)
     {
+        stage_timer_stop(packet.stream_index, STAGE_READ, stageStart);
+        
         //Is this a packet from the video stream?
         if(packet.stream_index == videoStream)
         {
             //Decode video frame
+            stageStart = stage_timer_start();
             avcodec_decode_video2(pCodecCtx, pFrame, &frameFinished, &packet);
+            stage_timer_stop(packet.stream_index, STAGE_DECODE, stageStart);
             
             //Did we get a video frame?
             if(frameFinished)
             {
-                AVPicture pict;
-                pict.data[0] = yPlane;
-                pict.data[1] = uPlane;
-                pict.data[2] = vPlane;
-                pict.linesize[0] = pCodecCtx->width;    //y width
-                pict.linesize[1] = uvPitch;             //u width
-                pict.linesize[2] = uvPitch;             //v width
+                SDL_Texture *texture;
+                const AVFrame *picture;
+                
+                stageStart = stage_timer_start();
+                picture = deinterlace_frame(deinterlacer, pFrame);
+                stage_timer_stop(packet.stream_index, STAGE_DEINTERLACE, stageStart);
+                if(!picture)
+                    picture = pFrame;
                 
-                //Convert the image into YUV format that SDL uses
-                sws_scale(sws_ctx,
-                          (uint8_t const* const*)pFrame->data,
-                          pFrame->linesize,
-                          0,
-                          pCodecCtx->height,
-                          pict.data,
-                          pict.linesize);
+                //Passes the decoder's planes through when the texture takes them as they are, converts otherwise
+                stageStart = stage_timer_start();
+                frame_display_prepare(display, picture);
+                stage_timer_stop(packet.stream_index, STAGE_CONVERT, stageStart);
                 
-                SDL_UpdateYUVTexture(texture,
-                                     NULL,
-                                     yPlane,
-                                     pCodecCtx->width,
-                                     uPlane,
-                                     uvPitch,
-                                     vPlane,
-                                     uvPitch);
+                stageStart = stage_timer_start();
+                texture = frame_display_upload(display);
+                stage_timer_stop(packet.stream_index, STAGE_UPLOAD, stageStart);
                 
+                stageStart = stage_timer_start();
                 SDL_RenderClear(renderer);
-                SDL_RenderCopy(renderer, texture, NULL, NULL);
+                if(texture)
+                    SDL_RenderCopy(renderer, texture, NULL, NULL);
                 SDL_RenderPresent(renderer);
+                stage_timer_stop(packet.stream_index, STAGE_PRESENT, stageStart);
+                
+                av_frame_unref(pFrame);
             }
         }
         //Free the packet that was allocated by av_read_frame
         av_free_packet(&packet);
         
-        SDL_PollEvent(&event);
-        switch (event.type) {
-            case SDL_QUIT:
-                SDL_Quit();
-                return -1;
-                break;
-                
-            default:
-                break;
+        if(SDL_PollEvent(&event))
+        {
+            switch (event.type) {
+                case SDL_QUIT:
+                    stage_timer_dump(stderr);
+                    sws_cache_dump(stderr);
+                    frame_display_dump(display, stderr);
+                    deinterlace_dump(deinterlacer, stderr);
+                    SDL_Quit();
+                    return -1;
+                    break;
+                    
+                case SDL_KEYDOWN:
+                    //Dump the stage latencies on demand
+                    if(event.key.keysym.sym == SDLK_h)
+                    {
+                        stage_timer_dump(stderr);
+                        sws_cache_dump(stderr);
+                        frame_display_dump(display, stderr);
+                        deinterlace_dump(deinterlacer, stderr);
+                    }
+                    break;
+                    
+                default:
+                    break;
+            }
         }
+        
+        stageStart = stage_timer_start();
     }
     
+    stage_timer_dump(stderr);
+    frame_display_dump(display, stderr);
+    deinterlace_dump(deinterlacer, stderr);
+    frame_display_destroy(&display);
+    deinterlace_destroy(&deinterlacer);
+    slice_scaler_destroy(&scaler);
+    slice_pool_destroy(&slicePool);
+    sws_cache_dump(stderr);
+    sws_cache_clear();
+    
     //Free the yuv frame
     av_frame_free(&pFrame);
-    free(yPlane);
-    free(uPlane);
-    free(vPlane);
     
     //Close the codec
     avcodec_close(pCodecCtx);
@@ -14,14 +14,24 @@
 
 #include <stdio.h>
 #include <assert.h>
+
+#include "deinterlace.h"
+#include "frame_display.h"
+#include "stage_timer.h"
+#include "sws_cache.h"
 #define SDL_AUDIO_BUFFER_SIZE 1024
 #define MAX_AUDIO_FRAME_SIZE 192000
 
 int quit = 0;   //To Quit the Program
 
+#define MAX_AUDIOQ_PACKETS 256   //Queue depth: number of packet nodes preallocated for the audio queue
+
 typedef struct PacketQueue
 {
     AVPacketList *first_pkt, *last_pkt;     //Linked list for packets
+    AVPacketList *free_pkt;                 //Nodes not in use, taken by put and returned by get
+    AVPacketList *nodes;                    //Storage for all the nodes, allocated once
+    int max_packets;
     int nb_packets;
     int size;
     SDL_mutex *mutex;
@@ -29,29 +39,69 @@ typedef struct PacketQueue
 } PacketQueue;
 PacketQueue audioq;
 
-void packet_queue_init(PacketQueue *q)
+int packet_queue_init(PacketQueue *q, int max_packets)
 {
+    int i;
+    
     memset(q, 0, sizeof(PacketQueue));
+    //Allocate every node up front so put/get never touch the heap under the mutex
+    q->nodes = av_mallocz_array(max_packets, sizeof(AVPacketList));
+    if(!q->nodes)
+        return -1;
+    for(i = 0; i < max_packets; i++)
+    {
+        av_init_packet(&q->nodes[i].pkt);
+        q->nodes[i].next = (i + 1 < max_packets) ? &q->nodes[i + 1] : NULL;
+    }
+    q->free_pkt = q->nodes;
+    q->max_packets = max_packets;
     q->mutex = SDL_CreateMutex();
     q->cond = SDL_CreateCond();
+    return 0;
 }
 
+void packet_queue_destroy(PacketQueue *q)
+{
+    AVPacketList *pkt1;
+    
+    for(pkt1 = q->first_pkt; pkt1; pkt1 = pkt1->next)
+        av_packet_unref(&pkt1->pkt);
+    av_freep(&q->nodes);
+    SDL_DestroyCond(q->cond);
+    SDL_DestroyMutex(q->mutex);
+}
+
+/*
+ Takes over the packet's reference (pkt is left blank), no copy of the data is made.
+ If every node is in use, waits until get returns one.
+ */
 int packet_queue_put(PacketQueue *q, AVPacket *pkt)
 {
     AVPacketList *pkt1;
-    if(av_dup_packet(pkt) < 0)
+    
+    //Packets from av_read_frame are already reference counted, this only copies if one is not
+    if(av_packet_make_refcounted(pkt) < 0)
     {
         return -1;
     }
     
-    pkt1 = av_malloc(sizeof(AVPacketList));
-    if(!pkt1)
-        return -1;
-    pkt1->pkt = *pkt;
-    pkt1->next = NULL;
-    
     SDL_LockMutex(q->mutex);
     
+    while(!q->free_pkt)
+    {
+        if(quit)
+        {
+            SDL_UnlockMutex(q->mutex);
+            return -1;
+        }
+        SDL_CondWait(q->cond, q->mutex);
+    }
+    pkt1 = q->free_pkt;
+    q->free_pkt = pkt1->next;
+    
+    av_packet_move_ref(&pkt1->pkt, pkt);
+    pkt1->next = NULL;
+    
     if(!q->last_pkt)
         q->first_pkt = pkt1;
     else
@@ -66,6 +116,9 @@ int packet_queue_put(PacketQueue *q, AVPacket *pkt)
     return 0;
 }
 
+/*
+ Moves the oldest packet's reference into pkt, the caller must av_packet_unref it when done.
+ */
 static int packet_queue_get(PacketQueue *q, AVPacket *pkt, int block)
 {
     AVPacketList *pkt1;
@@ -89,8 +142,12 @@ static int packet_queue_get(PacketQueue *q, AVPacket *pkt, int block)
                 q->last_pkt = NULL;
             q->nb_packets--;
             q->size -= pkt1->pkt.size;
-            *pkt = pkt1->pkt;
-            av_free(pkt1);
+            av_packet_move_ref(pkt, &pkt1->pkt);
+            
+            //Give the node back and wake put if it is waiting for one
+            pkt1->next = q->free_pkt;
+            q->free_pkt = pkt1;
+            SDL_CondSignal(q->cond);
             ret = 1;
             break;
         }
@@ -122,7 +179,9 @@ int audio_decode_frame(AVCodecContext *aCodecCtx, uint8_t *audio_buf, int buf_si
         while (audio_pkt_size > 0)
         {
             int got_frame = 0;
+            Uint64 stageStart = stage_timer_start();
             len1 = avcodec_decode_audio4(aCodecCtx, &frame, &got_frame, &pkt);
+            stage_timer_stop(pkt.stream_index, STAGE_DECODE, stageStart);
             if(len1 < 0)
             {
                 //If error, skip frame
@@ -151,11 +210,8 @@ int audio_decode_frame(AVCodecContext *aCodecCtx, uint8_t *audio_buf, int buf_si
         }
 
         fprintf(stderr, "hankyo1 \n");
-        // if(pkt.data)
-        // {
-        //     fprintf(stderr, "hankyo3 \n");
-        //     av_free_packet(&pkt);
-        // }
+        //Done with the previous packet, drop our reference before taking the next one
+        av_packet_unref(&pkt);
         
         if(quit)
         {
@@ -357,7 +413,11 @@ int main(int argc, const char * argv[]) {
         return -1;  //Could not open codec
     }
     
-    packet_queue_init(&audioq);
+    if(packet_queue_init(&audioq, MAX_AUDIOQ_PACKETS) < 0)
+    {
+        fprintf(stderr, "Could not allocate audio packet queue \n");
+        return -1;
+    }
     SDL_PauseAudio(0);  //To starts the audio device
     
     //Get a pointer to the codec context for the video stream
@@ -380,6 +440,9 @@ int main(int argc, const char * argv[]) {
         return -1;  //Error copying codec context
     }
 
+    //Frames we get own a reference to their buffers, so the deinterlacer can hold on to the last one without a copy
+    //Each frame is unref'ed once it has been used
+    pCodecCtx->refcounted_frames = 1;
     //Open codec
     if((avcodec_open2(pCodecCtx, pCodec, NULL) < 0))
     {
@@ -414,96 +477,73 @@ int main(int argc, const char * argv[]) {
         fprintf(stderr, "SDL: could not create renderer - exiting\n");
         return -1;
     }
-    SDL_Texture *texture = SDL_CreateTexture(renderer,
-                                            SDL_PIXELFORMAT_YV12,
-                                            SDL_TEXTUREACCESS_STREAMING,
-                                            pCodecCtx->width,
-                                            pCodecCtx->height);
-    if(!texture)
-    {
-        fprintf(stderr, "SDL: could not create texture - exiting\n");
-        return -1;
-    }
     
     /*
      Read through the entire video stream by reading in the packet, decoding it into our frame and once our frame is complete, will convert and save it
      */
-    struct SwsContext *sws_ctx = NULL;
     int frameFinished;
     
     AVPacket packet;
-    //Initialize SWS context for software scaling
-    sws_ctx = sws_getContext(pCodecCtx->width,
-                             pCodecCtx->height,
-                             pCodecCtx->pix_fmt,
-                             pCodecCtx->width,
-                             pCodecCtx->height,
-                             AV_PIX_FMT_RGB24,
-                             SWS_BILINEAR,
-                             NULL,
-                             NULL,
-                             NULL);
-    
-    //Set up YV12 pixel array(12 bits per pixel)
-    Uint8 *yPlane, *uPlane, *vPlane;
-    size_t yPlaneSz, uvPlaneSz;
-    int uvPitch;
-    
-    yPlaneSz = pCodecCtx->width * pCodecCtx->height;
-    uvPlaneSz = pCodecCtx->width * pCodecCtx->height / 4;
-    yPlane = (Uint8*)malloc(yPlaneSz);
-    uPlane = (Uint8*)malloc(uvPlaneSz);
-    vPlane = (Uint8*)malloc(uvPlaneSz);
-    if(!yPlane || !uPlane || !vPlane)
+    
+    //Interlaced frames are deinterlaced on this thread, progressive ones go straight on
+    Deinterlacer *deinterlacer = deinterlace_create(NULL, DEINTERLACE_ADAPTIVE, YUV2RGB_KERNEL_AUTO);
+    if(!deinterlacer)
     {
-        fprintf(stderr, "Could not allocate pixel buffers - exiting\n");
-        exit(1);
+        fprintf(stderr, "Could not create the deinterlacer - exiting\n");
+        return -1;
     }
     
-    uvPitch = pCodecCtx->width / 2; //Pitch is the term SDL uses to refer to the width of a fiven line of data
+    //Uploads YUV420P/NV12 frames straight from the decoder, converts the rest to YUV420P first
+    FrameDisplay *display = frame_display_create(renderer, pCodecCtx->width, pCodecCtx->height, NULL);
+    if(!display)
+    {
+        fprintf(stderr, "SDL: could not create texture - exiting\n");
+        return -1;
+    }
     
     int i=0;
+    Uint64 stageStart = stage_timer_start();
     while (av_read_frame(pFormatCtx, &packet) >= 0)
     {
+        stage_timer_stop(packet.stream_index, STAGE_READ, stageStart);
+        
         //Is this a packet from the video stream?
         if(packet.stream_index == videoStream)
         {
             //Decode video frame
+            stageStart = stage_timer_start();
             avcodec_decode_video2(pCodecCtx, pFrame, &frameFinished, &packet);
+            stage_timer_stop(packet.stream_index, STAGE_DECODE, stageStart);
             
             //Did we get a video frame?
             if(frameFinished)
             {
-                AVPicture pict;
-                pict.data[0] = yPlane;
-                pict.data[1] = uPlane;
-                pict.data[2] = vPlane;
-                pict.linesize[0] = pCodecCtx->width;    //y width
-                pict.linesize[1] = uvPitch;             //u width
-                pict.linesize[2] = uvPitch;             //v width
+                SDL_Texture *texture;
+                const AVFrame *picture;
+                
+                stageStart = stage_timer_start();
+                picture = deinterlace_frame(deinterlacer, pFrame);
+                stage_timer_stop(packet.stream_index, STAGE_DEINTERLACE, stageStart);
+                if(!picture)
+                    picture = pFrame;
                 
-                //Convert the image into YUV format that SDL uses
-                sws_scale(sws_ctx,
-                          (uint8_t const* const*)pFrame->data,
-                          pFrame->linesize,
-                          0,
-                          pCodecCtx->height,
-                          pict.data,
-                          pict.linesize);
+                //Passes the decoder's planes through when the texture takes them as they are, converts otherwise
+                stageStart = stage_timer_start();
+                frame_display_prepare(display, picture);
+                stage_timer_stop(packet.stream_index, STAGE_CONVERT, stageStart);
                 
-                SDL_UpdateYUVTexture(texture,
-                                     NULL,
-                                     yPlane,
-                                     pCodecCtx->width,
-                                     uPlane,
-                                     uvPitch,
-                                     vPlane,
-                                     uvPitch);
+                stageStart = stage_timer_start();
+                texture = frame_display_upload(display);
+                stage_timer_stop(packet.stream_index, STAGE_UPLOAD, stageStart);
                 
+                stageStart = stage_timer_start();
                 SDL_RenderClear(renderer);
-                SDL_RenderCopy(renderer, texture, NULL, NULL);
+                if(texture)
+                    SDL_RenderCopy(renderer, texture, NULL, NULL);
                 SDL_RenderPresent(renderer);
+                stage_timer_stop(packet.stream_index, STAGE_PRESENT, stageStart);
                 
+                av_frame_unref(pFrame);
                 av_free_packet(&packet);
             }
         }
@@ -516,24 +556,58 @@ int main(int argc, const char * argv[]) {
             av_free_packet(&packet);
         }
         
-        SDL_PollEvent(&event);
-        switch (event.type) {
-            case SDL_QUIT:
-                quit = 1;
-                SDL_Quit();
-                exit(0);
-                break;
-                
-            default:
-                break;
+        if(SDL_PollEvent(&event))
+        {
+            switch (event.type) {
+                case SDL_QUIT:
+                    quit = 1;
+                    stage_timer_dump(stderr);
+                    sws_cache_dump(stderr);
+                    frame_display_dump(display, stderr);
+                    deinterlace_dump(deinterlacer, stderr);
+                    SDL_Quit();
+                    exit(0);
+                    break;
+                    
+                case SDL_KEYDOWN:
+                    //Dump the stage latencies on demand
+                    if(event.key.keysym.sym == SDLK_h)
+                    {
+                        stage_timer_dump(stderr);
+                        sws_cache_dump(stderr);
+                        frame_display_dump(display, stderr);
+                        deinterlace_dump(deinterlacer, stderr);
+                    }
+                    break;
+                    
+                default:
+                    break;
+            }
         }
+        
+        stageStart = stage_timer_start();
     }
     
+    stage_timer_dump(stderr);
+    frame_display_dump(display, stderr);
+    deinterlace_dump(deinterlacer, stderr);
+    frame_display_destroy(&display);
+    deinterlace_destroy(&deinterlacer);
+    sws_cache_dump(stderr);
+    sws_cache_clear();
+    
+    //Stop the audio callback before freeing the packets it reads
+    //At end of file nothing set quit yet and the callback may be waiting in packet_queue_get,
+    //SDL_CloseAudio would wait for it forever
+    SDL_LockMutex(audioq.mutex);
+    quit = 1;
+    SDL_CondBroadcast(audioq.cond);
+    SDL_UnlockMutex(audioq.mutex);
+    SDL_CloseAudio();
+    packet_queue_destroy(&audioq);
+    
     //Free the yuv frame
     av_frame_free(&pFrame);
-    free(yPlane);
-    free(uPlane);
-    free(vPlane);
     
     //Close the codec
     avcodec_close(pCodecCtx);
@@ -0,0 +1,181 @@
+//
+//  slice_pool.c
+//  Fixed pool of worker threads that run the slices of one job at a time
+//
+//  A run publishes (func, opaque, nb_slices) and bumps a generation counter, then every thread,
+//  the caller included, takes the next slice index under the mutex until none are left.
+//  Slices are taken dynamically, so a thread that was descheduled does not hold up a fixed share.
+//
+#include <SDL2/SDL.h>
+#include <SDL2/SDL_thread.h>
+#include <stdlib.h>
+
+#include "slice_pool.h"
+
+typedef struct SliceWorker
+{
+    SlicePool *pool;
+    SDL_Thread *thread;
+    int index;
+} SliceWorker;
+
+struct SlicePool
+{
+    int threads;
+    SliceWorker *workers;
+
+    SDL_mutex *mutex;
+    SDL_cond *start;        //A new run was published (or quit)
+    SDL_cond *done;         //The last slice of the run finished
+    SDL_mutex *runLock;     //Serializes slice_pool_run callers
+
+    SliceFunc func;
+    void *opaque;
+    int nb_slices;
+    int next_slice;
+    int finished;
+    unsigned int generation;
+    int quit;
+};
+
+//Called with the mutex held, returns with it held
+static void run_slices(SlicePool *pool, int thread)
+{
+    while(pool->next_slice < pool->nb_slices)
+    {
+        int slice = pool->next_slice++;
+
+        SDL_UnlockMutex(pool->mutex);
+        pool->func(pool->opaque, slice, thread);
+        SDL_LockMutex(pool->mutex);
+
+        if(++pool->finished == pool->nb_slices)
+            SDL_CondSignal(pool->done);
+    }
+}
+
+static int slice_worker(void *arg)
+{
+    SliceWorker *worker = (SliceWorker *)arg;
+    SlicePool *pool = worker->pool;
+    unsigned int seen = 0;
+
+    SDL_LockMutex(pool->mutex);
+    for(;;)
+    {
+        while(pool->generation == seen && !pool->quit)
+            SDL_CondWait(pool->start, pool->mutex);
+        if(pool->quit)
+            break;
+        seen = pool->generation;
+        run_slices(pool, worker->index);
+    }
+    SDL_UnlockMutex(pool->mutex);
+    return 0;
+}
+
+SlicePool *slice_pool_create(int threads)
+{
+    SlicePool *pool;
+    int i;
+
+    if(threads <= 0)
+        threads = SDL_GetCPUCount();
+    if(threads < 1)
+        threads = 1;
+
+    pool = calloc(1, sizeof(SlicePool));
+    if(!pool)
+        return NULL;
+    pool->workers = calloc(threads, sizeof(SliceWorker));
+    pool->mutex = SDL_CreateMutex();
+    pool->start = SDL_CreateCond();
+    pool->done = SDL_CreateCond();
+    pool->runLock = SDL_CreateMutex();
+    if(!pool->workers || !pool->mutex || !pool->start || !pool->done || !pool->runLock)
+    {
+        slice_pool_destroy(&pool);
+        return NULL;
+    }
+
+    //Thread 0 is whoever calls slice_pool_run
+    pool->threads = 1;
+    for(i = 1; i < threads; i++)
+    {
+        SliceWorker *worker = &pool->workers[i];
+
+        worker->pool = pool;
+        worker->index = i;
+        worker->thread = SDL_CreateThread(slice_worker, "slice", worker);
+        if(!worker->thread)
+            break;
+        pool->threads++;
+    }
+    return pool;
+}
+
+int slice_pool_threads(const SlicePool *pool)
+{
+    return pool->threads;
+}
+
+void slice_pool_run(SlicePool *pool, SliceFunc func, void *opaque, int nb_slices)
+{
+    if(nb_slices <= 0)
+        return;
+    //Not worth waking anyone for a single slice
+    if(nb_slices == 1 || pool->threads == 1)
+    {
+        int i;
+        for(i = 0; i < nb_slices; i++)
+            func(opaque, i, 0);
+        return;
+    }
+
+    SDL_LockMutex(pool->runLock);
+    SDL_LockMutex(pool->mutex);
+    pool->func = func;
+    pool->opaque = opaque;
+    pool->nb_slices = nb_slices;
+    pool->next_slice = 0;
+    pool->finished = 0;
+    pool->generation++;
+    SDL_CondBroadcast(pool->start);
+
+    run_slices(pool, 0);
+    while(pool->finished < pool->nb_slices)
+        SDL_CondWait(pool->done, pool->mutex);
+    SDL_UnlockMutex(pool->mutex);
+    SDL_UnlockMutex(pool->runLock);
+}
+
+void slice_pool_destroy(SlicePool **poolPtr)
+{
+    SlicePool *pool = *poolPtr;
+    int i;
+
+    if(!pool)
+        return;
+
+    if(pool->mutex)
+    {
+        SDL_LockMutex(pool->mutex);
+        pool->quit = 1;
+        SDL_CondBroadcast(pool->start);
+        SDL_UnlockMutex(pool->mutex);
+    }
+    for(i = 1; i < pool->threads; i++)
+        SDL_WaitThread(pool->workers[i].thread, NULL);
+
+    if(pool->runLock)
+        SDL_DestroyMutex(pool->runLock);
+    if(pool->done)
+        SDL_DestroyCond(pool->done);
+    if(pool->start)
+        SDL_DestroyCond(pool->start);
+    if(pool->mutex)
+        SDL_DestroyMutex(pool->mutex);
+    free(pool->workers);
+    free(pool);
+    *poolPtr = NULL;
+}
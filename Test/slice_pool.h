@@ -0,0 +1,25 @@
+//
+//  slice_pool.h
+//  Fixed pool of worker threads that run the slices of one job at a time
+//
+#ifndef SLICE_POOL_H
+#define SLICE_POOL_H
+
+typedef struct SlicePool SlicePool;
+
+//Called once for every slice, thread is 0 for the calling thread and 1..threads-1 for the workers
+//No two slices of one run share a thread index at the same time, so it can select per-thread scratch
+typedef void (*SliceFunc)(void *opaque, int slice, int thread);
+
+//threads counts the calling thread, so threads - 1 workers are started (0 = one per CPU)
+SlicePool *slice_pool_create(int threads);
+
+int slice_pool_threads(const SlicePool *pool);
+
+//Run func for slices 0..nb_slices-1 on the pool and the calling thread, returns when all are done
+//Runs from different threads are serialized, the pool only works on one at a time
+void slice_pool_run(SlicePool *pool, SliceFunc func, void *opaque, int nb_slices);
+
+void slice_pool_destroy(SlicePool **pool);
+
+#endif
@@ -0,0 +1,301 @@
+//
+//  slice_scale.c
+//  Frame conversion split into horizontal bands that are converted in parallel
+//
+//  Band boundaries are placed where an output row maps exactly onto a source row
+//  (multiples of dst_h / gcd(src_h, dst_h), widened to the chroma subsampling), so every band's context
+//  has the same scale ratio as one context over the whole frame and approximately the same filter phase:
+//  swscale rounds each context's step to 16.16 fixed point from its own heights, so a band's step can
+//  be one unit off and the whole-frame context drifts from the exact positions by a fraction of that
+//  per row. Band output can therefore differ from a single-context conversion by a rounding step.
+//  Each context also converts a few rows past both ends of its band, the rows its vertical filter reads
+//  across the boundary, into a per-thread scratch image, and only the band's own rows are copied out.
+//
+#include <libavutil/common.h>
+#include <libavutil/imgutils.h>
+#include <libavutil/mathematics.h>
+#include <libavutil/mem.h>
+#include <libavutil/pixdesc.h>
+#include <libswscale/swscale.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "slice_scale.h"
+#include "sws_cache.h"
+
+#define MAX_BANDS 16
+//Bands thinner than this (output rows) cost more in overlap than they save
+#define MIN_BAND_ROWS 32
+
+typedef struct Band
+{
+    int dst_y, dst_h;           //Rows of the output this band owns
+    int ext_dst_y, ext_dst_h;   //Rows its context produces, the owned rows plus the overlap
+    int ext_src_y, ext_src_h;   //Source rows its context reads
+    struct SwsContext *ctx;
+} Band;
+
+typedef struct Scratch
+{
+    uint8_t *data[4];
+    int linesize[4];
+} Scratch;
+
+struct SliceScaler
+{
+    SlicePool *pool;
+    SwsCacheKey key;            //Whole-frame conversion the bands were laid out for
+    int configured;
+    Band bands[MAX_BANDS];
+    int nb_bands;
+    Scratch *scratch;           //One per pool thread
+    int scratchThreads;
+
+    //The conversion being run
+    const AVFrame *src;
+    uint8_t *const *dst;
+    const int *dstStride;
+};
+
+//Vertical taps of the scaler at 1:1, downscaling widens the filter by the ratio
+static int filter_taps(int flags)
+{
+    if(flags & SWS_POINT)
+        return 1;
+    if(flags & (SWS_FAST_BILINEAR | SWS_BILINEAR | SWS_AREA))
+        return 2;
+    if(flags & SWS_LANCZOS)
+        return 6;
+    if(flags & (SWS_X | SWS_GAUSS))
+        return 8;
+    if(flags & (SWS_SINC | SWS_SPLINE))
+        return 20;
+    return 4;   //SWS_BICUBIC, SWS_BICUBLIN
+}
+
+static int plane_shift(const AVPixFmtDescriptor *desc, int plane)
+{
+    return (plane == 1 || plane == 2) ? desc->log2_chroma_h : 0;
+}
+
+static void release_layout(SliceScaler *scaler)
+{
+    int i;
+
+    for(i = 0; i < scaler->nb_bands; i++)
+        sws_cache_release(scaler->bands[i].ctx);
+    for(i = 0; i < scaler->scratchThreads; i++)
+        av_freep(&scaler->scratch[i].data[0]);
+    free(scaler->scratch);
+    scaler->scratch = NULL;
+    scaler->scratchThreads = 0;
+    scaler->nb_bands = 0;
+    scaler->configured = 0;
+}
+
+static int configure(SliceScaler *scaler, const SwsCacheKey *key)
+{
+    const AVPixFmtDescriptor *srcDesc = av_pix_fmt_desc_get(key->src_fmt);
+    const AVPixFmtDescriptor *dstDesc = av_pix_fmt_desc_get(key->dst_fmt);
+    int64_t g, unitSrc, unitDst, srcAlign, dstAlign, m;
+    int units, overlap, nb, maxExt, b, i;
+    double ratio;
+
+    release_layout(scaler);
+    if(!srcDesc || !dstDesc || key->src_h <= 0 || key->dst_h <= 0)
+        return -1;
+
+    //Smallest run of output rows that starts on a source row and on a chroma row on both sides
+    g = av_gcd(key->src_h, key->dst_h);
+    unitSrc = key->src_h / g;
+    unitDst = key->dst_h / g;
+    srcAlign = 1 << srcDesc->log2_chroma_h;
+    dstAlign = 1 << dstDesc->log2_chroma_h;
+    m = srcAlign / av_gcd(srcAlign, unitSrc);
+    m = m / av_gcd(m, dstAlign / av_gcd(dstAlign, unitDst)) * (dstAlign / av_gcd(dstAlign, unitDst));
+    unitSrc *= m;
+    unitDst *= m;
+    units = (int)(key->dst_h / unitDst);
+
+    nb = slice_pool_threads(scaler->pool);
+    nb = FFMIN(nb, units);
+    nb = FFMIN(nb, MAX_BANDS);
+    nb = FFMIN(nb, key->dst_h / MIN_BAND_ROWS);
+    if(nb < 2)
+    {
+        //Not worth splitting: one context over the whole frame, written straight into dst
+        scaler->bands[0].dst_y = scaler->bands[0].ext_dst_y = scaler->bands[0].ext_src_y = 0;
+        scaler->bands[0].dst_h = scaler->bands[0].ext_dst_h = key->dst_h;
+        scaler->bands[0].ext_src_h = key->src_h;
+        scaler->bands[0].ctx = sws_cache_acquire(key);
+        if(!scaler->bands[0].ctx)
+            return -1;
+        scaler->nb_bands = 1;
+        scaler->key = *key;
+        scaler->configured = 1;
+        return 0;
+    }
+
+    //Source rows the vertical filter reaches past a band edge (in luma rows, chroma taps are coarser)
+    ratio = (double)key->src_h / key->dst_h;
+    overlap = (int)((filter_taps(key->flags) * FFMAX(ratio, 1.0)) / 2 + 2) * (int)srcAlign;
+    overlap = (int)((overlap + unitSrc - 1) / unitSrc);
+
+    maxExt = 0;
+    for(b = 0; b < nb; b++)
+    {
+        Band *band = &scaler->bands[b];
+        SwsCacheKey bandKey = *key;
+        int u0 = b * units / nb;
+        int u1 = (b + 1) * units / nb;
+        int ext0 = FFMAX(u0 - overlap, 0);
+        int ext1 = u1 + overlap;
+        int dstEnd = b == nb - 1 ? key->dst_h : (int)(u1 * unitDst);
+        int extDstEnd, extSrcEnd;
+
+        //The last band also takes the rows left over after the last whole unit
+        if(b == nb - 1 || ext1 >= units)
+        {
+            extDstEnd = key->dst_h;
+            extSrcEnd = key->src_h;
+        }
+        else
+        {
+            extDstEnd = (int)(ext1 * unitDst);
+            extSrcEnd = (int)(ext1 * unitSrc);
+        }
+
+        band->dst_y = (int)(u0 * unitDst);
+        band->dst_h = dstEnd - band->dst_y;
+        band->ext_dst_y = (int)(ext0 * unitDst);
+        band->ext_dst_h = extDstEnd - band->ext_dst_y;
+        band->ext_src_y = (int)(ext0 * unitSrc);
+        band->ext_src_h = extSrcEnd - band->ext_src_y;
+
+        bandKey.src_h = band->ext_src_h;
+        bandKey.dst_h = band->ext_dst_h;
+        band->ctx = sws_cache_acquire(&bandKey);
+        scaler->nb_bands++;
+        if(!band->ctx)
+        {
+            release_layout(scaler);
+            return -1;
+        }
+        maxExt = FFMAX(maxExt, band->ext_dst_h);
+    }
+
+    scaler->scratchThreads = slice_pool_threads(scaler->pool);
+    scaler->scratch = calloc(scaler->scratchThreads, sizeof(Scratch));
+    if(!scaler->scratch)
+    {
+        scaler->scratchThreads = 0;
+        release_layout(scaler);
+        return -1;
+    }
+    for(i = 0; i < scaler->scratchThreads; i++)
+    {
+        if(av_image_alloc(scaler->scratch[i].data, scaler->scratch[i].linesize,
+                          key->dst_w, maxExt, key->dst_fmt, 32) < 0)
+        {
+            release_layout(scaler);
+            return -1;
+        }
+    }
+
+    scaler->key = *key;
+    scaler->configured = 1;
+    return 0;
+}
+
+static void convert_band(void *opaque, int index, int thread)
+{
+    SliceScaler *scaler = (SliceScaler *)opaque;
+    const Band *band = &scaler->bands[index];
+    const AVFrame *src = scaler->src;
+    const AVPixFmtDescriptor *srcDesc = av_pix_fmt_desc_get(scaler->key.src_fmt);
+    const AVPixFmtDescriptor *dstDesc = av_pix_fmt_desc_get(scaler->key.dst_fmt);
+    const uint8_t *srcPlanes[4] = { NULL };
+    const Scratch *scratch;
+    int p, y;
+
+    for(p = 0; p < 4 && src->data[p]; p++)
+    {
+        //The palette of PAL8 and pseudo-paletted formats is not an image plane, it stays whole (as in av_frame_apply_cropping)
+        if(p == 1 && (srcDesc->flags & (AV_PIX_FMT_FLAG_PAL | AV_PIX_FMT_FLAG_PSEUDOPAL)))
+            srcPlanes[p] = src->data[p];
+        else
+            srcPlanes[p] = src->data[p] + (band->ext_src_y >> plane_shift(srcDesc, p)) * src->linesize[p];
+    }
+
+    if(scaler->nb_bands == 1)
+    {
+        sws_scale(band->ctx, srcPlanes, src->linesize, 0, band->ext_src_h, scaler->dst, scaler->dstStride);
+        return;
+    }
+
+    scratch = &scaler->scratch[thread];
+    sws_scale(band->ctx, srcPlanes, src->linesize, 0, band->ext_src_h, scratch->data, scratch->linesize);
+
+    //Copy out only the rows this band owns, the overlap rows belong to its neighbours
+    for(p = 0; p < av_pix_fmt_count_planes(scaler->key.dst_fmt); p++)
+    {
+        int shift = plane_shift(dstDesc, p);
+        int first = band->dst_y >> shift;
+        int last = AV_CEIL_RSHIFT(band->dst_y + band->dst_h, shift);
+        int skip = first - (band->ext_dst_y >> shift);
+        int bytes = av_image_get_linesize(scaler->key.dst_fmt, scaler->key.dst_w, p);
+
+        for(y = 0; y < last - first; y++)
+        {
+            memcpy(scaler->dst[p] + (first + y) * scaler->dstStride[p],
+                   scratch->data[p] + (skip + y) * scratch->linesize[p],
+                   bytes);
+        }
+    }
+}
+
+SliceScaler *slice_scaler_create(SlicePool *pool)
+{
+    SliceScaler *scaler = calloc(1, sizeof(SliceScaler));
+
+    if(!scaler)
+        return NULL;
+    scaler->pool = pool;
+    return scaler;
+}
+
+int slice_scaler_scale(SliceScaler *scaler, const AVFrame *src,
+                       uint8_t *const dst[], const int dst_stride[],
+                       int dst_w, int dst_h, enum AVPixelFormat dst_fmt, int flags)
+{
+    SwsCacheKey key;
+
+    sws_cache_key_from_frame(&key, src, dst_w, dst_h, dst_fmt, flags);
+    if(!scaler->configured || memcmp(&key, &scaler->key, sizeof(key)) != 0)
+    {
+        if(configure(scaler, &key) < 0)
+            return -1;
+    }
+
+    scaler->src = src;
+    scaler->dst = dst;
+    scaler->dstStride = dst_stride;
+    slice_pool_run(scaler->pool, convert_band, scaler, scaler->nb_bands);
+    return dst_h;
+}
+
+int slice_scaler_bands(const SliceScaler *scaler)
+{
+    return scaler->nb_bands;
+}
+
+void slice_scaler_destroy(SliceScaler **scalerPtr)
+{
+    SliceScaler *scaler = *scalerPtr;
+
+    if(!scaler)
+        return;
+    release_layout(scaler);
+    free(scaler);
+    *scalerPtr = NULL;
+}
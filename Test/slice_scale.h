@@ -0,0 +1,34 @@
+//
+//  slice_scale.h
+//  Frame conversion split into horizontal bands that are converted in parallel
+//
+//  sws_scale converts a frame on one thread. Here the output is cut into bands, one per pool thread,
+//  and every band has its own SwsContext over the source rows it needs plus enough overlap rows
+//  for the vertical filter taps, so bands never depend on each other.
+//
+#ifndef SLICE_SCALE_H
+#define SLICE_SCALE_H
+
+#include <libavutil/frame.h>
+#include <libavutil/pixfmt.h>
+#include <stdint.h>
+
+#include "slice_pool.h"
+
+typedef struct SliceScaler SliceScaler;
+
+//The pool can be shared with other scalers, their conversions then take turns on it
+SliceScaler *slice_scaler_create(SlicePool *pool);
+
+//Convert the whole of src into dst (dst_w x dst_h dst_fmt), returns dst_h or < 0
+//The band layout and contexts are rebuilt only when the source or destination parameters change
+int slice_scaler_scale(SliceScaler *scaler, const AVFrame *src,
+                       uint8_t *const dst[], const int dst_stride[],
+                       int dst_w, int dst_h, enum AVPixelFormat dst_fmt, int flags);
+
+//Number of bands of the last conversion (1 = not split)
+int slice_scaler_bands(const SliceScaler *scaler);
+
+void slice_scaler_destroy(SliceScaler **scaler);
+
+#endif
@@ -0,0 +1,121 @@
+//
+//  stage_timer.c
+//  Per-stage latency histograms for the player loops
+//
+//  Latencies are kept in HDR-style log-linear buckets: values below 2 * SUB_BUCKETS ns are exact,
+//  above that every power of two is split into SUB_BUCKETS buckets (about 3% relative error),
+//  so recording a sample is a few integer operations and the memory is fixed.
+//
+#include "stage_timer.h"
+
+#define SUB_BUCKET_BITS 5
+#define SUB_BUCKETS (1 << SUB_BUCKET_BITS)
+#define BUCKETS (48 * SUB_BUCKETS)
+
+typedef struct StageHistogram
+{
+    Uint64 counts[BUCKETS];
+    Uint64 total;
+    Uint64 max;
+} StageHistogram;
+
+static StageHistogram histograms[STAGE_MAX_STREAMS][STAGE_COUNT];
+
+static const char *stage_names[STAGE_COUNT] = {
+    "read",
+    "decode",
+    "deint",
+    "convert",
+    "upload",
+    "present",
+};
+
+static int bucket_index(Uint64 value)
+{
+    int msb, shift, index;
+
+    if(value < 2 * SUB_BUCKETS)
+        return (int)value;
+
+    msb = 63 - __builtin_clzll(value);
+    shift = msb - SUB_BUCKET_BITS;
+    index = (shift + 1) * SUB_BUCKETS + (int)((value >> shift) - SUB_BUCKETS);
+    return index < BUCKETS ? index : BUCKETS - 1;
+}
+
+//Midpoint of the values that fall into a bucket
+static Uint64 bucket_value(int index)
+{
+    int shift;
+    Uint64 base;
+
+    if(index < 2 * SUB_BUCKETS)
+        return (Uint64)index;
+
+    shift = index / SUB_BUCKETS - 1;
+    base = (Uint64)(index % SUB_BUCKETS + SUB_BUCKETS) << shift;
+    return base + ((1ULL << shift) >> 1);
+}
+
+void stage_timer_stop(int stream, StageId stage, Uint64 start)
+{
+    static Uint64 frequency = 0;
+    StageHistogram *hist;
+    Uint64 elapsed_ns;
+
+    if(stream < 0 || stream >= STAGE_MAX_STREAMS)
+        return;
+    if(!frequency)
+        frequency = SDL_GetPerformanceFrequency();
+
+    elapsed_ns = (SDL_GetPerformanceCounter() - start) * 1000000000ULL / frequency;
+
+    hist = &histograms[stream][stage];
+    hist->counts[bucket_index(elapsed_ns)]++;
+    hist->total++;
+    if(elapsed_ns > hist->max)
+        hist->max = elapsed_ns;
+}
+
+static Uint64 percentile(const StageHistogram *hist, double p)
+{
+    Uint64 target = (Uint64)(hist->total * p / 100.0 + 0.5);
+    Uint64 seen = 0;
+    int i;
+
+    if(target < 1)
+        target = 1;
+    for(i = 0; i < BUCKETS; i++)
+    {
+        seen += hist->counts[i];
+        if(seen >= target)
+            return bucket_value(i) < hist->max ? bucket_value(i) : hist->max;
+    }
+    return hist->max;
+}
+
+//Histograms written by other threads (the audio callback) are read without locking,
+//so a dump taken while playing may be off by the samples being recorded at that moment
+void stage_timer_dump(FILE *out)
+{
+    int stream, stage;
+
+    fprintf(out, "%-8s %-8s %10s %12s %12s %12s\n", "stream", "stage", "count", "p50(us)", "p99(us)", "max(us)");
+    for(stream = 0; stream < STAGE_MAX_STREAMS; stream++)
+    {
+        for(stage = 0; stage < STAGE_COUNT; stage++)
+        {
+            const StageHistogram *hist = &histograms[stream][stage];
+            if(!hist->total)
+                continue;
+
+            fprintf(out, "%-8d %-8s %10llu %12.1f %12.1f %12.1f\n",
+                    stream,
+                    stage_names[stage],
+                    (unsigned long long)hist->total,
+                    percentile(hist, 50.0) / 1000.0,
+                    percentile(hist, 99.0) / 1000.0,
+                    hist->max / 1000.0);
+        }
+    }
+}
@@ -0,0 +1,37 @@
+//
+//  stage_timer.h
+//  Per-stage latency histograms for the player loops
+//
+#ifndef STAGE_TIMER_H
+#define STAGE_TIMER_H
+
+#include <SDL2/SDL.h>
+#include <stdio.h>
+
+#define STAGE_MAX_STREAMS 8
+
+typedef enum StageId
+{
+    STAGE_READ,         //av_read_frame
+    STAGE_DECODE,       //avcodec_decode_video2 / avcodec_decode_audio4
+    STAGE_DEINTERLACE,  //deinterlace_frame
+    STAGE_CONVERT,      //sws_scale
+    STAGE_UPLOAD,       //SDL_UpdateYUVTexture
+    STAGE_PRESENT,      //SDL_RenderClear / SDL_RenderCopy / SDL_RenderPresent
+    STAGE_COUNT
+} StageId;
+
+//Take a monotonic timestamp at the start of a stage
+static inline Uint64 stage_timer_start(void)
+{
+    return SDL_GetPerformanceCounter();
+}
+
+//Record the time elapsed since start into the histogram of (stream, stage)
+//Each (stream, stage) pair must only be recorded from one thread
+void stage_timer_stop(int stream, StageId stage, Uint64 start);
+
+//Print count, p50, p99 and max for every stage that has samples
+void stage_timer_dump(FILE *out);
+
+#endif
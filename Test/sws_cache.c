@@ -0,0 +1,219 @@
+//
+//  sws_cache.c
+//  Shared cache of SwsContexts keyed by conversion parameters
+//
+//  The cache is a small fixed table: a lookup is a linear scan over a handful of keys, and a spin lock
+//  is enough because it is only held for the scan, never while a context is built, scaled or freed.
+//
+#include <SDL2/SDL.h>
+#include <string.h>
+
+#include "sws_cache.h"
+
+#define SWS_CACHE_SIZE 64
+
+typedef struct SwsCacheEntry
+{
+    SwsCacheKey key;
+    struct SwsContext *ctx;     //NULL = free slot
+    int in_use;
+    Uint64 last_used;           //For picking the least recently used idle entry to evict
+    double build_ms;            //What it cost to build, i.e. what every reuse saves
+} SwsCacheEntry;
+
+static SwsCacheEntry entries[SWS_CACHE_SIZE];
+static SwsCacheStats stats;
+static Uint64 useClock = 0;
+static SDL_SpinLock lock = 0;
+
+static int key_equal(const SwsCacheKey *a, const SwsCacheKey *b)
+{
+    return a->src_w == b->src_w && a->src_h == b->src_h && a->src_fmt == b->src_fmt &&
+           a->dst_w == b->dst_w && a->dst_h == b->dst_h && a->dst_fmt == b->dst_fmt &&
+           a->flags == b->flags && a->colorspace == b->colorspace && a->src_range == b->src_range;
+}
+
+void sws_cache_key_from_frame(SwsCacheKey *key, const AVFrame *frame,
+                              int dst_w, int dst_h, enum AVPixelFormat dst_fmt, int flags)
+{
+    //Zeroed first so the padding never makes two equal keys differ
+    memset(key, 0, sizeof(*key));
+    key->src_w = frame->width;
+    key->src_h = frame->height;
+    key->src_fmt = (enum AVPixelFormat)frame->format;
+    key->dst_w = dst_w;
+    key->dst_h = dst_h;
+    key->dst_fmt = dst_fmt;
+    key->flags = flags;
+    key->colorspace = frame->colorspace;
+    key->src_range = frame->color_range == AVCOL_RANGE_JPEG;
+}
+
+static struct SwsContext *build_context(const SwsCacheKey *key, double *build_ms)
+{
+    Uint64 start = SDL_GetPerformanceCounter();
+    struct SwsContext *ctx;
+    int *inv_table, *table;
+    int src_range, dst_range, brightness, contrast, saturation;
+
+    ctx = sws_getContext(key->src_w, key->src_h, key->src_fmt,
+                         key->dst_w, key->dst_h, key->dst_fmt,
+                         key->flags, NULL, NULL, NULL);
+    if(ctx)
+    {
+        //sws_getContext assumes BT.601 limited range, use the source's own matrix and range instead
+        if(sws_getColorspaceDetails(ctx, &inv_table, &src_range, &table, &dst_range,
+                                    &brightness, &contrast, &saturation) >= 0)
+        {
+            sws_setColorspaceDetails(ctx, sws_getCoefficients(key->colorspace), key->src_range,
+                                     table, dst_range, brightness, contrast, saturation);
+        }
+    }
+
+    *build_ms = (SDL_GetPerformanceCounter() - start) * 1000.0 / SDL_GetPerformanceFrequency();
+    return ctx;
+}
+
+struct SwsContext *sws_cache_acquire(const SwsCacheKey *key)
+{
+    struct SwsContext *ctx = NULL;
+    struct SwsContext *evicted = NULL;
+    SwsCacheEntry *slot = NULL;
+    double build_ms;
+    int i;
+
+    SDL_AtomicLock(&lock);
+    for(i = 0; i < SWS_CACHE_SIZE; i++)
+    {
+        if(entries[i].ctx && !entries[i].in_use && key_equal(&entries[i].key, key))
+        {
+            entries[i].in_use = 1;
+            entries[i].last_used = ++useClock;
+            stats.hits++;
+            stats.saved_ms += entries[i].build_ms;
+            ctx = entries[i].ctx;
+            break;
+        }
+    }
+    SDL_AtomicUnlock(&lock);
+    if(ctx)
+        return ctx;
+
+    //Built without the lock so other threads keep converting meanwhile
+    ctx = build_context(key, &build_ms);
+    if(!ctx)
+        return NULL;
+
+    SDL_AtomicLock(&lock);
+    stats.builds++;
+    stats.build_ms += build_ms;
+    //A free slot, otherwise the least recently used idle one
+    for(i = 0; i < SWS_CACHE_SIZE; i++)
+    {
+        if(!entries[i].ctx)
+        {
+            slot = &entries[i];
+            break;
+        }
+        if(!entries[i].in_use && (!slot || entries[i].last_used < slot->last_used))
+            slot = &entries[i];
+    }
+    if(slot)
+    {
+        if(slot->ctx)
+        {
+            evicted = slot->ctx;
+            stats.evictions++;
+        }
+        slot->key = *key;
+        slot->ctx = ctx;
+        slot->in_use = 1;
+        slot->last_used = ++useClock;
+        slot->build_ms = build_ms;
+    }
+    //No slot: every cached context is in use, this one is freed on release instead of cached
+    SDL_AtomicUnlock(&lock);
+
+    sws_freeContext(evicted);
+    return ctx;
+}
+
+void sws_cache_release(struct SwsContext *ctx)
+{
+    int i;
+
+    if(!ctx)
+        return;
+
+    SDL_AtomicLock(&lock);
+    for(i = 0; i < SWS_CACHE_SIZE; i++)
+    {
+        if(entries[i].ctx == ctx)
+        {
+            entries[i].in_use = 0;
+            SDL_AtomicUnlock(&lock);
+            return;
+        }
+    }
+    SDL_AtomicUnlock(&lock);
+
+    //Not cached (the table was full of contexts in use when it was built, or it was cleared meanwhile)
+    sws_freeContext(ctx);
+}
+
+int sws_cache_scale(const AVFrame *src,
+                    uint8_t *const dst[], const int dst_stride[],
+                    int dst_w, int dst_h, enum AVPixelFormat dst_fmt, int flags)
+{
+    SwsCacheKey key;
+    struct SwsContext *ctx;
+    int ret;
+
+    sws_cache_key_from_frame(&key, src, dst_w, dst_h, dst_fmt, flags);
+    ctx = sws_cache_acquire(&key);
+    if(!ctx)
+        return -1;
+
+    ret = sws_scale(ctx, (uint8_t const* const*)src->data, src->linesize, 0, src->height, dst, dst_stride);
+    sws_cache_release(ctx);
+    return ret;
+}
+
+void sws_cache_get_stats(SwsCacheStats *out)
+{
+    SDL_AtomicLock(&lock);
+    *out = stats;
+    SDL_AtomicUnlock(&lock);
+}
+
+void sws_cache_dump(FILE *out)
+{
+    SwsCacheStats s;
+
+    sws_cache_get_stats(&s);
+    fprintf(out, "sws cache: builds(%llu), hits(%llu), evictions(%llu), build time(%.3fms), saved(%.3fms)\n",
+            (unsigned long long)s.builds, (unsigned long long)s.hits, (unsigned long long)s.evictions,
+            s.build_ms, s.saved_ms);
+}
+
+void sws_cache_clear(void)
+{
+    struct SwsContext *idle[SWS_CACHE_SIZE];
+    int count = 0;
+    int i;
+
+    SDL_AtomicLock(&lock);
+    for(i = 0; i < SWS_CACHE_SIZE; i++)
+    {
+        if(!entries[i].ctx)
+            continue;
+        //A context in use is dropped from the table, sws_cache_release then frees it
+        if(!entries[i].in_use)
+            idle[count++] = entries[i].ctx;
+        memset(&entries[i], 0, sizeof(entries[i]));
+    }
+    SDL_AtomicUnlock(&lock);
+
+    for(i = 0; i < count; i++)
+        sws_freeContext(idle[i]);
+}
@@ -0,0 +1,64 @@
+//
+//  sws_cache.h
+//  Shared cache of SwsContexts keyed by conversion parameters
+//
+//  The players convert every decoded frame with sws_scale. Building the SwsContext (filter tables,
+//  SIMD code paths) costs far more than one conversion, so contexts are built once per set of
+//  parameters and handed out again for every later frame, stream or job that needs the same conversion.
+//  The key is taken from each frame, so a resolution or format change mid-stream just picks (or builds)
+//  another context instead of converting with a stale one.
+//
+#ifndef SWS_CACHE_H
+#define SWS_CACHE_H
+
+#include <libavutil/frame.h>
+#include <libavutil/pixfmt.h>
+#include <libswscale/swscale.h>
+#include <stdint.h>
+#include <stdio.h>
+
+typedef struct SwsCacheKey
+{
+    int src_w, src_h;
+    enum AVPixelFormat src_fmt;
+    int dst_w, dst_h;
+    enum AVPixelFormat dst_fmt;
+    int flags;              //SWS_BILINEAR, SWS_BICUBIC, ...
+    int colorspace;         //AVColorSpace of the source, selects the YUV <-> RGB matrix
+    int src_range;          //1 = full (JPEG) range source
+} SwsCacheKey;
+
+typedef struct SwsCacheStats
+{
+    uint64_t builds;        //sws_getContext calls
+    uint64_t hits;          //acquires served by an idle cached context
+    uint64_t evictions;     //contexts freed to make room for another key
+    double build_ms;        //total time spent building contexts
+    double saved_ms;        //build time of the contexts that were reused instead of rebuilt
+} SwsCacheStats;
+
+//Fill a key for converting frame to dst_w x dst_h dst_fmt
+void sws_cache_key_from_frame(SwsCacheKey *key, const AVFrame *frame,
+                              int dst_w, int dst_h, enum AVPixelFormat dst_fmt, int flags);
+
+//Take a context for key for exclusive use, building it if no idle one matches (NULL on failure)
+//Safe to call from any thread, two threads asking for the same key get two different contexts
+struct SwsContext *sws_cache_acquire(const SwsCacheKey *key);
+
+//Give a context back to the cache, it stays built for the next acquire with the same key
+void sws_cache_release(struct SwsContext *ctx);
+
+//Convert the whole of src into dst (dst_w x dst_h dst_fmt) with a cached context, returns the output height or < 0
+int sws_cache_scale(const AVFrame *src,
+                    uint8_t *const dst[], const int dst_stride[],
+                    int dst_w, int dst_h, enum AVPixelFormat dst_fmt, int flags);
+
+void sws_cache_get_stats(SwsCacheStats *stats);
+
+//Print builds, hits, evictions and time saved
+void sws_cache_dump(FILE *out);
+
+//Free every idle context (contexts still acquired are freed when released)
+void sws_cache_clear(void);
+
+#endif
@@ -0,0 +1,510 @@
+//
+//  tonemap.c
+//  HDR (PQ / HLG, BT.2020) -> SDR BT.709 RGB24 tone mapping for previews and exports
+//
+//  Linear light is kept relative to SDR white (100 nits = 1.0). The tables are indexed by the square
+//  root of their argument, which spends most of their entries on the dark end where the eye (and the
+//  8-bit output) needs them, and the AVX2 kernel looks them up with gathers, 8 pixels at a time.
+//  Its arithmetic is the scalar kernel's, operation for operation, so the two give the same bytes.
+//  The tables are rebuilt only when the transfer, the peak or the primaries change.
+//
+#include <libavutil/mastering_display_metadata.h>
+#include <libavutil/mem.h>
+#include <math.h>
+#include <stdlib.h>
+
+#include "tonemap.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define TONEMAP_X86 1
+#include <immintrin.h>
+#endif
+
+#define LUT_SIZE        4096
+#define SDR_WHITE       100.0       //nits
+#define HLG_PEAK        1000.0      //Nominal display peak the HLG OOTF renders for
+#define DEFAULT_PEAK    1000.0      //PQ content that does not say
+
+typedef enum Transfer
+{
+    TRANSFER_PQ,
+    TRANSFER_HLG,
+} Transfer;
+
+//BT.2020 luma weights, for the HLG OOTF
+static const float hlgKr = 0.2627f, hlgKg = 0.6780f, hlgKb = 0.0593f;
+
+//Linear BT.2020 RGB -> linear BT.709 RGB
+static const float bt2020To709[9] =
+{
+     1.6605f, -0.5876f, -0.0728f,
+    -0.1246f,  1.1329f, -0.0083f,
+    -0.0182f, -0.1006f,  1.1187f,
+};
+
+struct ToneMapper
+{
+    SlicePool *pool;
+    ToneCurve curve;
+    Yuv2RgbKernel kernel;
+
+    //What the tables were built for
+    int built;
+    Transfer transfer;
+    double peakNits;
+    int bt709Primaries;
+
+    float eotf[LUT_SIZE];       //Code >> 4 -> linear light (HLG: scene light, 0..1)
+    float ootf[LUT_SIZE];       //HLG: sqrt(scene luminance) -> gain to display light
+    float scale[LUT_SIZE];      //sqrt(max(R, G, B) / peak) -> curve(max) / max
+    int32_t oetf[LUT_SIZE];     //sqrt(linear) -> 8-bit BT.1886 code
+    float invPeak;
+    float gamut[9];
+
+    //The frame being mapped
+    const AVFrame *frame;
+    uint8_t *dst;
+    int dstStride;
+    int depth, semiPlanar, fullRange;
+    Yuv2RgbMatrix matrix;
+    int bands;
+
+    //Two RGB48 lines per thread
+    uint16_t **scratch;
+    int scratchThreads;
+    int scratchStride;          //Bytes
+};
+
+typedef int (*MapRowFunc)(const ToneMapper *mapper, const uint16_t *rgb48, uint8_t *rgb24, int x, int width);
+
+//SMPTE ST 2084
+static const double pqM1 = 2610.0 / 16384, pqM2 = 2523.0 / 4096 * 128;
+static const double pqC1 = 3424.0 / 4096, pqC2 = 2413.0 / 4096 * 32, pqC3 = 2392.0 / 4096 * 32;
+
+static double pq_to_nits(double e)
+{
+    double p = pow(e, 1 / pqM2);
+
+    return 10000 * pow(fmax(p - pqC1, 0) / (pqC2 - pqC3 * p), 1 / pqM1);
+}
+
+static double nits_to_pq(double nits)
+{
+    double y = pow(fmax(nits, 0) / 10000, pqM1);
+
+    return pow((pqC1 + pqC2 * y) / (1 + pqC3 * y), pqM2);
+}
+
+//ARIB STD-B67 inverse OETF, signal -> scene light 0..1
+static double hlg_to_scene(double e)
+{
+    const double a = 0.17883277, b = 0.28466892, c = 0.55991073;
+
+    return e <= 0.5 ? e * e / 3 : (exp((e - c) / a) + b) / 12;
+}
+
+static double hable(double x)
+{
+    const double a = 0.15, b = 0.50, c = 0.10, d = 0.20, e = 0.02, f = 0.30;
+
+    return (x * (a * x + c * b) + d * e) / (x * (a * x + b) + d * f) - e / f;
+}
+
+//ITU-R BT.2390 EETF from [0, peak] to [0, SDR white], sig and the result relative to SDR white
+static double bt2390(double sig, double peak)
+{
+    double srcPeak = nits_to_pq(peak * SDR_WHITE);
+    double maxLum = nits_to_pq(SDR_WHITE) / srcPeak;
+    double ks = 1.5 * maxLum - 0.5;
+    double e = nits_to_pq(sig * SDR_WHITE) / srcPeak;
+
+    if(e > ks)
+    {
+        double t = (e - ks) / (1 - ks);
+        double t2 = t * t, t3 = t2 * t;
+
+        e = (2 * t3 - 3 * t2 + 1) * ks + (t3 - 2 * t2 + t) * (1 - ks) + (-2 * t3 + 3 * t2) * maxLum;
+    }
+    return pq_to_nits(e * srcPeak) / SDR_WHITE;
+}
+
+static double apply_curve(ToneCurve curve, double sig, double peak)
+{
+    //Nothing above SDR white to bring down
+    if(peak <= 1.0)
+        return sig;
+
+    switch(curve)
+    {
+    case TONEMAP_HABLE:     return hable(sig) / hable(peak);
+    case TONEMAP_REINHARD:  return sig * (1 + sig / (peak * peak)) / (1 + sig);
+    default:                return bt2390(sig, peak);
+    }
+}
+
+static void build_tables(ToneMapper *mapper, Transfer transfer, double peakNits, int bt709Primaries)
+{
+    double peak = (transfer == TRANSFER_HLG ? HLG_PEAK : peakNits) / SDR_WHITE;
+    int i;
+
+    for(i = 0; i < LUT_SIZE; i++)
+    {
+        double e = (double)i / (LUT_SIZE - 1);
+        double t = e * e;
+        double sig = fmax(t * peak, 1e-6);
+
+        mapper->eotf[i] = (float)(transfer == TRANSFER_HLG ? hlg_to_scene(e) : pq_to_nits(e) / SDR_WHITE);
+        mapper->ootf[i] = (float)(HLG_PEAK / SDR_WHITE * pow(t, 0.2));
+        mapper->scale[i] = (float)(apply_curve(mapper->curve, sig, peak) / sig);
+        mapper->oetf[i] = (int32_t)lrint(255 * pow(t, 1 / 2.4));
+    }
+    mapper->invPeak = (float)(1 / peak);
+    for(i = 0; i < 9; i++)
+        mapper->gamut[i] = bt709Primaries ? (i % 4 == 0 ? 1.0f : 0.0f) : bt2020To709[i];
+
+    mapper->transfer = transfer;
+    mapper->peakNits = peakNits;
+    mapper->bt709Primaries = bt709Primaries;
+    mapper->built = 1;
+}
+
+//t is never negative here, above 1 it takes the last entry
+static inline int lut_index(float t)
+{
+    return (int)(sqrtf(t < 1.0f ? t : 1.0f) * (LUT_SIZE - 1) + 0.5f);
+}
+
+static int map_row_scalar(const ToneMapper *mapper, const uint16_t *rgb48, uint8_t *rgb24, int x, int width)
+{
+    const float *m = mapper->gamut;
+    const int hlg = mapper->transfer == TRANSFER_HLG;
+
+    for(; x < width; x++)
+    {
+        float r = mapper->eotf[rgb48[3 * x + 0] >> 4];
+        float g = mapper->eotf[rgb48[3 * x + 1] >> 4];
+        float b = mapper->eotf[rgb48[3 * x + 2] >> 4];
+        float sig, scale, ro, go, bo;
+
+        if(hlg)
+        {
+            float gain = mapper->ootf[lut_index(hlgKr * r + hlgKg * g + hlgKb * b)];
+
+            r *= gain;
+            g *= gain;
+            b *= gain;
+        }
+
+        sig = r > g ? r : g;
+        sig = sig > b ? sig : b;
+        scale = mapper->scale[lut_index(sig * mapper->invPeak)];
+        r *= scale;
+        g *= scale;
+        b *= scale;
+
+        ro = m[0] * r + m[1] * g + m[2] * b;
+        go = m[3] * r + m[4] * g + m[5] * b;
+        bo = m[6] * r + m[7] * g + m[8] * b;
+        rgb24[3 * x + 0] = (uint8_t)mapper->oetf[lut_index(ro > 0.0f ? ro : 0.0f)];
+        rgb24[3 * x + 1] = (uint8_t)mapper->oetf[lut_index(go > 0.0f ? go : 0.0f)];
+        rgb24[3 * x + 2] = (uint8_t)mapper->oetf[lut_index(bo > 0.0f ? bo : 0.0f)];
+    }
+    return x;
+}
+
+#ifdef TONEMAP_X86
+
+__attribute__((target("avx2"), always_inline))
+static inline __m256i lut_index_avx2(__m256 t, __m256 one, __m256 steps, __m256 half)
+{
+    return _mm256_cvttps_epi32(_mm256_add_ps(_mm256_mul_ps(_mm256_sqrt_ps(_mm256_min_ps(t, one)), steps), half));
+}
+
+//8 pixels a step. Each 128-bit lane gets two pixels from each of two 16-word loads, so the channels come
+//out in pixel order 0 1 4 5 | 2 3 6 7, which is put right again just before the store.
+__attribute__((target("avx2")))
+static int map_row_avx2(const ToneMapper *mapper, const uint16_t *rgb48, uint8_t *rgb24, int x, int width)
+{
+//Zero-extends the word at byte c of both pixels of a lane (bytes 0..5 and 6..11) into dwords 0, 1 or 2, 3
+#define LOW(c)  c, c + 1, -1, -1, c + 6, c + 7, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1
+#define HIGH(c) -1, -1, -1, -1, -1, -1, -1, -1, c, c + 1, -1, -1, c + 6, c + 7, -1, -1
+    const __m256i lowR = _mm256_setr_epi8(LOW(0), LOW(0)), highR = _mm256_setr_epi8(HIGH(0), HIGH(0));
+    const __m256i lowG = _mm256_setr_epi8(LOW(2), LOW(2)), highG = _mm256_setr_epi8(HIGH(2), HIGH(2));
+    const __m256i lowB = _mm256_setr_epi8(LOW(4), LOW(4)), highB = _mm256_setr_epi8(HIGH(4), HIGH(4));
+#undef LOW
+#undef HIGH
+    const __m256i split = _mm256_setr_epi32(0, 1, 2, 2, 3, 4, 5, 5);
+    const __m256i order = _mm256_setr_epi32(0, 1, 4, 5, 2, 3, 6, 7);
+    const __m256i pack = _mm256_setr_epi8(0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14, -1, -1, -1, -1,
+                                          0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14, -1, -1, -1, -1);
+    const __m256 zero = _mm256_setzero_ps();
+    const __m256 one = _mm256_set1_ps(1.0f);
+    const __m256 steps = _mm256_set1_ps(LUT_SIZE - 1);
+    const __m256 half = _mm256_set1_ps(0.5f);
+    const __m256 invPeak = _mm256_set1_ps(mapper->invPeak);
+    const __m256 kr = _mm256_set1_ps(hlgKr), kg = _mm256_set1_ps(hlgKg), kb = _mm256_set1_ps(hlgKb);
+    const float *m = mapper->gamut;
+    const int hlg = mapper->transfer == TRANSFER_HLG;
+
+    //The second load reads up to word 27 and the second 16-byte store runs 4 bytes past the 8 pixels,
+    //both inside pixels 8 and 9, which a later step (or the tail) writes
+    for(; x + 10 <= width; x += 8)
+    {
+        const uint16_t *in = rgb48 + 3 * x;
+        //Pixels 0 1 | 2 3 and 4 5 | 6 7, each pixel pair in the low 12 bytes of a lane
+        __m256i p0 = _mm256_permutevar8x32_epi32(_mm256_loadu_si256((const __m256i *)in), split);
+        __m256i p1 = _mm256_permutevar8x32_epi32(_mm256_loadu_si256((const __m256i *)(in + 12)), split);
+        __m256i cr = _mm256_or_si256(_mm256_shuffle_epi8(p0, lowR), _mm256_shuffle_epi8(p1, highR));
+        __m256i cg = _mm256_or_si256(_mm256_shuffle_epi8(p0, lowG), _mm256_shuffle_epi8(p1, highG));
+        __m256i cb = _mm256_or_si256(_mm256_shuffle_epi8(p0, lowB), _mm256_shuffle_epi8(p1, highB));
+        __m256 r = _mm256_i32gather_ps(mapper->eotf, _mm256_srli_epi32(cr, 4), 4);
+        __m256 g = _mm256_i32gather_ps(mapper->eotf, _mm256_srli_epi32(cg, 4), 4);
+        __m256 b = _mm256_i32gather_ps(mapper->eotf, _mm256_srli_epi32(cb, 4), 4);
+        __m256 sig, scale, ro, go, bo;
+        __m256i pr, pg, pb;
+
+        if(hlg)
+        {
+            __m256 ys = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(kr, r), _mm256_mul_ps(kg, g)), _mm256_mul_ps(kb, b));
+            __m256 gain = _mm256_i32gather_ps(mapper->ootf, lut_index_avx2(ys, one, steps, half), 4);
+
+            r = _mm256_mul_ps(r, gain);
+            g = _mm256_mul_ps(g, gain);
+            b = _mm256_mul_ps(b, gain);
+        }
+
+        sig = _mm256_max_ps(_mm256_max_ps(r, g), b);
+        scale = _mm256_i32gather_ps(mapper->scale, lut_index_avx2(_mm256_mul_ps(sig, invPeak), one, steps, half), 4);
+        r = _mm256_mul_ps(r, scale);
+        g = _mm256_mul_ps(g, scale);
+        b = _mm256_mul_ps(b, scale);
+
+#define GAMUT_ROW(i) _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(_mm256_set1_ps(m[i]), r),           \
+                                                 _mm256_mul_ps(_mm256_set1_ps(m[i + 1]), g)),       \
+                                   _mm256_mul_ps(_mm256_set1_ps(m[i + 2]), b))
+        ro = _mm256_max_ps(GAMUT_ROW(0), zero);
+        go = _mm256_max_ps(GAMUT_ROW(3), zero);
+        bo = _mm256_max_ps(GAMUT_ROW(6), zero);
+#undef GAMUT_ROW
+
+        pr = _mm256_i32gather_epi32(mapper->oetf, lut_index_avx2(ro, one, steps, half), 4);
+        pg = _mm256_i32gather_epi32(mapper->oetf, lut_index_avx2(go, one, steps, half), 4);
+        pb = _mm256_i32gather_epi32(mapper->oetf, lut_index_avx2(bo, one, steps, half), 4);
+
+        //One pixel per dword, then the 3 bytes of each squeezed together in each lane
+        pr = _mm256_or_si256(_mm256_or_si256(pr, _mm256_slli_epi32(pg, 8)), _mm256_slli_epi32(pb, 16));
+        pr = _mm256_shuffle_epi8(_mm256_permutevar8x32_epi32(pr, order), pack);
+        _mm_storeu_si128((__m128i *)(rgb24 + 3 * x), _mm256_castsi256_si128(pr));
+        _mm_storeu_si128((__m128i *)(rgb24 + 3 * x + 12), _mm256_extracti128_si256(pr, 1));
+    }
+    return x;
+}
+
+#endif
+
+//SSE4.1 has no gathers, a table lookup per lane would cost more than it saves
+static MapRowFunc map_row_func(Yuv2RgbKernel kernel)
+{
+#ifdef TONEMAP_X86
+    if(kernel == YUV2RGB_KERNEL_AVX2 || kernel == YUV2RGB_KERNEL_AVX512)
+        return map_row_avx2;
+#endif
+    return map_row_scalar;
+}
+
+ToneMapper *tonemap_create(SlicePool *pool, ToneCurve curve, Yuv2RgbKernel kernel)
+{
+    ToneMapper *mapper;
+
+    if(kernel == YUV2RGB_KERNEL_AUTO)
+        kernel = yuv2rgb_best_kernel();
+    else if(!yuv2rgb_kernel_supported(kernel))
+        return NULL;
+
+    mapper = calloc(1, sizeof(ToneMapper));
+    if(!mapper)
+        return NULL;
+    mapper->pool = pool;
+    mapper->curve = curve;
+    mapper->kernel = kernel;
+    mapper->peakNits = DEFAULT_PEAK;
+    mapper->scratchThreads = pool ? slice_pool_threads(pool) : 1;
+    mapper->scratch = calloc(mapper->scratchThreads, sizeof(uint16_t *));
+    if(!mapper->scratch)
+    {
+        tonemap_destroy(&mapper);
+        return NULL;
+    }
+    return mapper;
+}
+
+const char *tonemap_curve_name(ToneCurve curve)
+{
+    switch(curve)
+    {
+    case TONEMAP_HABLE:     return "hable";
+    case TONEMAP_REINHARD:  return "reinhard";
+    case TONEMAP_BT2390:    return "bt2390";
+    default:                return "unknown";
+    }
+}
+
+static int frame_transfer(const AVFrame *frame)
+{
+    switch(frame->color_trc)
+    {
+    case AVCOL_TRC_SMPTE2084:       return TRANSFER_PQ;
+    case AVCOL_TRC_ARIB_STD_B67:    return TRANSFER_HLG;
+    default:                        return -1;
+    }
+}
+
+static int frame_layout(const AVFrame *frame, int *depth, int *semiPlanar)
+{
+    switch(frame->format)
+    {
+    case AV_PIX_FMT_YUV420P10: *depth = 10; *semiPlanar = 0; return 0;
+    case AV_PIX_FMT_YUV420P12: *depth = 12; *semiPlanar = 0; return 0;
+    case AV_PIX_FMT_P010:      *depth = 10; *semiPlanar = 1; return 0;
+    default:                   return -1;
+    }
+}
+
+int tonemap_frame_is_hdr(const AVFrame *frame)
+{
+    int depth, semiPlanar;
+
+    return frame_transfer(frame) >= 0 && frame_layout(frame, &depth, &semiPlanar) == 0;
+}
+
+double tonemap_frame_peak(const AVFrame *frame)
+{
+    AVFrameSideData *sd = av_frame_get_side_data(frame, AV_FRAME_DATA_CONTENT_LIGHT_LEVEL);
+
+    if(sd && ((const AVContentLightMetadata *)sd->data)->MaxCLL > 0)
+        return ((const AVContentLightMetadata *)sd->data)->MaxCLL;
+
+    sd = av_frame_get_side_data(frame, AV_FRAME_DATA_MASTERING_DISPLAY_METADATA);
+    if(sd)
+    {
+        const AVMasteringDisplayMetadata *mastering = (const AVMasteringDisplayMetadata *)sd->data;
+
+        if(mastering->has_luminance && mastering->max_luminance.num > 0)
+            return av_q2d(mastering->max_luminance);
+    }
+    return 0;
+}
+
+static int ensure_scratch(ToneMapper *mapper, int width)
+{
+    int stride = FFALIGN(width * 6, 64);
+    int t;
+
+    if(stride <= mapper->scratchStride)
+        return 0;
+    for(t = 0; t < mapper->scratchThreads; t++)
+    {
+        av_freep(&mapper->scratch[t]);
+        mapper->scratch[t] = av_mallocz(stride * 2);
+        if(!mapper->scratch[t])
+        {
+            mapper->scratchStride = 0;
+            return -1;
+        }
+    }
+    mapper->scratchStride = stride;
+    return 0;
+}
+
+//Bands start on even lines, so a band's first line pair shares its chroma line with nobody else
+static void map_band(void *opaque, int band, int thread)
+{
+    ToneMapper *mapper = (ToneMapper *)opaque;
+    const AVFrame *frame = mapper->frame;
+    MapRowFunc row = map_row_func(mapper->kernel);
+    uint16_t *rgb48 = mapper->scratch[thread];
+    int pairs = (frame->height + 1) / 2;
+    int first = pairs * band / mapper->bands * 2;
+    int last = FFMIN(pairs * (band + 1) / mapper->bands * 2, frame->height);
+    int y, j;
+
+    for(y = first; y < last; y += 2)
+    {
+        int lines = FFMIN(last - y, 2);
+        const uint8_t *src[3] =
+        {
+            frame->data[0] + y * frame->linesize[0],
+            frame->data[1] + (y >> 1) * frame->linesize[1],
+            mapper->semiPlanar ? NULL : frame->data[2] + (y >> 1) * frame->linesize[2],
+        };
+
+        yuv2rgb_convert16(src, frame->linesize, mapper->depth, mapper->semiPlanar,
+                          rgb48, mapper->scratchStride, frame->width, lines,
+                          mapper->matrix, mapper->fullRange, mapper->kernel);
+        for(j = 0; j < lines; j++)
+        {
+            const uint16_t *in = (const uint16_t *)((const uint8_t *)rgb48 + j * mapper->scratchStride);
+            uint8_t *out = mapper->dst + (y + j) * mapper->dstStride;
+
+            map_row_scalar(mapper, in, out, row(mapper, in, out, 0, frame->width), frame->width);
+        }
+    }
+}
+
+int tonemap_frame(ToneMapper *mapper, const AVFrame *frame, uint8_t *dst, int dst_stride)
+{
+    int transfer = frame_transfer(frame);
+    int bt709Primaries = frame->color_primaries == AVCOL_PRI_BT709;
+    double peakNits = mapper->peakNits;
+
+    if(transfer < 0 || frame_layout(frame, &mapper->depth, &mapper->semiPlanar) < 0)
+        return -1;
+
+    //Light level metadata usually comes with the first frame only, later frames keep its peak
+    if(transfer == TRANSFER_PQ && tonemap_frame_peak(frame) > 0)
+        peakNits = tonemap_frame_peak(frame);
+    if(!mapper->built || mapper->transfer != (Transfer)transfer || mapper->peakNits != peakNits ||
+       mapper->bt709Primaries != bt709Primaries)
+    {
+        build_tables(mapper, (Transfer)transfer, peakNits, bt709Primaries);
+    }
+    if(ensure_scratch(mapper, frame->width) < 0)
+        return -1;
+
+    mapper->frame = frame;
+    mapper->dst = dst;
+    mapper->dstStride = dst_stride;
+    //HDR is BT.2020 whatever it is tagged, unless it says BT.709
+    mapper->matrix = frame->colorspace == AVCOL_SPC_BT709 ? YUV2RGB_BT709 : YUV2RGB_BT2020;
+    mapper->fullRange = frame->color_range == AVCOL_RANGE_JPEG;
+
+    if(!mapper->pool || frame->height < 64)
+    {
+        mapper->bands = 1;
+        map_band(mapper, 0, 0);
+    }
+    else
+    {
+        //A few bands per thread so an unlucky one does not hold up the rest
+        mapper->bands = FFMIN(slice_pool_threads(mapper->pool) * 4, frame->height / 16);
+        slice_pool_run(mapper->pool, map_band, mapper, mapper->bands);
+    }
+    return 0;
+}
+
+void tonemap_destroy(ToneMapper **mapperPtr)
+{
+    ToneMapper *mapper = *mapperPtr;
+    int t;
+
+    if(!mapper)
+        return;
+    if(mapper->scratch)
+    {
+        for(t = 0; t < mapper->scratchThreads; t++)
+            av_freep(&mapper->scratch[t]);
+        free(mapper->scratch);
+    }
+    free(mapper);
+    *mapperPtr = NULL;
+}
@@ -0,0 +1,49 @@
+//
+//  tonemap.h
+//  HDR (PQ / HLG, BT.2020) -> SDR BT.709 RGB24 tone mapping for previews and exports
+//
+//  A frame goes through the 16-bit YUV -> RGB48 converter and then, per pixel: linearize, (HLG) the
+//  display OOTF, the tone curve on max(R, G, B), BT.2020 -> BT.709 primaries, BT.1886 encoding.
+//  Every transfer function and the curve are lookup tables, the rest is a few multiplies, and the
+//  frame is cut into bands run on a slice pool. Each band converts and maps two lines at a time
+//  through a small per-thread buffer, so the RGB48 intermediate never leaves the cache.
+//
+#ifndef TONEMAP_H
+#define TONEMAP_H
+
+#include <libavutil/frame.h>
+#include <stdint.h>
+
+#include "slice_pool.h"
+#include "yuv2rgb.h"
+
+typedef enum ToneCurve
+{
+    TONEMAP_HABLE,      //Filmic, keeps some contrast in the highlights
+    TONEMAP_REINHARD,   //Extended Reinhard, the source peak lands exactly on SDR white
+    TONEMAP_BT2390,     //ITU-R BT.2390 EETF, a knee in PQ space, untouched below it
+    TONEMAP_CURVE_COUNT,
+} ToneCurve;
+
+typedef struct ToneMapper ToneMapper;
+
+//pool may be NULL to map on the caller's thread only, kernel is for both the YUV conversion and the mapping
+//(SSE4.1 has no gathers, it maps with the scalar code)
+ToneMapper *tonemap_create(SlicePool *pool, ToneCurve curve, Yuv2RgbKernel kernel);
+
+const char *tonemap_curve_name(ToneCurve curve);
+
+//1 if the frame is tagged PQ (SMPTE ST 2084) or HLG (ARIB STD-B67) and is a format tonemap_frame takes
+int tonemap_frame_is_hdr(const AVFrame *frame);
+
+//Peak luminance of the frame's content in nits: MaxCLL, else the mastering display peak, 0 when it carries neither
+//(tonemap_frame then keeps the last peak it saw, 1000 to begin with)
+double tonemap_frame_peak(const AVFrame *frame);
+
+//Map a YUV420P10/YUV420P12/P010 HDR frame at its own size to RGB24 in dst
+//Returns 0, or < 0 when the frame is not HDR or not one of those formats
+int tonemap_frame(ToneMapper *mapper, const AVFrame *frame, uint8_t *dst, int dst_stride);
+
+void tonemap_destroy(ToneMapper **mapper);
+
+#endif
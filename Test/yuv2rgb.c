@@ -0,0 +1,616 @@
+//
+//  yuv2rgb.c
+//  YUV420P -> RGB24 and 10/12-bit 4:2:0 -> RGB48 conversion with SIMD kernels picked at runtime
+//
+//  All kernels compute in 16-bit fixed point with pmulhrsw rounding, (a * b + 0x4000) >> 15:
+//  samples are offset and shifted up by 7, coefficients are in Q13, so every product lands in Q5,
+//  and R/G/B = (Y term + chroma terms + 16) >> 5 saturated to 8 bits. The scalar kernel spells out the
+//  same steps, which keeps every kernel bit-exact with it.
+//  Chroma is taken from the nearest sample (2x2 per chroma sample), as swscale's unscaled YUV420P
+//  converter does.
+//  The 10/12-bit path does the same in 32-bit lanes (pmulld) with Q13 coefficients that also scale the
+//  samples up to 16 bits, and writes RGB48. It has SSE4.1 and AVX2 kernels, again bit-exact with its scalar one.
+//  The SIMD kernels are compiled with target attributes, so the file needs no -m flags and the
+//  binary still runs on CPUs without them.
+//
+#include <math.h>
+
+#include "yuv2rgb.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define YUV2RGB_X86 1
+#include <immintrin.h>
+#endif
+
+typedef struct Coeffs
+{
+    int16_t yoff;       //16 for limited range, 0 for full range
+    int16_t cy;         //Q13
+    int16_t crv, cgu, cgv, cbu;
+} Coeffs;
+
+//Returns the x it got up to, the rest of the row is left to the next kernel down
+typedef int (*RowFunc)(const uint8_t *y, const uint8_t *u, const uint8_t *v, uint8_t *rgb,
+                       int x, int width, const Coeffs *c);
+
+//Kr and Kb of each Yuv2RgbMatrix
+static const double matrixWeights[][2] =
+{
+    { 0.299, 0.114 },       //BT.601
+    { 0.2126, 0.0722 },     //BT.709
+    { 0.2627, 0.0593 },     //BT.2020 (non-constant luminance)
+};
+
+static void make_coeffs(Coeffs *c, Yuv2RgbMatrix matrix, int full_range)
+{
+    double kr = matrixWeights[matrix][0];
+    double kb = matrixWeights[matrix][1];
+    double kg = 1.0 - kr - kb;
+    double ys = full_range ? 1.0 : 255.0 / 219.0;
+    double cs = full_range ? 1.0 : 255.0 / 224.0;
+
+    c->yoff = full_range ? 0 : 16;
+    c->cy = (int16_t)lrint(ys * 8192);
+    c->crv = (int16_t)lrint(2 * (1 - kr) * cs * 8192);
+    c->cgu = (int16_t)lrint(2 * (1 - kb) * kb / kg * cs * 8192);
+    c->cgv = (int16_t)lrint(2 * (1 - kr) * kr / kg * cs * 8192);
+    c->cbu = (int16_t)lrint(2 * (1 - kb) * cs * 8192);
+}
+
+static inline int mulhrs(int a, int b)
+{
+    return (a * b + 0x4000) >> 15;
+}
+
+static inline uint8_t clip_uint8(int v)
+{
+    return v < 0 ? 0 : v > 255 ? 255 : (uint8_t)v;
+}
+
+static int row_scalar(const uint8_t *y, const uint8_t *u, const uint8_t *v, uint8_t *rgb,
+                      int x, int width, const Coeffs *c)
+{
+    for(; x < width; x++)
+    {
+        int yt = mulhrs((y[x] - c->yoff) * 128, c->cy);
+        int u7 = (u[x >> 1] - 128) * 128;
+        int v7 = (v[x >> 1] - 128) * 128;
+
+        rgb[3 * x + 0] = clip_uint8((yt + mulhrs(v7, c->crv) + 16) >> 5);
+        rgb[3 * x + 1] = clip_uint8((yt - mulhrs(u7, c->cgu) - mulhrs(v7, c->cgv) + 16) >> 5);
+        rgb[3 * x + 2] = clip_uint8((yt + mulhrs(u7, c->cbu) + 16) >> 5);
+    }
+    return x;
+}
+
+//High bit depth: depth-bit samples in, 16-bit samples (0..65535) out, all in 32-bit lanes with Q13 coefficients
+//that also carry the depth-bit to 16-bit scaling. Depths up to 12 keep every sum inside 31 bits.
+typedef struct Coeffs16
+{
+    int32_t yoff, bias;
+    int32_t cy, crv, cgu, cgv, cbu;
+    int shift;          //Samples stored in the high bits (P010) are shifted down by this first
+    int cstep;          //1 = planar chroma, 2 = U and V interleaved (u points at U, v at V)
+} Coeffs16;
+
+typedef int (*Row16Func)(const uint16_t *y, const uint16_t *u, const uint16_t *v, uint16_t *rgb,
+                         int x, int width, const Coeffs16 *c);
+
+static void make_coeffs16(Coeffs16 *c, Yuv2RgbMatrix matrix, int full_range, int depth, int semi_planar)
+{
+    double kr = matrixWeights[matrix][0];
+    double kb = matrixWeights[matrix][1];
+    double kg = 1.0 - kr - kb;
+    double ys = full_range ? 65535.0 / ((1 << depth) - 1) : 65535.0 / (219 << (depth - 8));
+    double cs = full_range ? 65535.0 / ((1 << depth) - 1) : 65535.0 / (224 << (depth - 8));
+
+    c->yoff = full_range ? 0 : 16 << (depth - 8);
+    c->bias = 1 << (depth - 1);
+    c->cy = (int32_t)lrint(ys * 8192);
+    c->crv = (int32_t)lrint(2 * (1 - kr) * cs * 8192);
+    c->cgu = (int32_t)lrint(2 * (1 - kb) * kb / kg * cs * 8192);
+    c->cgv = (int32_t)lrint(2 * (1 - kr) * kr / kg * cs * 8192);
+    c->cbu = (int32_t)lrint(2 * (1 - kb) * cs * 8192);
+    c->shift = semi_planar ? 16 - depth : 0;
+    c->cstep = semi_planar ? 2 : 1;
+}
+
+static inline uint16_t clip_uint16(int v)
+{
+    return v < 0 ? 0 : v > 65535 ? 65535 : (uint16_t)v;
+}
+
+static int row16_scalar(const uint16_t *y, const uint16_t *u, const uint16_t *v, uint16_t *rgb,
+                        int x, int width, const Coeffs16 *c)
+{
+    for(; x < width; x++)
+    {
+        int yt = ((y[x] >> c->shift) - c->yoff) * c->cy + 4096;
+        int uu = (u[(x >> 1) * c->cstep] >> c->shift) - c->bias;
+        int vv = (v[(x >> 1) * c->cstep] >> c->shift) - c->bias;
+
+        rgb[3 * x + 0] = clip_uint16((yt + vv * c->crv) >> 13);
+        rgb[3 * x + 1] = clip_uint16((yt - uu * c->cgu - vv * c->cgv) >> 13);
+        rgb[3 * x + 2] = clip_uint16((yt + uu * c->cbu) >> 13);
+    }
+    return x;
+}
+
+#ifdef YUV2RGB_X86
+
+//Interleave 16 R, G and B bytes into 48 bytes of RGB24
+__attribute__((target("sse4.1"), always_inline))
+static inline void store_rgb24(uint8_t *dst, __m128i r, __m128i g, __m128i b)
+{
+    const __m128i r0 = _mm_setr_epi8(0, -1, -1, 1, -1, -1, 2, -1, -1, 3, -1, -1, 4, -1, -1, 5);
+    const __m128i g0 = _mm_setr_epi8(-1, 0, -1, -1, 1, -1, -1, 2, -1, -1, 3, -1, -1, 4, -1, -1);
+    const __m128i b0 = _mm_setr_epi8(-1, -1, 0, -1, -1, 1, -1, -1, 2, -1, -1, 3, -1, -1, 4, -1);
+    const __m128i r1 = _mm_setr_epi8(-1, -1, 6, -1, -1, 7, -1, -1, 8, -1, -1, 9, -1, -1, 10, -1);
+    const __m128i g1 = _mm_setr_epi8(5, -1, -1, 6, -1, -1, 7, -1, -1, 8, -1, -1, 9, -1, -1, 10);
+    const __m128i b1 = _mm_setr_epi8(-1, 5, -1, -1, 6, -1, -1, 7, -1, -1, 8, -1, -1, 9, -1, -1);
+    const __m128i r2 = _mm_setr_epi8(-1, 11, -1, -1, 12, -1, -1, 13, -1, -1, 14, -1, -1, 15, -1, -1);
+    const __m128i g2 = _mm_setr_epi8(-1, -1, 11, -1, -1, 12, -1, -1, 13, -1, -1, 14, -1, -1, 15, -1);
+    const __m128i b2 = _mm_setr_epi8(10, -1, -1, 11, -1, -1, 12, -1, -1, 13, -1, -1, 14, -1, -1, 15);
+
+    _mm_storeu_si128((__m128i *)dst, _mm_or_si128(_mm_or_si128(_mm_shuffle_epi8(r, r0),
+                                                                _mm_shuffle_epi8(g, g0)),
+                                                   _mm_shuffle_epi8(b, b0)));
+    _mm_storeu_si128((__m128i *)(dst + 16), _mm_or_si128(_mm_or_si128(_mm_shuffle_epi8(r, r1),
+                                                                       _mm_shuffle_epi8(g, g1)),
+                                                          _mm_shuffle_epi8(b, b1)));
+    _mm_storeu_si128((__m128i *)(dst + 32), _mm_or_si128(_mm_or_si128(_mm_shuffle_epi8(r, r2),
+                                                                       _mm_shuffle_epi8(g, g2)),
+                                                          _mm_shuffle_epi8(b, b2)));
+}
+
+//One vector of 16-bit Y, U, V in, 16-bit R, G, B out (before packing), with the kernel's constants in scope
+#define CONVERT_PIXELS(prefix, y16, u16, v16, r, g, b)                                                     \
+    do {                                                                                              \
+        __typeof__(y16) yt_ = prefix##_mulhrs_epi16(prefix##_slli_epi16(prefix##_sub_epi16(y16, yoff), 7), cy); \
+        __typeof__(y16) u7_ = prefix##_slli_epi16(prefix##_sub_epi16(u16, bias), 7);                  \
+        __typeof__(y16) v7_ = prefix##_slli_epi16(prefix##_sub_epi16(v16, bias), 7);                  \
+        r = prefix##_srai_epi16(prefix##_add_epi16(prefix##_add_epi16(yt_, prefix##_mulhrs_epi16(v7_, crv)), round), 5); \
+        g = prefix##_srai_epi16(prefix##_add_epi16(prefix##_sub_epi16(prefix##_sub_epi16(yt_,          \
+                prefix##_mulhrs_epi16(u7_, cgu)), prefix##_mulhrs_epi16(v7_, cgv)), round), 5);       \
+        b = prefix##_srai_epi16(prefix##_add_epi16(prefix##_add_epi16(yt_, prefix##_mulhrs_epi16(u7_, cbu)), round), 5); \
+    } while(0)
+
+__attribute__((target("sse4.1")))
+static int row_sse41(const uint8_t *y, const uint8_t *u, const uint8_t *v, uint8_t *rgb,
+                     int x, int width, const Coeffs *c)
+{
+    const __m128i yoff = _mm_set1_epi16(c->yoff);
+    const __m128i cy = _mm_set1_epi16(c->cy);
+    const __m128i crv = _mm_set1_epi16(c->crv);
+    const __m128i cgu = _mm_set1_epi16(c->cgu);
+    const __m128i cgv = _mm_set1_epi16(c->cgv);
+    const __m128i cbu = _mm_set1_epi16(c->cbu);
+    const __m128i bias = _mm_set1_epi16(128);
+    const __m128i round = _mm_set1_epi16(16);
+
+    //16 pixels, 8 chroma samples per step
+    for(; x + 16 <= width; x += 16)
+    {
+        __m128i y8 = _mm_loadu_si128((const __m128i *)(y + x));
+        __m128i u8 = _mm_loadl_epi64((const __m128i *)(u + (x >> 1)));
+        __m128i v8 = _mm_loadl_epi64((const __m128i *)(v + (x >> 1)));
+        __m128i rl, gl, bl, rh, gh, bh;
+
+        u8 = _mm_unpacklo_epi8(u8, u8);
+        v8 = _mm_unpacklo_epi8(v8, v8);
+        CONVERT_PIXELS(_mm, _mm_cvtepu8_epi16(y8), _mm_cvtepu8_epi16(u8), _mm_cvtepu8_epi16(v8), rl, gl, bl);
+        CONVERT_PIXELS(_mm, _mm_cvtepu8_epi16(_mm_srli_si128(y8, 8)), _mm_cvtepu8_epi16(_mm_srli_si128(u8, 8)),
+                       _mm_cvtepu8_epi16(_mm_srli_si128(v8, 8)), rh, gh, bh);
+        store_rgb24(rgb + 3 * x, _mm_packus_epi16(rl, rh), _mm_packus_epi16(gl, gh), _mm_packus_epi16(bl, bh));
+    }
+    return x;
+}
+
+__attribute__((target("avx2")))
+static int row_avx2(const uint8_t *y, const uint8_t *u, const uint8_t *v, uint8_t *rgb,
+                    int x, int width, const Coeffs *c)
+{
+    const __m256i yoff = _mm256_set1_epi16(c->yoff);
+    const __m256i cy = _mm256_set1_epi16(c->cy);
+    const __m256i crv = _mm256_set1_epi16(c->crv);
+    const __m256i cgu = _mm256_set1_epi16(c->cgu);
+    const __m256i cgv = _mm256_set1_epi16(c->cgv);
+    const __m256i cbu = _mm256_set1_epi16(c->cbu);
+    const __m256i bias = _mm256_set1_epi16(128);
+    const __m256i round = _mm256_set1_epi16(16);
+
+    //32 pixels, 16 chroma samples per step
+    for(; x + 32 <= width; x += 32)
+    {
+        __m128i u8 = _mm_loadu_si128((const __m128i *)(u + (x >> 1)));
+        __m128i v8 = _mm_loadu_si128((const __m128i *)(v + (x >> 1)));
+        __m256i rl, gl, bl, rh, gh, bh, r, g, b;
+
+        CONVERT_PIXELS(_mm256, _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i *)(y + x))),
+                       _mm256_cvtepu8_epi16(_mm_unpacklo_epi8(u8, u8)), _mm256_cvtepu8_epi16(_mm_unpacklo_epi8(v8, v8)),
+                       rl, gl, bl);
+        CONVERT_PIXELS(_mm256, _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i *)(y + x + 16))),
+                       _mm256_cvtepu8_epi16(_mm_unpackhi_epi8(u8, u8)), _mm256_cvtepu8_epi16(_mm_unpackhi_epi8(v8, v8)),
+                       rh, gh, bh);
+
+        //packus works per 128-bit lane, put the 8-pixel quarters back in order
+        r = _mm256_permute4x64_epi64(_mm256_packus_epi16(rl, rh), _MM_SHUFFLE(3, 1, 2, 0));
+        g = _mm256_permute4x64_epi64(_mm256_packus_epi16(gl, gh), _MM_SHUFFLE(3, 1, 2, 0));
+        b = _mm256_permute4x64_epi64(_mm256_packus_epi16(bl, bh), _MM_SHUFFLE(3, 1, 2, 0));
+        store_rgb24(rgb + 3 * x, _mm256_castsi256_si128(r), _mm256_castsi256_si128(g), _mm256_castsi256_si128(b));
+        store_rgb24(rgb + 3 * x + 48, _mm256_extracti128_si256(r, 1), _mm256_extracti128_si256(g, 1),
+                    _mm256_extracti128_si256(b, 1));
+    }
+    return row_sse41(y, u, v, rgb, x, width, c);
+}
+
+__attribute__((target("avx512f,avx512bw")))
+static int row_avx512(const uint8_t *y, const uint8_t *u, const uint8_t *v, uint8_t *rgb,
+                      int x, int width, const Coeffs *c)
+{
+    const __m512i yoff = _mm512_set1_epi16(c->yoff);
+    const __m512i cy = _mm512_set1_epi16(c->cy);
+    const __m512i crv = _mm512_set1_epi16(c->crv);
+    const __m512i cgu = _mm512_set1_epi16(c->cgu);
+    const __m512i cgv = _mm512_set1_epi16(c->cgv);
+    const __m512i cbu = _mm512_set1_epi16(c->cbu);
+    const __m512i bias = _mm512_set1_epi16(128);
+    const __m512i round = _mm512_set1_epi16(16);
+    //Each chroma word twice: samples 0..15 for the first 32 pixels, 16..31 for the next 32
+    const __m512i dupLo = _mm512_set_epi16(15, 15, 14, 14, 13, 13, 12, 12, 11, 11, 10, 10, 9, 9, 8, 8,
+                                           7, 7, 6, 6, 5, 5, 4, 4, 3, 3, 2, 2, 1, 1, 0, 0);
+    const __m512i dupHi = _mm512_add_epi16(dupLo, _mm512_set1_epi16(16));
+    const __m512i order = _mm512_setr_epi64(0, 2, 4, 6, 1, 3, 5, 7);
+
+    //64 pixels, 32 chroma samples per step
+    for(; x + 64 <= width; x += 64)
+    {
+        __m512i u16 = _mm512_cvtepu8_epi16(_mm256_loadu_si256((const __m256i *)(u + (x >> 1))));
+        __m512i v16 = _mm512_cvtepu8_epi16(_mm256_loadu_si256((const __m256i *)(v + (x >> 1))));
+        __m512i rl, gl, bl, rh, gh, bh, r, g, b;
+
+        CONVERT_PIXELS(_mm512, _mm512_cvtepu8_epi16(_mm256_loadu_si256((const __m256i *)(y + x))),
+                       _mm512_permutexvar_epi16(dupLo, u16), _mm512_permutexvar_epi16(dupLo, v16), rl, gl, bl);
+        CONVERT_PIXELS(_mm512, _mm512_cvtepu8_epi16(_mm256_loadu_si256((const __m256i *)(y + x + 32))),
+                       _mm512_permutexvar_epi16(dupHi, u16), _mm512_permutexvar_epi16(dupHi, v16), rh, gh, bh);
+
+        r = _mm512_permutexvar_epi64(order, _mm512_packus_epi16(rl, rh));
+        g = _mm512_permutexvar_epi64(order, _mm512_packus_epi16(gl, gh));
+        b = _mm512_permutexvar_epi64(order, _mm512_packus_epi16(bl, bh));
+        store_rgb24(rgb + 3 * x, _mm512_extracti32x4_epi32(r, 0), _mm512_extracti32x4_epi32(g, 0),
+                    _mm512_extracti32x4_epi32(b, 0));
+        store_rgb24(rgb + 3 * x + 48, _mm512_extracti32x4_epi32(r, 1), _mm512_extracti32x4_epi32(g, 1),
+                    _mm512_extracti32x4_epi32(b, 1));
+        store_rgb24(rgb + 3 * x + 96, _mm512_extracti32x4_epi32(r, 2), _mm512_extracti32x4_epi32(g, 2),
+                    _mm512_extracti32x4_epi32(b, 2));
+        store_rgb24(rgb + 3 * x + 144, _mm512_extracti32x4_epi32(r, 3), _mm512_extracti32x4_epi32(g, 3),
+                    _mm512_extracti32x4_epi32(b, 3));
+    }
+    return row_avx2(y, u, v, rgb, x, width, c);
+}
+
+//Interleave 8 R, G and B words into 48 bytes of RGB48
+__attribute__((target("sse4.1"), always_inline))
+static inline void store_rgb48(uint16_t *dst, __m128i r, __m128i g, __m128i b)
+{
+    const __m128i r0 = _mm_setr_epi8(0, 1, -1, -1, -1, -1, 2, 3, -1, -1, -1, -1, 4, 5, -1, -1);
+    const __m128i g0 = _mm_setr_epi8(-1, -1, 0, 1, -1, -1, -1, -1, 2, 3, -1, -1, -1, -1, 4, 5);
+    const __m128i b0 = _mm_setr_epi8(-1, -1, -1, -1, 0, 1, -1, -1, -1, -1, 2, 3, -1, -1, -1, -1);
+    const __m128i r1 = _mm_setr_epi8(-1, -1, 6, 7, -1, -1, -1, -1, 8, 9, -1, -1, -1, -1, 10, 11);
+    const __m128i g1 = _mm_setr_epi8(-1, -1, -1, -1, 6, 7, -1, -1, -1, -1, 8, 9, -1, -1, -1, -1);
+    const __m128i b1 = _mm_setr_epi8(4, 5, -1, -1, -1, -1, 6, 7, -1, -1, -1, -1, 8, 9, -1, -1);
+    const __m128i r2 = _mm_setr_epi8(-1, -1, -1, -1, 12, 13, -1, -1, -1, -1, 14, 15, -1, -1, -1, -1);
+    const __m128i g2 = _mm_setr_epi8(10, 11, -1, -1, -1, -1, 12, 13, -1, -1, -1, -1, 14, 15, -1, -1);
+    const __m128i b2 = _mm_setr_epi8(-1, -1, 10, 11, -1, -1, -1, -1, 12, 13, -1, -1, -1, -1, 14, 15);
+
+    _mm_storeu_si128((__m128i *)dst, _mm_or_si128(_mm_or_si128(_mm_shuffle_epi8(r, r0),
+                                                                _mm_shuffle_epi8(g, g0)),
+                                                   _mm_shuffle_epi8(b, b0)));
+    _mm_storeu_si128((__m128i *)(dst + 8), _mm_or_si128(_mm_or_si128(_mm_shuffle_epi8(r, r1),
+                                                                      _mm_shuffle_epi8(g, g1)),
+                                                         _mm_shuffle_epi8(b, b1)));
+    _mm_storeu_si128((__m128i *)(dst + 16), _mm_or_si128(_mm_or_si128(_mm_shuffle_epi8(r, r2),
+                                                                       _mm_shuffle_epi8(g, g2)),
+                                                          _mm_shuffle_epi8(b, b2)));
+}
+
+//One vector of 32-bit Y, U, V in, 32-bit R, G, B out (before packing), with the kernel's constants in scope
+#define CONVERT_PIXELS16(prefix, y32, u32, v32, r, g, b)                                              \
+    do {                                                                                              \
+        __typeof__(y32) yt_ = prefix##_add_epi32(prefix##_mullo_epi32(prefix##_sub_epi32(y32, yoff), cy), round); \
+        __typeof__(y32) uu_ = prefix##_sub_epi32(u32, bias);                                          \
+        __typeof__(y32) vv_ = prefix##_sub_epi32(v32, bias);                                          \
+        r = prefix##_srai_epi32(prefix##_add_epi32(yt_, prefix##_mullo_epi32(vv_, crv)), 13);        \
+        g = prefix##_srai_epi32(prefix##_sub_epi32(prefix##_sub_epi32(yt_, prefix##_mullo_epi32(uu_, cgu)), \
+                                                   prefix##_mullo_epi32(vv_, cgv)), 13);              \
+        b = prefix##_srai_epi32(prefix##_add_epi32(yt_, prefix##_mullo_epi32(uu_, cbu)), 13);        \
+    } while(0)
+
+__attribute__((target("sse4.1")))
+static int row16_sse41(const uint16_t *y, const uint16_t *u, const uint16_t *v, uint16_t *rgb,
+                       int x, int width, const Coeffs16 *c)
+{
+    const __m128i yoff = _mm_set1_epi32(c->yoff);
+    const __m128i bias = _mm_set1_epi32(c->bias);
+    const __m128i cy = _mm_set1_epi32(c->cy);
+    const __m128i crv = _mm_set1_epi32(c->crv);
+    const __m128i cgu = _mm_set1_epi32(c->cgu);
+    const __m128i cgv = _mm_set1_epi32(c->cgv);
+    const __m128i cbu = _mm_set1_epi32(c->cbu);
+    const __m128i round = _mm_set1_epi32(4096);
+    const __m128i shift = _mm_cvtsi32_si128(c->shift);
+    //Each chroma word twice, from planar U or V, or from interleaved UV
+    const __m128i dupU = _mm_setr_epi8(0, 1, 0, 1, 4, 5, 4, 5, 8, 9, 8, 9, 12, 13, 12, 13);
+    const __m128i dupV = _mm_setr_epi8(2, 3, 2, 3, 6, 7, 6, 7, 10, 11, 10, 11, 14, 15, 14, 15);
+
+    //8 pixels, 4 chroma samples per step
+    for(; x + 8 <= width; x += 8)
+    {
+        __m128i y16 = _mm_srl_epi16(_mm_loadu_si128((const __m128i *)(y + x)), shift);
+        __m128i u16, v16, rl, gl, bl, rh, gh, bh;
+
+        if(c->cstep == 2)
+        {
+            __m128i uv = _mm_srl_epi16(_mm_loadu_si128((const __m128i *)(u + x)), shift);
+            u16 = _mm_shuffle_epi8(uv, dupU);
+            v16 = _mm_shuffle_epi8(uv, dupV);
+        }
+        else
+        {
+            u16 = _mm_loadl_epi64((const __m128i *)(u + (x >> 1)));
+            v16 = _mm_loadl_epi64((const __m128i *)(v + (x >> 1)));
+            u16 = _mm_unpacklo_epi16(u16, u16);
+            v16 = _mm_unpacklo_epi16(v16, v16);
+        }
+
+        CONVERT_PIXELS16(_mm, _mm_cvtepu16_epi32(y16), _mm_cvtepu16_epi32(u16), _mm_cvtepu16_epi32(v16), rl, gl, bl);
+        CONVERT_PIXELS16(_mm, _mm_cvtepu16_epi32(_mm_srli_si128(y16, 8)), _mm_cvtepu16_epi32(_mm_srli_si128(u16, 8)),
+                         _mm_cvtepu16_epi32(_mm_srli_si128(v16, 8)), rh, gh, bh);
+        store_rgb48(rgb + 3 * x, _mm_packus_epi32(rl, rh), _mm_packus_epi32(gl, gh), _mm_packus_epi32(bl, bh));
+    }
+    return x;
+}
+
+__attribute__((target("avx2")))
+static int row16_avx2(const uint16_t *y, const uint16_t *u, const uint16_t *v, uint16_t *rgb,
+                      int x, int width, const Coeffs16 *c)
+{
+    const __m256i yoff = _mm256_set1_epi32(c->yoff);
+    const __m256i bias = _mm256_set1_epi32(c->bias);
+    const __m256i cy = _mm256_set1_epi32(c->cy);
+    const __m256i crv = _mm256_set1_epi32(c->crv);
+    const __m256i cgu = _mm256_set1_epi32(c->cgu);
+    const __m256i cgv = _mm256_set1_epi32(c->cgv);
+    const __m256i cbu = _mm256_set1_epi32(c->cbu);
+    const __m256i round = _mm256_set1_epi32(4096);
+    const __m128i shift = _mm_cvtsi32_si128(c->shift);
+    const __m256i dupLo = _mm256_setr_epi32(0, 0, 1, 1, 2, 2, 3, 3);
+    const __m256i dupHi = _mm256_setr_epi32(4, 4, 5, 5, 6, 6, 7, 7);
+    const __m256i evens = _mm256_setr_epi32(0, 0, 2, 2, 4, 4, 6, 6);
+    const __m256i odds = _mm256_setr_epi32(1, 1, 3, 3, 5, 5, 7, 7);
+
+    //16 pixels, 8 chroma samples per step
+    for(; x + 16 <= width; x += 16)
+    {
+        __m256i y16 = _mm256_srl_epi16(_mm256_loadu_si256((const __m256i *)(y + x)), shift);
+        __m256i ul, vl, uh, vh, rl, gl, bl, rh, gh, bh, r, g, b;
+
+        if(c->cstep == 2)
+        {
+            //U0 V0 U1 V1 ... as 32-bit, U from the even lanes and V from the odd ones
+            __m256i uv = _mm256_srl_epi16(_mm256_loadu_si256((const __m256i *)(u + x)), shift);
+            __m256i lo = _mm256_cvtepu16_epi32(_mm256_castsi256_si128(uv));
+            __m256i hi = _mm256_cvtepu16_epi32(_mm256_extracti128_si256(uv, 1));
+
+            ul = _mm256_permutevar8x32_epi32(lo, evens);
+            vl = _mm256_permutevar8x32_epi32(lo, odds);
+            uh = _mm256_permutevar8x32_epi32(hi, evens);
+            vh = _mm256_permutevar8x32_epi32(hi, odds);
+        }
+        else
+        {
+            __m256i u32 = _mm256_cvtepu16_epi32(_mm_loadu_si128((const __m128i *)(u + (x >> 1))));
+            __m256i v32 = _mm256_cvtepu16_epi32(_mm_loadu_si128((const __m128i *)(v + (x >> 1))));
+
+            ul = _mm256_permutevar8x32_epi32(u32, dupLo);
+            vl = _mm256_permutevar8x32_epi32(v32, dupLo);
+            uh = _mm256_permutevar8x32_epi32(u32, dupHi);
+            vh = _mm256_permutevar8x32_epi32(v32, dupHi);
+        }
+
+        CONVERT_PIXELS16(_mm256, _mm256_cvtepu16_epi32(_mm256_castsi256_si128(y16)), ul, vl, rl, gl, bl);
+        CONVERT_PIXELS16(_mm256, _mm256_cvtepu16_epi32(_mm256_extracti128_si256(y16, 1)), uh, vh, rh, gh, bh);
+
+        //packus works per 128-bit lane, put the 4-pixel quarters back in order
+        r = _mm256_permute4x64_epi64(_mm256_packus_epi32(rl, rh), _MM_SHUFFLE(3, 1, 2, 0));
+        g = _mm256_permute4x64_epi64(_mm256_packus_epi32(gl, gh), _MM_SHUFFLE(3, 1, 2, 0));
+        b = _mm256_permute4x64_epi64(_mm256_packus_epi32(bl, bh), _MM_SHUFFLE(3, 1, 2, 0));
+        store_rgb48(rgb + 3 * x, _mm256_castsi256_si128(r), _mm256_castsi256_si128(g), _mm256_castsi256_si128(b));
+        store_rgb48(rgb + 3 * x + 24, _mm256_extracti128_si256(r, 1), _mm256_extracti128_si256(g, 1),
+                    _mm256_extracti128_si256(b, 1));
+    }
+    return row16_sse41(y, u, v, rgb, x, width, c);
+}
+
+#endif
+
+int yuv2rgb_kernel_supported(Yuv2RgbKernel kernel)
+{
+    switch(kernel)
+    {
+    case YUV2RGB_KERNEL_SCALAR:
+        return 1;
+#ifdef YUV2RGB_X86
+    case YUV2RGB_KERNEL_SSE41:
+        __builtin_cpu_init();
+        return __builtin_cpu_supports("sse4.1") != 0;
+    case YUV2RGB_KERNEL_AVX2:
+        __builtin_cpu_init();
+        return __builtin_cpu_supports("avx2") != 0;
+    case YUV2RGB_KERNEL_AVX512:
+        __builtin_cpu_init();
+        return __builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512bw");
+#endif
+    default:
+        return 0;
+    }
+}
+
+Yuv2RgbKernel yuv2rgb_best_kernel(void)
+{
+    int k;
+
+    for(k = YUV2RGB_KERNEL_COUNT - 1; k > YUV2RGB_KERNEL_SCALAR; k--)
+    {
+        if(yuv2rgb_kernel_supported((Yuv2RgbKernel)k))
+            return (Yuv2RgbKernel)k;
+    }
+    return YUV2RGB_KERNEL_SCALAR;
+}
+
+const char *yuv2rgb_kernel_name(Yuv2RgbKernel kernel)
+{
+    switch(kernel)
+    {
+    case YUV2RGB_KERNEL_SCALAR: return "scalar";
+    case YUV2RGB_KERNEL_SSE41:  return "sse4.1";
+    case YUV2RGB_KERNEL_AVX2:   return "avx2";
+    case YUV2RGB_KERNEL_AVX512: return "avx512";
+    case YUV2RGB_KERNEL_AUTO:   return "auto";
+    default:                    return "unknown";
+    }
+}
+
+static RowFunc row_func(Yuv2RgbKernel kernel)
+{
+    switch(kernel)
+    {
+#ifdef YUV2RGB_X86
+    case YUV2RGB_KERNEL_SSE41:  return row_sse41;
+    case YUV2RGB_KERNEL_AVX2:   return row_avx2;
+    case YUV2RGB_KERNEL_AVX512: return row_avx512;
+#endif
+    default:                    return row_scalar;
+    }
+}
+
+int yuv2rgb_convert(const uint8_t *const src[3], const int src_stride[3],
+                    uint8_t *dst, int dst_stride, int width, int height,
+                    Yuv2RgbMatrix matrix, int full_range, Yuv2RgbKernel kernel)
+{
+    Coeffs c;
+    RowFunc row;
+    int j;
+
+    if(kernel == YUV2RGB_KERNEL_AUTO)
+        kernel = yuv2rgb_best_kernel();
+    else if(!yuv2rgb_kernel_supported(kernel))
+        return -1;
+
+    make_coeffs(&c, matrix, full_range);
+    row = row_func(kernel);
+    for(j = 0; j < height; j++)
+    {
+        const uint8_t *y = src[0] + j * src_stride[0];
+        const uint8_t *u = src[1] + (j >> 1) * src_stride[1];
+        const uint8_t *v = src[2] + (j >> 1) * src_stride[2];
+        uint8_t *rgb = dst + j * dst_stride;
+
+        //Whatever the vector loop leaves at the end of the row
+        row_scalar(y, u, v, rgb, row(y, u, v, rgb, 0, width, &c), width, &c);
+    }
+    return 0;
+}
+
+static Yuv2RgbMatrix frame_matrix(const AVFrame *frame)
+{
+    switch(frame->colorspace)
+    {
+    case AVCOL_SPC_BT709:       return YUV2RGB_BT709;
+    case AVCOL_SPC_BT2020_NCL:
+    case AVCOL_SPC_BT2020_CL:   return YUV2RGB_BT2020;
+    default:                    return YUV2RGB_BT601;
+    }
+}
+
+int yuv2rgb_convert_frame(const AVFrame *frame, uint8_t *dst, int dst_stride)
+{
+    //Cached: the CPU does not change under us, and this runs for every frame
+    static Yuv2RgbKernel best = YUV2RGB_KERNEL_AUTO;
+    int full_range;
+    Yuv2RgbMatrix matrix;
+
+    if(frame->format != AV_PIX_FMT_YUV420P && frame->format != AV_PIX_FMT_YUVJ420P)
+        return -1;
+
+    if(best == YUV2RGB_KERNEL_AUTO)
+        best = yuv2rgb_best_kernel();
+    full_range = frame->format == AV_PIX_FMT_YUVJ420P || frame->color_range == AVCOL_RANGE_JPEG;
+    matrix = frame_matrix(frame);
+    return yuv2rgb_convert((const uint8_t *const *)frame->data, frame->linesize, dst, dst_stride,
+                           frame->width, frame->height, matrix, full_range, best);
+}
+
+//AVX-512 has no 16-bit kernel of its own, the AVX2 one is used
+static Row16Func row16_func(Yuv2RgbKernel kernel)
+{
+    switch(kernel)
+    {
+#ifdef YUV2RGB_X86
+    case YUV2RGB_KERNEL_SSE41:  return row16_sse41;
+    case YUV2RGB_KERNEL_AVX2:
+    case YUV2RGB_KERNEL_AVX512: return row16_avx2;
+#endif
+    default:                    return row16_scalar;
+    }
+}
+
+int yuv2rgb_convert16(const uint8_t *const src[3], const int src_stride[3], int depth, int semi_planar,
+                      uint16_t *dst, int dst_stride, int width, int height,
+                      Yuv2RgbMatrix matrix, int full_range, Yuv2RgbKernel kernel)
+{
+    Coeffs16 c;
+    Row16Func row;
+    int j;
+
+    if(depth < 9 || depth > 12)
+        return -1;
+    if(kernel == YUV2RGB_KERNEL_AUTO)
+        kernel = yuv2rgb_best_kernel();
+    else if(!yuv2rgb_kernel_supported(kernel))
+        return -1;
+
+    make_coeffs16(&c, matrix, full_range, depth, semi_planar);
+    row = row16_func(kernel);
+    for(j = 0; j < height; j++)
+    {
+        const uint16_t *y = (const uint16_t *)(src[0] + j * src_stride[0]);
+        const uint16_t *u = (const uint16_t *)(src[1] + (j >> 1) * src_stride[1]);
+        //Interleaved chroma: V is the word after U
+        const uint16_t *v = semi_planar ? u + 1 : (const uint16_t *)(src[2] + (j >> 1) * src_stride[2]);
+        uint16_t *rgb = (uint16_t *)((uint8_t *)dst + j * dst_stride);
+
+        row16_scalar(y, u, v, rgb, row(y, u, v, rgb, 0, width, &c), width, &c);
+    }
+    return 0;
+}
+
+int yuv2rgb_convert_frame16(const AVFrame *frame, uint16_t *dst, int dst_stride)
+{
+    static Yuv2RgbKernel best = YUV2RGB_KERNEL_AUTO;
+    int depth, semi_planar;
+
+    switch(frame->format)
+    {
+    case AV_PIX_FMT_YUV420P10: depth = 10; semi_planar = 0; break;
+    case AV_PIX_FMT_YUV420P12: depth = 12; semi_planar = 0; break;
+    case AV_PIX_FMT_P010:      depth = 10; semi_planar = 1; break;
+    default:                   return -1;
+    }
+
+    if(best == YUV2RGB_KERNEL_AUTO)
+        best = yuv2rgb_best_kernel();
+    return yuv2rgb_convert16((const uint8_t *const *)frame->data, frame->linesize, depth, semi_planar,
+                             dst, dst_stride, frame->width, frame->height,
+                             frame_matrix(frame), frame->color_range == AVCOL_RANGE_JPEG, best);
+}
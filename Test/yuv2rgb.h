@@ -0,0 +1,59 @@
+//
+//  yuv2rgb.h
+//  YUV420P -> RGB24 conversion with SSE4.1 / AVX2 / AVX-512 kernels picked at runtime,
+//  and 10/12-bit 4:2:0 (planar or P010) -> RGB48 with SSE4.1 / AVX2 kernels
+//
+//  Every kernel runs the same 16-bit fixed point arithmetic as the scalar one, so their outputs are
+//  bit-exact with each other; the scalar kernel is the reference the others are checked against.
+//
+#ifndef YUV2RGB_H
+#define YUV2RGB_H
+
+#include <libavutil/frame.h>
+#include <stdint.h>
+
+typedef enum Yuv2RgbMatrix
+{
+    YUV2RGB_BT601,
+    YUV2RGB_BT709,
+    YUV2RGB_BT2020,     //Non-constant luminance, HDR10
+} Yuv2RgbMatrix;
+
+typedef enum Yuv2RgbKernel
+{
+    YUV2RGB_KERNEL_SCALAR,
+    YUV2RGB_KERNEL_SSE41,
+    YUV2RGB_KERNEL_AVX2,
+    YUV2RGB_KERNEL_AVX512,
+    YUV2RGB_KERNEL_COUNT,
+    YUV2RGB_KERNEL_AUTO = -1,   //The fastest kernel this CPU supports
+} Yuv2RgbKernel;
+
+//1 if the CPU (and OS) can run kernel
+int yuv2rgb_kernel_supported(Yuv2RgbKernel kernel);
+
+Yuv2RgbKernel yuv2rgb_best_kernel(void);
+
+const char *yuv2rgb_kernel_name(Yuv2RgbKernel kernel);
+
+//Convert a YUV420P plane set of width x height to packed RGB24, full_range = 1 for JPEG range input
+//Returns 0, or < 0 if the kernel is not supported here
+int yuv2rgb_convert(const uint8_t *const src[3], const int src_stride[3],
+                    uint8_t *dst, int dst_stride, int width, int height,
+                    Yuv2RgbMatrix matrix, int full_range, Yuv2RgbKernel kernel);
+
+//Convert a decoded YUV420P/YUVJ420P frame at its own size, with the matrix and range it is tagged with
+//Returns < 0 for any other pixel format so the caller can fall back to sws_scale
+int yuv2rgb_convert_frame(const AVFrame *frame, uint8_t *dst, int dst_stride);
+
+//Convert 4:2:0 depth-bit samples (9 to 12) to packed native endian RGB48 on the full 0..65535 scale
+//semi_planar = 1 for P010 style input: interleaved UV in src[1], samples in the high bits of each word
+//Strides are in bytes. Returns 0, or < 0 for an unsupported depth or kernel
+int yuv2rgb_convert16(const uint8_t *const src[3], const int src_stride[3], int depth, int semi_planar,
+                      uint16_t *dst, int dst_stride, int width, int height,
+                      Yuv2RgbMatrix matrix, int full_range, Yuv2RgbKernel kernel);
+
+//Convert a decoded YUV420P10/YUV420P12/P010 frame at its own size, < 0 for any other pixel format
+int yuv2rgb_convert_frame16(const AVFrame *frame, uint16_t *dst, int dst_stride);
+
+#endif
@@ -0,0 +1,431 @@
+//
+//  yuv2rgb_bench.c
+//  Checks and times the yuv2rgb kernels
+//
+//  For every matrix and range: every SIMD kernel must match the scalar one exactly, and the scalar
+//  one must stay within TOLERANCE of sws_scale (SWS_BILINEAR) on the same frame.
+//  The same checks run for the 16-bit path on YUV420P10 and P010 frames (RGB48 out, TOLERANCE scaled to 16 bits).
+//  Then every kernel this CPU supports, and sws_scale, converts the frame repeatedly and is timed,
+//  followed by each tone curve mapping the 10-bit frame as PQ on all CPUs.
+//
+//  Usage: yuv2rgb_bench.out [width height [iterations]]
+//  Exits with 1 when a check fails.
+//
+#include <libavutil/common.h>
+#include <libavutil/frame.h>
+#include <libavutil/imgutils.h>
+#include <libavutil/mem.h>
+#include <libavutil/pixdesc.h>
+#include <libswscale/swscale.h>
+#include <SDL2/SDL.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "sws_cache.h"
+#include "tonemap.h"
+#include "yuv2rgb.h"
+
+//Largest per-sample difference allowed against sws_scale (its tables round differently)
+#define TOLERANCE 3
+
+static const char *matrix_name(Yuv2RgbMatrix matrix)
+{
+    return matrix == YUV2RGB_BT2020 ? "BT.2020" : matrix == YUV2RGB_BT709 ? "BT.709" : "BT.601";
+}
+
+static enum AVColorSpace matrix_colorspace(Yuv2RgbMatrix matrix)
+{
+    return matrix == YUV2RGB_BT2020 ? AVCOL_SPC_BT2020_NCL : matrix == YUV2RGB_BT709 ? AVCOL_SPC_BT709 : AVCOL_SPC_BT470BG;
+}
+
+static double elapsed_ms(Uint64 start)
+{
+    return (SDL_GetPerformanceCounter() - start) * 1000.0 / SDL_GetPerformanceFrequency();
+}
+
+//Noise on top of gradients, so both flat and busy areas and the clipping ends are covered
+static void fill_frame(AVFrame *frame)
+{
+    unsigned int seed = 12345;
+    int p, x, y;
+
+    for(p = 0; p < 3; p++)
+    {
+        int w = p ? (frame->width + 1) / 2 : frame->width;
+        int h = p ? (frame->height + 1) / 2 : frame->height;
+
+        for(y = 0; y < h; y++)
+        {
+            for(x = 0; x < w; x++)
+            {
+                seed = seed * 1103515245 + 12345;
+                frame->data[p][y * frame->linesize[p] + x] = (uint8_t)((x * 255 / w + y * 255 / h) / 2 +
+                                                                       ((seed >> 16) & 63) - 32);
+            }
+        }
+    }
+}
+
+//Compares only the pixels of each row, kernels leave the padding up to the stride alone
+static int rows_differ(const uint8_t *a, const uint8_t *b, int stride, int row_bytes, int height)
+{
+    int y;
+
+    for(y = 0; y < height; y++)
+    {
+        if(memcmp(a + y * stride, b + y * stride, row_bytes) != 0)
+            return 1;
+    }
+    return 0;
+}
+
+static int check(AVFrame *frame, uint8_t *ref, uint8_t *out, int stride, Yuv2RgbMatrix matrix, int full_range)
+{
+    uint8_t *dst[4] = { out, NULL, NULL, NULL };
+    int dstStride[4] = { stride, 0, 0, 0 };
+    int failed = 0;
+    int maxDiff = 0;
+    long long over1 = 0;
+    int k, y, x;
+
+    yuv2rgb_convert((const uint8_t *const *)frame->data, frame->linesize, ref, stride,
+                    frame->width, frame->height, matrix, full_range, YUV2RGB_KERNEL_SCALAR);
+
+    for(k = YUV2RGB_KERNEL_SCALAR + 1; k < YUV2RGB_KERNEL_COUNT; k++)
+    {
+        if(!yuv2rgb_kernel_supported((Yuv2RgbKernel)k))
+            continue;
+        yuv2rgb_convert((const uint8_t *const *)frame->data, frame->linesize, out, stride,
+                        frame->width, frame->height, matrix, full_range, (Yuv2RgbKernel)k);
+        if(rows_differ(out, ref, stride, frame->width * 3, frame->height))
+        {
+            fprintf(stderr, "%s %s: %s differs from scalar\n", matrix_name(matrix),
+                    full_range ? "full" : "limited", yuv2rgb_kernel_name((Yuv2RgbKernel)k));
+            failed = 1;
+        }
+    }
+
+    frame->colorspace = matrix_colorspace(matrix);
+    frame->color_range = full_range ? AVCOL_RANGE_JPEG : AVCOL_RANGE_MPEG;
+    if(sws_cache_scale(frame, dst, dstStride, frame->width, frame->height, AV_PIX_FMT_RGB24, SWS_BILINEAR) < 0)
+    {
+        fprintf(stderr, "sws_scale failed\n");
+        return 1;
+    }
+    for(y = 0; y < frame->height; y++)
+    {
+        for(x = 0; x < frame->width * 3; x++)
+        {
+            int diff = abs(ref[y * stride + x] - out[y * stride + x]);
+
+            if(diff > maxDiff)
+                maxDiff = diff;
+            if(diff > 1)
+                over1++;
+        }
+    }
+    printf("%-7s %-7s: max diff vs sws_scale %d, %.3f%% of samples off by more than 1\n",
+           matrix_name(matrix), full_range ? "full" : "limited",
+           maxDiff, over1 * 100.0 / ((double)frame->width * 3 * frame->height));
+    if(maxDiff > TOLERANCE)
+    {
+        fprintf(stderr, "  over the tolerance of %d\n", TOLERANCE);
+        failed = 1;
+    }
+    return failed;
+}
+
+//Random depth-bit samples, in the high bits of each word for P010
+static void fill_frame16(AVFrame *frame, int depth, int semi_planar)
+{
+    unsigned int seed = 54321;
+    int shift = semi_planar ? 16 - depth : 0;
+    int p, x, y;
+
+    for(p = 0; p < (semi_planar ? 2 : 3); p++)
+    {
+        int w = p ? (frame->width + 1) / 2 * (semi_planar ? 2 : 1) : frame->width;
+        int h = p ? (frame->height + 1) / 2 : frame->height;
+
+        for(y = 0; y < h; y++)
+        {
+            uint16_t *line = (uint16_t *)(frame->data[p] + y * frame->linesize[p]);
+
+            for(x = 0; x < w; x++)
+            {
+                seed = seed * 1103515245 + 12345;
+                line[x] = (uint16_t)(((seed >> 8) & ((1 << depth) - 1)) << shift);
+            }
+        }
+    }
+}
+
+static int check16(AVFrame *frame, int depth, int semi_planar, uint16_t *ref, uint16_t *out, int stride,
+                   Yuv2RgbMatrix matrix, int full_range)
+{
+    uint8_t *dst[4] = { (uint8_t *)out, NULL, NULL, NULL };
+    int dstStride[4] = { stride, 0, 0, 0 };
+    int failed = 0;
+    int maxDiff = 0;
+    int k, y, x;
+
+    yuv2rgb_convert16((const uint8_t *const *)frame->data, frame->linesize, depth, semi_planar, ref, stride,
+                      frame->width, frame->height, matrix, full_range, YUV2RGB_KERNEL_SCALAR);
+
+    for(k = YUV2RGB_KERNEL_SCALAR + 1; k < YUV2RGB_KERNEL_COUNT; k++)
+    {
+        if(!yuv2rgb_kernel_supported((Yuv2RgbKernel)k))
+            continue;
+        yuv2rgb_convert16((const uint8_t *const *)frame->data, frame->linesize, depth, semi_planar, out, stride,
+                          frame->width, frame->height, matrix, full_range, (Yuv2RgbKernel)k);
+        if(rows_differ((const uint8_t *)out, (const uint8_t *)ref, stride, frame->width * 6, frame->height))
+        {
+            fprintf(stderr, "%s %s %s: %s differs from scalar\n", av_get_pix_fmt_name(frame->format),
+                    matrix_name(matrix), full_range ? "full" : "limited", yuv2rgb_kernel_name((Yuv2RgbKernel)k));
+            failed = 1;
+        }
+    }
+
+    frame->colorspace = matrix_colorspace(matrix);
+    frame->color_range = full_range ? AVCOL_RANGE_JPEG : AVCOL_RANGE_MPEG;
+    if(sws_cache_scale(frame, dst, dstStride, frame->width, frame->height, AV_PIX_FMT_RGB48, SWS_BILINEAR) < 0)
+    {
+        fprintf(stderr, "sws_scale failed\n");
+        return 1;
+    }
+    for(y = 0; y < frame->height; y++)
+    {
+        const uint16_t *a = (const uint16_t *)((const uint8_t *)ref + y * stride);
+        const uint16_t *b = (const uint16_t *)((const uint8_t *)out + y * stride);
+
+        for(x = 0; x < frame->width * 3; x++)
+        {
+            int diff = abs(a[x] - b[x]);
+
+            if(diff > maxDiff)
+                maxDiff = diff;
+        }
+    }
+    printf("%-7s %-7s %-7s: max diff vs sws_scale %d (of 65535)\n", av_get_pix_fmt_name(frame->format),
+           matrix_name(matrix), full_range ? "full" : "limited", maxDiff);
+    if(maxDiff > TOLERANCE * 257)
+    {
+        fprintf(stderr, "  over the tolerance of %d\n", TOLERANCE * 257);
+        failed = 1;
+    }
+    return failed;
+}
+
+static void report(const char *name, double ms, int iterations, const AVFrame *frame, double scalarMs)
+{
+    double perFrame = ms / iterations;
+
+    printf("%-10s %8.3fms/frame %9.1f Mpixel/s", name, perFrame,
+           (double)frame->width * frame->height / (perFrame * 1000.0));
+    if(scalarMs > 0)
+        printf("  x%.2f vs scalar", scalarMs / perFrame);
+    printf("\n");
+}
+
+int main(int argc, char *argv[])
+{
+    int width = argc > 2 ? atoi(argv[1]) : 1920;
+    int height = argc > 2 ? atoi(argv[2]) : 1080;
+    int iterations = argc > 3 ? atoi(argv[3]) : 200;
+    AVFrame *frame;
+    uint8_t *ref, *out;
+    uint8_t *dst[4];
+    int dstStride[4] = { 0 };
+    double scalarMs = 0;
+    int stride, failed = 0;
+    int m, r, k, i;
+
+    if(width <= 0 || height <= 0 || iterations <= 0)
+    {
+        fprintf(stderr, "Usage: %s [width height [iterations]]\n", argv[0]);
+        return 1;
+    }
+
+    frame = av_frame_alloc();
+    frame->format = AV_PIX_FMT_YUV420P;
+    frame->width = width;
+    frame->height = height;
+    if(av_frame_get_buffer(frame, 32) < 0)
+    {
+        fprintf(stderr, "Could not allocate a %dx%d frame\n", width, height);
+        return 1;
+    }
+    fill_frame(frame);
+
+    stride = FFALIGN(width * 3, 32);
+    ref = av_malloc(stride * height);
+    out = av_malloc(stride * height);
+    dst[0] = out;
+    dstStride[0] = stride;
+
+    printf("%dx%d, best kernel here: %s\n", width, height, yuv2rgb_kernel_name(yuv2rgb_best_kernel()));
+    for(m = YUV2RGB_BT601; m <= YUV2RGB_BT2020; m++)
+    {
+        for(r = 0; r < 2; r++)
+            failed |= check(frame, ref, out, stride, (Yuv2RgbMatrix)m, r);
+    }
+
+    //Timed with the default (BT.601 limited) tagging, as most decoded frames have
+    frame->colorspace = AVCOL_SPC_UNSPECIFIED;
+    frame->color_range = AVCOL_RANGE_MPEG;
+    for(k = YUV2RGB_KERNEL_SCALAR; k < YUV2RGB_KERNEL_COUNT; k++)
+    {
+        Uint64 start;
+        double ms;
+
+        if(!yuv2rgb_kernel_supported((Yuv2RgbKernel)k))
+        {
+            printf("%-10s not supported on this CPU\n", yuv2rgb_kernel_name((Yuv2RgbKernel)k));
+            continue;
+        }
+        start = SDL_GetPerformanceCounter();
+        for(i = 0; i < iterations; i++)
+        {
+            yuv2rgb_convert((const uint8_t *const *)frame->data, frame->linesize, out, stride,
+                            width, height, YUV2RGB_BT601, 0, (Yuv2RgbKernel)k);
+        }
+        ms = elapsed_ms(start);
+        report(yuv2rgb_kernel_name((Yuv2RgbKernel)k), ms, iterations, frame, scalarMs);
+        if(k == YUV2RGB_KERNEL_SCALAR)
+            scalarMs = ms / iterations;
+    }
+
+    {
+        Uint64 start = SDL_GetPerformanceCounter();
+
+        for(i = 0; i < iterations; i++)
+            sws_cache_scale(frame, dst, dstStride, width, height, AV_PIX_FMT_RGB24, SWS_BILINEAR);
+        report("sws_scale", elapsed_ms(start), iterations, frame, scalarMs);
+    }
+
+    //16-bit path: YUV420P10 and P010 in, RGB48 out, checked and then timed on YUV420P10
+    {
+        const enum AVPixelFormat formats[2] = { AV_PIX_FMT_YUV420P10, AV_PIX_FMT_P010 };
+        int stride16 = FFALIGN(width * 6, 32);
+        uint16_t *ref16 = av_malloc(stride16 * height);
+        uint16_t *out16 = av_malloc(stride16 * height);
+        AVFrame *frame16 = NULL;
+        int f;
+
+        dst[0] = (uint8_t *)out16;
+        dstStride[0] = stride16;
+        for(f = 1; f >= 0; f--)
+        {
+            av_frame_free(&frame16);
+            frame16 = av_frame_alloc();
+            frame16->format = formats[f];
+            frame16->width = width;
+            frame16->height = height;
+            if(!ref16 || !out16 || av_frame_get_buffer(frame16, 32) < 0)
+            {
+                fprintf(stderr, "Could not allocate a %dx%d 16-bit frame\n", width, height);
+                return 1;
+            }
+            fill_frame16(frame16, 10, formats[f] == AV_PIX_FMT_P010);
+            for(m = YUV2RGB_BT601; m <= YUV2RGB_BT2020; m++)
+            {
+                for(r = 0; r < 2; r++)
+                {
+                    failed |= check16(frame16, 10, formats[f] == AV_PIX_FMT_P010, ref16, out16, stride16,
+                                      (Yuv2RgbMatrix)m, r);
+                }
+            }
+        }
+
+        //frame16 is the YUV420P10 one now
+        frame16->colorspace = AVCOL_SPC_UNSPECIFIED;
+        frame16->color_range = AVCOL_RANGE_MPEG;
+        scalarMs = 0;
+        for(k = YUV2RGB_KERNEL_SCALAR; k <= YUV2RGB_KERNEL_AVX2; k++)
+        {
+            char name[32];
+            Uint64 start;
+            double ms;
+
+            if(!yuv2rgb_kernel_supported((Yuv2RgbKernel)k))
+                continue;
+            start = SDL_GetPerformanceCounter();
+            for(i = 0; i < iterations; i++)
+            {
+                yuv2rgb_convert16((const uint8_t *const *)frame16->data, frame16->linesize, 10, 0, out16, stride16,
+                                  width, height, YUV2RGB_BT601, 0, (Yuv2RgbKernel)k);
+            }
+            ms = elapsed_ms(start);
+            snprintf(name, sizeof(name), "%s 16", yuv2rgb_kernel_name((Yuv2RgbKernel)k));
+            report(name, ms, iterations, frame16, scalarMs);
+            if(k == YUV2RGB_KERNEL_SCALAR)
+                scalarMs = ms / iterations;
+        }
+        {
+            Uint64 start = SDL_GetPerformanceCounter();
+
+            for(i = 0; i < iterations; i++)
+                sws_cache_scale(frame16, dst, dstStride, width, height, AV_PIX_FMT_RGB48, SWS_BILINEAR);
+            report("sws 16", elapsed_ms(start), iterations, frame16, scalarMs);
+        }
+
+        //Tone mapping the same frame tagged PQ, into the 8-bit buffer, with the best kernel on every CPU
+        {
+            SlicePool *pool = slice_pool_create(0);
+            int c, cpus;
+
+            frame16->color_trc = AVCOL_TRC_SMPTE2084;
+            for(c = 0; pool && c < TONEMAP_CURVE_COUNT; c++)
+            {
+                ToneMapper *mapper = tonemap_create(pool, (ToneCurve)c, YUV2RGB_KERNEL_AUTO);
+                char name[32];
+                Uint64 start;
+
+                if(!mapper)
+                    continue;
+                start = SDL_GetPerformanceCounter();
+                for(i = 0; i < iterations; i++)
+                    tonemap_frame(mapper, frame16, out, stride);
+                snprintf(name, sizeof(name), "tm %s", tonemap_curve_name((ToneCurve)c));
+                report(name, elapsed_ms(start), iterations, frame16, 0);
+                tonemap_destroy(&mapper);
+            }
+
+            //Whether the default curve keeps up with the video: pool sizes 1, 2, 4... up to every CPU
+            cpus = pool ? slice_pool_threads(pool) : 0;
+            for(c = 1; c <= cpus; c = c == cpus ? cpus + 1 : FFMIN(c * 2, cpus))
+            {
+                SlicePool *sized = slice_pool_create(c);
+                ToneMapper *mapper = sized ? tonemap_create(sized, TONEMAP_BT2390, YUV2RGB_KERNEL_AUTO) : NULL;
+                double perFrame;
+                Uint64 start;
+
+                if(mapper)
+                {
+                    start = SDL_GetPerformanceCounter();
+                    for(i = 0; i < iterations; i++)
+                        tonemap_frame(mapper, frame16, out, stride);
+                    perFrame = elapsed_ms(start) / iterations;
+                    printf("tm %2d thread%s %8.3fms/frame %7.1f fps%s\n", c, c > 1 ? "s" : " ", perFrame,
+                           1000.0 / perFrame, perFrame <= 1000.0 / 60 ? "  real time at 60 fps"
+                           : perFrame <= 1000.0 / 24 ? "  real time at 24 fps" : "");
+                }
+                tonemap_destroy(&mapper);
+                slice_pool_destroy(&sized);
+            }
+            slice_pool_destroy(&pool);
+        }
+
+        av_frame_free(&frame16);
+        av_free(ref16);
+        av_free(out16);
+    }
+
+    sws_cache_clear();
+    av_free(ref);
+    av_free(out);
+    av_frame_free(&frame);
+    printf(failed ? "FAILED\n" : "OK\n");
+    return failed;
+}
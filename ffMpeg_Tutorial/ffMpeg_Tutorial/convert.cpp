@@ -0,0 +1,89 @@
+//
+//  convert.cpp
+//  ffMpeg_Tutorial
+//
+
+#include <array>
+
+#include "convert.hpp"
+
+namespace media
+{
+namespace convert
+{
+    namespace
+    {
+        struct Entry
+        {
+            AVPixelFormat src, dst;
+            Matrix matrix;
+            Range range;
+            ConvertFunc func;
+        };
+
+        template<class Src, class Dst>
+        struct Pair
+        {
+        };
+
+        //The four matrix / range instantiations of one format pair
+        template<class Src, class Dst>
+        constexpr std::array<Entry, 4> entries(Pair<Src, Dst>)
+        {
+            return {{
+                { Src::format, Dst::format, Matrix::BT601, Range::Limited, &convertFrame<Src, Dst, Matrix::BT601, Range::Limited> },
+                { Src::format, Dst::format, Matrix::BT601, Range::Full, &convertFrame<Src, Dst, Matrix::BT601, Range::Full> },
+                { Src::format, Dst::format, Matrix::BT709, Range::Limited, &convertFrame<Src, Dst, Matrix::BT709, Range::Limited> },
+                { Src::format, Dst::format, Matrix::BT709, Range::Full, &convertFrame<Src, Dst, Matrix::BT709, Range::Full> },
+            }};
+        }
+
+        template<class... Pairs>
+        constexpr auto makeTable(Pairs... pairs)
+        {
+            std::array<Entry, 4 * sizeof...(Pairs)> table{};
+            size_t n = 0;
+
+            ([&](auto pair)
+            {
+                for(const Entry& entry : entries(pair))
+                    table[n++] = entry;
+            }(pairs), ...);
+            return table;
+        }
+
+        //The format pairs worth a dedicated instantiation: what decoders output -> what we save or upload
+        constexpr auto converters = makeTable(Pair<Yuv420p, Rgb24>(),
+                                              Pair<Yuv420p, Bgr24>(),
+                                              Pair<Yuv420p, Rgba>(),
+                                              Pair<Yuv420p, Bgra>(),
+                                              Pair<Nv12, Rgb24>(),
+                                              Pair<Nv12, Rgba>(),
+                                              Pair<Nv12, Bgra>());
+    }
+
+    ConvertFunc findConverter(AVPixelFormat srcFormat, AVPixelFormat dstFormat, Matrix matrix, Range range)
+    {
+        if(srcFormat == AV_PIX_FMT_YUVJ420P)
+        {
+            srcFormat = AV_PIX_FMT_YUV420P;
+            range = Range::Full;
+        }
+
+        for(const Entry& entry : converters)
+        {
+            if(entry.src == srcFormat && entry.dst == dstFormat && entry.matrix == matrix && entry.range == range)
+                return entry.func;
+        }
+        return NULL;
+    }
+
+    ConvertFunc findConverter(const AVFrame *src, AVPixelFormat dstFormat)
+    {
+        Matrix matrix = src->colorspace == AVCOL_SPC_BT709 ? Matrix::BT709 : Matrix::BT601;
+        Range range = src->color_range == AVCOL_RANGE_JPEG ? Range::Full : Range::Limited;
+
+        return findConverter((AVPixelFormat)src->format, dstFormat, matrix, range);
+    }
+}
+}
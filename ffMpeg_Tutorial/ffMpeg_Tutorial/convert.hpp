@@ -0,0 +1,221 @@
+//
+//  convert.hpp
+//  ffMpeg_Tutorial
+//
+//  YUV -> packed RGB conversion specialised at compile time.
+//  The source layout, destination layout, matrix and range are all template parameters and the coefficients
+//  are constexpr, so an instantiation's inner loop has no per-pixel or per-row branches left to take
+//  and the compiler is free to vectorize it.
+//  The hot combinations are instantiated once in convert.cpp and picked at runtime with findConverter().
+//
+
+#ifndef convert_hpp
+#define convert_hpp
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+
+extern "C" {
+#include "libavutil/frame.h"
+#include "libavutil/pixfmt.h"
+}
+
+namespace media
+{
+namespace convert
+{
+    enum class Matrix
+    {
+        BT601,
+        BT709,
+    };
+
+    enum class Range
+    {
+        Limited,    //Y 16..235, chroma 16..240
+        Full,       //0..255 (the YUVJ formats)
+    };
+
+    /*
+     Luma weights of each matrix, indexed by Matrix
+     */
+    struct MatrixWeights
+    {
+        double kr, kb;
+    };
+
+    constexpr MatrixWeights matrixWeights[] =
+    {
+        { 0.299, 0.114 },       //BT.601
+        { 0.2126, 0.0722 },     //BT.709
+    };
+
+    constexpr int fixedPoint(double value, int shift)
+    {
+        return (int)(value * (1 << shift) + (value < 0 ? -0.5 : 0.5));
+    }
+
+    /*
+     Integer coefficients in Q14 for one matrix and range, all computed at compile time.
+     R = (y * (Y - yOffset) + rv * V' + round) >> shift, and so on, with U' = U - 128, V' = V - 128
+     */
+    template<Matrix M, Range R>
+    struct Coefficients
+    {
+        static constexpr int shift = 14;
+        static constexpr int round = 1 << (shift - 1);
+
+        static constexpr double kr = matrixWeights[(int)M].kr;
+        static constexpr double kb = matrixWeights[(int)M].kb;
+        static constexpr double kg = 1.0 - kr - kb;
+        static constexpr double yScale = R == Range::Full ? 1.0 : 255.0 / 219.0;
+        static constexpr double cScale = R == Range::Full ? 1.0 : 255.0 / 224.0;
+
+        static constexpr int yOffset = R == Range::Full ? 0 : 16;
+        static constexpr int y = fixedPoint(yScale, shift);
+        static constexpr int rv = fixedPoint(2 * (1 - kr) * cScale, shift);
+        static constexpr int gu = fixedPoint(2 * (1 - kb) * kb / kg * cScale, shift);
+        static constexpr int gv = fixedPoint(2 * (1 - kr) * kr / kg * cScale, shift);
+        static constexpr int bu = fixedPoint(2 * (1 - kb) * cScale, shift);
+    };
+
+    /*
+     Source layouts: where the samples of one line are, and how to read chroma sample i of that line.
+     Both are 4:2:0, chroma sample i covers pixels 2i and 2i + 1 of two lines.
+     */
+    struct Yuv420p
+    {
+        static constexpr AVPixelFormat format = AV_PIX_FMT_YUV420P;
+
+        struct Line
+        {
+            const uint8_t *y, *u, *v;
+            int cb(int i) const { return u[i]; }
+            int cr(int i) const { return v[i]; }
+        };
+
+        static Line line(const AVFrame *frame, int row)
+        {
+            return Line{ frame->data[0] + (ptrdiff_t)row * frame->linesize[0],
+                         frame->data[1] + (ptrdiff_t)(row >> 1) * frame->linesize[1],
+                         frame->data[2] + (ptrdiff_t)(row >> 1) * frame->linesize[2] };
+        }
+    };
+
+    struct Nv12
+    {
+        static constexpr AVPixelFormat format = AV_PIX_FMT_NV12;
+
+        struct Line
+        {
+            const uint8_t *y, *uv;
+            int cb(int i) const { return uv[2 * i]; }
+            int cr(int i) const { return uv[2 * i + 1]; }
+        };
+
+        static Line line(const AVFrame *frame, int row)
+        {
+            return Line{ frame->data[0] + (ptrdiff_t)row * frame->linesize[0],
+                         frame->data[1] + (ptrdiff_t)(row >> 1) * frame->linesize[1] };
+        }
+    };
+
+    /*
+     Destination layouts: byte offset of each channel inside a pixel, A < 0 when there is no alpha
+     */
+    template<AVPixelFormat F, int R, int G, int B, int A>
+    struct PackedRgb
+    {
+        static constexpr AVPixelFormat format = F;
+        static constexpr int bytes = A < 0 ? 3 : 4;
+
+        static void store(uint8_t *pixel, int r, int g, int b)
+        {
+            pixel[R] = (uint8_t)r;
+            pixel[G] = (uint8_t)g;
+            pixel[B] = (uint8_t)b;
+            if constexpr(A >= 0)
+                pixel[A] = 255;
+        }
+    };
+
+    using Rgb24 = PackedRgb<AV_PIX_FMT_RGB24, 0, 1, 2, -1>;
+    using Bgr24 = PackedRgb<AV_PIX_FMT_BGR24, 2, 1, 0, -1>;
+    using Rgba = PackedRgb<AV_PIX_FMT_RGBA, 0, 1, 2, 3>;
+    using Bgra = PackedRgb<AV_PIX_FMT_BGRA, 2, 1, 0, 3>;
+
+    //One pixel from its luma sample and the three chroma terms of its chroma sample
+    template<class Dst, class C>
+    inline void storePixel(uint8_t *out, int luma, int r, int g, int b)
+    {
+        const int y = (luma - C::yOffset) * C::y + C::round;
+
+        Dst::store(out,
+                   std::clamp((y + r) >> C::shift, 0, 255),
+                   std::clamp((y + g) >> C::shift, 0, 255),
+                   std::clamp((y + b) >> C::shift, 0, 255));
+    }
+
+    /*
+     Converts lines [begin, end) of src into dst (same size as src, lines dstStride bytes apart).
+     The loop runs over chroma samples: a sample's three terms are computed once and shared by the two
+     pixels it covers, and no index needs halving, which keeps every load and store contiguous.
+     */
+    template<class Src, class Dst, Matrix M, Range R>
+    void convertLines(const AVFrame *src, uint8_t *dst, int dstStride, int begin, int end)
+    {
+        using C = Coefficients<M, R>;
+        const int width = src->width;
+        const int pairs = width >> 1;
+
+        for(int row = begin; row < end; row++)
+        {
+            const typename Src::Line in = Src::line(src, row);
+            const uint8_t *__restrict luma = in.y;
+            uint8_t *__restrict out = dst + (ptrdiff_t)row * dstStride;
+
+            for(int i = 0; i < pairs; i++)
+            {
+                const int u = in.cb(i) - 128;
+                const int v = in.cr(i) - 128;
+                const int r = C::rv * v;
+                const int g = -C::gu * u - C::gv * v;
+                const int b = C::bu * u;
+
+                storePixel<Dst, C>(out + 2 * i * Dst::bytes, luma[2 * i], r, g, b);
+                storePixel<Dst, C>(out + (2 * i + 1) * Dst::bytes, luma[2 * i + 1], r, g, b);
+            }
+
+            //The last pixel of an odd width has a chroma sample of its own
+            if(width & 1)
+            {
+                const int u = in.cb(pairs) - 128;
+                const int v = in.cr(pairs) - 128;
+
+                storePixel<Dst, C>(out + (width - 1) * Dst::bytes, luma[width - 1],
+                                   C::rv * v, -C::gu * u - C::gv * v, C::bu * u);
+            }
+        }
+    }
+
+    template<class Src, class Dst, Matrix M, Range R>
+    void convertFrame(const AVFrame *src, uint8_t *dst, int dstStride)
+    {
+        convertLines<Src, Dst, M, R>(src, dst, dstStride, 0, src->height);
+    }
+
+    typedef void (*ConvertFunc)(const AVFrame *src, uint8_t *dst, int dstStride);
+
+    /*
+     Instantiated converter for this combination, NULL when it is not one of the hot ones in convert.cpp.
+     The YUVJ formats are accepted as their plain counterparts, with full range.
+     */
+    ConvertFunc findConverter(AVPixelFormat srcFormat, AVPixelFormat dstFormat, Matrix matrix, Range range);
+
+    //Same, with the matrix and range src is tagged with (BT.601 / limited when untagged)
+    ConvertFunc findConverter(const AVFrame *src, AVPixelFormat dstFormat);
+}
+}
+
+#endif /* convert_hpp */
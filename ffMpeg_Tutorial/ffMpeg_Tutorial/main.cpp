@@ -12,20 +12,41 @@
 #include <iostream>
 #include <CoreFoundation/CoreFoundation.h>
 #include <AudioToolbox/AudioToolbox.h>
+#include <memory>
 
 extern "C" {
 #include "libavformat/avformat.h"
 #include "libavcodec/avcodec.h"
 #include "libswscale/swscale.h"
 }
+
+#include "media.hpp"
+#include "pipeline.hpp"
+
+using media::Packet;
+using media::Frame;
+using media::Demuxer;
+using media::Decoder;
 #define SDL_AUDIO_BUFFER_SIZE 1024
 #define MAX_AUDIO_FRAME_SIZE 192000
+#define PIPELINE_DEPTH 8        //Packets/frames each pipeline stage may run ahead of the next one
 
 int quit = 0;   //To Quit the Program
 
+#define MAX_AUDIOQ_PACKETS 256   //Queue depth: number of packet nodes preallocated for the audio queue
+
+typedef struct PacketNode
+{
+    Packet pkt;
+    PacketNode *next;
+} PacketNode;
+
 typedef struct PacketQueue
 {
-    AVPacketList *first_pkt, *last_pkt;     //Linked list for packets
+    PacketNode *first_pkt, *last_pkt;       //Linked list for packets
+    PacketNode *free_pkt;                   //Nodes not in use, taken by put and returned by get
+    PacketNode *nodes;                      //Storage for all the nodes, allocated once
+    int max_packets;
     int nb_packets;
     int size;
     SDL_mutex *mutex;
@@ -33,36 +54,75 @@ typedef struct PacketQueue
 } PacketQueue;
 PacketQueue audioq;
 
-void packet_queue_init(PacketQueue *q)
+int packet_queue_init(PacketQueue *q, int max_packets)
 {
-    memset(q, 0, sizeof(PacketQueue));
+    int i;
+    
+    q->first_pkt = q->last_pkt = NULL;
+    q->nb_packets = 0;
+    q->size = 0;
+    //Allocate every node up front so put/get never touch the heap under the mutex
+    q->nodes = new (std::nothrow) PacketNode[max_packets];
+    if(!q->nodes)
+        return -1;
+    for(i = 0; i < max_packets; i++)
+    {
+        q->nodes[i].next = (i + 1 < max_packets) ? &q->nodes[i + 1] : NULL;
+    }
+    q->free_pkt = q->nodes;
+    q->max_packets = max_packets;
     q->mutex = SDL_CreateMutex();
     q->cond = SDL_CreateCond();
+    return 0;
 }
 
-int packet_queue_put(PacketQueue *q, AVPacket *pkt)
+void packet_queue_destroy(PacketQueue *q)
 {
-    AVPacketList *pkt1;
-    if(av_dup_packet(pkt) < 0)
+    //Deleting the nodes drops the references of any packets still queued
+    delete[] q->nodes;
+    q->nodes = q->first_pkt = q->last_pkt = q->free_pkt = NULL;
+    SDL_DestroyCond(q->cond);
+    SDL_DestroyMutex(q->mutex);
+}
+
+/*
+ Takes over the packet's reference (pkt is left blank), no copy of the data is made.
+ If every node is in use, waits until get returns one.
+ */
+int packet_queue_put(PacketQueue *q, Packet&& pkt)
+{
+    PacketNode *pkt1;
+    
+    //Packets from av_read_frame are already reference counted, this only copies if one is not
+    if(av_packet_make_refcounted(pkt.get()) < 0)
     {
         return -1;
     }
     
-    pkt1 = (AVPacketList*)av_malloc(sizeof(AVPacketList));
-    if(!pkt1)
-        return -1;
-    pkt1->pkt = *pkt;
-    pkt1->next = NULL;
-    
     SDL_LockMutex(q->mutex);
     
+    while(!q->free_pkt)
+    {
+        if(quit)
+        {
+            SDL_UnlockMutex(q->mutex);
+            return -1;
+        }
+        SDL_CondWait(q->cond, q->mutex);
+    }
+    pkt1 = q->free_pkt;
+    q->free_pkt = pkt1->next;
+    
+    pkt1->pkt = std::move(pkt);
+    pkt1->next = NULL;
+    
     if(!q->last_pkt)
         q->first_pkt = pkt1;
     else
         q->last_pkt->next = pkt1;
     q->last_pkt = pkt1;
     q->nb_packets++;
-    q->size += pkt1->pkt.size;
+    q->size += pkt1->pkt.get()->size;
     
     SDL_CondSignal(q->cond);    //send a signal to get function(if it is waiting)
     SDL_UnlockMutex(q->mutex);
@@ -70,9 +130,12 @@ int packet_queue_put(PacketQueue *q, AVPacket *pkt)
     return 0;
 }
 
-static int packet_queue_get(PacketQueue *q, AVPacket *pkt, int block)
+/*
+ Moves the oldest packet into pkt (dropping what pkt held before).
+ */
+static int packet_queue_get(PacketQueue *q, Packet& pkt, int block)
 {
-    AVPacketList *pkt1;
+    PacketNode *pkt1;
     int ret;
     
     SDL_LockMutex(q->mutex);
@@ -92,9 +155,13 @@ static int packet_queue_get(PacketQueue *q, AVPacket *pkt, int block)
             if(!q->first_pkt)
                 q->last_pkt = NULL;
             q->nb_packets--;
-            q->size -= pkt1->pkt.size;
-            *pkt = pkt1->pkt;
-            av_free(pkt1);
+            q->size -= pkt1->pkt.get()->size;
+            pkt = std::move(pkt1->pkt);
+            
+            //Give the node back and wake put if it is waiting for one
+            pkt1->next = q->free_pkt;
+            q->free_pkt = pkt1;
+            SDL_CondSignal(q->cond);
             ret = 1;
             break;
         }
@@ -112,13 +179,13 @@ static int packet_queue_get(PacketQueue *q, AVPacket *pkt, int block)
     return ret;
 }
 
-int audio_decode_frame(AVCodecContext *aCodecCtx, uint8_t *audio_buf, int buf_size)
+int audio_decode_frame(Decoder *aDecoder, uint8_t *audio_buf, int buf_size)
 {
-    static AVPacket pkt;
-    static uint8_t *audio_pkt_data = NULL;
+    static Packet pkt;
+    static Frame frame;
     static int audio_pkt_size = 0;
-    static AVFrame frame;
     
+    AVCodecContext *aCodecCtx = aDecoder->get();
     int len1, data_size = 0;
     
     for(;;)
@@ -126,24 +193,24 @@ int audio_decode_frame(AVCodecContext *aCodecCtx, uint8_t *audio_buf, int buf_si
         while (audio_pkt_size > 0)
         {
             int got_frame = 0;
-            len1 = avcodec_decode_audio4(aCodecCtx, &frame, &got_frame, &pkt);
+            len1 = aDecoder->decode(pkt, frame, &got_frame);
             if(len1 < 0)
             {
                 //If error, skip frame
                 audio_pkt_size = 0;
                 break;
             }
-            audio_pkt_data += len1;
             audio_pkt_size -= len1;
             if(got_frame)
             {
                 data_size = av_samples_get_buffer_size(NULL,
                                                        aCodecCtx->channels,
-                                                       frame.nb_samples,
+                                                       frame->nb_samples,
                                                        aCodecCtx->sample_fmt,
                                                        1);
                 //assert(data_size <= buf_size);
-                memcpy(audio_buf, frame.data[0], data_size);
+                memcpy(audio_buf, frame->data[0], data_size);
+                frame.unref();
             }
             if(data_size <= 0)
             {
@@ -155,11 +222,6 @@ int audio_decode_frame(AVCodecContext *aCodecCtx, uint8_t *audio_buf, int buf_si
         }
 
         fprintf(stderr, "hankyo1 \n");
-        // if(pkt.data)
-        // {
-        //     fprintf(stderr, "hankyo3 \n");
-        //     av_free_packet(&pkt);
-        // }
         
         if(quit)
         {
@@ -169,7 +231,8 @@ int audio_decode_frame(AVCodecContext *aCodecCtx, uint8_t *audio_buf, int buf_si
 
         fprintf(stderr, "hankyo4 \n");
         
-        if(packet_queue_get(&audioq, &pkt, 1) < 0)
+        //Replaces (and so releases) the packet we are done with
+        if(packet_queue_get(&audioq, pkt, 1) < 0)
         {
             fprintf(stderr, "hankyo3 \n");
             return -1;
@@ -177,8 +240,7 @@ int audio_decode_frame(AVCodecContext *aCodecCtx, uint8_t *audio_buf, int buf_si
         
         fprintf(stderr, "hankyo5 \n");
 
-        audio_pkt_data = pkt.data;
-        audio_pkt_size = pkt.size;
+        audio_pkt_size = pkt.get()->size;
 
         fprintf(stderr, "audio packet size: %d \n", audio_pkt_size);
     }
@@ -194,7 +256,7 @@ void audio_callback(void *userdata, Uint8 *stream, int len)
 {
     fprintf(stderr, "audio callback called \n");
 
-    AVCodecContext *aCodecCtx = (AVCodecContext*)userdata;
+    Decoder *aDecoder = (Decoder*)userdata;
     int len1, audio_size;
     
     static uint8_t audio_buf[(MAX_AUDIO_FRAME_SIZE * 3) / 2];
@@ -207,7 +269,7 @@ void audio_callback(void *userdata, Uint8 *stream, int len)
         // fprintf(stderr, "audio buf index(%d), audio buf size(%d) \n", audio_buf_index, audio_buf_size);
         if(audio_buf_index >= audio_buf_size)
         {
-            audio_size = audio_decode_frame(aCodecCtx, audio_buf, sizeof(audio_buf));
+            audio_size = audio_decode_frame(aDecoder, audio_buf, sizeof(audio_buf));
             
             // fprintf(stderr, "audio size : %d \n", audio_size);
             
@@ -234,29 +296,107 @@ void audio_callback(void *userdata, Uint8 *stream, int len)
     }
 }
 
+/*
+ Closes the audio device and then frees the audio queue when it goes out of scope.
+ Declared after the audio Decoder, so the callback is stopped before the decoder it uses is closed.
+ At end of file (or after -pipeline) nothing set quit yet and the callback may be waiting in
+ packet_queue_get, so it is woken first or SDL_CloseAudio would wait for it forever.
+ */
+struct AudioGuard
+{
+    bool opened = false;
+    ~AudioGuard()
+    {
+        SDL_LockMutex(audioq.mutex);
+        quit = 1;
+        SDL_CondBroadcast(audioq.cond);
+        SDL_UnlockMutex(audioq.mutex);
+        if(opened)
+            SDL_CloseAudio();
+        packet_queue_destroy(&audioq);
+    }
+};
+
+//SDL objects are freed by their own destroy functions when the owner goes out of scope
+typedef std::unique_ptr<SDL_Window, decltype(&SDL_DestroyWindow)> WindowPtr;
+typedef std::unique_ptr<SDL_Renderer, decltype(&SDL_DestroyRenderer)> RendererPtr;
+typedef std::unique_ptr<SDL_Texture, decltype(&SDL_DestroyTexture)> TexturePtr;
+typedef std::unique_ptr<SwsContext, decltype(&sws_freeContext)> SwsContextPtr;
+
+/*
+ Plays the video stream through the coroutine pipeline: demux, decode and convert run as stages on a thread pool
+ and this thread only uploads and presents the converted YUV420P frames.
+ Audio packets are handed to the audio queue by the demux stage.
+ */
+static void play_with_pipeline(Demuxer& demuxer, int videoStream, int audioStream, Decoder& videoDecoder,
+                               SDL_Renderer *renderer, SDL_Texture *texture, int width, int height)
+{
+    media::ThreadPool pool;
+    media::VideoPipeline pipeline(pool, PIPELINE_DEPTH);
+    SDL_Event event;
+    
+    pipeline.start(demuxer, videoStream, videoDecoder, AV_PIX_FMT_YUV420P, width, height,
+                   [audioStream](Packet&& pkt)
+                   {
+                       if(pkt.streamIndex() == audioStream)
+                           packet_queue_put(&audioq, std::move(pkt));
+                   });
+    
+    while(std::optional<Frame> frame = pipeline.nextFrame())
+    {
+        SDL_UpdateYUVTexture(texture,
+                             NULL,
+                             (*frame)->data[0],
+                             (*frame)->linesize[0],
+                             (*frame)->data[1],
+                             (*frame)->linesize[1],
+                             (*frame)->data[2],
+                             (*frame)->linesize[2]);
+        
+        SDL_RenderClear(renderer);
+        SDL_RenderCopy(renderer, texture, NULL, NULL);
+        SDL_RenderPresent(renderer);
+        
+        if(SDL_PollEvent(&event))
+        {
+            switch (event.type) {
+                case SDL_QUIT:
+                    quit = 1;
+                    SDL_Quit();
+                    exit(0);
+                    break;
+                    
+                default:
+                    break;
+            }
+        }
+    }
+}
+
 int main(int argc, const char * argv[]) {
-    AVFormatContext *pFormatCtx = NULL;
+    Demuxer demuxer;
     int videoStream, audioStream;
 
-    AVCodecContext *pCodecCtxOrig = NULL;
-    AVCodecContext *pCodecCtx = NULL;
-    AVCodecContext *aCodecCtxOrig = NULL;
-    AVCodecContext *aCodecCtx = NULL;
+    Decoder videoDecoder;
+    Decoder audioDecoder;
     
     SDL_AudioSpec wanted_spec, spec;
     
-    AVCodec *pCodec = NULL;
-    AVCodec *aCodec = NULL;
-    
     /*
      Storing the Data
      */
-    AVFrame *pFrame = NULL;
-    AVFrame *pFrameRGB = NULL;
+    Packet packet;
+    Frame pFrame;
     
     SDL_Event event;
-    
-    SDL_Window *screen;
+
+    if(argc < 2)
+    {
+        fprintf(stderr, "usage: %s <input> [-pipeline]\n", argv[0]);
+        return -1;
+    }
+    //-pipeline: run demux/decode/convert as coroutine stages on a thread pool
+    bool usePipeline = argc > 2 && strcmp(argv[2], "-pipeline") == 0;
 
     //Registers all available file formats and codecs with the library
     av_register_all();
@@ -269,69 +409,40 @@ int main(int argc, const char * argv[]) {
     }
     
     /*
-     Read File Header
+     Read File Header and check out the stream information
      */
-    //Reads file header and Stores information about the file format in the AVFormatContext
-    if(avformat_open_input(&pFormatCtx, argv[1], NULL, NULL) != 0)
+    if(demuxer.open(argv[1]) < 0)
     {
-        return -1;  //Couldn't open file
-    }
-    
-    /*
-     Check out the stream information
-     */
-    //Retrieve stream information
-    if(avformat_find_stream_info(pFormatCtx, NULL) < 0)
-    {
-        return -1;  //Couldn't find stream information
+        return -1;  //Couldn't open file or find stream information
     }
     
     /*
      Dump information about file onto standard error
      */
-    av_dump_format(pFormatCtx, 0, argv[1], 0);
-    
-    //pFormatCtx->streams :Array of pointters
-    //pFormatCtx->nb_streams :Number of elements in AVFormatContext.streams
+    av_dump_format(demuxer.get(), 0, argv[1], 0);
     
-    //Find the first video stream
-    videoStream = -1 ;
-    audioStream = -1;
-    for(int i = 0; i < pFormatCtx->nb_streams; i++)
-    {
-        if(pFormatCtx->streams[i]->codec->codec_type == AVMEDIA_TYPE_VIDEO && videoStream < 0)
-        {
-            videoStream = i;
-        }
-        if(pFormatCtx->streams[i]->codec->codec_type == AVMEDIA_TYPE_AUDIO && audioStream < 0)
-        {
-            audioStream = i;
-        }
-    }
+    //Find the first video and audio stream
+    videoStream = demuxer.findStream(AVMEDIA_TYPE_VIDEO);
+    audioStream = demuxer.findStream(AVMEDIA_TYPE_AUDIO);
     if(videoStream == -1)
         return -1;
     if(audioStream == -1)
         return -1;
 
-    //Get a pointer to the codec context for the video stream
-    aCodecCtxOrig = pFormatCtx->streams[audioStream]->codec;
-    
-    //Find the decoder for the video stream
-    aCodec = avcodec_find_decoder(aCodecCtxOrig->codec_id);
-
-    if(aCodec == NULL)
+    //Find, copy and open the codec for the audio stream
+    if(audioDecoder.open(demuxer.stream(audioStream)) < 0)
     {
-        fprintf(stderr, "Unsupported Audio codec! \n");
-        return -1;  //Codec not found
+        fprintf(stderr, "Could not open audio codec \n");
+        return -1;
     }
-    //Copy context
-    aCodecCtx = avcodec_alloc_context3(aCodec);
-    //Must not use the AVCodecContext from the video stream directly!
-    if((avcodec_copy_context(aCodecCtx, aCodecCtxOrig) != 0))
+
+    if(packet_queue_init(&audioq, MAX_AUDIOQ_PACKETS) < 0)
     {
-        fprintf(stderr, "Couldn't copy Audio codec context \n");
-        return -1;  //Error copying codec context
+        fprintf(stderr, "Could not allocate audio packet queue \n");
+        return -1;
     }
+    AudioGuard audioGuard;
+    
     /*
      Contained within the codec context is all the information we need to set up our audio
      
@@ -342,63 +453,40 @@ int main(int argc, const char * argv[]) {
      silence: value that indicated silence
      samples: size of the audio buffer
      */
-    wanted_spec.freq = aCodecCtx->sample_rate;
+    wanted_spec.freq = audioDecoder->sample_rate;
     wanted_spec.format = AUDIO_S16SYS;
-    wanted_spec.channels = aCodecCtx->channels;
+    wanted_spec.channels = audioDecoder->channels;
     wanted_spec.silence = 0;
     wanted_spec.samples = SDL_AUDIO_BUFFER_SIZE;
     wanted_spec.callback = audio_callback;
-    wanted_spec.userdata = aCodecCtx;
+    wanted_spec.userdata = &audioDecoder;
     
     if(SDL_OpenAudio(&wanted_spec, &spec) < 0)
     {
         fprintf(stderr, "SDL OpenAudio: %s \n", SDL_GetError());
         return -1;
     }
+    audioGuard.opened = true;
     
-    //Open codec
-    if((avcodec_open2(aCodecCtx, aCodec, NULL) < 0))
+    //Find, copy and open the codec for the video stream
+    if(videoDecoder.open(demuxer.stream(videoStream)) < 0)
     {
-        fprintf(stderr, "Could not open audio codec \n");
-        return -1;  //Could not open codec
-    }
-    
-    packet_queue_init(&audioq);
-    SDL_PauseAudio(0);  //To starts the audio device
-    
-    //Get a pointer to the codec context for the video stream
-    pCodecCtxOrig = pFormatCtx->streams[videoStream]->codec;
-
-    //Find the decoder for the video stream
-    pCodec = avcodec_find_decoder(pCodecCtxOrig->codec_id);
-    if(pCodec == NULL)
-    {
-        fprintf(stderr, "Unsupported video codec! \n");
-        return -1;  //Codec not found
-    }
-
-    //Copy context
-    pCodecCtx = avcodec_alloc_context3(pCodec);
-    //Must not use the AVCodecContext from the video stream directly!
-    if( (avcodec_copy_context(pCodecCtx, pCodecCtxOrig) != 0) )
-    {
-        fprintf(stderr, "Couldn't copy video codec context \n");
-        return -1;  //Error copying codec context
+        fprintf(stderr, "Could not open video codec \n");
+        return -1;
     }
 
-    //Open codec
-    if((avcodec_open2(pCodecCtx, pCodec, NULL) < 0))
+    if(!pFrame.valid())
     {
-        fprintf(stderr, "Could not open video codec \n");
-        return -1;  //Error copying codec context
+        fprintf(stderr, "Could not allocate video frame \n");
+        return -1;
     }
 
-
-    //Allocate video frame
-    pFrame = av_frame_alloc();
+    int width = videoDecoder->width;
+    int height = videoDecoder->height;
 
     //Set up a screen with the given width * height
-    screen = SDL_CreateWindow("Video Player", SDL_WINDOWPOS_UNDEFINED, SDL_WINDOWPOS_UNDEFINED, pCodecCtx->width, pCodecCtx->height, SDL_WINDOW_OPENGL);
+    WindowPtr screen(SDL_CreateWindow("Video Player", SDL_WINDOWPOS_UNDEFINED, SDL_WINDOWPOS_UNDEFINED, width, height, SDL_WINDOW_OPENGL),
+                     SDL_DestroyWindow);
     if(!screen)
     {
         fprintf(stderr, "SDL: could not set video mode - exiting\n");
@@ -406,139 +494,138 @@ int main(int argc, const char * argv[]) {
     }
     
     //Allocate a place to put YUV image on that screen
-    SDL_Renderer *renderer = SDL_CreateRenderer(screen, -1, 0);
+    RendererPtr renderer(SDL_CreateRenderer(screen.get(), -1, 0), SDL_DestroyRenderer);
     if(!renderer)
     {
         fprintf(stderr, "SDL: could not create renderer - exiting\n");
         return -1;
     }
-    SDL_Texture *texture = SDL_CreateTexture(renderer,
-                                            SDL_PIXELFORMAT_YV12,
-                                            SDL_TEXTUREACCESS_STREAMING,
-                                            pCodecCtx->width,
-                                            pCodecCtx->height);
+    TexturePtr texture(SDL_CreateTexture(renderer.get(),
+                                         SDL_PIXELFORMAT_YV12,
+                                         SDL_TEXTUREACCESS_STREAMING,
+                                         width,
+                                         height),
+                       SDL_DestroyTexture);
     if(!texture)
     {
         fprintf(stderr, "SDL: could not create texture - exiting\n");
         return -1;
     }
     
+    if(usePipeline)
+    {
+        SDL_PauseAudio(0);  //To starts the audio device
+        play_with_pipeline(demuxer, videoStream, audioStream, videoDecoder, renderer.get(), texture.get(), width, height);
+        return 0;
+    }
+    
     /*
      Read through the entire video stream by reading in the packet, decoding it into our frame and once our frame is complete, will convert and save it
      */
-    struct SwsContext *sws_ctx = NULL;
     int frameFinished;
     
-    AVPacket packet;
     //Initialize SWS context for software scaling
-    sws_ctx = sws_getContext(pCodecCtx->width,
-                             pCodecCtx->height,
-                             pCodecCtx->pix_fmt,
-                             pCodecCtx->width,
-                             pCodecCtx->height,
-                             AV_PIX_FMT_RGB24,
-                             SWS_BILINEAR,
-                             NULL,
-                             NULL,
-                             NULL);
-    
-    //Set up YV12 pixel array(12 bits per pixel)
-    Uint8 *yPlane, *uPlane, *vPlane;
-    size_t yPlaneSz, uvPlaneSz;
-    int uvPitch;
-    
-    yPlaneSz = pCodecCtx->width * pCodecCtx->height;
-    uvPlaneSz = pCodecCtx->width * pCodecCtx->height / 4;
-    yPlane = (Uint8*)malloc(yPlaneSz);
-    uPlane = (Uint8*)malloc(uvPlaneSz);
-    vPlane = (Uint8*)malloc(uvPlaneSz);
-    if(!yPlane || !uPlane || !vPlane)
+    SwsContextPtr sws_ctx(sws_getContext(width,
+                                         height,
+                                         videoDecoder->pix_fmt,
+                                         width,
+                                         height,
+                                         AV_PIX_FMT_YUV420P,
+                                         SWS_BILINEAR,
+                                         NULL,
+                                         NULL,
+                                         NULL),
+                          sws_freeContext);
+    if(!sws_ctx)
     {
-        fprintf(stderr, "Could not allocate pixel buffers - exiting\n");
-        exit(1);
+        fprintf(stderr, "Could not initialize the conversion context - exiting\n");
+        return -1;
     }
     
-    uvPitch = pCodecCtx->width / 2; //Pitch is the term SDL uses to refer to the width of a fiven line of data
+    //A second texture to write the next frame into while the renderer may still read the one just presented
+    TexturePtr backTexture(SDL_CreateTexture(renderer.get(),
+                                             SDL_PIXELFORMAT_YV12,
+                                             SDL_TEXTUREACCESS_STREAMING,
+                                             width,
+                                             height),
+                           SDL_DestroyTexture);
+    if(!backTexture)
+    {
+        fprintf(stderr, "SDL: could not create texture - exiting\n");
+        return -1;
+    }
+    SDL_Texture *textures[2] = { texture.get(), backTexture.get() };
+    int current = 0;
     
-    int i=0;
-    while (av_read_frame(pFormatCtx, &packet) >= 0)
+    SDL_PauseAudio(0);  //To starts the audio device
+    
+    //read() drops the previous packet's reference before reading the next one
+    while (demuxer.read(packet) >= 0)
     {
         //Is this a packet from the video stream?
-        if(packet.stream_index == videoStream)
+        if(packet.streamIndex() == videoStream)
         {
             //Decode video frame
-            avcodec_decode_video2(pCodecCtx, pFrame, &frameFinished, &packet);
+            videoDecoder.decode(packet, pFrame, &frameFinished);
             
             //Did we get a video frame?
             if(frameFinished)
             {
-                AVPicture pict;
-                pict.data[0] = yPlane;
-                pict.data[1] = uPlane;
-                pict.data[2] = vPlane;
-                pict.linesize[0] = pCodecCtx->width;    //y width
-                pict.linesize[1] = uvPitch;             //u width
-                pict.linesize[2] = uvPitch;             //v width
+                SDL_Texture *target = textures[current];
+                void *pixels;
+                int pitch;
+                
+                //Convert the image into YUV format that SDL uses, straight into the texture's memory
+                //A locked YV12 texture is the Y plane followed by V then U, each at half the pitch
+                if(SDL_LockTexture(target, NULL, &pixels, &pitch) < 0)
+                {
+                    pFrame.unref();
+                    continue;
+                }
+                uint8_t *planes[3];
+                int pitches[3] = { pitch, (pitch + 1) / 2, (pitch + 1) / 2 };
+                planes[0] = (uint8_t *)pixels;
+                planes[2] = planes[0] + pitch * height;
+                planes[1] = planes[2] + pitches[2] * ((height + 1) / 2);
                 
-                //Convert the image into YUV format that SDL uses
-                sws_scale(sws_ctx,
+                sws_scale(sws_ctx.get(),
                           (uint8_t const* const*)pFrame->data,
                           pFrame->linesize,
                           0,
-                          pCodecCtx->height,
-                          pict.data,
-                          pict.linesize);
+                          height,
+                          planes,
+                          pitches);
+                SDL_UnlockTexture(target);
+                current ^= 1;
                 
-                SDL_UpdateYUVTexture(texture,
-                                     NULL,
-                                     yPlane,
-                                     pCodecCtx->width,
-                                     uPlane,
-                                     uvPitch,
-                                     vPlane,
-                                     uvPitch);
+                SDL_RenderClear(renderer.get());
+                SDL_RenderCopy(renderer.get(), target, NULL, NULL);
+                SDL_RenderPresent(renderer.get());
                 
-                SDL_RenderClear(renderer);
-                SDL_RenderCopy(renderer, texture, NULL, NULL);
-                SDL_RenderPresent(renderer);
-                
-                av_free_packet(&packet);
+                pFrame.unref();
             }
         }
-        else if(packet.stream_index == audioStream)
+        else if(packet.streamIndex() == audioStream)
         {
-            packet_queue_put(&audioq, &packet);
-        }
-        else
-        {
-            av_free_packet(&packet);
+            //Hands the reference to the queue, packet is blank afterwards
+            packet_queue_put(&audioq, std::move(packet));
         }
         
-        SDL_PollEvent(&event);
-        switch (event.type) {
-            case SDL_QUIT:
-                quit = 1;
-                SDL_Quit();
-                exit(0);
-                break;
-                
-            default:
-                break;
+        if(SDL_PollEvent(&event))
+        {
+            switch (event.type) {
+                case SDL_QUIT:
+                    quit = 1;
+                    SDL_Quit();
+                    exit(0);
+                    break;
+                    
+                default:
+                    break;
+            }
         }
     }
     
-    //Free the yuv frame
-    av_frame_free(&pFrame);
-    free(yPlane);
-    free(uPlane);
-    free(vPlane);
-    
-    //Close the codec
-    avcodec_close(pCodecCtx);
-    avcodec_close(pCodecCtxOrig);
-    
-    //Close the video file
-    avformat_close_input(&pFormatCtx);
-    
+    //Everything else (audio device, queue, frame, codecs and the file) is released as it goes out of scope
     return 0;
 }
@@ -0,0 +1,246 @@
+//
+//  media.cpp
+//  ffMpeg_Tutorial
+//
+
+#include "media.hpp"
+
+namespace media
+{
+    /*
+     Packet
+     */
+    Packet::Packet()
+    {
+        av_init_packet(&pkt);
+        pkt.data = NULL;
+        pkt.size = 0;
+    }
+
+    Packet::~Packet()
+    {
+        av_packet_unref(&pkt);
+    }
+
+    Packet::Packet(Packet&& other)
+    {
+        //Takes the reference and leaves other blank
+        av_packet_move_ref(&pkt, &other.pkt);
+    }
+
+    Packet& Packet::operator=(Packet&& other)
+    {
+        if(this != &other)
+        {
+            av_packet_unref(&pkt);
+            av_packet_move_ref(&pkt, &other.pkt);
+        }
+        return *this;
+    }
+
+    void Packet::unref()
+    {
+        av_packet_unref(&pkt);
+    }
+
+    /*
+     Frame
+     */
+    Frame::Frame()
+    : frame(av_frame_alloc())
+    {
+    }
+
+    Frame::~Frame()
+    {
+        av_frame_free(&frame);
+    }
+
+    Frame::Frame(Frame&& other)
+    : frame(other.frame)
+    {
+        other.frame = NULL;
+    }
+
+    Frame& Frame::operator=(Frame&& other)
+    {
+        if(this != &other)
+        {
+            av_frame_free(&frame);
+            frame = other.frame;
+            other.frame = NULL;
+        }
+        return *this;
+    }
+
+    void Frame::unref()
+    {
+        if(frame)
+            av_frame_unref(frame);
+    }
+
+    /*
+     Demuxer
+     */
+    Demuxer::Demuxer()
+    : formatCtx(NULL)
+    {
+    }
+
+    Demuxer::~Demuxer()
+    {
+        close();
+    }
+
+    Demuxer::Demuxer(Demuxer&& other)
+    : formatCtx(other.formatCtx)
+    {
+        other.formatCtx = NULL;
+    }
+
+    Demuxer& Demuxer::operator=(Demuxer&& other)
+    {
+        if(this != &other)
+        {
+            close();
+            formatCtx = other.formatCtx;
+            other.formatCtx = NULL;
+        }
+        return *this;
+    }
+
+    int Demuxer::open(const char *filename)
+    {
+        close();
+
+        //Reads file header and Stores information about the file format in the AVFormatContext
+        if(avformat_open_input(&formatCtx, filename, NULL, NULL) != 0)
+        {
+            return -1;  //Couldn't open file
+        }
+        //Retrieve stream information
+        if(avformat_find_stream_info(formatCtx, NULL) < 0)
+        {
+            close();
+            return -2;  //Couldn't find stream information
+        }
+        return 0;
+    }
+
+    void Demuxer::close()
+    {
+        //Does nothing if the file is not open
+        avformat_close_input(&formatCtx);
+    }
+
+    int Demuxer::findStream(AVMediaType type) const
+    {
+        if(!formatCtx)
+            return -1;
+
+        for(unsigned int i = 0; i < formatCtx->nb_streams; i++)
+        {
+            if(formatCtx->streams[i]->codec->codec_type == type)
+                return i;
+        }
+        return -1;
+    }
+
+    AVStream* Demuxer::stream(int index) const
+    {
+        if(!formatCtx || index < 0 || index >= (int)formatCtx->nb_streams)
+            return NULL;
+        return formatCtx->streams[index];
+    }
+
+    int Demuxer::read(Packet& pkt)
+    {
+        if(!formatCtx)
+            return AVERROR(EINVAL);
+
+        pkt.unref();
+        return av_read_frame(formatCtx, pkt.get());
+    }
+
+    /*
+     Decoder
+     */
+    Decoder::Decoder()
+    : codecCtx(NULL)
+    {
+    }
+
+    Decoder::~Decoder()
+    {
+        close();
+    }
+
+    Decoder::Decoder(Decoder&& other)
+    : codecCtx(other.codecCtx)
+    {
+        other.codecCtx = NULL;
+    }
+
+    Decoder& Decoder::operator=(Decoder&& other)
+    {
+        if(this != &other)
+        {
+            close();
+            codecCtx = other.codecCtx;
+            other.codecCtx = NULL;
+        }
+        return *this;
+    }
+
+    int Decoder::open(const AVStream *stream)
+    {
+        AVCodec *codec;
+
+        close();
+
+        //Find the decoder for the stream
+        codec = avcodec_find_decoder(stream->codec->codec_id);
+        if(codec == NULL)
+        {
+            return -1;  //Codec not found
+        }
+
+        //Copy context
+        codecCtx = avcodec_alloc_context3(codec);
+        //Must not use the AVCodecContext from the stream directly!
+        if(!codecCtx || avcodec_copy_context(codecCtx, stream->codec) != 0)
+        {
+            close();
+            return -2;  //Error copying codec context
+        }
+
+        //Decoded frames hold their own references, so a Frame stays valid after the next decode call
+        codecCtx->refcounted_frames = 1;
+
+        //Open codec
+        if(avcodec_open2(codecCtx, codec, NULL) < 0)
+        {
+            close();
+            return -3;  //Could not open codec
+        }
+        return 0;
+    }
+
+    void Decoder::close()
+    {
+        //Closes the codec and frees the context, does nothing if there is none
+        avcodec_free_context(&codecCtx);
+    }
+
+    int Decoder::decode(Packet& pkt, Frame& frame, int *gotFrame)
+    {
+        *gotFrame = 0;
+        if(!codecCtx || !frame.valid())
+            return AVERROR(EINVAL);
+
+        frame.unref();
+        if(codecCtx->codec_type == AVMEDIA_TYPE_VIDEO)
+            return avcodec_decode_video2(codecCtx, frame.get(), gotFrame, pkt.get());
+        return avcodec_decode_audio4(codecCtx, frame.get(), gotFrame, pkt.get());
+    }
+}
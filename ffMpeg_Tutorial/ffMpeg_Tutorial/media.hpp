@@ -0,0 +1,140 @@
+//
+//  media.hpp
+//  ffMpeg_Tutorial
+//
+//  Move-only owners for the FFmpeg objects used by the player.
+//  Each one frees what it holds in its destructor, so an early return can't leak,
+//  and moving one only hands over buffer references (the data is never copied).
+//
+
+#ifndef media_hpp
+#define media_hpp
+
+extern "C" {
+#include "libavformat/avformat.h"
+#include "libavcodec/avcodec.h"
+}
+
+namespace media
+{
+    /*
+     Owns the buffer reference of one packet.
+     The AVPacket lives inside the object, so creating and moving a Packet never touches the heap.
+     A moved-from Packet is blank and can be read into again.
+     */
+    class Packet
+    {
+    public:
+        Packet();
+        ~Packet();
+
+        Packet(Packet&& other);
+        Packet& operator=(Packet&& other);
+        Packet(const Packet&) = delete;
+        Packet& operator=(const Packet&) = delete;
+
+        //Drops the buffer reference, the Packet is blank afterwards
+        void unref();
+        bool empty() const { return pkt.data == NULL && pkt.side_data_elems == 0; }
+        int streamIndex() const { return pkt.stream_index; }
+
+        AVPacket* get() { return &pkt; }
+        const AVPacket* get() const { return &pkt; }
+
+    private:
+        AVPacket pkt;
+    };
+
+    /*
+     Owns one AVFrame and whatever buffers it references.
+     Moving a Frame hands over the AVFrame itself, the moved-from Frame holds nothing until assigned again.
+     */
+    class Frame
+    {
+    public:
+        Frame();
+        ~Frame();
+
+        Frame(Frame&& other);
+        Frame& operator=(Frame&& other);
+        Frame(const Frame&) = delete;
+        Frame& operator=(const Frame&) = delete;
+
+        //Drops the buffer references but keeps the AVFrame for the next decode
+        void unref();
+        bool valid() const { return frame != NULL; }
+
+        AVFrame* get() { return frame; }
+        const AVFrame* get() const { return frame; }
+        AVFrame* operator->() { return frame; }
+        const AVFrame* operator->() const { return frame; }
+
+    private:
+        AVFrame *frame;
+    };
+
+    /*
+     Owns an opened input file.
+     */
+    class Demuxer
+    {
+    public:
+        Demuxer();
+        ~Demuxer();
+
+        Demuxer(Demuxer&& other);
+        Demuxer& operator=(Demuxer&& other);
+        Demuxer(const Demuxer&) = delete;
+        Demuxer& operator=(const Demuxer&) = delete;
+
+        //Opens the file and reads its stream information, < 0 on error
+        int open(const char *filename);
+        void close();
+
+        //Index of the first stream of this type, -1 if there is none
+        int findStream(AVMediaType type) const;
+        AVStream* stream(int index) const;
+
+        //Reads the next packet into pkt (its previous reference is dropped first), < 0 at the end or on error
+        int read(Packet& pkt);
+
+        AVFormatContext* get() const { return formatCtx; }
+
+    private:
+        AVFormatContext *formatCtx;
+    };
+
+    /*
+     Owns a codec context opened for one stream.
+     */
+    class Decoder
+    {
+    public:
+        Decoder();
+        ~Decoder();
+
+        Decoder(Decoder&& other);
+        Decoder& operator=(Decoder&& other);
+        Decoder(const Decoder&) = delete;
+        Decoder& operator=(const Decoder&) = delete;
+
+        //Opens a decoder on a copy of the stream's codec parameters, < 0 on error
+        int open(const AVStream *stream);
+        void close();
+
+        /*
+         Decodes pkt into frame (its previous reference is dropped first).
+         Returns the number of bytes used or < 0 on error, gotFrame is set when frame holds a picture or samples.
+         Pass a blank Packet to drain the frames still buffered in the decoder.
+         */
+        int decode(Packet& pkt, Frame& frame, int *gotFrame);
+
+        AVCodecContext* get() const { return codecCtx; }
+        AVCodecContext* operator->() const { return codecCtx; }
+
+    private:
+        AVCodecContext *codecCtx;
+    };
+}
+
+#endif /* media_hpp */
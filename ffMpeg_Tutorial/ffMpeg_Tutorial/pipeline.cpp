@@ -0,0 +1,253 @@
+//
+//  pipeline.cpp
+//  ffMpeg_Tutorial
+//
+
+#include <algorithm>
+
+#include "convert.hpp"
+#include "pipeline.hpp"
+
+namespace media
+{
+    /*
+     ThreadPool
+     */
+    ThreadPool::ThreadPool(unsigned int threads)
+    : stopping(false)
+    {
+        if(threads == 0)
+            threads = std::max(1u, std::thread::hardware_concurrency());
+        for(unsigned int i = 0; i < threads; i++)
+            workers.emplace_back(&ThreadPool::run, this);
+    }
+
+    ThreadPool::~ThreadPool()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+        cond.notify_all();
+        for(std::thread& worker : workers)
+            worker.join();
+    }
+
+    void ThreadPool::post(std::coroutine_handle<> handle)
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            ready.push_back(handle);
+        }
+        cond.notify_one();
+    }
+
+    void ThreadPool::run()
+    {
+        for(;;)
+        {
+            std::coroutine_handle<> handle;
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                cond.wait(lock, [this] { return !ready.empty() || stopping; });
+                if(ready.empty())
+                    return;
+                handle = ready.front();
+                ready.pop_front();
+            }
+            //Runs the coroutine until its next co_await suspends it (or it finishes)
+            handle.resume();
+        }
+    }
+
+    /*
+     Task / TaskGroup
+     */
+    std::suspend_never Task::promise_type::final_suspend() noexcept
+    {
+        //The frame is destroyed right after this, so this is the last thing that touches it
+        if(group)
+            group->finished();
+        return {};
+    }
+
+    void TaskGroup::spawn(ThreadPool& pool, Task task)
+    {
+        std::coroutine_handle<Task::promise_type> handle = std::exchange(task.handle, nullptr);
+
+        handle.promise().group = this;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            running++;
+        }
+        pool.post(handle);
+    }
+
+    void TaskGroup::wait()
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        cond.wait(lock, [this] { return running == 0; });
+    }
+
+    void TaskGroup::finished()
+    {
+        //Notify while holding the lock, wait() may destroy the group as soon as it sees 0
+        std::lock_guard<std::mutex> lock(mutex);
+        running--;
+        cond.notify_all();
+    }
+
+    /*
+     Stages
+     */
+    Generator<Packet> readPackets(Demuxer& demuxer, int streamIndex, std::function<void(Packet&&)> others)
+    {
+        Packet pkt;
+
+        while(demuxer.read(pkt) >= 0)
+        {
+            if(pkt.streamIndex() == streamIndex)
+                co_yield std::move(pkt);
+            else if(others)
+                others(std::move(pkt));
+        }
+    }
+
+    Task demuxStage(Demuxer& demuxer, int streamIndex, Channel<Packet>& out, std::function<void(Packet&&)> others)
+    {
+        Generator<Packet> source = readPackets(demuxer, streamIndex, std::move(others));
+
+        while(source.next())
+        {
+            //Closed by the consumer: stop reading
+            if(!co_await out.send(std::move(source.value())))
+                break;
+        }
+        out.close();
+    }
+
+    Task decodeStage(Decoder& decoder, Channel<Packet>& in, Channel<Frame>& out)
+    {
+        Frame frame;
+        int gotFrame;
+
+        while(std::optional<Packet> pkt = co_await in.receive())
+        {
+            if(decoder.decode(*pkt, frame, &gotFrame) < 0 || !gotFrame)
+                continue;
+            //The frame goes to the next stage, decode into a new one
+            if(!co_await out.send(std::move(frame)))
+            {
+                in.close();
+                co_return;
+            }
+            frame = Frame();
+        }
+
+        //End of the stream: take out the frames still buffered in the decoder
+        Packet flush;
+        while(decoder.decode(flush, frame, &gotFrame) >= 0 && gotFrame)
+        {
+            if(!co_await out.send(std::move(frame)))
+                break;
+            frame = Frame();
+        }
+        out.close();
+    }
+
+    Task convertStage(Channel<Frame>& in, Channel<Frame>& out, AVPixelFormat format, int width, int height)
+    {
+        SwsContext *swsCtx = NULL;
+
+        while(std::optional<Frame> src = co_await in.receive())
+        {
+            Frame dst;
+            //A specialised converter when the frame only changes format, not size
+            convert::ConvertFunc converter = NULL;
+
+            if((*src)->width == width && (*src)->height == height)
+                converter = convert::findConverter(src->get(), format);
+            if(!converter)
+            {
+                //Reuses the context as long as the input size and format stay the same
+                swsCtx = sws_getCachedContext(swsCtx,
+                                              (*src)->width, (*src)->height, (AVPixelFormat)(*src)->format,
+                                              width, height, format,
+                                              SWS_BILINEAR, NULL, NULL, NULL);
+                if(!swsCtx)
+                    break;
+            }
+            if(!dst.valid())
+                break;
+
+            dst->format = format;
+            dst->width = width;
+            dst->height = height;
+            if(av_frame_get_buffer(dst.get(), 32) < 0)
+                break;
+            av_frame_copy_props(dst.get(), src->get());
+
+            if(converter)
+            {
+                converter(src->get(), dst->data[0], dst->linesize[0]);
+            }
+            else
+            {
+                sws_scale(swsCtx,
+                          (uint8_t const* const*)(*src)->data,
+                          (*src)->linesize,
+                          0,
+                          (*src)->height,
+                          dst->data,
+                          dst->linesize);
+            }
+
+            if(!co_await out.send(std::move(dst)))
+                break;
+        }
+
+        sws_freeContext(swsCtx);
+        //Either the end of the stream or an error: stop the stages on both sides
+        in.close();
+        out.close();
+    }
+
+    /*
+     VideoPipeline
+     */
+    VideoPipeline::VideoPipeline(ThreadPool& pool, size_t depth)
+    : pool(pool),
+      packets(pool, depth),
+      decoded(pool, depth),
+      converted(pool, depth)
+    {
+    }
+
+    VideoPipeline::~VideoPipeline()
+    {
+        stop();
+    }
+
+    void VideoPipeline::start(Demuxer& demuxer, int streamIndex, Decoder& decoder,
+                              AVPixelFormat format, int width, int height,
+                              std::function<void(Packet&&)> others)
+    {
+        tasks.spawn(pool, demuxStage(demuxer, streamIndex, packets, std::move(others)));
+        tasks.spawn(pool, decodeStage(decoder, packets, decoded));
+        tasks.spawn(pool, convertStage(decoded, converted, format, width, height));
+    }
+
+    std::optional<Frame> VideoPipeline::nextFrame()
+    {
+        return converted.receiveBlocking();
+    }
+
+    void VideoPipeline::stop()
+    {
+        //Closing every channel wakes each stage wherever it is waiting
+        converted.close();
+        decoded.close();
+        packets.close();
+        tasks.wait();
+    }
+}
@@ -0,0 +1,391 @@
+//
+//  pipeline.hpp
+//  ffMpeg_Tutorial
+//
+//  Coroutine based demux -> decode -> convert pipeline.
+//  Every stage is a coroutine (Task) that co_awaits packets or frames from the previous stage through a Channel.
+//  A waiting stage is suspended, not blocked, so all the stages share the few threads of one ThreadPool
+//  instead of holding a dedicated OS thread each.
+//
+
+#ifndef pipeline_hpp
+#define pipeline_hpp
+
+#include <condition_variable>
+#include <coroutine>
+#include <cstddef>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <optional>
+#include <thread>
+#include <utility>
+#include <vector>
+
+extern "C" {
+#include "libswscale/swscale.h"
+}
+
+#include "media.hpp"
+
+namespace media
+{
+    /*
+     Resumes suspended coroutines on a fixed set of worker threads.
+     */
+    class ThreadPool
+    {
+    public:
+        //0 threads = one per CPU core
+        explicit ThreadPool(unsigned int threads = 0);
+        //Runs whatever is still queued, then joins the workers
+        ~ThreadPool();
+
+        ThreadPool(const ThreadPool&) = delete;
+        ThreadPool& operator=(const ThreadPool&) = delete;
+
+        void post(std::coroutine_handle<> handle);
+
+        //co_await pool.schedule() continues the coroutine on one of the pool's threads
+        auto schedule()
+        {
+            struct Awaiter
+            {
+                ThreadPool *pool;
+                bool await_ready() const noexcept { return false; }
+                void await_suspend(std::coroutine_handle<> handle) { pool->post(handle); }
+                void await_resume() const noexcept {}
+            };
+            return Awaiter{this};
+        }
+
+    private:
+        void run();
+
+        std::mutex mutex;
+        std::condition_variable cond;
+        std::deque<std::coroutine_handle<>> ready;
+        bool stopping;
+        std::vector<std::thread> workers;
+    };
+
+    class TaskGroup;
+
+    /*
+     A pipeline stage. It does not start when called, TaskGroup::spawn starts it on a pool thread,
+     and its frame frees itself when the body returns.
+     */
+    class Task
+    {
+    public:
+        struct promise_type
+        {
+            TaskGroup *group = nullptr;
+
+            Task get_return_object() { return Task(std::coroutine_handle<promise_type>::from_promise(*this)); }
+            std::suspend_always initial_suspend() noexcept { return {}; }
+            std::suspend_never final_suspend() noexcept;
+            void return_void() noexcept {}
+            //Stages report errors by closing their channels, an exception escaping one is a bug
+            void unhandled_exception() noexcept { std::terminate(); }
+        };
+
+        Task(Task&& other) noexcept : handle(std::exchange(other.handle, nullptr)) {}
+        Task(const Task&) = delete;
+        Task& operator=(const Task&) = delete;
+        //A Task that was never spawned is destroyed without running
+        ~Task() { if(handle) handle.destroy(); }
+
+    private:
+        friend class TaskGroup;
+        explicit Task(std::coroutine_handle<promise_type> h) : handle(h) {}
+
+        std::coroutine_handle<promise_type> handle;
+    };
+
+    /*
+     Starts Tasks on a pool and waits for all of them to finish.
+     */
+    class TaskGroup
+    {
+    public:
+        TaskGroup() : running(0) {}
+        //Waits, so the tasks never outlive the channels they use
+        ~TaskGroup() { wait(); }
+
+        void spawn(ThreadPool& pool, Task task);
+        void wait();
+
+    private:
+        friend struct Task::promise_type;
+        void finished();
+
+        std::mutex mutex;
+        std::condition_variable cond;
+        int running;
+    };
+
+    /*
+     Pulls values out of a coroutine one co_yield at a time, on the caller's thread.
+     */
+    template <typename T>
+    class Generator
+    {
+    public:
+        struct promise_type
+        {
+            std::optional<T> value;
+
+            Generator get_return_object() { return Generator(std::coroutine_handle<promise_type>::from_promise(*this)); }
+            std::suspend_always initial_suspend() noexcept { return {}; }
+            std::suspend_always final_suspend() noexcept { return {}; }
+            std::suspend_always yield_value(T&& v) { value = std::move(v); return {}; }
+            void return_void() noexcept {}
+            void unhandled_exception() noexcept { std::terminate(); }
+        };
+
+        Generator(Generator&& other) noexcept : handle(std::exchange(other.handle, nullptr)) {}
+        Generator(const Generator&) = delete;
+        Generator& operator=(const Generator&) = delete;
+        ~Generator() { if(handle) handle.destroy(); }
+
+        //Runs the coroutine up to its next co_yield, false once it has returned
+        bool next()
+        {
+            handle.promise().value.reset();
+            handle.resume();
+            return !handle.done();
+        }
+        //The value of the last co_yield, move it out to take it
+        T& value() { return *handle.promise().value; }
+
+    private:
+        explicit Generator(std::coroutine_handle<promise_type> h) : handle(h) {}
+
+        std::coroutine_handle<promise_type> handle;
+    };
+
+    /*
+     Bounded queue between two stages.
+     co_await send() suspends the sender while the channel is full, co_await receive() suspends the receiver while it is empty,
+     and the other side resumes them on the pool. Values are moved in and out, never copied.
+     */
+    template <typename T>
+    class Channel
+    {
+    public:
+        Channel(ThreadPool& pool, size_t capacity) : pool(pool), capacity(capacity ? capacity : 1), closed(false) {}
+
+        Channel(const Channel&) = delete;
+        Channel& operator=(const Channel&) = delete;
+
+        class SendAwaiter
+        {
+        public:
+            SendAwaiter(Channel& channel, T&& value) : channel(channel), value(std::move(value)), ok(false) {}
+
+            bool await_ready() const noexcept { return false; }
+            bool await_suspend(std::coroutine_handle<> handle);
+            //false if the channel was closed, the value is dropped then
+            bool await_resume() const noexcept { return ok; }
+
+        private:
+            friend class Channel;
+            Channel& channel;
+            T value;
+            bool ok;
+            std::coroutine_handle<> waiter;
+        };
+
+        class ReceiveAwaiter
+        {
+        public:
+            explicit ReceiveAwaiter(Channel& channel) : channel(channel) {}
+
+            bool await_ready() const noexcept { return false; }
+            bool await_suspend(std::coroutine_handle<> handle);
+            //Empty once the channel is closed and drained
+            std::optional<T> await_resume() { return std::move(result); }
+
+        private:
+            friend class Channel;
+            Channel& channel;
+            std::optional<T> result;
+            std::coroutine_handle<> waiter;
+        };
+
+        SendAwaiter send(T value) { return SendAwaiter(*this, std::move(value)); }
+        ReceiveAwaiter receive() { return ReceiveAwaiter(*this); }
+
+        //For a thread that is not a coroutine (e.g. the SDL render loop), waits on a condition variable instead
+        std::optional<T> receiveBlocking();
+
+        //Wakes every waiting sender (send returns false) and receiver (receive returns empty once drained)
+        void close();
+
+    private:
+        //Called with the mutex held: refills the queue from the first waiting sender, if any
+        void takeWaitingSender();
+
+        ThreadPool& pool;
+        size_t capacity;
+        std::mutex mutex;
+        std::condition_variable cond;
+        std::deque<T> items;
+        std::deque<SendAwaiter*> senders;
+        std::deque<ReceiveAwaiter*> receivers;
+        bool closed;
+    };
+
+    template <typename T>
+    bool Channel<T>::SendAwaiter::await_suspend(std::coroutine_handle<> handle)
+    {
+        std::lock_guard<std::mutex> lock(channel.mutex);
+
+        if(channel.closed)
+            return false;
+
+        ok = true;
+        //A suspended receiver gets the value directly
+        if(!channel.receivers.empty())
+        {
+            ReceiveAwaiter *receiver = channel.receivers.front();
+            channel.receivers.pop_front();
+            receiver->result.emplace(std::move(value));
+            channel.pool.post(receiver->waiter);
+            return false;
+        }
+        if(channel.items.size() < channel.capacity)
+        {
+            channel.items.push_back(std::move(value));
+            channel.cond.notify_one();
+            return false;
+        }
+
+        //Full: wait until a receiver takes our value
+        waiter = handle;
+        channel.senders.push_back(this);
+        return true;
+    }
+
+    template <typename T>
+    bool Channel<T>::ReceiveAwaiter::await_suspend(std::coroutine_handle<> handle)
+    {
+        std::lock_guard<std::mutex> lock(channel.mutex);
+
+        if(!channel.items.empty())
+        {
+            result.emplace(std::move(channel.items.front()));
+            channel.items.pop_front();
+            channel.takeWaitingSender();
+            return false;
+        }
+        if(channel.closed)
+            return false;
+
+        //Empty: wait until a sender hands us a value or the channel is closed
+        waiter = handle;
+        channel.receivers.push_back(this);
+        return true;
+    }
+
+    template <typename T>
+    void Channel<T>::takeWaitingSender()
+    {
+        if(senders.empty())
+            return;
+
+        SendAwaiter *sender = senders.front();
+        senders.pop_front();
+        items.push_back(std::move(sender->value));
+        pool.post(sender->waiter);
+    }
+
+    template <typename T>
+    std::optional<T> Channel<T>::receiveBlocking()
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        std::optional<T> result;
+
+        cond.wait(lock, [this] { return !items.empty() || closed; });
+        if(!items.empty())
+        {
+            result.emplace(std::move(items.front()));
+            items.pop_front();
+            takeWaitingSender();
+        }
+        return result;
+    }
+
+    template <typename T>
+    void Channel<T>::close()
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+
+        closed = true;
+        for(SendAwaiter *sender : senders)
+        {
+            sender->ok = false;
+            pool.post(sender->waiter);
+        }
+        senders.clear();
+        for(ReceiveAwaiter *receiver : receivers)
+            pool.post(receiver->waiter);
+        receivers.clear();
+        cond.notify_all();
+    }
+
+    /*
+     Stages
+     */
+
+    //Yields the packets of one stream, every other packet goes to others (if set)
+    Generator<Packet> readPackets(Demuxer& demuxer, int streamIndex, std::function<void(Packet&&)> others);
+
+    //Sends the packets of one stream into out, closes out at the end of the file
+    Task demuxStage(Demuxer& demuxer, int streamIndex, Channel<Packet>& out, std::function<void(Packet&&)> others);
+
+    //Decodes every packet from in and sends the frames into out, drains the decoder and closes out when in is closed
+    Task decodeStage(Decoder& decoder, Channel<Packet>& in, Channel<Frame>& out);
+
+    //Converts every frame from in to format at width x height and sends the copies into out
+    //Same-size YUV -> packed RGB goes through the specialised converters of convert.hpp, the rest through swscale
+    Task convertStage(Channel<Frame>& in, Channel<Frame>& out, AVPixelFormat format, int width, int height);
+
+    /*
+     A demux -> decode -> convert chain for one video stream.
+     The stages run on the pool, the caller pulls converted frames with nextFrame() on its own thread.
+     */
+    class VideoPipeline
+    {
+    public:
+        //depth: how many packets/frames each channel holds before its sender is suspended
+        VideoPipeline(ThreadPool& pool, size_t depth);
+        //Stops the stages and waits for them
+        ~VideoPipeline();
+
+        VideoPipeline(const VideoPipeline&) = delete;
+        VideoPipeline& operator=(const VideoPipeline&) = delete;
+
+        //The demuxer and decoder must stay open until the pipeline is stopped, others gets the packets of the other streams
+        void start(Demuxer& demuxer, int streamIndex, Decoder& decoder,
+                   AVPixelFormat format, int width, int height,
+                   std::function<void(Packet&&)> others);
+
+        //Next converted frame, empty at the end of the stream
+        std::optional<Frame> nextFrame();
+
+        //Closes every channel so each stage finishes, then waits for them
+        void stop();
+
+    private:
+        ThreadPool& pool;
+        Channel<Packet> packets;
+        Channel<Frame> decoded;
+        Channel<Frame> converted;
+        TaskGroup tasks;
+    };
+}
+
+#endif /* pipeline_hpp */
@@ -61,9 +61,9 @@ for library in ${libSet[@]}; do
 done
 
 if [ ${sourceFileExtension} == 'cpp' ]; then
-	g++ $libraryFileSet $objectFileSet -o output/main
+	g++ $libraryFileSet $objectFileSet -lpthread -ldl -o output/main
 else
-	gcc $libraryFileSet $objectFileSet -o output/main
+	gcc $libraryFileSet $objectFileSet -lpthread -ldl -o output/main
 fi
 
 $(rm -rf temp/)
\ No newline at end of file
@@ -0,0 +1,38 @@
+#ifndef ALLOC_STATS_H
+#define ALLOC_STATS_H
+
+#include <stdint.h>
+#include <stdio.h>
+
+typedef enum _AllocStage {
+    // 단계를 지정하지 않은 할당 (디코더 내부 스레드 포함)
+    ALLOC_STAGE_OTHER = 0,
+    ALLOC_STAGE_DEMUX,
+    ALLOC_STAGE_DECODE,
+    ALLOC_STAGE_OUTPUT,
+    ALLOC_STAGE_COUNT,
+} AllocStage;
+
+typedef struct _AllocCounters {
+    int64_t allocs[ALLOC_STAGE_COUNT];
+    int64_t bytes[ALLOC_STAGE_COUNT];
+    int64_t frees[ALLOC_STAGE_COUNT];
+} AllocCounters;
+
+// malloc 계열 함수를 가로채 셀 수 있는 환경(glibc)이면 1
+int alloc_stats_available(void);
+
+// 켜져 있는 동안만 할당을 셈 (꺼져 있으면 가로챈 함수는 바로 원래 함수를 부름)
+void alloc_stats_enable(int enable);
+
+// 현재 스레드에서 이후에 일어나는 할당을 stage로 분류, 이전 단계를 반환
+AllocStage alloc_stats_set_stage(AllocStage stage);
+
+void alloc_stats_snapshot(AllocCounters* counters);
+
+// after - before 를 frames로 나눈 프레임당 할당 수와 바이트를 단계별로 출력
+void alloc_stats_print(FILE* out, const AllocCounters* before, const AllocCounters* after, int64_t frames);
+
+const char* alloc_stage_name(AllocStage stage);
+
+#endif
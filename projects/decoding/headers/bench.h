@@ -0,0 +1,23 @@
+#ifndef BENCH_H
+#define BENCH_H
+
+#include <stdio.h>
+
+typedef struct _BenchOptions {
+    // 측정할 반복 횟수, 매 반복마다 미리 읽어둔 패킷 전체를 처음부터 디코딩
+    int iterations;
+    // 측정 전에 버리는 반복 횟수 (디코더 내부 버퍼가 자리잡도록)
+    int warmup_iterations;
+    // 디코더 내부 스레드 수 (0 = 자동)
+    int thread_count;
+    // 비디오 프레임 버퍼를 풀에서 재사용 (DecodeOptions.frame_pool)
+    int frame_pool;
+} BenchOptions;
+
+void init_bench_options(BenchOptions* opts);
+
+// 비디오 패킷을 모두 메모리에 읽어둔 뒤 디코딩 성능만 측정해 JSON으로 출력
+// 할당을 셀 수 있는 환경이면 측정 구간의 프레임당 할당 수와 바이트도 함께 출력
+int run_decode_benchmark(const char* filename, const BenchOptions* opts, FILE* out);
+
+#endif
@@ -0,0 +1,51 @@
+#ifndef DECODE_SERVICE_H
+#define DECODE_SERVICE_H
+
+#include <stdint.h>
+
+#include "memory_governor.h"
+
+typedef struct _DecodeService DecodeService;
+
+typedef struct _DecodeJobStats {
+    const char* filename;
+    int64_t frames;
+    // 제출부터 첫 작업이 실행되기까지 걸린 시간
+    double wait_sec;
+    // 제출부터 디코딩이 끝나기까지 걸린 시간
+    double latency_sec;
+    int done;
+    int failed;
+} DecodeJobStats;
+
+typedef struct _DecodeServiceStats {
+    int jobs;
+    int64_t frames;
+    // 첫 제출부터 마지막 작업 완료까지
+    double elapsed_sec;
+    double fps;
+    // 다른 워커의 큐에서 훔쳐 온 작업 수
+    int64_t steals;
+    // 메모리 예산이 모자라 거절한 제출 수
+    int refused;
+} DecodeServiceStats;
+
+// threads개의 워커가 공유하는 work-stealing 스레드 풀을 만듦
+DecodeService* decode_service_create(int threads);
+
+// 작업을 제출하기 전에 호출, 작업마다 job_bytes(디코더와 프레임 몫)를 예산에서 잡고 읽어둔 패킷도 계산에 넣음
+// 예산이 모자라면 submit이 AVERROR(EAGAIN)으로 거절함
+void decode_service_set_memory_governor(DecodeService* service, MemoryGovernor* governor, int64_t job_bytes);
+
+// 파일 하나를 디코딩하는 작업을 추가하고 작업 번호를 반환, 실패하면 음수
+int decode_service_submit(DecodeService* service, const char* filename);
+
+// 지금까지 추가된 작업이 모두 끝날 때까지 기다림
+void decode_service_wait(DecodeService* service);
+
+int decode_service_job_stats(DecodeService* service, int job_id, DecodeJobStats* stats);
+void decode_service_stats(DecodeService* service, DecodeServiceStats* stats);
+
+void decode_service_destroy(DecodeService** service);
+
+#endif
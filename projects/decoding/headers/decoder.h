@@ -0,0 +1,51 @@
+#ifndef DECODER_H
+#define DECODER_H
+
+#include <libavformat/avformat.h>
+#include <libavcodec/avcodec.h>
+
+#include "memory_governor.h"
+
+typedef enum _DecodeQuality {
+    DECODE_QUALITY_FULL = 0,
+    // lowres, 루프 필터/비참조 프레임 IDCT 생략, FLAG2_FAST 를 조합한 빠른 미리보기 화질
+    DECODE_QUALITY_PREVIEW,
+} DecodeQuality;
+
+typedef struct _DecodeOptions {
+    // 키프레임(I-frame)만 디코딩 (썸네일, 장면 인덱싱 용도)
+    int keyframe_only;
+    // 0보다 크면 키프레임을 하나 디코딩할 때마다 이 간격(초)만큼 다음 키프레임으로 탐색
+    double keyframe_interval;
+    DecodeQuality quality;
+    // 디코더 내부 스레드 수 (0 = FFmpeg가 자동으로 결정)
+    int thread_count;
+    // 비디오 프레임 버퍼를 평면 하나짜리 풀에서 재사용 (frame_pool.h)
+    int frame_pool;
+    // frame_pool을 쓸 때 풀 버퍼를 계산에 넣을 메모리 예산 (NULL 가능)
+    MemoryGovernor* memory;
+} DecodeOptions;
+
+typedef struct _FileContext {
+    AVFormatContext* fmt_ctx;
+    int v_index;
+    int a_index;
+    DecodeOptions opts;
+} FileContext;
+
+void init_decode_options(DecodeOptions* opts);
+
+int open_input(FileContext* file, const char* filename, const DecodeOptions* opts);
+void release(FileContext* file);
+
+// 디코더에 넘길 필요가 없는 패킷이면 0을 반환
+int should_decode_packet(const FileContext* file, const AVPacket* pkt);
+int decode_packet(AVCodecContext* codec_ctx, AVPacket* pkt, AVFrame** frame, int* got_frame);
+
+// 다음 비디오 프레임 하나를 디코딩 (pts는 스트림 time_base), 더 이상 없으면 AVERROR_EOF
+int read_video_frame(FileContext* file, AVFrame* frame);
+
+// pts(스트림 time_base) 이후로 interval 만큼 떨어진 다음 키프레임으로 이동
+int seek_next_keyframe(FileContext* file, int64_t pts, double interval);
+
+#endif
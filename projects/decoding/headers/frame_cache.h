@@ -0,0 +1,41 @@
+#ifndef FRAME_CACHE_H
+#define FRAME_CACHE_H
+
+#include <libavutil/frame.h>
+#include <stdint.h>
+
+#include "memory_governor.h"
+
+typedef struct _FrameCache FrameCache;
+
+typedef struct _FrameCacheStats {
+    int64_t hits;
+    int64_t misses;
+    int64_t evictions;
+    // 백그라운드 스레드가 미리 디코딩해 넣은 프레임 수
+    int64_t prefetched;
+    int frames;
+    int64_t bytes;
+    int64_t budget_bytes;
+} FrameCacheStats;
+
+// filename의 비디오 스트림을 디코딩한 프레임을 budget_bytes 만큼 보관하는 캐시를 만듦
+// prefetch_frames가 0보다 크면 요청한 위치 주변을 백그라운드 스레드에서 미리 디코딩
+// memory가 있으면 보관한 프레임을 그 예산에 계산하고, 다른 컴포넌트가 자리를 요청하면 캐시를 줄임 (NULL 가능)
+FrameCache* frame_cache_create(const char* filename, int64_t budget_bytes, int prefetch_frames, MemoryGovernor* memory);
+
+// pts(스트림 time_base)에 화면에 보이는 프레임을 frame에 참조로 넘김 (데이터 복사 없음)
+// 캐시에 없으면 앞선 키프레임부터 디코딩해서 캐시에 넣음
+int frame_cache_get(FrameCache* cache, int64_t pts, AVFrame* frame);
+
+// 비디오 스트림 시작으로부터 seconds 초에 보이는 프레임, frame_cache_get과 같음
+int frame_cache_get_at(FrameCache* cache, double seconds, AVFrame* frame);
+
+// current 바로 앞(direction < 0) 또는 바로 뒤(direction > 0) 프레임을 frame에 넘김
+int frame_cache_step(FrameCache* cache, const AVFrame* current, int direction, AVFrame* frame);
+
+void frame_cache_stats(FrameCache* cache, FrameCacheStats* stats);
+
+void frame_cache_destroy(FrameCache** cache);
+
+#endif
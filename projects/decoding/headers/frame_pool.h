@@ -0,0 +1,28 @@
+#ifndef FRAME_POOL_H
+#define FRAME_POOL_H
+
+#include <libavcodec/avcodec.h>
+#include <stdint.h>
+
+#include "memory_governor.h"
+
+typedef struct _FramePoolStats {
+    // get_buffer2 호출 수 (디코더가 요청한 프레임 버퍼 수)
+    int64_t gets;
+    // 크기나 포맷이 바뀌어 풀을 새로 만든 횟수
+    int reinits;
+    // 풀에서 처리하지 못해 FFmpeg 기본 할당으로 넘긴 수
+    int64_t fallbacks;
+} FramePoolStats;
+
+// avcodec_open2 전에 호출, 비디오 프레임의 모든 평면을 버퍼 하나에 담아 풀에서 재사용하도록 get_buffer2를 바꿈
+// 기본 할당은 평면마다 버퍼를 따로 꺼내므로 프레임당 할당(AVBuffer/AVBufferRef 래퍼)이 평면 수만큼 늘어남
+// memory가 있으면 풀이 만든 버퍼를 (풀에서 쉬고 있는 것도) 그 예산에 계산함 (NULL 가능)
+int frame_pool_attach(AVCodecContext* codec_ctx, const AVCodec* decoder, MemoryGovernor* memory);
+
+// avcodec_close 뒤에 호출, 아직 프레임이 잡고 있는 버퍼는 그 프레임이 해제될 때 함께 해제됨
+void frame_pool_detach(AVCodecContext* codec_ctx);
+
+int frame_pool_stats(const AVCodecContext* codec_ctx, FramePoolStats* stats);
+
+#endif
@@ -0,0 +1,40 @@
+#ifndef FRAMEHASH_H
+#define FRAMEHASH_H
+
+#include <libavformat/avformat.h>
+#include <libavcodec/avcodec.h>
+#include <stdio.h>
+
+#include "decoder.h"
+
+#define FRAME_HASH_MAX_PLANES AV_NUM_DATA_POINTERS
+
+typedef enum _FrameHashType {
+    // 평면마다 XXH3-64, 디코더 업그레이드 회귀 비교용으로 빠름
+    FRAME_HASH_XXH3 = 0,
+    // ffmpeg -f framemd5 와 같은 형식 (평면을 패딩 없이 이어붙인 데이터의 MD5)
+    FRAME_HASH_MD5,
+} FrameHashType;
+
+typedef struct _FrameHashContext {
+    FrameHashType type;
+    FILE* out;
+    const FileContext* file;
+    struct AVMD5* md5;
+    int64_t frames;
+    // 해시한 바이트 수와 해시에 쓴 시간 (디코딩 시간과 비교하기 위함)
+    int64_t bytes;
+    int64_t hash_time_us;
+} FrameHashContext;
+
+// 헤더(#format, #tb, #dimensions ...)를 out에 출력
+int init_frame_hash(FrameHashContext* ctx, FrameHashType type, const FileContext* file, FILE* out);
+void release_frame_hash(FrameHashContext* ctx);
+
+// 프레임 하나의 해시 줄을 출력, frame의 타임스탬프는 time_base 기준
+int write_frame_hash(FrameHashContext* ctx, int stream_index, const AVFrame* frame, AVRational time_base);
+
+// 각 평면을 행 단위로 해시하므로 linesize 패딩은 포함되지 않음, 평면 수를 반환
+int hash_frame_planes(const AVFrame* frame, enum AVMediaType type, uint64_t hashes[FRAME_HASH_MAX_PLANES]);
+
+#endif
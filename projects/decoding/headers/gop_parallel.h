@@ -0,0 +1,34 @@
+#ifndef GOP_PARALLEL_H
+#define GOP_PARALLEL_H
+
+#include <libavutil/frame.h>
+
+#include "memory_governor.h"
+
+// 디코딩된 프레임을 pts 순서대로 넘겨받는 함수, frame은 호출이 끝나면 해제됨
+typedef void (*GopFrameCallback)(AVFrame* frame, void* opaque);
+
+typedef struct _GopParallelOptions {
+    // GOP 하나씩 맡아 디코딩할 워커(디코더 인스턴스) 수
+    int threads;
+    // 재정렬 버퍼에 동시에 담아둘 수 있는 GOP 수, 메모리 사용량의 상한이 됨
+    int max_buffered_gops;
+    // 재정렬 버퍼의 프레임을 이 예산에 계산하고, 예산이 모자라면 앞선 GOP가 내보내질 때까지 디코딩을 미룸 (NULL 가능)
+    MemoryGovernor* memory;
+} GopParallelOptions;
+
+typedef struct _GopParallelStats {
+    int gops;
+    int frames;
+    // 파일 첫 GOP가 open GOP일 때처럼 참조할 이전 GOP가 없어 버려진 leading 프레임 수
+    int dropped_frames;
+    double elapsed_sec;
+} GopParallelStats;
+
+void init_gop_parallel_options(GopParallelOptions* opts);
+
+// 파일을 키프레임 단위로 나누어 여러 디코더에서 동시에 디코딩하고, 프레임은 순서대로 callback에 넘김
+int decode_gop_parallel(const char* filename, const GopParallelOptions* opts,
+                        GopFrameCallback callback, void* opaque, GopParallelStats* stats);
+
+#endif
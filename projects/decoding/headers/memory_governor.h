@@ -0,0 +1,73 @@
+#ifndef MEMORY_GOVERNOR_H
+#define MEMORY_GOVERNOR_H
+
+#include <libavutil/frame.h>
+#include <stdint.h>
+#include <stdio.h>
+
+// 프로세스 안의 여러 파이프라인(캐시, GOP 버퍼, 프레임 풀, 디코딩 서비스)이 나눠 쓰는 메모리 예산
+// 각 모듈은 컴포넌트로 등록해 잡고 있는 바이트를 알리고, 예산이 모자라면
+// 기다리거나(backpressure), 캐시를 줄이게 하거나, 새 작업을 거절함
+typedef struct _MemoryGovernor MemoryGovernor;
+typedef struct _MemoryComponent MemoryComponent;
+
+// 다른 컴포넌트에 자리가 필요할 때 호출됨, bytes 만큼 (가능하면) 해제하고 실제로 해제한 바이트를 반환
+// governor의 잠금 없이 호출되므로 콜백 안에서 memory_release를 불러도 됨
+typedef int64_t (*MemoryShrinkCallback)(void* opaque, int64_t bytes);
+
+#define MEMORY_NAME_SIZE 32
+
+typedef struct _MemoryUsage {
+    char name[MEMORY_NAME_SIZE];
+    int64_t bytes;
+    int64_t peak_bytes;
+} MemoryUsage;
+
+typedef struct _MemoryGovernorStats {
+    int64_t budget_bytes;
+    int64_t bytes;
+    int64_t peak_bytes;
+    // 예산이 모자라 memory_wait_for_room에서 기다린 횟수
+    int64_t waits;
+    // 다른 컴포넌트의 요청으로 캐시를 줄여 확보한 바이트
+    int64_t shrunk_bytes;
+    // memory_try_charge가 거절한 횟수
+    int64_t refused;
+} MemoryGovernorStats;
+
+MemoryGovernor* memory_governor_create(int64_t budget_bytes);
+
+// 등록된 컴포넌트가 남아있으면 안 됨
+void memory_governor_destroy(MemoryGovernor** governor);
+
+// name은 사용량 보고에 쓰임, 줄일 수 없는 컴포넌트는 shrink에 NULL
+// governor가 NULL이면 NULL을 반환하고, 아래 함수들은 컴포넌트가 NULL이면 아무 일도 하지 않음
+MemoryComponent* memory_register(MemoryGovernor* governor, const char* name, MemoryShrinkCallback shrink, void* opaque);
+
+// 아직 잡고 있는 바이트는 사용량에서 빠짐, 반환된 뒤에는 shrink 콜백이 더 이상 호출되지 않음
+void memory_unregister(MemoryComponent** component);
+
+void memory_charge(MemoryComponent* component, int64_t bytes);
+void memory_release(MemoryComponent* component, int64_t bytes);
+
+// 예산 안에서 bytes를 더 쓸 수 있으면 (필요하면 다른 컴포넌트를 줄여서) 계산에 넣고 0, 아니면 AVERROR(EAGAIN)
+int memory_try_charge(MemoryComponent* component, int64_t bytes);
+
+// 전체 사용량이 예산을 넘었으면 1
+int memory_over_budget(const MemoryComponent* component);
+
+// bytes가 들어갈 자리가 생길 때까지 다른 컴포넌트를 줄이고 기다림, 계산에 넣지는 않음
+// 이 컴포넌트가 아무것도 잡고 있지 않으면 바로 0을 반환 (예산은 넘을 수 있지만 멈추지는 않음)
+// timeout_ms가 지나도 자리가 없으면 AVERROR(EAGAIN), 음수면 무한히 기다림
+// 자기 잠금을 잡은 채로 부르면 shrink 콜백과 교착될 수 있음
+int memory_wait_for_room(MemoryComponent* component, int64_t bytes, int timeout_ms);
+
+// 컴포넌트별 현재 사용량을 usage에 최대 max 개까지 채우고 등록된 컴포넌트 수를 반환
+int memory_governor_usage(MemoryGovernor* governor, MemoryUsage* usage, int max);
+void memory_governor_stats(MemoryGovernor* governor, MemoryGovernorStats* stats);
+void memory_governor_print(FILE* out, MemoryGovernor* governor);
+
+// 프레임이 참조하는 버퍼 크기의 합 (다른 프레임과 공유하는 버퍼도 포함)
+int64_t memory_frame_bytes(const AVFrame* frame);
+
+#endif
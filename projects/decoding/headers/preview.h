@@ -0,0 +1,20 @@
+#ifndef PREVIEW_H
+#define PREVIEW_H
+
+typedef struct _PreviewReport {
+    int frames;
+    int lowres;
+    double full_decode_sec;
+    double preview_decode_sec;
+    // full_decode_sec / preview_decode_sec
+    double speedup;
+    // 미리보기 해상도로 줄인 원본 프레임 대비 luma PSNR (dB)
+    double psnr_avg;
+    double psnr_min;
+} PreviewReport;
+
+// 같은 파일을 원본 화질과 미리보기 화질로 나란히 디코딩해 속도와 화질 차이를 측정
+// max_frames가 0 이하이면 파일 끝까지 비교
+int measure_preview_quality(const char* filename, int max_frames, PreviewReport* report);
+
+#endif
@@ -0,0 +1,35 @@
+#ifndef REVERSE_H
+#define REVERSE_H
+
+#include "gop_parallel.h"
+#include "memory_governor.h"
+
+typedef struct _ReverseOptions {
+    // 비디오 스트림 시작으로부터 이 시각(초)부터 거꾸로 재생, 0보다 작으면 파일 끝에서부터
+    double start_seconds;
+    // GOP 하나에서 보관할 최대 프레임 수, 메모리 사용량은 이 값의 두 배(내보내는 GOP + 미리 읽는 GOP)로 제한됨
+    // GOP가 이보다 길면 뒤쪽부터 나누어 같은 키프레임에서 다시 디코딩
+    int max_gop_frames;
+    // 보관 중인 프레임을 이 예산에 계산하고, 예산이 모자라면 다음 GOP를 미리 디코딩하지 않고 기다림 (NULL 가능)
+    MemoryGovernor* memory;
+} ReverseOptions;
+
+typedef struct _ReverseStats {
+    int gops;
+    int frames;
+    // max_gop_frames를 넘어 나누어 다시 디코딩한 횟수
+    int redecoded_gops;
+    // 디코딩 시간이 그 GOP의 재생 시간보다 길었던 GOP 수 (실시간 역재생이 끊기는 지점)
+    int slow_gops;
+    double max_gop_decode_sec;
+    double elapsed_sec;
+} ReverseStats;
+
+void init_reverse_options(ReverseOptions* opts);
+
+// 키프레임 단위로 GOP 하나씩 디코딩해 프레임을 pts 역순으로 callback에 넘김
+// 다음(더 앞선) GOP는 다른 스레드가 동시에 디코딩해 둠
+int decode_reverse(const char* filename, const ReverseOptions* opts,
+                   GopFrameCallback callback, void* opaque, ReverseStats* stats);
+
+#endif
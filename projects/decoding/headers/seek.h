@@ -0,0 +1,33 @@
+#ifndef SEEK_H
+#define SEEK_H
+
+#include <libavformat/avformat.h>
+#include <libavutil/frame.h>
+
+#include "decoder.h"
+
+typedef struct _SeekStats {
+    // 요청한 위치와 실제로 돌려준 프레임의 pts (스트림 time_base)
+    int64_t target_pts;
+    int64_t frame_pts;
+    // 키프레임부터 목표 프레임 전까지 디코딩해서 버린 프레임 수
+    int preroll_frames;
+    // 목표보다 먼저 끝나서 비참조 프레임이면 디코딩을 생략하도록 넘긴 패킷 수
+    int skipped_packets;
+    int decoded_packets;
+    double seek_sec;
+    double decode_sec;
+    double total_sec;
+} SeekStats;
+
+// 스트림 시작으로부터 seconds 초인 위치를 스트림 time_base의 pts로 바꿈
+int64_t seconds_to_pts(const AVStream* stream, double seconds);
+
+// 비디오 스트림 시작으로부터 seconds 초에 화면에 보이는 프레임을 frame에 디코딩
+// 앞선 키프레임으로 탐색한 뒤 목표까지 디코딩하며, 중간 프레임은 변환 없이 바로 버림
+int seek_frame_at(FileContext* file, double seconds, AVFrame* frame, SeekStats* stats);
+
+// target_pts(스트림 time_base) 이하에서 가장 늦은 프레임을 frame에 디코딩
+int seek_frame_at_pts(FileContext* file, int64_t target_pts, AVFrame* frame, SeekStats* stats);
+
+#endif
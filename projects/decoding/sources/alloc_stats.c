@@ -0,0 +1,177 @@
+#define _GNU_SOURCE
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "alloc_stats.h"
+
+static AllocCounters totals;
+static int accounting = 0;
+static __thread AllocStage current_stage = ALLOC_STAGE_OTHER;
+
+static const char* stage_names[ALLOC_STAGE_COUNT] = {
+    "other",
+    "demux",
+    "decode",
+    "output",
+};
+
+#if defined(__GLIBC__)
+#include <dlfcn.h>
+
+// 프로그램 안에 malloc 계열 함수를 정의하면 libavcodec/libavformat/libavutil의 할당도 모두 이쪽으로 옴
+// (av_malloc은 posix_memalign을 씀) 실제 할당은 dlsym(RTLD_NEXT)로 찾은 libc 함수에 넘김
+static void* (*real_malloc)(size_t);
+static void* (*real_calloc)(size_t, size_t);
+static void* (*real_realloc)(void*, size_t);
+static int (*real_posix_memalign)(void**, size_t, size_t);
+static void (*real_free)(void*);
+static int resolving = 0;
+
+// dlsym이 내부에서 calloc을 부르므로 libc 함수를 찾는 동안에는 이 정적 영역에서 나누어 줌
+static char bootstrap_heap[8192] __attribute__((aligned(16)));
+static size_t bootstrap_used = 0;
+
+static void* bootstrap_alloc(size_t size) {
+    void* ptr;
+
+    size = (size + 15) & ~(size_t)15;
+    if (bootstrap_used + size > sizeof(bootstrap_heap)) {
+        return NULL;
+    }
+    ptr = bootstrap_heap + bootstrap_used;
+    bootstrap_used += size;
+    return ptr;
+}
+
+static int from_bootstrap(const void* ptr) {
+    return (const char*)ptr >= bootstrap_heap && (const char*)ptr < bootstrap_heap + sizeof(bootstrap_heap);
+}
+
+// 첫 할당은 프로그램 시작 중 (스레드가 하나일 때) 일어나므로 잠금 없이 한 번만 찾음
+static void resolve(void) {
+    if (real_malloc != NULL || resolving) {
+        return;
+    }
+    resolving = 1;
+    real_calloc = (void* (*)(size_t, size_t))dlsym(RTLD_NEXT, "calloc");
+    real_realloc = (void* (*)(void*, size_t))dlsym(RTLD_NEXT, "realloc");
+    real_posix_memalign = (int (*)(void**, size_t, size_t))dlsym(RTLD_NEXT, "posix_memalign");
+    real_free = (void (*)(void*))dlsym(RTLD_NEXT, "free");
+    real_malloc = (void* (*)(size_t))dlsym(RTLD_NEXT, "malloc");
+    resolving = 0;
+}
+
+static void count_alloc(size_t size) {
+    if (accounting) {
+        AllocStage stage = current_stage;
+        __atomic_fetch_add(&totals.allocs[stage], 1, __ATOMIC_RELAXED);
+        __atomic_fetch_add(&totals.bytes[stage], (int64_t)size, __ATOMIC_RELAXED);
+    }
+}
+
+static void count_free(void) {
+    if (accounting) {
+        __atomic_fetch_add(&totals.frees[current_stage], 1, __ATOMIC_RELAXED);
+    }
+}
+
+void* malloc(size_t size) {
+    resolve();
+    if (real_malloc == NULL) {
+        return bootstrap_alloc(size);
+    }
+    count_alloc(size);
+    return real_malloc(size);
+}
+
+void* calloc(size_t count, size_t size) {
+    resolve();
+    if (real_calloc == NULL) {
+        // 정적 영역은 처음부터 0으로 채워져 있음
+        return size && count > SIZE_MAX / size ? NULL : bootstrap_alloc(count * size);
+    }
+    count_alloc(count * size);
+    return real_calloc(count, size);
+}
+
+void* realloc(void* ptr, size_t size) {
+    resolve();
+    if (from_bootstrap(ptr)) {
+        size_t available = bootstrap_heap + sizeof(bootstrap_heap) - (char*)ptr;
+        void* moved = malloc(size);
+        if (moved != NULL) {
+            memcpy(moved, ptr, size < available ? size : available);
+        }
+        return moved;
+    }
+    if (ptr != NULL) {
+        count_free();
+    }
+    count_alloc(size);
+    return real_realloc(ptr, size);
+}
+
+int posix_memalign(void** ptr, size_t alignment, size_t size) {
+    resolve();
+    count_alloc(size);
+    return real_posix_memalign(ptr, alignment, size);
+}
+
+void free(void* ptr) {
+    if (ptr == NULL || from_bootstrap(ptr)) {
+        return;
+    }
+    resolve();
+    count_free();
+    real_free(ptr);
+}
+
+int alloc_stats_available(void) {
+    return 1;
+}
+#else
+int alloc_stats_available(void) {
+    return 0;
+}
+#endif
+
+void alloc_stats_enable(int enable) {
+    __atomic_store_n(&accounting, enable, __ATOMIC_RELAXED);
+}
+
+AllocStage alloc_stats_set_stage(AllocStage stage) {
+    AllocStage previous = current_stage;
+
+    current_stage = stage;
+    return previous;
+}
+
+void alloc_stats_snapshot(AllocCounters* counters) {
+    int stage;
+
+    for (stage = 0; stage < ALLOC_STAGE_COUNT; stage++) {
+        counters->allocs[stage] = __atomic_load_n(&totals.allocs[stage], __ATOMIC_RELAXED);
+        counters->bytes[stage] = __atomic_load_n(&totals.bytes[stage], __ATOMIC_RELAXED);
+        counters->frees[stage] = __atomic_load_n(&totals.frees[stage], __ATOMIC_RELAXED);
+    }
+}
+
+void alloc_stats_print(FILE* out, const AllocCounters* before, const AllocCounters* after, int64_t frames) {
+    double per_frame = frames > 0 ? 1.0 / frames : 0.0;
+    int stage;
+
+    fprintf(out, "%-8s %12s %12s %14s %16s\n", "stage", "allocs", "frees", "allocs/frame", "bytes/frame");
+    for (stage = 0; stage < ALLOC_STAGE_COUNT; stage++) {
+        int64_t allocs = after->allocs[stage] - before->allocs[stage];
+        int64_t frees = after->frees[stage] - before->frees[stage];
+        int64_t bytes = after->bytes[stage] - before->bytes[stage];
+
+        fprintf(out, "%-8s %12lld %12lld %14.2f %16.1f\n", stage_names[stage], (long long)allocs,
+                (long long)frees, allocs * per_frame, bytes * per_frame);
+    }
+}
+
+const char* alloc_stage_name(AllocStage stage) {
+    return stage >= 0 && stage < ALLOC_STAGE_COUNT ? stage_names[stage] : "unknown";
+}
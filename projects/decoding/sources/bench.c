@@ -0,0 +1,265 @@
+#include <libavformat/avformat.h>
+#include <libavcodec/avcodec.h>
+#include <libavutil/avutil.h>
+#include <libavutil/imgutils.h>
+#include <libavutil/pixdesc.h>
+#include <libavutil/time.h>
+#include <sys/resource.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "decoder.h"
+#include "bench.h"
+#include "alloc_stats.h"
+#include "frame_pool.h"
+
+typedef struct _BenchResult {
+    int64_t* latencies;
+    int nb_latencies;
+    int latency_capacity;
+    int64_t frames;
+    int64_t output_bytes;
+    // 측정 구간(워밍업 이후) 동안의 할당
+    AllocCounters allocs_before;
+    AllocCounters allocs_after;
+} BenchResult;
+
+void init_bench_options(BenchOptions* opts) {
+    opts->iterations = 10;
+    opts->warmup_iterations = 1;
+    opts->thread_count = 0;
+    opts->frame_pool = 0;
+}
+
+// 사용자 + 시스템 CPU 시간(마이크로초), 디코더 스레드가 쓴 시간도 포함됨
+static int64_t cpu_time_us(void) {
+    struct rusage usage;
+
+    getrusage(RUSAGE_SELF, &usage);
+    return (int64_t)(usage.ru_utime.tv_sec + usage.ru_stime.tv_sec) * 1000000 +
+           usage.ru_utime.tv_usec + usage.ru_stime.tv_usec;
+}
+
+static int compare_int64(const void* a, const void* b) {
+    int64_t x = *(const int64_t*)a;
+    int64_t y = *(const int64_t*)b;
+    return (x > y) - (x < y);
+}
+
+static int64_t percentile(const int64_t* sorted, int count, double p) {
+    int index;
+
+    if (count == 0) {
+        return 0;
+    }
+    index = (int)(p / 100.0 * (count - 1) + 0.5);
+    return sorted[FFMIN(index, count - 1)];
+}
+
+static void record_frame(BenchResult* result, const AVFrame* frame, int64_t latency) {
+    if (result == NULL) {
+        return;
+    }
+    if (result->nb_latencies < result->latency_capacity) {
+        result->latencies[result->nb_latencies++] = latency;
+    }
+    result->frames++;
+    result->output_bytes += av_image_get_buffer_size(frame->format, frame->width, frame->height, 1);
+}
+
+// 미리 읽어둔 패킷을 처음부터 끝까지 한 번 디코딩, result가 NULL이면 측정하지 않음
+static int decode_iteration(AVCodecContext* codec_ctx, AVPacket* packets, int nb_packets,
+                            AVFrame* frame, BenchResult* result) {
+    AVPacket flush_pkt;
+    AllocStage stage;
+    int got_frame;
+    int64_t start;
+    int i;
+
+    // 패킷과 프레임은 반복마다 같은 것을 다시 쓰므로 이 구간의 할당은 모두 디코더 안에서 일어난 것
+    stage = alloc_stats_set_stage(ALLOC_STAGE_DECODE);
+    avcodec_flush_buffers(codec_ctx);
+
+    for (i = 0; i < nb_packets; i++) {
+        got_frame = 0;
+        start = av_gettime_relative();
+        if (decode_packet(codec_ctx, &packets[i], &frame, &got_frame) < 0) {
+            continue;
+        }
+        if (got_frame) {
+            record_frame(result, frame, av_gettime_relative() - start);
+            av_frame_unref(frame);
+        }
+    }
+
+    av_init_packet(&flush_pkt);
+    flush_pkt.data = NULL;
+    flush_pkt.size = 0;
+    do {
+        got_frame = 0;
+        start = av_gettime_relative();
+        if (decode_packet(codec_ctx, &flush_pkt, &frame, &got_frame) < 0) {
+            break;
+        }
+        if (got_frame) {
+            record_frame(result, frame, av_gettime_relative() - start);
+            av_frame_unref(frame);
+        }
+    } while (got_frame);
+
+    alloc_stats_set_stage(stage);
+    return 0;
+}
+
+static void print_json_string(FILE* out, const char* str) {
+    fputc('"', out);
+    for (; *str; str++) {
+        if (*str == '"' || *str == '\\') {
+            fprintf(out, "\\%c", *str);
+        } else if ((unsigned char)*str < 0x20) {
+            fprintf(out, "\\u%04x", (unsigned char)*str);
+        } else {
+            fputc(*str, out);
+        }
+    }
+    fputc('"', out);
+}
+
+// 프레임당 할당 수와 바이트, 디코더 내부 스레드에서 일어난 할당은 "other"로 분류됨
+static void print_alloc_json(FILE* out, const BenchResult* result) {
+    double per_frame = result->frames > 0 ? 1.0 / result->frames : 0.0;
+    int64_t allocs = 0, bytes = 0;
+    int stage;
+
+    for (stage = 0; stage < ALLOC_STAGE_COUNT; stage++) {
+        allocs += result->allocs_after.allocs[stage] - result->allocs_before.allocs[stage];
+        bytes += result->allocs_after.bytes[stage] - result->allocs_before.bytes[stage];
+    }
+    fprintf(out, "  \"allocs_per_frame\": %.3f,\n", allocs * per_frame);
+    fprintf(out, "  \"alloc_bytes_per_frame\": %.1f,\n", bytes * per_frame);
+    fprintf(out, "  \"allocs_per_frame_by_stage\": {");
+    for (stage = 0; stage < ALLOC_STAGE_COUNT; stage++) {
+        fprintf(out, "%s\"%s\": %.3f", stage ? ", " : "", alloc_stage_name(stage),
+                (result->allocs_after.allocs[stage] - result->allocs_before.allocs[stage]) * per_frame);
+    }
+    fprintf(out, "},\n");
+}
+
+int run_decode_benchmark(const char* filename, const BenchOptions* opts, FILE* out) {
+    FileContext file;
+    DecodeOptions decode_opts;
+    AVCodecContext* codec_ctx;
+    AVPacket* packets = NULL;
+    AVPacket pkt;
+    AVFrame* frame = NULL;
+    BenchResult result;
+    int nb_packets = 0, packet_capacity = 0;
+    int64_t input_bytes = 0;
+    int64_t wall_start, wall_time, cpu_start, cpu_time;
+    FramePoolStats pool_stats;
+    unsigned version = avcodec_version();
+    int ret = 0;
+    int i;
+
+    memset(&result, 0, sizeof(result));
+
+    init_decode_options(&decode_opts);
+    decode_opts.thread_count = opts->thread_count;
+    decode_opts.frame_pool = opts->frame_pool;
+    if (open_input(&file, filename, &decode_opts) < 0 || file.v_index < 0) {
+        release(&file);
+        return -1;
+    }
+    codec_ctx = file.fmt_ctx->streams[file.v_index]->codec;
+
+    // 파일 I/O와 디먹싱 비용을 빼기 위해 비디오 패킷을 모두 메모리에 올려둠
+    while (av_read_frame(file.fmt_ctx, &pkt) >= 0) {
+        if (pkt.stream_index != file.v_index) {
+            av_free_packet(&pkt);
+            continue;
+        }
+        if (nb_packets == packet_capacity) {
+            packet_capacity = packet_capacity ? packet_capacity * 2 : 256;
+            if (av_reallocp_array(&packets, packet_capacity, sizeof(AVPacket)) < 0) {
+                av_free_packet(&pkt);
+                nb_packets = 0;
+                ret = -2;
+                goto end;
+            }
+        }
+        input_bytes += pkt.size;
+        av_packet_move_ref(&packets[nb_packets++], &pkt);
+    }
+
+    frame = av_frame_alloc();
+    result.latency_capacity = FFMAX(nb_packets + 64, 1) * opts->iterations;
+    result.latencies = av_malloc_array(result.latency_capacity, sizeof(int64_t));
+    if (frame == NULL || result.latencies == NULL) {
+        ret = -3;
+        goto end;
+    }
+
+    for (i = 0; i < opts->warmup_iterations; i++) {
+        decode_iteration(codec_ctx, packets, nb_packets, frame, NULL);
+    }
+
+    // 워밍업에서 디코더 내부 버퍼와 프레임 풀이 자리잡은 뒤의 할당만 셈
+    alloc_stats_enable(1);
+    alloc_stats_snapshot(&result.allocs_before);
+    wall_start = av_gettime_relative();
+    cpu_start = cpu_time_us();
+    for (i = 0; i < opts->iterations; i++) {
+        decode_iteration(codec_ctx, packets, nb_packets, frame, &result);
+    }
+    wall_time = av_gettime_relative() - wall_start;
+    cpu_time = cpu_time_us() - cpu_start;
+    alloc_stats_snapshot(&result.allocs_after);
+    alloc_stats_enable(0);
+
+    qsort(result.latencies, result.nb_latencies, sizeof(int64_t), compare_int64);
+
+    fprintf(out, "{\n");
+    fprintf(out, "  \"file\": ");
+    print_json_string(out, filename);
+    fprintf(out, ",\n");
+    fprintf(out, "  \"codec\": \"%s\",\n", codec_ctx->codec->name);
+    fprintf(out, "  \"width\": %d,\n", codec_ctx->width);
+    fprintf(out, "  \"height\": %d,\n", codec_ctx->height);
+    fprintf(out, "  \"pix_fmt\": \"%s\",\n", av_get_pix_fmt_name(codec_ctx->pix_fmt) ? av_get_pix_fmt_name(codec_ctx->pix_fmt) : "none");
+    fprintf(out, "  \"threads\": %d,\n", codec_ctx->thread_count);
+    fprintf(out, "  \"libavcodec\": \"%u.%u.%u\",\n", AV_VERSION_MAJOR(version), AV_VERSION_MINOR(version), AV_VERSION_MICRO(version));
+    fprintf(out, "  \"configuration\": ");
+    print_json_string(out, avcodec_configuration());
+    fprintf(out, ",\n");
+    fprintf(out, "  \"iterations\": %d,\n", opts->iterations);
+    fprintf(out, "  \"packets\": %d,\n", nb_packets);
+    fprintf(out, "  \"input_bytes\": %lld,\n", (long long)input_bytes);
+    fprintf(out, "  \"frames\": %lld,\n", (long long)result.frames);
+    fprintf(out, "  \"wall_sec\": %.6f,\n", wall_time / 1000000.0);
+    fprintf(out, "  \"cpu_sec\": %.6f,\n", cpu_time / 1000000.0);
+    fprintf(out, "  \"fps\": %.3f,\n", wall_time > 0 ? result.frames * 1000000.0 / wall_time : 0.0);
+    fprintf(out, "  \"output_mb_per_sec\": %.3f,\n", wall_time > 0 ? result.output_bytes / (double)wall_time : 0.0);
+    fprintf(out, "  \"cpu_us_per_frame\": %.3f,\n", result.frames > 0 ? (double)cpu_time / result.frames : 0.0);
+    fprintf(out, "  \"frame_pool\": %s,\n", frame_pool_stats(codec_ctx, &pool_stats) == 0 ? "true" : "false");
+    if (alloc_stats_available()) {
+        print_alloc_json(out, &result);
+    }
+    fprintf(out, "  \"latency_us\": {\"p50\": %lld, \"p90\": %lld, \"p99\": %lld, \"max\": %lld}\n",
+            (long long)percentile(result.latencies, result.nb_latencies, 50),
+            (long long)percentile(result.latencies, result.nb_latencies, 90),
+            (long long)percentile(result.latencies, result.nb_latencies, 99),
+            (long long)(result.nb_latencies > 0 ? result.latencies[result.nb_latencies - 1] : 0));
+    fprintf(out, "}\n");
+
+end:
+    for (i = 0; i < nb_packets; i++) {
+        av_free_packet(&packets[i]);
+    }
+    av_free(packets);
+    av_free(result.latencies);
+    av_frame_free(&frame);
+    release(&file);
+
+    return ret;
+}
@@ -0,0 +1,528 @@
+#include <libavformat/avformat.h>
+#include <libavcodec/avcodec.h>
+#include <libavutil/avstring.h>
+#include <libavutil/avutil.h>
+#include <libavutil/time.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "decoder.h"
+#include "decode_service.h"
+#include "memory_governor.h"
+
+// 디먹스 작업 하나가 읽어오는 최대 패킷 수, 긴 파일도 이 단위로 끊어서 다른 작업과 번갈아 실행됨
+#define DEMUX_BATCH 32
+
+typedef enum _TaskKind {
+    TASK_DEMUX,
+    TASK_DECODE,
+} TaskKind;
+
+typedef struct _DecodeJob {
+    char* filename;
+    FileContext file;
+    int opened;
+    AVFrame* frame;
+    AVPacket packets[DEMUX_BATCH];
+    int nb_packets;
+    // 쌓아둔 패킷의 크기 합과 제출할 때 잡아둔 디코더 몫, 작업이 끝나면 한꺼번에 돌려줌
+    int64_t packet_bytes;
+    int64_t reserved_bytes;
+    MemoryComponent* memory;
+    int eof;
+    // 작업은 한 번에 하나만 큐에 들어가므로 같은 파일의 디먹스와 디코딩은 겹치지 않음
+    TaskKind next_task;
+    int64_t frames;
+    int64_t submit_time;
+    int64_t start_time;
+    int64_t end_time;
+    int done;
+    int failed;
+} DecodeJob;
+
+// 워커마다 하나씩 갖는 작업 큐 (원형 버퍼)
+// 주인 워커는 앞에서 꺼내고 새 작업은 뒤에 넣으며, 다른 워커는 뒤에서 훔쳐 감
+typedef struct _TaskQueue {
+    DecodeJob** tasks;
+    int capacity;
+    int head;
+    int count;
+    pthread_mutex_t mutex;
+} TaskQueue;
+
+typedef struct _Worker {
+    DecodeService* service;
+    TaskQueue queue;
+    pthread_t thread;
+    int index;
+    int started;
+} Worker;
+
+struct _DecodeService {
+    Worker* workers;
+    int nb_workers;
+    DecodeJob** jobs;
+    int nb_jobs;
+    // 새로 제출된 작업을 넣을 워커 (라운드 로빈)
+    int next_worker;
+    // 모든 큐에 들어있는 작업 수
+    int pending;
+    int running_jobs;
+    int shutdown;
+    int64_t steals;
+    MemoryComponent* memory;
+    int64_t job_bytes;
+    int refused;
+    int64_t first_submit;
+    int64_t last_done;
+    pthread_mutex_t mutex;
+    pthread_cond_t task_ready;
+    pthread_cond_t job_done;
+};
+
+static int queue_push(TaskQueue* queue, DecodeJob* job) {
+    pthread_mutex_lock(&queue->mutex);
+    if (queue->count == queue->capacity) {
+        int capacity = queue->capacity ? queue->capacity * 2 : 16;
+        DecodeJob** tasks = av_malloc_array(capacity, sizeof(DecodeJob*));
+        int i;
+
+        if (tasks == NULL) {
+            pthread_mutex_unlock(&queue->mutex);
+            return AVERROR(ENOMEM);
+        }
+        for (i = 0; i < queue->count; i++) {
+            tasks[i] = queue->tasks[(queue->head + i) % queue->capacity];
+        }
+        av_free(queue->tasks);
+        queue->tasks = tasks;
+        queue->capacity = capacity;
+        queue->head = 0;
+    }
+    queue->tasks[(queue->head + queue->count) % queue->capacity] = job;
+    queue->count++;
+    pthread_mutex_unlock(&queue->mutex);
+    return 0;
+}
+
+static DecodeJob* queue_pop_head(TaskQueue* queue) {
+    DecodeJob* job = NULL;
+
+    pthread_mutex_lock(&queue->mutex);
+    if (queue->count > 0) {
+        job = queue->tasks[queue->head];
+        queue->head = (queue->head + 1) % queue->capacity;
+        queue->count--;
+    }
+    pthread_mutex_unlock(&queue->mutex);
+    return job;
+}
+
+static DecodeJob* queue_pop_tail(TaskQueue* queue) {
+    DecodeJob* job = NULL;
+
+    pthread_mutex_lock(&queue->mutex);
+    if (queue->count > 0) {
+        queue->count--;
+        job = queue->tasks[(queue->head + queue->count) % queue->capacity];
+    }
+    pthread_mutex_unlock(&queue->mutex);
+    return job;
+}
+
+// 큐에 넣은 뒤에는 다른 워커가 바로 실행할 수 있으므로 job에 접근하면 안 됨
+static int schedule(Worker* worker, DecodeJob* job) {
+    DecodeService* service = worker->service;
+
+    if (queue_push(&worker->queue, job) < 0) {
+        return AVERROR(ENOMEM);
+    }
+
+    pthread_mutex_lock(&service->mutex);
+    service->pending++;
+    pthread_cond_signal(&service->task_ready);
+    pthread_mutex_unlock(&service->mutex);
+    return 0;
+}
+
+static DecodeJob* steal_task(Worker* self) {
+    DecodeService* service = self->service;
+    int i;
+
+    for (i = 1; i < service->nb_workers; i++) {
+        Worker* victim = &service->workers[(self->index + i) % service->nb_workers];
+        DecodeJob* job = queue_pop_tail(&victim->queue);
+        if (job != NULL) {
+            pthread_mutex_lock(&service->mutex);
+            service->steals++;
+            pthread_mutex_unlock(&service->mutex);
+            return job;
+        }
+    }
+    return NULL;
+}
+
+static void finish_job(DecodeService* service, DecodeJob* job) {
+    int i;
+
+    for (i = 0; i < job->nb_packets; i++) {
+        av_free_packet(&job->packets[i]);
+    }
+    job->nb_packets = 0;
+    av_frame_free(&job->frame);
+    release(&job->file);
+    memory_release(job->memory, job->packet_bytes + job->reserved_bytes);
+    job->packet_bytes = job->reserved_bytes = 0;
+
+    pthread_mutex_lock(&service->mutex);
+    job->end_time = av_gettime_relative();
+    job->done = 1;
+    service->running_jobs--;
+    service->last_done = job->end_time;
+    pthread_cond_broadcast(&service->job_done);
+    pthread_mutex_unlock(&service->mutex);
+}
+
+// 패킷을 최대 DEMUX_BATCH개 읽어 작업에 쌓아둠
+// 전체 메모리 예산을 넘었으면 패킷 하나만 읽고 넘겨 다른 작업이 디코딩해 메모리를 풀 시간을 줌
+static int run_demux(DecodeJob* job) {
+    AVPacket pkt;
+
+    if (!job->opened) {
+        DecodeOptions opts;
+
+        // 파일 여러 개를 동시에 디코딩하므로 디코더 하나는 스레드 하나만 사용
+        init_decode_options(&opts);
+        opts.thread_count = 1;
+        job->opened = 1;
+        if (open_input(&job->file, job->filename, &opts) < 0) {
+            return -1;
+        }
+        job->frame = av_frame_alloc();
+        if (job->frame == NULL) {
+            return -2;
+        }
+    }
+
+    while (job->nb_packets < DEMUX_BATCH) {
+        if (av_read_frame(job->file.fmt_ctx, &pkt) < 0) {
+            job->eof = 1;
+            break;
+        }
+        if (!should_decode_packet(&job->file, &pkt)) {
+            av_free_packet(&pkt);
+            continue;
+        }
+        job->packet_bytes += pkt.size;
+        memory_charge(job->memory, pkt.size);
+        av_packet_move_ref(&job->packets[job->nb_packets++], &pkt);
+        if (memory_over_budget(job->memory)) {
+            break;
+        }
+    }
+    return 0;
+}
+
+static int decode_into_job(DecodeJob* job, AVCodecContext* codec_ctx, AVPacket* pkt) {
+    int got_frame = 0;
+
+    if (decode_packet(codec_ctx, pkt, &job->frame, &got_frame) < 0) {
+        return 0;
+    }
+    if (got_frame) {
+        // 처리량은 비디오 프레임 기준으로 집계
+        if (codec_ctx->codec_type == AVMEDIA_TYPE_VIDEO) {
+            job->frames++;
+        }
+        av_frame_unref(job->frame);
+    }
+    return got_frame;
+}
+
+static void drain_job_decoder(DecodeJob* job, int stream_index) {
+    AVCodecContext* codec_ctx;
+    AVPacket flush_pkt;
+
+    if (stream_index < 0) {
+        return;
+    }
+    codec_ctx = job->file.fmt_ctx->streams[stream_index]->codec;
+    av_init_packet(&flush_pkt);
+    flush_pkt.data = NULL;
+    flush_pkt.size = 0;
+
+    while (decode_into_job(job, codec_ctx, &flush_pkt)) {
+    }
+}
+
+// 쌓아둔 패킷을 모두 디코딩, 파일 끝이면 디코더를 비움
+static int run_decode(DecodeJob* job) {
+    int i;
+
+    for (i = 0; i < job->nb_packets; i++) {
+        AVPacket* pkt = &job->packets[i];
+        decode_into_job(job, job->file.fmt_ctx->streams[pkt->stream_index]->codec, pkt);
+        av_free_packet(pkt);
+    }
+    job->nb_packets = 0;
+    memory_release(job->memory, job->packet_bytes);
+    job->packet_bytes = 0;
+
+    if (job->eof) {
+        drain_job_decoder(job, job->file.v_index);
+        drain_job_decoder(job, job->file.a_index);
+        return 1;
+    }
+    return 0;
+}
+
+static void run_task(Worker* worker, DecodeJob* job) {
+    int ret;
+
+    if (job->start_time == 0) {
+        pthread_mutex_lock(&worker->service->mutex);
+        job->start_time = av_gettime_relative();
+        pthread_mutex_unlock(&worker->service->mutex);
+    }
+
+    if (job->next_task == TASK_DEMUX) {
+        ret = run_demux(job);
+        job->next_task = TASK_DECODE;
+    } else {
+        ret = run_decode(job);
+        job->next_task = TASK_DEMUX;
+    }
+
+    if (ret < 0) {
+        job->failed = 1;
+    }
+    if (ret != 0) {
+        finish_job(worker->service, job);
+        return;
+    }
+
+    // 이어지는 작업은 자기 큐의 맨 뒤로 보내 먼저 들어온 다른 파일의 작업이 먼저 실행되도록 함
+    if (schedule(worker, job) < 0) {
+        job->failed = 1;
+        finish_job(worker->service, job);
+    }
+}
+
+static void* service_worker(void* arg) {
+    Worker* self = (Worker*)arg;
+    DecodeService* service = self->service;
+
+    while (1) {
+        DecodeJob* job = queue_pop_head(&self->queue);
+        if (job == NULL) {
+            job = steal_task(self);
+        }
+
+        if (job == NULL) {
+            pthread_mutex_lock(&service->mutex);
+            while (service->pending == 0 && !service->shutdown) {
+                pthread_cond_wait(&service->task_ready, &service->mutex);
+            }
+            if (service->pending == 0 && service->shutdown) {
+                pthread_mutex_unlock(&service->mutex);
+                break;
+            }
+            pthread_mutex_unlock(&service->mutex);
+            continue;
+        }
+
+        pthread_mutex_lock(&service->mutex);
+        service->pending--;
+        pthread_mutex_unlock(&service->mutex);
+
+        run_task(self, job);
+    }
+    return NULL;
+}
+
+DecodeService* decode_service_create(int threads) {
+    DecodeService* service;
+    int started = 0;
+    int i;
+
+    service = av_mallocz(sizeof(DecodeService));
+    if (service == NULL) {
+        return NULL;
+    }
+
+    service->nb_workers = FFMAX(threads, 1);
+    service->workers = av_mallocz_array(service->nb_workers, sizeof(Worker));
+    if (service->workers == NULL) {
+        av_free(service);
+        return NULL;
+    }
+
+    pthread_mutex_init(&service->mutex, NULL);
+    pthread_cond_init(&service->task_ready, NULL);
+    pthread_cond_init(&service->job_done, NULL);
+
+    for (i = 0; i < service->nb_workers; i++) {
+        Worker* worker = &service->workers[i];
+        worker->service = service;
+        worker->index = i;
+        pthread_mutex_init(&worker->queue.mutex, NULL);
+    }
+    for (i = 0; i < service->nb_workers; i++) {
+        Worker* worker = &service->workers[i];
+        worker->started = pthread_create(&worker->thread, NULL, service_worker, worker) == 0;
+        started += worker->started;
+    }
+
+    // 워커가 하나도 없으면 제출된 작업이 끝나지 않으므로 서비스를 만들지 않음
+    if (started == 0) {
+        decode_service_destroy(&service);
+    }
+    return service;
+}
+
+void decode_service_set_memory_governor(DecodeService* service, MemoryGovernor* governor, int64_t job_bytes) {
+    memory_unregister(&service->memory);
+    service->memory = memory_register(governor, "decode service", NULL, NULL);
+    service->job_bytes = job_bytes;
+}
+
+int decode_service_submit(DecodeService* service, const char* filename) {
+    DecodeJob* job;
+    Worker* worker;
+    int job_id;
+
+    // 디코더와 패킷을 담을 자리가 없으면 작업을 받지 않음, 호출한 쪽이 나중에 다시 제출
+    if (memory_try_charge(service->memory, service->job_bytes) < 0) {
+        pthread_mutex_lock(&service->mutex);
+        service->refused++;
+        pthread_mutex_unlock(&service->mutex);
+        return AVERROR(EAGAIN);
+    }
+
+    job = av_mallocz(sizeof(DecodeJob));
+    if (job == NULL) {
+        memory_release(service->memory, service->job_bytes);
+        return AVERROR(ENOMEM);
+    }
+    job->memory = service->memory;
+    job->reserved_bytes = service->job_bytes;
+    job->filename = av_strdup(filename);
+    if (job->filename == NULL) {
+        memory_release(service->memory, service->job_bytes);
+        av_free(job);
+        return AVERROR(ENOMEM);
+    }
+    job->file.fmt_ctx = NULL;
+    job->next_task = TASK_DEMUX;
+    job->submit_time = av_gettime_relative();
+
+    pthread_mutex_lock(&service->mutex);
+    av_dynarray_add(&service->jobs, &service->nb_jobs, job);
+    if (service->jobs == NULL) {
+        pthread_mutex_unlock(&service->mutex);
+        memory_release(service->memory, service->job_bytes);
+        av_free(job->filename);
+        av_free(job);
+        return AVERROR(ENOMEM);
+    }
+    job_id = service->nb_jobs - 1;
+    if (service->first_submit == 0) {
+        service->first_submit = job->submit_time;
+    }
+    service->running_jobs++;
+    worker = &service->workers[service->next_worker];
+    service->next_worker = (service->next_worker + 1) % service->nb_workers;
+    pthread_mutex_unlock(&service->mutex);
+
+    if (schedule(worker, job) < 0) {
+        job->failed = 1;
+        finish_job(service, job);
+    }
+    return job_id;
+}
+
+void decode_service_wait(DecodeService* service) {
+    pthread_mutex_lock(&service->mutex);
+    while (service->running_jobs > 0) {
+        pthread_cond_wait(&service->job_done, &service->mutex);
+    }
+    pthread_mutex_unlock(&service->mutex);
+}
+
+int decode_service_job_stats(DecodeService* service, int job_id, DecodeJobStats* stats) {
+    DecodeJob* job;
+
+    pthread_mutex_lock(&service->mutex);
+    if (job_id < 0 || job_id >= service->nb_jobs) {
+        pthread_mutex_unlock(&service->mutex);
+        return -1;
+    }
+    job = service->jobs[job_id];
+
+    stats->filename = job->filename;
+    stats->done = job->done;
+    stats->failed = job->failed;
+    stats->frames = job->done ? job->frames : 0;
+    stats->wait_sec = job->start_time ? (job->start_time - job->submit_time) / 1000000.0 : 0.0;
+    stats->latency_sec = job->done ? (job->end_time - job->submit_time) / 1000000.0 : 0.0;
+    pthread_mutex_unlock(&service->mutex);
+    return 0;
+}
+
+void decode_service_stats(DecodeService* service, DecodeServiceStats* stats) {
+    int i;
+
+    memset(stats, 0, sizeof(*stats));
+
+    pthread_mutex_lock(&service->mutex);
+    stats->jobs = service->nb_jobs;
+    for (i = 0; i < service->nb_jobs; i++) {
+        if (service->jobs[i]->done) {
+            stats->frames += service->jobs[i]->frames;
+        }
+    }
+    stats->steals = service->steals;
+    stats->refused = service->refused;
+    if (service->last_done > service->first_submit) {
+        stats->elapsed_sec = (service->last_done - service->first_submit) / 1000000.0;
+        stats->fps = stats->frames / stats->elapsed_sec;
+    }
+    pthread_mutex_unlock(&service->mutex);
+}
+
+void decode_service_destroy(DecodeService** service) {
+    DecodeService* s = *service;
+    int i;
+
+    if (s == NULL) {
+        return;
+    }
+
+    decode_service_wait(s);
+
+    pthread_mutex_lock(&s->mutex);
+    s->shutdown = 1;
+    pthread_cond_broadcast(&s->task_ready);
+    pthread_mutex_unlock(&s->mutex);
+
+    for (i = 0; i < s->nb_workers; i++) {
+        if (s->workers[i].started) {
+            pthread_join(s->workers[i].thread, NULL);
+        }
+        av_free(s->workers[i].queue.tasks);
+        pthread_mutex_destroy(&s->workers[i].queue.mutex);
+    }
+    for (i = 0; i < s->nb_jobs; i++) {
+        av_free(s->jobs[i]->filename);
+        av_free(s->jobs[i]);
+    }
+    av_free(s->jobs);
+    av_free(s->workers);
+    memory_unregister(&s->memory);
+
+    pthread_cond_destroy(&s->job_done);
+    pthread_cond_destroy(&s->task_ready);
+    pthread_mutex_destroy(&s->mutex);
+    av_freep(service);
+}
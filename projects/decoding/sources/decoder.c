@@ -0,0 +1,208 @@
+#include <libavformat/avformat.h>
+#include <libavcodec/avcodec.h>
+#include <libavutil/common.h>
+#include <libavutil/avutil.h>
+#include <stdio.h>
+
+#include "decoder.h"
+#include "frame_pool.h"
+
+// 미리보기 화질에서 사용할 lowres 값 (1 = 가로/세로 1/2)
+#define PREVIEW_LOWRES 1
+
+void init_decode_options(DecodeOptions* opts) {
+    opts->keyframe_only = 0;
+    opts->keyframe_interval = 0.0;
+    opts->quality = DECODE_QUALITY_FULL;
+    opts->thread_count = 0;
+    opts->frame_pool = 0;
+    opts->memory = NULL;
+}
+
+static int open_decoder(AVCodecContext* codec_ctx, const DecodeOptions* opts) {
+    // Codec ID를 통해 FFmpeg 라이브러리가 자동으로 코덱을 찾도록 함
+    AVCodec* decoder = avcodec_find_decoder(codec_ctx->codec_id);
+
+    if (decoder == NULL) {
+        return -1;
+    }
+
+    // 키프레임이 아닌 프레임은 디코더 안에서도 버리도록 함
+    if (opts->keyframe_only && codec_ctx->codec_type == AVMEDIA_TYPE_VIDEO) {
+        codec_ctx->skip_frame = AVDISCARD_NONKEY;
+    }
+
+    // 미리보기 화질: 코덱이 지원하는 만큼 축소 디코딩하고 화질에 덜 중요한 단계를 생략
+    if (opts->quality == DECODE_QUALITY_PREVIEW && codec_ctx->codec_type == AVMEDIA_TYPE_VIDEO) {
+        codec_ctx->lowres = FFMIN(PREVIEW_LOWRES, av_codec_get_max_lowres(decoder));
+        codec_ctx->skip_loop_filter = AVDISCARD_ALL;
+        codec_ctx->skip_idct = AVDISCARD_NONREF;
+        codec_ctx->flags2 |= AV_CODEC_FLAG2_FAST;
+    }
+
+    if (opts->thread_count > 0) {
+        codec_ctx->thread_count = opts->thread_count;
+    }
+
+    // 디코딩된 프레임의 버퍼를 호출한 쪽이 참조로 소유하도록 함
+    // 0이면 다음 디코딩 호출에서 프레임이 무효가 되어 복사 없이 보관할 수 없음
+    codec_ctx->refcounted_frames = 1;
+
+    if (opts->frame_pool) {
+        frame_pool_attach(codec_ctx, decoder, opts->memory);
+    }
+
+    // 찾아낸 디코더를 통해 코덱을 염
+    if (avcodec_open2(codec_ctx, decoder, NULL) < 0) {
+        frame_pool_detach(codec_ctx);
+        return -2;
+    }
+    return 0;
+}
+
+int open_input(FileContext* file, const char* filename, const DecodeOptions* opts) {
+    unsigned int index;
+
+    file->fmt_ctx = NULL;
+    file->a_index = file->v_index = -1;
+    if (opts != NULL) {
+        file->opts = *opts;
+    } else {
+        init_decode_options(&file->opts);
+    }
+
+    if (avformat_open_input(&file->fmt_ctx, filename, NULL, NULL) < 0) {
+        printf("Could not open input file %s\n", filename);
+        return -1;
+    }
+
+    if (avformat_find_stream_info(file->fmt_ctx, NULL) < 0) {
+        printf("Failed to retrieve input stream information\n");
+        return -2;
+    }
+
+    // Find Video, Audio Index
+    for(index = 0; index < file->fmt_ctx->nb_streams; index++) {
+        AVCodecContext *codec_ctx = file->fmt_ctx->streams[index]->codec;
+        if (codec_ctx->codec_type == AVMEDIA_TYPE_VIDEO && file->v_index < 0) {
+            if (open_decoder(codec_ctx, &file->opts) < 0) {
+                break;
+            }
+            file->v_index = index;
+        }else if (codec_ctx->codec_type == AVMEDIA_TYPE_AUDIO && file->a_index < 0) {
+            if (open_decoder(codec_ctx, &file->opts) < 0) {
+                break;
+            }
+            file->a_index = index;
+        }
+    }
+
+    if (file->v_index < 0 && file->a_index < 0) {
+        printf("Failed to retrieve input stream information\n");
+        return -3;
+    }
+    return 0;
+}
+
+void release(FileContext* file) {
+    if (file->fmt_ctx != NULL) {
+        unsigned int index;
+        for (index = 0; index < file->fmt_ctx->nb_streams; index++) {
+            AVCodecContext* codec_ctx = file->fmt_ctx->streams[index]->codec;
+            if (index == file->v_index || index == file->a_index) {
+                avcodec_close(codec_ctx);
+                frame_pool_detach(codec_ctx);
+            }
+        }
+        avformat_close_input(&file->fmt_ctx);
+    }
+}
+
+int should_decode_packet(const FileContext* file, const AVPacket* pkt) {
+    if ((pkt->stream_index != file->v_index) && (pkt->stream_index != file->a_index)) {
+        return 0;
+    }
+
+    // 키프레임 모드에서는 키프레임이 아닌 비디오 패킷을 디코더에 넘기기 전에 버림
+    if (file->opts.keyframe_only && pkt->stream_index == file->v_index && !(pkt->flags & AV_PKT_FLAG_KEY)) {
+        return 0;
+    }
+    return 1;
+}
+
+int decode_packet(AVCodecContext* codec_ctx, AVPacket* pkt, AVFrame** frame, int* got_frame) {
+    int (*decode_func)(AVCodecContext*, AVFrame*, int*, const AVPacket*);
+    int decoded_size;
+
+    // 비디오인지 오디오인지에 따라 디코딩할 함수를 정함
+    decode_func = (codec_ctx->codec_type == AVMEDIA_TYPE_VIDEO) ? avcodec_decode_video2 : avcodec_decode_audio4;
+    decoded_size = decode_func(codec_ctx, *frame, got_frame, pkt);
+    if(*got_frame) {
+        // Packet에 있는 PTS, DTS 를 자동으로 프레임으로 넘겨줌
+        (*frame)->pts = av_frame_get_best_effort_timestamp(*frame);
+    }
+
+    return decoded_size;
+}
+
+int read_video_frame(FileContext* file, AVFrame* frame) {
+    AVCodecContext* codec_ctx;
+    AVPacket pkt;
+    int got_frame;
+    int ret;
+
+    if (file->v_index < 0) {
+        return AVERROR_STREAM_NOT_FOUND;
+    }
+    codec_ctx = file->fmt_ctx->streams[file->v_index]->codec;
+
+    while (1) {
+        ret = av_read_frame(file->fmt_ctx, &pkt);
+        if (ret < 0) {
+            // 더는 읽어올 패킷이 없으면 디코더에 남아있는 프레임을 꺼냄
+            av_init_packet(&pkt);
+            pkt.data = NULL;
+            pkt.size = 0;
+            got_frame = 0;
+            decode_packet(codec_ctx, &pkt, &frame, &got_frame);
+            return got_frame ? 0 : AVERROR_EOF;
+        }
+        if (pkt.stream_index != file->v_index || !should_decode_packet(file, &pkt)) {
+            av_free_packet(&pkt);
+            continue;
+        }
+
+        got_frame = 0;
+        ret = decode_packet(codec_ctx, &pkt, &frame, &got_frame);
+        av_free_packet(&pkt);
+        if (ret >= 0 && got_frame) {
+            return 0;
+        }
+    }
+}
+
+int seek_next_keyframe(FileContext* file, int64_t pts, double interval) {
+    AVStream* stream;
+    int64_t target;
+    unsigned int index;
+
+    if (file->v_index < 0 || pts == AV_NOPTS_VALUE) {
+        return -1;
+    }
+
+    stream = file->fmt_ctx->streams[file->v_index];
+    target = pts + (int64_t)(interval / av_q2d(stream->time_base));
+
+    // min_ts를 현재 위치 다음으로 두어 같은 키프레임으로 되돌아가지 않도록 함
+    if (avformat_seek_file(file->fmt_ctx, file->v_index, pts + 1, target, INT64_MAX, 0) < 0) {
+        return -2;
+    }
+
+    // 탐색 이후에는 디코더 안에 남아있는 이전 위치의 데이터를 비워야 함
+    for (index = 0; index < file->fmt_ctx->nb_streams; index++) {
+        if (index == file->v_index || index == file->a_index) {
+            avcodec_flush_buffers(file->fmt_ctx->streams[index]->codec);
+        }
+    }
+    return 0;
+}
@@ -3,109 +3,342 @@
 #include <libavutil/common.h>
 #include <libavutil/avutil.h>
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 
-typedef struct _FileContext {
-    AVFormatContext* fmt_ctx;
-    int v_index;
-    int a_index;
-} FileContext;
+#include "decoder.h"
+#include "preview.h"
+#include "gop_parallel.h"
+#include "bench.h"
+#include "decode_service.h"
+#include "framehash.h"
+#include "seek.h"
+#include "frame_cache.h"
+#include "reverse.h"
+#include "alloc_stats.h"
+#include "memory_governor.h"
+
+// -A 옵션에서 디코더와 프레임 풀이 자리잡을 때까지 세지 않고 넘기는 프레임 수
+#define ALLOC_WARMUP_FRAMES 30
+// -M 옵션과 -j를 함께 쓸 때 작업 하나(디코더와 참조 프레임)마다 예산에서 잡아두는 크기
+#define SERVICE_JOB_BYTES (64LL * 1024 * 1024)
 
 static FileContext inputFile;
+// -H 옵션을 주면 프레임 정보 대신 프레임 해시를 출력
+static FrameHashContext* frameHash = NULL;
+// -A 옵션: 출력한 프레임 수와 워밍업 이후의 할당 시작 시점
+static int allocAccounting = 0;
+static int64_t outputFrames = 0;
+static AllocCounters allocsAfterWarmup;
+// -M 옵션: 캐시, GOP 버퍼, 프레임 풀, 디코딩 서비스가 함께 쓰는 메모리 예산
+static MemoryGovernor* memoryGovernor = NULL;
+
+static void print_frame(AVCodecContext* codec_ctx, AVFrame* decoded_frame) {
+    printf("------------\n");
+    if (codec_ctx->codec_type == AVMEDIA_TYPE_VIDEO) {
+        printf("Video :frame(width: %d, height: %d)\n", decoded_frame->width, decoded_frame->height);
+        printf("Video: frame(sample_aspect_ratio: %d/%d)", decoded_frame->sample_aspect_ratio.num, decoded_frame->sample_aspect_ratio.den);
+        if (inputFile.opts.keyframe_only) {
+            printf("\nVideo: keyframe(pts: %lld)\n", (long long)decoded_frame->pts);
+        }
+    } else {
+        printf("Audio: frame(nb_samples: %d)\n", decoded_frame->nb_samples);
+        printf("Audio: frame(channels: %d)\n", decoded_frame->channels);
+    }
+}
 
-static int open_decoder(AVCodecContext* codec_ctx) {
-    // Codec ID를 통해 FFmpeg 라이브러리가 자동으로 코덱을 찾도록 함
-    AVCodec* decoder = avcodec_find_decoder(codec_ctx->codec_id);
+// time_base는 decoded_frame의 타임스탬프 기준 (디코딩 루프는 코덱, 탐색은 스트림 time_base)
+static void output_frame(int stream_index, AVCodecContext* codec_ctx, AVFrame* decoded_frame, AVRational time_base) {
+    AllocStage stage = alloc_stats_set_stage(ALLOC_STAGE_OUTPUT);
 
-    if (decoder == NULL) {
-        return -1;
+    if (frameHash != NULL) {
+        write_frame_hash(frameHash, stream_index, decoded_frame, time_base);
+    } else {
+        print_frame(codec_ctx, decoded_frame);
     }
+    alloc_stats_set_stage(stage);
 
-    // 찾아낸 디코더를 통해 코덱을 염
-    if (avcodec_open2(codec_ctx, decoder, NULL) < 0) {
-        return -2;
+    if (allocAccounting && ++outputFrames == ALLOC_WARMUP_FRAMES) {
+        alloc_stats_snapshot(&allocsAfterWarmup);
     }
-    return 0;
 }
 
-static int open_input(const char* filename) {
-    unsigned int index;
-
-    inputFile.fmt_ctx = NULL;
-    inputFile.a_index = inputFile.v_index = -1;
+static void print_gop_frame(AVFrame* frame, void* opaque) {
+    printf("------------\n");
+    printf("Video :frame(width: %d, height: %d, pts: %lld)\n", frame->width, frame->height, (long long)frame->pts);
+}
 
-    if (avformat_open_input(&inputFile.fmt_ctx, filename, NULL, NULL) < 0) {
-        printf("Could not open input file %s\n", filename);
-        return -1;
-    }
+// 조작자가 seconds 주변에서 프레임을 앞뒤로 넘겨보는 것을 흉내내 캐시 적중률을 봄
+static int scrub_with_cache(const char* filename, double seconds, int64_t budget_bytes) {
+    static const int steps[] = { 5, -10, 5, 10, -10 };
+    FrameCache* cache;
+    FrameCacheStats stats;
+    AVFrame* frame;
+    AVFrame* next;
+    int i, j;
 
-    if (avformat_find_stream_info(inputFile.fmt_ctx, NULL) < 0) {
-        printf("Failed to retrieve input stream information\n");
+    cache = frame_cache_create(filename, budget_bytes, 30, memoryGovernor);
+    frame = av_frame_alloc();
+    next = av_frame_alloc();
+    if (cache == NULL || frame == NULL || next == NULL || frame_cache_get_at(cache, seconds, frame) < 0) {
+        av_frame_free(&frame);
+        av_frame_free(&next);
+        frame_cache_destroy(&cache);
         return -2;
     }
 
-    // Find Video, Audio Index
-    for(index = 0; index < inputFile.fmt_ctx->nb_streams; index++) {
-        AVCodecContext *codec_ctx = inputFile.fmt_ctx->streams[index]->codec;
-        if (codec_ctx->codec_type == AVMEDIA_TYPE_VIDEO && inputFile.v_index < 0) {
-            if (open_decoder(codec_ctx) < 0) {
-                break;
-            }
-            inputFile.v_index = index;
-        }else if (codec_ctx->codec_type == AVMEDIA_TYPE_AUDIO && inputFile.a_index < 0) {
-            if (open_decoder(codec_ctx) < 0) {
+    for (i = 0; i < (int)(sizeof(steps) / sizeof(steps[0])); i++) {
+        for (j = 0; j < abs(steps[i]); j++) {
+            if (frame_cache_step(cache, frame, steps[i], next) < 0) {
                 break;
             }
-            inputFile.a_index = index;
+            av_frame_unref(frame);
+            av_frame_move_ref(frame, next);
         }
+        printf("Scrub: step(%+d), frame pts(%lld)\n", steps[i], (long long)frame->pts);
     }
 
-    if (inputFile.v_index < 0 && inputFile.a_index < 0) {
-        printf("Failed to retrieve input stream information\n");
-        return -3;
-    }
+    frame_cache_stats(cache, &stats);
+    printf("Frame cache: hits(%lld), misses(%lld), hit rate(%.1f%%), prefetched(%lld), evictions(%lld)\n",
+           (long long)stats.hits, (long long)stats.misses,
+           stats.hits + stats.misses > 0 ? 100.0 * stats.hits / (stats.hits + stats.misses) : 0.0,
+           (long long)stats.prefetched, (long long)stats.evictions);
+    printf("Frame cache: frames(%d), memory(%.1fMB / %.1fMB)\n", stats.frames,
+           stats.bytes / 1048576.0, stats.budget_bytes / 1048576.0);
+
+    av_frame_free(&frame);
+    av_frame_free(&next);
+    frame_cache_destroy(&cache);
     return 0;
 }
 
-static void release() {
-    if (inputFile.fmt_ctx != NULL) {
-        unsigned int index;
-        for (index = 0; index < inputFile.fmt_ctx->nb_streams; index++) {
-            AVCodecContext* codec_ctx = inputFile.fmt_ctx->streams[index]->codec;
-            if (index == inputFile.v_index || index == inputFile.a_index) {
-                avcodec_close(codec_ctx);
-            }
-        }
-        avformat_close_input(&inputFile.fmt_ctx);
+static void report_memory(void) {
+    if (memoryGovernor != NULL) {
+        memory_governor_print(stderr, memoryGovernor);
     }
 }
 
-static int decode_packet(AVCodecContext* codec_ctx, AVPacket* pkt, AVFrame** frame, int* got_frame) {
-    int (*decode_func)(AVCodecContext*, AVFrame*, int*, const AVPacket*);
-    int decoded_size;
+// 디코더 안에 남아있는 프레임을 모두 꺼냄
+static void drain_decoder(int stream_index, AVCodecContext* codec_ctx, AVFrame* decoded_frame) {
+    AVPacket flush_pkt;
+    int got_frame;
 
-    // 비디오인지 오디오인지에 따라 디코딩할 함수를 정함
-    decode_func = (codec_ctx->codec_type == AVMEDIA_TYPE_VIDEO) ? avcodec_decode_video2 : avcodec_decode_audio4;
-    decoded_size = decode_func(codec_ctx, *frame, got_frame, pkt);
-    if(*got_frame) {
-        // Packet에 있는 PTS, DTS 를 자동으로 프레임으로 넘겨줌
-        (*frame)->pts = av_frame_get_best_effort_timestamp(*frame);
-    }
+    av_init_packet(&flush_pkt);
+    flush_pkt.data = NULL;
+    flush_pkt.size = 0;
 
-    return decoded_size;
+    do {
+        got_frame = 0;
+        if (decode_packet(codec_ctx, &flush_pkt, &decoded_frame, &got_frame) < 0) {
+            break;
+        }
+        if (got_frame) {
+            output_frame(stream_index, codec_ctx, decoded_frame, codec_ctx->time_base);
+            av_frame_unref(decoded_frame);
+        }
+    } while (got_frame);
 }
 
 int main(int argc, char* argv[]) {
     int ret;
+    int arg_index;
+    int measure_preview = 0;
+    int gop_threads = 0;
+    int bench_iterations = 0;
+    int service_threads = 0;
+    int hash_type = -1;
+    double seek_time = -1.0;
+    int cache_mb = 0;
+    int memory_mb = 0;
+    int reverse = 0;
+    double reverse_from = -1.0;
+    AllocCounters allocs_end;
+    FrameHashContext hash_ctx;
+    DecodeOptions opts;
 
     av_register_all();
 
-    if (argc < 2) {
-        printf("usage: %s<input>\n", argv[0]);
+    init_decode_options(&opts);
+    for (arg_index = 1; arg_index < argc - 1 && argv[arg_index][0] == '-'; arg_index++) {
+        if (strcmp(argv[arg_index], "-k") == 0) {
+            opts.keyframe_only = 1;
+        } else if (strcmp(argv[arg_index], "-i") == 0 && arg_index + 1 < argc - 1) {
+            opts.keyframe_only = 1;
+            opts.keyframe_interval = atof(argv[++arg_index]);
+        } else if (strcmp(argv[arg_index], "-p") == 0) {
+            opts.quality = DECODE_QUALITY_PREVIEW;
+        } else if (strcmp(argv[arg_index], "-P") == 0) {
+            measure_preview = 1;
+        } else if (strcmp(argv[arg_index], "-g") == 0 && arg_index + 1 < argc - 1) {
+            gop_threads = atoi(argv[++arg_index]);
+        } else if (strcmp(argv[arg_index], "-b") == 0 && arg_index + 1 < argc - 1) {
+            bench_iterations = atoi(argv[++arg_index]);
+        } else if (strcmp(argv[arg_index], "-F") == 0) {
+            opts.frame_pool = 1;
+        } else if (strcmp(argv[arg_index], "-A") == 0) {
+            allocAccounting = 1;
+        } else if (strcmp(argv[arg_index], "-T") == 0 && arg_index + 1 < argc - 1) {
+            opts.thread_count = atoi(argv[++arg_index]);
+        } else if (strcmp(argv[arg_index], "-j") == 0 && arg_index + 1 < argc - 1) {
+            service_threads = atoi(argv[++arg_index]);
+        } else if (strcmp(argv[arg_index], "-s") == 0 && arg_index + 1 < argc - 1) {
+            seek_time = atof(argv[++arg_index]);
+        } else if (strcmp(argv[arg_index], "-C") == 0 && arg_index + 1 < argc - 1) {
+            cache_mb = atoi(argv[++arg_index]);
+        } else if (strcmp(argv[arg_index], "-M") == 0 && arg_index + 1 < argc - 1) {
+            memory_mb = atoi(argv[++arg_index]);
+        } else if (strcmp(argv[arg_index], "-r") == 0 && arg_index + 1 < argc - 1) {
+            reverse = 1;
+            arg_index++;
+            reverse_from = strcmp(argv[arg_index], "end") == 0 ? -1.0 : atof(argv[arg_index]);
+        } else if (strcmp(argv[arg_index], "-H") == 0 && arg_index + 1 < argc - 1) {
+            arg_index++;
+            if (strcmp(argv[arg_index], "xxh3") == 0) {
+                hash_type = FRAME_HASH_XXH3;
+            } else if (strcmp(argv[arg_index], "md5") == 0) {
+                hash_type = FRAME_HASH_MD5;
+            } else {
+                break;
+            }
+        } else {
+            break;
+        }
+    }
+
+    if (arg_index >= argc || (service_threads == 0 && arg_index != argc - 1)) {
+        printf("usage: %s [-k] [-i <seconds>] [-p] [-P] [-g <threads>] [-b <iterations>] [-T <threads>] [-F] [-A] [-j <threads>] [-H <xxh3|md5>] [-s <seconds> [-C <MB>]] [-r <seconds|end>] [-M <MB>] <input>...\n", argv[0]);
+        printf("  -k            decode keyframes only\n");
+        printf("  -i <seconds>  decode keyframes only, seeking this far between them\n");
+        printf("  -p            decode video at preview quality\n");
+        printf("  -P            measure preview quality speedup and PSNR against full decode\n");
+        printf("  -g <threads>  decode video GOPs in parallel on this many decoder instances\n");
+        printf("  -b <count>    benchmark video decoding from memory for this many iterations (JSON)\n");
+        printf("  -T <threads>  number of decoder threads (default: auto)\n");
+        printf("  -F            reuse video frame buffers from a single-buffer-per-frame pool\n");
+        printf("  -A            count heap allocations per frame and stage after warmup (stderr)\n");
+        printf("  -j <threads>  decode every input concurrently on a shared pool of this many threads\n");
+        printf("  -H xxh3       print per-plane XXH3-64 checksums of every decoded frame\n");
+        printf("  -H md5        print frame checksums in ffmpeg framemd5 format\n");
+        printf("  -s <seconds>  decode only the video frame shown at this time and report seek latency\n");
+        printf("  -C <MB>       with -s, step back and forth around that time through a frame cache of this size\n");
+        printf("  -r <seconds>  play video backwards from this time (or from the end) one GOP at a time\n");
+        printf("  -M <MB>       share this memory budget between caches, GOP buffers, frame pools and jobs (stderr report)\n");
+        return 0;
+    }
+
+    if (memory_mb > 0) {
+        memoryGovernor = memory_governor_create((int64_t)memory_mb * 1024 * 1024);
+        opts.memory = memoryGovernor;
+    }
+
+    if (measure_preview) {
+        PreviewReport report;
+        if (measure_preview_quality(argv[arg_index], 0, &report) < 0) {
+            printf("Failed to measure preview quality\n");
+            return 0;
+        }
+        printf("Preview: frames(%d), lowres(%d)\n", report.frames, report.lowres);
+        printf("Preview: decode time(full: %.3fs, preview: %.3fs, speedup: %.2fx)\n",
+               report.full_decode_sec, report.preview_decode_sec, report.speedup);
+        printf("Preview: luma PSNR against full decode(avg: %.2fdB, min: %.2fdB)\n",
+               report.psnr_avg, report.psnr_min);
+        return 0;
+    }
+
+    if (service_threads > 0) {
+        DecodeService* service = decode_service_create(service_threads);
+        DecodeServiceStats stats;
+        DecodeJobStats job_stats;
+        int job_id;
+
+        if (service == NULL) {
+            printf("Failed to create decode service\n");
+            return 0;
+        }
+        decode_service_set_memory_governor(service, memoryGovernor, SERVICE_JOB_BYTES);
+        for (; arg_index < argc; arg_index++) {
+            if (decode_service_submit(service, argv[arg_index]) == AVERROR(EAGAIN)) {
+                printf("Refused %s: memory budget exhausted\n", argv[arg_index]);
+            }
+        }
+        decode_service_wait(service);
+
+        for (job_id = 0; decode_service_job_stats(service, job_id, &job_stats) == 0; job_id++) {
+            printf("Job %d: %s frames(%lld), wait(%.3fs), latency(%.3fs)%s\n", job_id, job_stats.filename,
+                   (long long)job_stats.frames, job_stats.wait_sec, job_stats.latency_sec,
+                   job_stats.failed ? " failed" : "");
+        }
+        decode_service_stats(service, &stats);
+        printf("Service: jobs(%d), frames(%lld), %.3fs (%.1f fps), steals(%lld), refused(%d)\n", stats.jobs,
+               (long long)stats.frames, stats.elapsed_sec, stats.fps, (long long)stats.steals, stats.refused);
+
+        report_memory();
+        decode_service_destroy(&service);
+        memory_governor_destroy(&memoryGovernor);
+        return 0;
+    }
+
+    if (cache_mb > 0 && seek_time >= 0) {
+        if (scrub_with_cache(argv[arg_index], seek_time, (int64_t)cache_mb * 1024 * 1024) < 0) {
+            printf("Failed to scrub through the frame cache\n");
+        }
+        report_memory();
+        memory_governor_destroy(&memoryGovernor);
+        return 0;
+    }
+
+    if (reverse) {
+        ReverseOptions reverse_opts;
+        ReverseStats stats;
+
+        init_reverse_options(&reverse_opts);
+        reverse_opts.start_seconds = reverse_from;
+        reverse_opts.memory = memoryGovernor;
+        if (decode_reverse(argv[arg_index], &reverse_opts, print_gop_frame, NULL, &stats) < 0) {
+            printf("Failed to play backwards\n");
+        }
+        printf("Reverse: gops(%d), frames(%d), redecoded(%d), slow gops(%d), max gop decode(%.3fs), %.3fs (%.1f fps)\n",
+               stats.gops, stats.frames, stats.redecoded_gops, stats.slow_gops, stats.max_gop_decode_sec,
+               stats.elapsed_sec, stats.elapsed_sec > 0 ? stats.frames / stats.elapsed_sec : 0.0);
+        report_memory();
+        memory_governor_destroy(&memoryGovernor);
+        return 0;
+    }
+
+    if (bench_iterations > 0) {
+        BenchOptions bench_opts;
+
+        init_bench_options(&bench_opts);
+        bench_opts.iterations = bench_iterations;
+        bench_opts.thread_count = opts.thread_count;
+        bench_opts.frame_pool = opts.frame_pool;
+        if (run_decode_benchmark(argv[arg_index], &bench_opts, stdout) < 0) {
+            printf("Failed to run decode benchmark\n");
+        }
+        return 0;
+    }
+
+    if (gop_threads > 0) {
+        GopParallelOptions gop_opts;
+        GopParallelStats stats;
+
+        init_gop_parallel_options(&gop_opts);
+        gop_opts.threads = gop_threads;
+        gop_opts.max_buffered_gops = 2 * gop_threads;
+        gop_opts.memory = memoryGovernor;
+        if (decode_gop_parallel(argv[arg_index], &gop_opts, print_gop_frame, NULL, &stats) < 0) {
+            printf("Failed to decode GOPs in parallel\n");
+        }
+        printf("GOP parallel: gops(%d), frames(%d), dropped(%d), %.3fs (%.1f fps)\n",
+               stats.gops, stats.frames, stats.dropped_frames, stats.elapsed_sec,
+               stats.elapsed_sec > 0 ? stats.frames / stats.elapsed_sec : 0.0);
+        report_memory();
+        memory_governor_destroy(&memoryGovernor);
         return 0;
     }
 
-    if (open_input(argv[1]) < 0) {
-        release();
+    if (open_input(&inputFile, argv[arg_index], &opts) < 0) {
+        release(&inputFile);
 
         return 0;
     }
@@ -113,7 +346,42 @@ int main(int argc, char* argv[]) {
     // AVFrame은 디코딩한, 즉 압축하지 않은 raw 데이터를 담는데 사용
     AVFrame* decoded_frame = av_frame_alloc();
     if (decoded_frame == NULL) {
-        release();
+        release(&inputFile);
+
+        return 0;
+    }
+
+    if (hash_type >= 0) {
+        if (init_frame_hash(&hash_ctx, hash_type, &inputFile, stdout) < 0) {
+            av_frame_free(&decoded_frame);
+            release(&inputFile);
+
+            return 0;
+        }
+        frameHash = &hash_ctx;
+    }
+
+    if (seek_time >= 0) {
+        SeekStats seek_stats;
+
+        if (seek_frame_at(&inputFile, seek_time, decoded_frame, &seek_stats) < 0) {
+            fprintf(stderr, "Failed to seek to %.3fs\n", seek_time);
+        } else {
+            AVStream* stream = inputFile.fmt_ctx->streams[inputFile.v_index];
+
+            // seek_frame_at이 돌려준 프레임의 pts는 스트림 time_base 기준
+            output_frame(inputFile.v_index, stream->codec, decoded_frame, stream->time_base);
+            av_frame_unref(decoded_frame);
+            fprintf(stderr, "Seek: target pts(%lld), frame pts(%lld), preroll(%d), packets(%d, skippable %d), seek(%.3fms), decode(%.3fms), total(%.3fms)\n",
+                    (long long)seek_stats.target_pts, (long long)seek_stats.frame_pts, seek_stats.preroll_frames,
+                    seek_stats.decoded_packets, seek_stats.skipped_packets, seek_stats.seek_sec * 1000.0,
+                    seek_stats.decode_sec * 1000.0, seek_stats.total_sec * 1000.0);
+        }
+        if (frameHash != NULL) {
+            release_frame_hash(&hash_ctx);
+        }
+        av_frame_free(&decoded_frame);
+        release(&inputFile);
 
         return 0;
     }
@@ -121,42 +389,94 @@ int main(int argc, char* argv[]) {
     AVPacket pkt;
     int got_frame;
 
+    if (allocAccounting) {
+        if (alloc_stats_available()) {
+            alloc_stats_enable(1);
+        } else {
+            fprintf(stderr, "Allocation accounting is not supported on this platform\n");
+            allocAccounting = 0;
+        }
+    }
+
     while(1) {
+        alloc_stats_set_stage(ALLOC_STAGE_DEMUX);
         ret = av_read_frame(inputFile.fmt_ctx, &pkt);
+        alloc_stats_set_stage(ALLOC_STAGE_DECODE);
         if (ret == AVERROR_EOF) {
-            printf("End of frame\n");
+            if (frameHash == NULL) {
+                printf("End of frame\n");
+            }
+            if (inputFile.v_index >= 0) {
+                drain_decoder(inputFile.v_index, inputFile.fmt_ctx->streams[inputFile.v_index]->codec, decoded_frame);
+            }
+            if (inputFile.a_index >= 0) {
+                drain_decoder(inputFile.a_index, inputFile.fmt_ctx->streams[inputFile.a_index]->codec, decoded_frame);
+            }
             break;
         }
-        if ((pkt.stream_index != inputFile.v_index) && (pkt.stream_index != inputFile.a_index)) {
+        if (!should_decode_packet(&inputFile, &pkt)) {
             av_free_packet(&pkt);
             continue;
         }
 
         AVStream* avStream = inputFile.fmt_ctx->streams[pkt.stream_index];
         AVCodecContext* codec_ctx = avStream->codec;
+        int stream_index = pkt.stream_index;
+        int64_t pkt_pts = pkt.pts;
         got_frame = 0;
 
         av_packet_rescale_ts(&pkt, avStream->time_base, codec_ctx->time_base);
 
         ret = decode_packet(codec_ctx, &pkt, &decoded_frame, &got_frame);
         if (ret >= 0 && got_frame) {
-            printf("------------\n");
-            if (codec_ctx->codec_type == AVMEDIA_TYPE_VIDEO) {
-                printf("Video :frame(width: %d, height: %d)\n", decoded_frame->width, decoded_frame->height);
-                printf("Video: frame(sample_aspect_ratio: %d/%d)", decoded_frame->sample_aspect_ratio.num, decoded_frame->sample_aspect_ratio.den);
-            } else {
-                printf("Audio: frame(nb_samples: %d)\n", decoded_frame->nb_samples);
-                printf("Audio: frame(channels: %d)\n", decoded_frame->channels);
-            }
+            output_frame(stream_index, codec_ctx, decoded_frame, codec_ctx->time_base);
             av_frame_unref(decoded_frame);
         }
 
+        // 패킷 데이터는 av_read_frame에서 할당되므로 해제도 디먹싱 단계로 셈
+        alloc_stats_set_stage(ALLOC_STAGE_DEMUX);
         av_free_packet(&pkt);
+        alloc_stats_set_stage(ALLOC_STAGE_DECODE);
+
+        // 키프레임 하나를 꺼낸 뒤 다음 키프레임 위치로 바로 건너뜀
+        if (opts.keyframe_interval > 0 && stream_index == inputFile.v_index) {
+            drain_decoder(stream_index, codec_ctx, decoded_frame);
+            if (seek_next_keyframe(&inputFile, pkt_pts, opts.keyframe_interval) < 0) {
+                if (frameHash == NULL) {
+                    printf("End of keyframes\n");
+                }
+                break;
+            }
+        }
+    }
+
+    alloc_stats_set_stage(ALLOC_STAGE_OTHER);
+    if (allocAccounting) {
+        alloc_stats_snapshot(&allocs_end);
+        alloc_stats_enable(0);
+        if (outputFrames > ALLOC_WARMUP_FRAMES) {
+            fprintf(stderr, "Allocations after %d warmup frames (%lld frames):\n", ALLOC_WARMUP_FRAMES,
+                    (long long)(outputFrames - ALLOC_WARMUP_FRAMES));
+            alloc_stats_print(stderr, &allocsAfterWarmup, &allocs_end, outputFrames - ALLOC_WARMUP_FRAMES);
+        } else {
+            fprintf(stderr, "Allocations: fewer than %d frames decoded, nothing measured\n", ALLOC_WARMUP_FRAMES + 1);
+        }
+    }
+
+    // 해시 출력(stdout)을 그대로 비교할 수 있도록 통계는 stderr로
+    if (frameHash != NULL) {
+        fprintf(stderr, "Frame hash: frames(%lld), %.1fMB hashed in %.3fs (%.1f MB/s)\n",
+                (long long)hash_ctx.frames, hash_ctx.bytes / 1000000.0, hash_ctx.hash_time_us / 1000000.0,
+                hash_ctx.hash_time_us > 0 ? (double)hash_ctx.bytes / hash_ctx.hash_time_us : 0.0);
+        release_frame_hash(&hash_ctx);
     }
 
     av_frame_free(&decoded_frame);
 
-    release();
+    // 디코더를 닫기 전에 출력해야 프레임 풀이 아직 잡고 있는 버퍼가 보임
+    report_memory();
+    release(&inputFile);
+    memory_governor_destroy(&memoryGovernor);
 
     return 0;
-}
\ No newline at end of file
+}
@@ -0,0 +1,443 @@
+#include <libavformat/avformat.h>
+#include <libavcodec/avcodec.h>
+#include <libavutil/avutil.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "decoder.h"
+#include "seek.h"
+#include "frame_cache.h"
+#include "memory_governor.h"
+
+typedef struct _CacheEntry {
+    int stream_index;
+    int64_t pts;
+    int64_t duration;
+    AVFrame* frame;
+    int64_t bytes;
+    // LRU 목록, 앞쪽일수록 최근에 사용됨
+    struct _CacheEntry* prev;
+    struct _CacheEntry* next;
+} CacheEntry;
+
+struct _FrameCache {
+    // get/step을 부르는 스레드가 쓰는 디코더
+    FileContext file;
+    // 미리 읽기 스레드 전용 디코더 (FFmpeg 컨텍스트는 스레드 간에 공유하지 않음)
+    FileContext prefetch_file;
+
+    // (stream_index, pts) 순으로 정렬된 항목, 이진 탐색으로 찾음
+    CacheEntry** entries;
+    int nb_entries;
+    int capacity;
+    CacheEntry* lru_head;
+    CacheEntry* lru_tail;
+    int64_t bytes;
+    int64_t budget_bytes;
+    // 다른 파이프라인과 나눠 쓰는 예산, 넘으면 자기 예산 안이라도 오래된 프레임부터 버림
+    MemoryComponent* memory;
+
+    int64_t hits;
+    int64_t misses;
+    int64_t evictions;
+    int64_t prefetched;
+
+    pthread_mutex_t mutex;
+    pthread_cond_t request;
+    pthread_t thread;
+    int thread_started;
+    // 미리 읽기를 요청받은 위치, 새 요청이 오면 이전 요청은 버림
+    int64_t prefetch_pts;
+    int prefetch_frames;
+    int quit;
+};
+
+static int compare_key(const CacheEntry* entry, int stream_index, int64_t pts) {
+    if (entry->stream_index != stream_index) {
+        return entry->stream_index < stream_index ? -1 : 1;
+    }
+    return (entry->pts > pts) - (entry->pts < pts);
+}
+
+// 키가 (stream_index, pts) 이하인 마지막 항목의 위치, 없으면 -1
+static int find_index(const FrameCache* cache, int stream_index, int64_t pts) {
+    int low = 0, high = cache->nb_entries;
+
+    while (low < high) {
+        int mid = (low + high) / 2;
+        if (compare_key(cache->entries[mid], stream_index, pts) <= 0) {
+            low = mid + 1;
+        } else {
+            high = mid;
+        }
+    }
+    return low - 1;
+}
+
+// pts에 화면에 보이는 프레임, 즉 표시 구간 [pts, pts + duration)에 pts가 들어가는 항목
+static CacheEntry* lookup(const FrameCache* cache, int stream_index, int64_t pts) {
+    int index = find_index(cache, stream_index, pts);
+    CacheEntry* entry;
+
+    if (index < 0) {
+        return NULL;
+    }
+    entry = cache->entries[index];
+    if (entry->stream_index != stream_index) {
+        return NULL;
+    }
+    if (entry->pts == pts || (entry->duration > 0 && pts < entry->pts + entry->duration)) {
+        return entry;
+    }
+    return NULL;
+}
+
+static void lru_unlink(FrameCache* cache, CacheEntry* entry) {
+    if (entry->prev != NULL) {
+        entry->prev->next = entry->next;
+    } else {
+        cache->lru_head = entry->next;
+    }
+    if (entry->next != NULL) {
+        entry->next->prev = entry->prev;
+    } else {
+        cache->lru_tail = entry->prev;
+    }
+    entry->prev = entry->next = NULL;
+}
+
+static void lru_push_front(FrameCache* cache, CacheEntry* entry) {
+    entry->prev = NULL;
+    entry->next = cache->lru_head;
+    if (cache->lru_head != NULL) {
+        cache->lru_head->prev = entry;
+    } else {
+        cache->lru_tail = entry;
+    }
+    cache->lru_head = entry;
+}
+
+static void remove_entry(FrameCache* cache, CacheEntry* entry) {
+    int index = find_index(cache, entry->stream_index, entry->pts);
+
+    memmove(&cache->entries[index], &cache->entries[index + 1],
+            (cache->nb_entries - index - 1) * sizeof(CacheEntry*));
+    cache->nb_entries--;
+    lru_unlink(cache, entry);
+    cache->bytes -= entry->bytes;
+    memory_release(cache->memory, entry->bytes);
+    av_frame_free(&entry->frame);
+    av_free(entry);
+}
+
+// 예산을 넘으면 가장 오래 쓰지 않은 프레임부터 버림, keep은 방금 넣은 항목이라 남겨둠
+static void evict(FrameCache* cache, const CacheEntry* keep) {
+    while ((cache->bytes > cache->budget_bytes || memory_over_budget(cache->memory)) &&
+           cache->lru_tail != NULL && cache->lru_tail != keep) {
+        remove_entry(cache, cache->lru_tail);
+        cache->evictions++;
+    }
+}
+
+// 다른 컴포넌트가 예산을 필요로 할 때 governor가 부름, 가장 오래 쓰지 않은 프레임부터 bytes 만큼 버림
+static int64_t shrink_cache(void* opaque, int64_t bytes) {
+    FrameCache* cache = (FrameCache*)opaque;
+    int64_t freed = 0;
+
+    pthread_mutex_lock(&cache->mutex);
+    while (freed < bytes && cache->lru_tail != NULL) {
+        freed += cache->lru_tail->bytes;
+        remove_entry(cache, cache->lru_tail);
+        cache->evictions++;
+    }
+    pthread_mutex_unlock(&cache->mutex);
+    return freed;
+}
+
+// mutex를 잡은 상태에서 호출, 프레임은 참조만 늘리고 데이터는 복사하지 않음
+static int insert(FrameCache* cache, int stream_index, const AVFrame* frame) {
+    CacheEntry* entry;
+    int index;
+
+    if (frame->pts == AV_NOPTS_VALUE) {
+        return 0;
+    }
+    index = find_index(cache, stream_index, frame->pts);
+    if (index >= 0 && compare_key(cache->entries[index], stream_index, frame->pts) == 0) {
+        return 0;
+    }
+
+    if (cache->nb_entries == cache->capacity) {
+        int capacity = cache->capacity ? cache->capacity * 2 : 64;
+        CacheEntry** entries = av_realloc_array(cache->entries, capacity, sizeof(CacheEntry*));
+        if (entries == NULL) {
+            return AVERROR(ENOMEM);
+        }
+        cache->entries = entries;
+        cache->capacity = capacity;
+    }
+
+    entry = av_mallocz(sizeof(CacheEntry));
+    if (entry == NULL) {
+        return AVERROR(ENOMEM);
+    }
+    entry->frame = av_frame_alloc();
+    if (entry->frame == NULL || av_frame_ref(entry->frame, frame) < 0) {
+        av_frame_free(&entry->frame);
+        av_free(entry);
+        return AVERROR(ENOMEM);
+    }
+    entry->stream_index = stream_index;
+    entry->pts = frame->pts;
+    entry->duration = frame->pkt_duration;
+    entry->bytes = memory_frame_bytes(frame);
+
+    index++;
+    memmove(&cache->entries[index + 1], &cache->entries[index], (cache->nb_entries - index) * sizeof(CacheEntry*));
+    cache->entries[index] = entry;
+    cache->nb_entries++;
+    lru_push_front(cache, entry);
+    cache->bytes += entry->bytes;
+    memory_charge(cache->memory, entry->bytes);
+
+    evict(cache, entry);
+    return 1;
+}
+
+// pts부터 캐시에 연달아 들어있는 프레임 수 (max 까지만 셈)
+static int cached_run(const FrameCache* cache, int stream_index, int64_t pts, int max) {
+    CacheEntry* entry;
+    int count = 0;
+
+    while (count < max && (entry = lookup(cache, stream_index, pts)) != NULL && entry->duration > 0) {
+        pts = entry->pts + entry->duration;
+        count++;
+    }
+    return count;
+}
+
+static int prefetch_cancelled(FrameCache* cache) {
+    int cancelled;
+
+    pthread_mutex_lock(&cache->mutex);
+    cancelled = cache->quit || cache->prefetch_pts != AV_NOPTS_VALUE;
+    pthread_mutex_unlock(&cache->mutex);
+    return cancelled;
+}
+
+// center가 속한 GOP의 키프레임부터 center 뒤로 prefetch_frames 개까지 디코딩해서 캐시에 넣음
+// 조작자가 다른 위치로 옮겨가면 (새 요청) 바로 그만둠
+static void prefetch_around(FrameCache* cache, int64_t center, AVFrame* frame) {
+    FileContext* file = &cache->prefetch_file;
+    AVCodecContext* codec_ctx = file->fmt_ctx->streams[file->v_index]->codec;
+    AVPacket pkt;
+    int after = 0;
+    int got_frame;
+    int ret;
+
+    pthread_mutex_lock(&cache->mutex);
+    ret = cached_run(cache, file->v_index, center, cache->prefetch_frames + 1);
+    pthread_mutex_unlock(&cache->mutex);
+    if (ret > cache->prefetch_frames) {
+        return;
+    }
+
+    if (av_seek_frame(file->fmt_ctx, file->v_index, center, AVSEEK_FLAG_BACKWARD) < 0) {
+        return;
+    }
+    avcodec_flush_buffers(codec_ctx);
+
+    // 전체 예산이 모자라면 미리 읽은 프레임이 지금 보고 있는 프레임을 밀어내므로 읽지 않음
+    while (after < cache->prefetch_frames && !prefetch_cancelled(cache) && !memory_over_budget(cache->memory)) {
+        ret = av_read_frame(file->fmt_ctx, &pkt);
+        if (ret < 0) {
+            break;
+        }
+        if (pkt.stream_index != file->v_index) {
+            av_free_packet(&pkt);
+            continue;
+        }
+
+        got_frame = 0;
+        ret = decode_packet(codec_ctx, &pkt, &frame, &got_frame);
+        av_free_packet(&pkt);
+        if (ret < 0 || !got_frame) {
+            continue;
+        }
+
+        if (frame->pts != AV_NOPTS_VALUE && frame->pts > center) {
+            after++;
+        }
+        pthread_mutex_lock(&cache->mutex);
+        if (insert(cache, file->v_index, frame) > 0) {
+            cache->prefetched++;
+        }
+        pthread_mutex_unlock(&cache->mutex);
+        av_frame_unref(frame);
+    }
+}
+
+static void* prefetch_worker(void* arg) {
+    FrameCache* cache = (FrameCache*)arg;
+    AVFrame* frame = av_frame_alloc();
+    int64_t center;
+
+    pthread_mutex_lock(&cache->mutex);
+    while (!cache->quit) {
+        if (cache->prefetch_pts == AV_NOPTS_VALUE) {
+            pthread_cond_wait(&cache->request, &cache->mutex);
+            continue;
+        }
+        center = cache->prefetch_pts;
+        cache->prefetch_pts = AV_NOPTS_VALUE;
+        pthread_mutex_unlock(&cache->mutex);
+
+        if (frame != NULL) {
+            prefetch_around(cache, center, frame);
+        }
+
+        pthread_mutex_lock(&cache->mutex);
+    }
+    pthread_mutex_unlock(&cache->mutex);
+
+    av_frame_free(&frame);
+    return NULL;
+}
+
+// 앞쪽으로 미리 읽어둔 프레임이 절반 아래로 줄었을 때만 요청
+// 캐시 안에서 한 프레임씩 움직일 때마다 미리 읽기를 키프레임부터 다시 시작하지 않도록 함
+static void request_prefetch(FrameCache* cache, int64_t pts) {
+    int ahead = cache->prefetch_frames / 2;
+
+    if (!cache->thread_started) {
+        return;
+    }
+    pthread_mutex_lock(&cache->mutex);
+    if (cached_run(cache, cache->file.v_index, pts, ahead + 1) <= ahead) {
+        cache->prefetch_pts = pts;
+        pthread_cond_signal(&cache->request);
+    }
+    pthread_mutex_unlock(&cache->mutex);
+}
+
+FrameCache* frame_cache_create(const char* filename, int64_t budget_bytes, int prefetch_frames, MemoryGovernor* memory) {
+    FrameCache* cache = av_mallocz(sizeof(FrameCache));
+    DecodeOptions opts;
+
+    if (cache == NULL) {
+        return NULL;
+    }
+    cache->budget_bytes = budget_bytes;
+    cache->prefetch_frames = prefetch_frames;
+    cache->prefetch_pts = AV_NOPTS_VALUE;
+    pthread_mutex_init(&cache->mutex, NULL);
+    pthread_cond_init(&cache->request, NULL);
+    cache->memory = memory_register(memory, "frame cache", shrink_cache, cache);
+
+    init_decode_options(&opts);
+    if (open_input(&cache->file, filename, &opts) < 0 || cache->file.v_index < 0) {
+        frame_cache_destroy(&cache);
+        return NULL;
+    }
+
+    if (prefetch_frames > 0) {
+        if (open_input(&cache->prefetch_file, filename, &opts) >= 0 && cache->prefetch_file.v_index >= 0 &&
+            pthread_create(&cache->thread, NULL, prefetch_worker, cache) == 0) {
+            cache->thread_started = 1;
+        }
+    }
+    return cache;
+}
+
+int frame_cache_get(FrameCache* cache, int64_t pts, AVFrame* frame) {
+    SeekStats seek_stats;
+    CacheEntry* entry;
+    int stream_index = cache->file.v_index;
+    int ret;
+
+    av_frame_unref(frame);
+
+    pthread_mutex_lock(&cache->mutex);
+    entry = lookup(cache, stream_index, pts);
+    if (entry != NULL) {
+        lru_unlink(cache, entry);
+        lru_push_front(cache, entry);
+        cache->hits++;
+        ret = av_frame_ref(frame, entry->frame);
+        pthread_mutex_unlock(&cache->mutex);
+
+        request_prefetch(cache, pts);
+        return ret;
+    }
+    cache->misses++;
+    pthread_mutex_unlock(&cache->mutex);
+
+    ret = seek_frame_at_pts(&cache->file, pts, frame, &seek_stats);
+    if (ret < 0) {
+        return ret;
+    }
+
+    pthread_mutex_lock(&cache->mutex);
+    insert(cache, stream_index, frame);
+    pthread_mutex_unlock(&cache->mutex);
+
+    request_prefetch(cache, pts);
+    return 0;
+}
+
+int frame_cache_get_at(FrameCache* cache, double seconds, AVFrame* frame) {
+    return frame_cache_get(cache, seconds_to_pts(cache->file.fmt_ctx->streams[cache->file.v_index], seconds), frame);
+}
+
+int frame_cache_step(FrameCache* cache, const AVFrame* current, int direction, AVFrame* frame) {
+    if (current->pts == AV_NOPTS_VALUE) {
+        return AVERROR(EINVAL);
+    }
+    // 앞 프레임은 current 직전 시각에 보이는 프레임, 뒤 프레임은 current의 표시가 끝나는 시각의 프레임
+    if (direction < 0) {
+        return frame_cache_get(cache, current->pts - 1, frame);
+    }
+    return frame_cache_get(cache, current->pts + FFMAX(current->pkt_duration, 1), frame);
+}
+
+void frame_cache_stats(FrameCache* cache, FrameCacheStats* stats) {
+    pthread_mutex_lock(&cache->mutex);
+    stats->hits = cache->hits;
+    stats->misses = cache->misses;
+    stats->evictions = cache->evictions;
+    stats->prefetched = cache->prefetched;
+    stats->frames = cache->nb_entries;
+    stats->bytes = cache->bytes;
+    stats->budget_bytes = cache->budget_bytes;
+    pthread_mutex_unlock(&cache->mutex);
+}
+
+void frame_cache_destroy(FrameCache** cache_ptr) {
+    FrameCache* cache = *cache_ptr;
+
+    if (cache == NULL) {
+        return;
+    }
+
+    if (cache->thread_started) {
+        pthread_mutex_lock(&cache->mutex);
+        cache->quit = 1;
+        pthread_cond_signal(&cache->request);
+        pthread_mutex_unlock(&cache->mutex);
+        pthread_join(cache->thread, NULL);
+    }
+
+    // 해제한 뒤에는 shrink_cache가 불리지 않고, 남은 프레임은 사용량에서 한꺼번에 빠짐
+    memory_unregister(&cache->memory);
+    while (cache->lru_tail != NULL) {
+        remove_entry(cache, cache->lru_tail);
+    }
+    av_free(cache->entries);
+
+    release(&cache->file);
+    release(&cache->prefetch_file);
+    pthread_cond_destroy(&cache->request);
+    pthread_mutex_destroy(&cache->mutex);
+    av_freep(cache_ptr);
+}
@@ -0,0 +1,300 @@
+#include <libavcodec/avcodec.h>
+#include <libavutil/buffer.h>
+#include <libavutil/imgutils.h>
+#include <libavutil/mem.h>
+#include <libavutil/pixdesc.h>
+#include <limits.h>
+#include <pthread.h>
+#include <string.h>
+
+#include "frame_pool.h"
+#include "memory_governor.h"
+
+// 평면 시작 위치 정렬 (av_malloc이 보장하는 정렬의 배수)
+#define FRAME_POOL_ALIGN 64
+// 디코더가 평면 끝을 넘어 읽는 SIMD 코드를 위한 여유 (FFmpeg 기본 할당과 같은 16 + 정렬)
+#define FRAME_POOL_PADDING (16 + FRAME_POOL_ALIGN - 1)
+
+// 풀 버퍼를 메모리 예산에 계산하는 컴포넌트
+// 디코더를 닫은 뒤에도 프레임이 잡고 있던 버퍼가 나중에 해제되므로, 풀과 FramePool이 모두 사라질 때 등록을 해제
+typedef struct _PoolMemory {
+    MemoryComponent* component;
+    int refs;
+    pthread_mutex_t mutex;
+} PoolMemory;
+
+// AVBufferPool 하나마다 (크기가 바뀌면 새 풀을 만듦)
+typedef struct _PoolAccount {
+    PoolMemory* memory;
+    int size;
+} PoolAccount;
+
+typedef struct _FramePool {
+    AVBufferPool* pool;
+    PoolMemory* memory;
+    int format;
+    int width;
+    int height;
+    int linesize[4];
+    size_t offsets[4];
+    int planes;
+    int size;
+    FramePoolStats stats;
+    // thread_safe_callbacks 이면 frame threading 의 워커들이 get_buffer2를 동시에 부르므로 위 상태를 모두 보호
+    pthread_mutex_t mutex;
+} FramePool;
+
+static PoolMemory* pool_memory_ref(PoolMemory* memory) {
+    pthread_mutex_lock(&memory->mutex);
+    memory->refs++;
+    pthread_mutex_unlock(&memory->mutex);
+    return memory;
+}
+
+static void pool_memory_unref(PoolMemory** memory_ptr) {
+    PoolMemory* memory = *memory_ptr;
+    int refs;
+
+    if (memory == NULL) {
+        return;
+    }
+    pthread_mutex_lock(&memory->mutex);
+    refs = --memory->refs;
+    pthread_mutex_unlock(&memory->mutex);
+
+    if (refs == 0) {
+        memory_unregister(&memory->component);
+        pthread_mutex_destroy(&memory->mutex);
+        av_free(memory);
+    }
+    *memory_ptr = NULL;
+}
+
+static void account_buffer_free(void* opaque, uint8_t* data) {
+    PoolAccount* account = (PoolAccount*)opaque;
+
+    memory_release(account->memory->component, account->size);
+    av_free(data);
+}
+
+// 풀이 비어 새 버퍼를 만들 때만 불림, 풀에 돌아가 재사용되는 동안에는 계속 계산에 남음
+static AVBufferRef* account_buffer_alloc(void* opaque, int size) {
+    PoolAccount* account = (PoolAccount*)opaque;
+    uint8_t* data = av_malloc(size);
+    AVBufferRef* buf;
+
+    if (data == NULL) {
+        return NULL;
+    }
+    buf = av_buffer_create(data, size, account_buffer_free, account, 0);
+    if (buf == NULL) {
+        av_free(data);
+        return NULL;
+    }
+    memory_charge(account->memory->component, size);
+    return buf;
+}
+
+// 풀의 마지막 버퍼까지 해제된 뒤 불림
+static void account_pool_free(void* opaque) {
+    PoolAccount* account = (PoolAccount*)opaque;
+
+    pool_memory_unref(&account->memory);
+    av_free(account);
+}
+
+static AVBufferPool* create_buffer_pool(FramePool* pool, int size) {
+    PoolAccount* account;
+    AVBufferPool* buffer_pool;
+
+    if (pool->memory == NULL) {
+        return av_buffer_pool_init(size, NULL);
+    }
+    account = av_mallocz(sizeof(PoolAccount));
+    if (account == NULL) {
+        return NULL;
+    }
+    account->memory = pool_memory_ref(pool->memory);
+    account->size = size;
+    buffer_pool = av_buffer_pool_init2(size, account, account_buffer_alloc, account_pool_free);
+    if (buffer_pool == NULL) {
+        pool_memory_unref(&account->memory);
+        av_free(account);
+    }
+    return buffer_pool;
+}
+
+// mutex를 잡은 상태에서 호출
+static int fallback_get_buffer(AVCodecContext* codec_ctx, AVFrame* frame, int flags) {
+    FramePool* pool = (FramePool*)codec_ctx->opaque;
+
+    pool->stats.fallbacks++;
+    return avcodec_default_get_buffer2(codec_ctx, frame, flags);
+}
+
+// FFmpeg 기본 할당(update_frame_pool)과 같은 방식으로 정렬된 linesize와 평면 크기를 구함, mutex를 잡은 상태에서 호출
+static int update_pool(AVCodecContext* codec_ctx, FramePool* pool, const AVFrame* frame) {
+    uint8_t* data[4];
+    int linesize[4];
+    int linesize_align[AV_NUM_DATA_POINTERS];
+    int w = frame->width;
+    int h = frame->height;
+    int unaligned;
+    int total;
+    size_t offset = 0;
+    int i;
+
+    avcodec_align_dimensions2(codec_ctx, &w, &h, linesize_align);
+
+    // linesize가 모두 정렬될 때까지 폭을 늘림
+    do {
+        if (av_image_fill_linesizes(linesize, frame->format, w) < 0) {
+            return -1;
+        }
+        w += w & ~(w - 1);
+
+        unaligned = 0;
+        for (i = 0; i < 4; i++) {
+            unaligned |= linesize[i] % linesize_align[i];
+        }
+    } while (unaligned);
+
+    // 버퍼 없이 호출하면 평면 시작 위치가 0 기준 오프셋으로 채워짐
+    total = av_image_fill_pointers(data, frame->format, h, NULL, linesize);
+    if (total < 0) {
+        return -1;
+    }
+
+    pool->planes = 0;
+    for (i = 0; i < 4 && linesize[i]; i++) {
+        size_t plane_size;
+
+        if (i + 1 < 4 && linesize[i + 1]) {
+            plane_size = data[i + 1] - data[i];
+        } else {
+            plane_size = total - (data[i] - data[0]);
+        }
+        pool->linesize[i] = linesize[i];
+        pool->offsets[i] = offset;
+        offset += FFALIGN(plane_size + FRAME_POOL_PADDING, FRAME_POOL_ALIGN);
+        pool->planes++;
+    }
+    if (offset > INT_MAX) {
+        return -1;
+    }
+
+    av_buffer_pool_uninit(&pool->pool);
+    pool->pool = create_buffer_pool(pool, (int)offset);
+    if (pool->pool == NULL) {
+        return -1;
+    }
+    pool->size = (int)offset;
+    pool->format = frame->format;
+    pool->width = frame->width;
+    pool->height = frame->height;
+    pool->stats.reinits++;
+    return 0;
+}
+
+static int pooled_get_buffer(AVCodecContext* codec_ctx, AVFrame* frame, int flags) {
+    FramePool* pool = (FramePool*)codec_ctx->opaque;
+    const AVPixFmtDescriptor* desc = av_pix_fmt_desc_get(frame->format);
+    int ret;
+    int i;
+
+    // thread_safe_callbacks 이므로 frame threading 의 워커 스레드들이 동시에 호출할 수 있음
+    pthread_mutex_lock(&pool->mutex);
+
+    // 팔레트나 하드웨어 프레임은 기본 할당이 따로 처리해야 함
+    if (desc == NULL || (desc->flags & (AV_PIX_FMT_FLAG_PAL | AV_PIX_FMT_FLAG_PSEUDOPAL | AV_PIX_FMT_FLAG_HWACCEL)) ||
+        codec_ctx->hw_frames_ctx != NULL) {
+        ret = fallback_get_buffer(codec_ctx, frame, flags);
+        pthread_mutex_unlock(&pool->mutex);
+        return ret;
+    }
+
+    if (pool->pool == NULL || pool->format != frame->format ||
+        pool->width != frame->width || pool->height != frame->height) {
+        if (update_pool(codec_ctx, pool, frame) < 0) {
+            ret = fallback_get_buffer(codec_ctx, frame, flags);
+            pthread_mutex_unlock(&pool->mutex);
+            return ret;
+        }
+    }
+
+    // 풀이 비어있을 때만 실제 버퍼를 할당, 이후에는 해제된 프레임의 버퍼를 그대로 다시 씀
+    frame->buf[0] = av_buffer_pool_get(pool->pool);
+    if (frame->buf[0] == NULL) {
+        pthread_mutex_unlock(&pool->mutex);
+        return AVERROR(ENOMEM);
+    }
+    for (i = 0; i < pool->planes; i++) {
+        frame->data[i] = frame->buf[0]->data + pool->offsets[i];
+        frame->linesize[i] = pool->linesize[i];
+    }
+    for (; i < AV_NUM_DATA_POINTERS; i++) {
+        frame->data[i] = NULL;
+        frame->linesize[i] = 0;
+    }
+    frame->extended_data = frame->data;
+    pool->stats.gets++;
+    pthread_mutex_unlock(&pool->mutex);
+    return 0;
+}
+
+int frame_pool_attach(AVCodecContext* codec_ctx, const AVCodec* decoder, MemoryGovernor* memory) {
+    FramePool* pool;
+
+    // 디코더가 직접 할당한 버퍼를 받을 수 없으면 (DR1 미지원) 기본 할당을 그대로 씀
+    if (codec_ctx->codec_type != AVMEDIA_TYPE_VIDEO || !(decoder->capabilities & AV_CODEC_CAP_DR1)) {
+        return -1;
+    }
+    pool = av_mallocz(sizeof(FramePool));
+    if (pool == NULL) {
+        return -2;
+    }
+    if (memory != NULL) {
+        pool->memory = av_mallocz(sizeof(PoolMemory));
+        if (pool->memory == NULL) {
+            av_free(pool);
+            return -2;
+        }
+        pool->memory->component = memory_register(memory, "frame pool", NULL, NULL);
+        pool->memory->refs = 1;
+        pthread_mutex_init(&pool->memory->mutex, NULL);
+    }
+    pthread_mutex_init(&pool->mutex, NULL);
+    codec_ctx->opaque = pool;
+    codec_ctx->get_buffer2 = pooled_get_buffer;
+    codec_ctx->thread_safe_callbacks = 1;
+    return 0;
+}
+
+void frame_pool_detach(AVCodecContext* codec_ctx) {
+    FramePool* pool;
+
+    if (codec_ctx->get_buffer2 != pooled_get_buffer) {
+        return;
+    }
+    pool = (FramePool*)codec_ctx->opaque;
+    av_buffer_pool_uninit(&pool->pool);
+    pool_memory_unref(&pool->memory);
+    pthread_mutex_destroy(&pool->mutex);
+    av_free(pool);
+    codec_ctx->opaque = NULL;
+    codec_ctx->get_buffer2 = avcodec_default_get_buffer2;
+}
+
+int frame_pool_stats(const AVCodecContext* codec_ctx, FramePoolStats* stats) {
+    FramePool* pool;
+
+    if (codec_ctx->get_buffer2 != pooled_get_buffer) {
+        memset(stats, 0, sizeof(*stats));
+        return -1;
+    }
+    pool = (FramePool*)codec_ctx->opaque;
+    pthread_mutex_lock(&pool->mutex);
+    *stats = pool->stats;
+    pthread_mutex_unlock(&pool->mutex);
+    return 0;
+}
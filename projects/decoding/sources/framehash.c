@@ -0,0 +1,614 @@
+#include <libavformat/avformat.h>
+#include <libavcodec/avcodec.h>
+#include <libavutil/avutil.h>
+#include <libavutil/bswap.h>
+#include <libavutil/cpu.h>
+#include <libavutil/imgutils.h>
+#include <libavutil/intreadwrite.h>
+#include <libavutil/md5.h>
+#include <libavutil/mem.h>
+#include <libavutil/pixdesc.h>
+#include <libavutil/time.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <string.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define FRAMEHASH_X86 1
+#endif
+
+#include "framehash.h"
+
+// XXH3-64 (seed 0, 기본 secret) 스트리밍 구현
+// 결과는 xxhash 라이브러리의 XXH3_64bits() 와 같음
+#define XXH_STRIPE_LEN 64
+#define XXH_SECRET_CONSUME_RATE 8
+#define XXH_ACC_NB 8
+#define XXH_SECRET_SIZE 192
+#define XXH_SECRET_MERGEACCS_START 11
+#define XXH_SECRET_LASTACC_START 7
+#define XXH_MID_SIZE_MAX 240
+#define XXH_BUFFER_SIZE 256
+#define XXH_STRIPES_PER_BLOCK ((XXH_SECRET_SIZE - XXH_STRIPE_LEN) / XXH_SECRET_CONSUME_RATE)
+
+#define XXH_PRIME32_1 0x9E3779B1U
+#define XXH_PRIME32_2 0x85EBCA77U
+#define XXH_PRIME32_3 0xC2B2AE3DU
+#define XXH_PRIME64_1 0x9E3779B185EBCA87ULL
+#define XXH_PRIME64_2 0xC2B2AE3D27D4EB4FULL
+#define XXH_PRIME64_3 0x165667B19E3779F9ULL
+#define XXH_PRIME64_4 0x85EBCA77C2B2AE63ULL
+#define XXH_PRIME64_5 0x27D4EB2F165667C5ULL
+
+// md5 모드에서 planar 오디오를 interleave 할 때 쓰는 버퍼 크기
+#define INTERLEAVE_BUFFER_SIZE 4096
+
+DECLARE_ALIGNED(64, static const uint8_t, xxh_secret)[XXH_SECRET_SIZE] = {
+    0xb8, 0xfe, 0x6c, 0x39, 0x23, 0xa4, 0x4b, 0xbe, 0x7c, 0x01, 0x81, 0x2c, 0xf7, 0x21, 0xad, 0x1c,
+    0xde, 0xd4, 0x6d, 0xe9, 0x83, 0x90, 0x97, 0xdb, 0x72, 0x40, 0xa4, 0xa4, 0xb7, 0xb3, 0x67, 0x1f,
+    0xcb, 0x79, 0xe6, 0x4e, 0xcc, 0xc0, 0xe5, 0x78, 0x82, 0x5a, 0xd0, 0x7d, 0xcc, 0xff, 0x72, 0x21,
+    0xb8, 0x08, 0x46, 0x74, 0xf7, 0x43, 0x24, 0x8e, 0xe0, 0x35, 0x90, 0xe6, 0x81, 0x3a, 0x26, 0x4c,
+    0x3c, 0x28, 0x52, 0xbb, 0x91, 0xc3, 0x00, 0xcb, 0x88, 0xd0, 0x65, 0x8b, 0x1b, 0x53, 0x2e, 0xa3,
+    0x71, 0x64, 0x48, 0x97, 0xa2, 0x0d, 0xf9, 0x4e, 0x38, 0x19, 0xef, 0x46, 0xa9, 0xde, 0xac, 0xd8,
+    0xa8, 0xfa, 0x76, 0x3f, 0xe3, 0x9c, 0x34, 0x3f, 0xf9, 0xdc, 0xbb, 0xc7, 0xc7, 0x0b, 0x4f, 0x1d,
+    0x8a, 0x51, 0xe0, 0x4b, 0xcd, 0xb4, 0x59, 0x31, 0xc8, 0x9f, 0x7e, 0xc9, 0xd9, 0x78, 0x73, 0x64,
+    0xea, 0xc5, 0xac, 0x83, 0x34, 0xd3, 0xeb, 0xc3, 0xc5, 0x81, 0xa0, 0xff, 0xfa, 0x13, 0x63, 0xeb,
+    0x17, 0x0d, 0xdd, 0x51, 0xb7, 0xf0, 0xda, 0x49, 0xd3, 0x16, 0x55, 0x26, 0x29, 0xd4, 0x68, 0x9e,
+    0x2b, 0x16, 0xbe, 0x58, 0x7d, 0x47, 0xa1, 0xfc, 0x8f, 0xf8, 0xb8, 0xd1, 0x7a, 0xd0, 0x31, 0xce,
+    0x45, 0xcb, 0x3a, 0x8f, 0x95, 0x16, 0x04, 0x28, 0xaf, 0xd7, 0xfb, 0xca, 0xbb, 0x4b, 0x40, 0x7e,
+};
+
+typedef struct _Xxh3State {
+    DECLARE_ALIGNED(64, uint64_t, acc)[XXH_ACC_NB];
+    DECLARE_ALIGNED(64, uint8_t, buffer)[XXH_BUFFER_SIZE];
+    size_t buffered;
+    size_t nb_stripes_acc;
+    uint64_t total_len;
+} Xxh3State;
+
+// 64바이트 stripe 를 nb_stripes 개 누적, secret 은 stripe 마다 8바이트씩 이동
+typedef void (*XxhAccumulateFunc)(uint64_t* acc, const uint8_t* input, const uint8_t* secret, size_t nb_stripes);
+typedef void (*XxhScrambleFunc)(uint64_t* acc, const uint8_t* secret);
+
+static XxhAccumulateFunc xxh_accumulate;
+static XxhScrambleFunc xxh_scramble;
+
+static uint64_t mul128_fold64(uint64_t lhs, uint64_t rhs) {
+#if defined(__SIZEOF_INT128__)
+    unsigned __int128 product = (unsigned __int128)lhs * rhs;
+    return (uint64_t)product ^ (uint64_t)(product >> 64);
+#else
+    uint64_t lo_lo = (lhs & 0xFFFFFFFF) * (rhs & 0xFFFFFFFF);
+    uint64_t hi_lo = (lhs >> 32) * (rhs & 0xFFFFFFFF);
+    uint64_t lo_hi = (lhs & 0xFFFFFFFF) * (rhs >> 32);
+    uint64_t hi_hi = (lhs >> 32) * (rhs >> 32);
+    uint64_t cross = (lo_lo >> 32) + (hi_lo & 0xFFFFFFFF) + lo_hi;
+    uint64_t upper = (hi_lo >> 32) + (cross >> 32) + hi_hi;
+    uint64_t lower = (cross << 32) | (lo_lo & 0xFFFFFFFF);
+    return lower ^ upper;
+#endif
+}
+
+static uint64_t rotl64(uint64_t value, int bits) {
+    return (value << bits) | (value >> (64 - bits));
+}
+
+static uint64_t xxh64_avalanche(uint64_t h) {
+    h ^= h >> 33;
+    h *= XXH_PRIME64_2;
+    h ^= h >> 29;
+    h *= XXH_PRIME64_3;
+    return h ^ (h >> 32);
+}
+
+static uint64_t xxh3_avalanche(uint64_t h) {
+    h ^= h >> 37;
+    h *= 0x165667919E3779F9ULL;
+    return h ^ (h >> 32);
+}
+
+static uint64_t xxh3_rrmxmx(uint64_t h, uint64_t len) {
+    h ^= rotl64(h, 49) ^ rotl64(h, 24);
+    h *= 0x9FB21C651E98DF25ULL;
+    h ^= (h >> 35) + len;
+    h *= 0x9FB21C651E98DF25ULL;
+    return h ^ (h >> 28);
+}
+
+static uint64_t xxh3_mix16(const uint8_t* input, const uint8_t* secret) {
+    return mul128_fold64(AV_RL64(input) ^ AV_RL64(secret), AV_RL64(input + 8) ^ AV_RL64(secret + 8));
+}
+
+// 240바이트 이하는 스트리밍 누적기를 쓰지 않고 길이별 전용 경로로 해시
+static uint64_t xxh3_hash_short(const uint8_t* input, size_t len) {
+    const uint8_t* secret = xxh_secret;
+    uint64_t acc;
+    size_t i;
+
+    if (len == 0) {
+        return xxh64_avalanche(AV_RL64(secret + 56) ^ AV_RL64(secret + 64));
+    }
+    if (len <= 3) {
+        uint32_t combined = ((uint32_t)input[0] << 16) | ((uint32_t)input[len >> 1] << 24) |
+                            (uint32_t)input[len - 1] | ((uint32_t)len << 8);
+        return xxh64_avalanche(combined ^ (uint64_t)(AV_RL32(secret) ^ AV_RL32(secret + 4)));
+    }
+    if (len <= 8) {
+        uint64_t input64 = AV_RL32(input + len - 4) + ((uint64_t)AV_RL32(input) << 32);
+        return xxh3_rrmxmx(input64 ^ (AV_RL64(secret + 8) ^ AV_RL64(secret + 16)), len);
+    }
+    if (len <= 16) {
+        uint64_t lo = AV_RL64(input) ^ (AV_RL64(secret + 24) ^ AV_RL64(secret + 32));
+        uint64_t hi = AV_RL64(input + len - 8) ^ (AV_RL64(secret + 40) ^ AV_RL64(secret + 48));
+        return xxh3_avalanche(len + av_bswap64(lo) + hi + mul128_fold64(lo, hi));
+    }
+
+    acc = len * XXH_PRIME64_1;
+    if (len <= 128) {
+        if (len > 32) {
+            if (len > 64) {
+                if (len > 96) {
+                    acc += xxh3_mix16(input + 48, secret + 96);
+                    acc += xxh3_mix16(input + len - 64, secret + 112);
+                }
+                acc += xxh3_mix16(input + 32, secret + 64);
+                acc += xxh3_mix16(input + len - 48, secret + 80);
+            }
+            acc += xxh3_mix16(input + 16, secret + 32);
+            acc += xxh3_mix16(input + len - 32, secret + 48);
+        }
+        acc += xxh3_mix16(input, secret);
+        acc += xxh3_mix16(input + len - 16, secret + 16);
+        return xxh3_avalanche(acc);
+    }
+
+    for (i = 0; i < 8; i++) {
+        acc += xxh3_mix16(input + 16 * i, secret + 16 * i);
+    }
+    acc = xxh3_avalanche(acc);
+    for (; i < len / 16; i++) {
+        acc += xxh3_mix16(input + 16 * i, secret + 16 * (i - 8) + 3);
+    }
+    acc += xxh3_mix16(input + len - 16, secret + 136 - 17);
+    return xxh3_avalanche(acc);
+}
+
+static void accumulate_scalar(uint64_t* acc, const uint8_t* input, const uint8_t* secret, size_t nb_stripes) {
+    size_t n;
+    int i;
+
+    for (n = 0; n < nb_stripes; n++) {
+        const uint8_t* in = input + n * XXH_STRIPE_LEN;
+        const uint8_t* key = secret + n * XXH_SECRET_CONSUME_RATE;
+        for (i = 0; i < XXH_ACC_NB; i++) {
+            uint64_t data = AV_RL64(in + 8 * i);
+            uint64_t data_key = data ^ AV_RL64(key + 8 * i);
+            acc[i ^ 1] += data;
+            acc[i] += (data_key & 0xFFFFFFFF) * (data_key >> 32);
+        }
+    }
+}
+
+static void scramble_scalar(uint64_t* acc, const uint8_t* secret) {
+    int i;
+
+    for (i = 0; i < XXH_ACC_NB; i++) {
+        uint64_t value = acc[i];
+        value ^= value >> 47;
+        value ^= AV_RL64(secret + 8 * i);
+        acc[i] = value * XXH_PRIME32_1;
+    }
+}
+
+#ifdef FRAMEHASH_X86
+// 누적기를 레지스터에 올려둔 채로 stripe 를 연속 처리 (acc 는 64바이트 정렬)
+__attribute__((target("sse2")))
+static void accumulate_sse2(uint64_t* acc, const uint8_t* input, const uint8_t* secret, size_t nb_stripes) {
+    __m128i xacc[4];
+    size_t n;
+    int i;
+
+    for (i = 0; i < 4; i++) {
+        xacc[i] = _mm_load_si128((const __m128i*)acc + i);
+    }
+    for (n = 0; n < nb_stripes; n++) {
+        const uint8_t* in = input + n * XXH_STRIPE_LEN;
+        const uint8_t* key = secret + n * XXH_SECRET_CONSUME_RATE;
+        for (i = 0; i < 4; i++) {
+            __m128i data = _mm_loadu_si128((const __m128i*)(in + 16 * i));
+            __m128i data_key = _mm_xor_si128(data, _mm_loadu_si128((const __m128i*)(key + 16 * i)));
+            __m128i data_key_hi = _mm_shuffle_epi32(data_key, _MM_SHUFFLE(0, 3, 0, 1));
+            __m128i product = _mm_mul_epu32(data_key, data_key_hi);
+            __m128i data_swap = _mm_shuffle_epi32(data, _MM_SHUFFLE(1, 0, 3, 2));
+            xacc[i] = _mm_add_epi64(_mm_add_epi64(xacc[i], data_swap), product);
+        }
+    }
+    for (i = 0; i < 4; i++) {
+        _mm_store_si128((__m128i*)acc + i, xacc[i]);
+    }
+}
+
+__attribute__((target("sse2")))
+static void scramble_sse2(uint64_t* acc, const uint8_t* secret) {
+    const __m128i prime32 = _mm_set1_epi32((int)XXH_PRIME32_1);
+    int i;
+
+    for (i = 0; i < 4; i++) {
+        __m128i value = _mm_load_si128((const __m128i*)acc + i);
+        __m128i data_key;
+        __m128i prod_lo, prod_hi;
+
+        value = _mm_xor_si128(value, _mm_srli_epi64(value, 47));
+        data_key = _mm_xor_si128(value, _mm_loadu_si128((const __m128i*)(secret + 16 * i)));
+        prod_lo = _mm_mul_epu32(data_key, prime32);
+        prod_hi = _mm_mul_epu32(_mm_shuffle_epi32(data_key, _MM_SHUFFLE(0, 3, 0, 1)), prime32);
+        _mm_store_si128((__m128i*)acc + i, _mm_add_epi64(prod_lo, _mm_slli_epi64(prod_hi, 32)));
+    }
+}
+
+__attribute__((target("avx2")))
+static void accumulate_avx2(uint64_t* acc, const uint8_t* input, const uint8_t* secret, size_t nb_stripes) {
+    __m256i xacc0 = _mm256_load_si256((const __m256i*)acc);
+    __m256i xacc1 = _mm256_load_si256((const __m256i*)acc + 1);
+    size_t n;
+
+    for (n = 0; n < nb_stripes; n++) {
+        const uint8_t* in = input + n * XXH_STRIPE_LEN;
+        const uint8_t* key = secret + n * XXH_SECRET_CONSUME_RATE;
+        __m256i data0 = _mm256_loadu_si256((const __m256i*)in);
+        __m256i data1 = _mm256_loadu_si256((const __m256i*)(in + 32));
+        __m256i data_key0 = _mm256_xor_si256(data0, _mm256_loadu_si256((const __m256i*)key));
+        __m256i data_key1 = _mm256_xor_si256(data1, _mm256_loadu_si256((const __m256i*)(key + 32)));
+        __m256i product0 = _mm256_mul_epu32(data_key0, _mm256_srli_epi64(data_key0, 32));
+        __m256i product1 = _mm256_mul_epu32(data_key1, _mm256_srli_epi64(data_key1, 32));
+
+        xacc0 = _mm256_add_epi64(_mm256_add_epi64(xacc0, _mm256_shuffle_epi32(data0, _MM_SHUFFLE(1, 0, 3, 2))), product0);
+        xacc1 = _mm256_add_epi64(_mm256_add_epi64(xacc1, _mm256_shuffle_epi32(data1, _MM_SHUFFLE(1, 0, 3, 2))), product1);
+    }
+    _mm256_store_si256((__m256i*)acc, xacc0);
+    _mm256_store_si256((__m256i*)acc + 1, xacc1);
+}
+
+__attribute__((target("avx2")))
+static void scramble_avx2(uint64_t* acc, const uint8_t* secret) {
+    const __m256i prime32 = _mm256_set1_epi32((int)XXH_PRIME32_1);
+    int i;
+
+    for (i = 0; i < 2; i++) {
+        __m256i value = _mm256_load_si256((const __m256i*)acc + i);
+        __m256i data_key;
+        __m256i prod_lo, prod_hi;
+
+        value = _mm256_xor_si256(value, _mm256_srli_epi64(value, 47));
+        data_key = _mm256_xor_si256(value, _mm256_loadu_si256((const __m256i*)(secret + 32 * i)));
+        prod_lo = _mm256_mul_epu32(data_key, prime32);
+        prod_hi = _mm256_mul_epu32(_mm256_srli_epi64(data_key, 32), prime32);
+        _mm256_store_si256((__m256i*)acc + i, _mm256_add_epi64(prod_lo, _mm256_slli_epi64(prod_hi, 32)));
+    }
+}
+#endif
+
+// CPU가 지원하는 가장 넓은 SIMD 커널을 고름 (여러 스레드에서 불려도 같은 값을 씀)
+static void select_xxh3_kernels(void) {
+    XxhAccumulateFunc accumulate = accumulate_scalar;
+    XxhScrambleFunc scramble = scramble_scalar;
+#ifdef FRAMEHASH_X86
+    int flags = av_get_cpu_flags();
+
+    if (flags & AV_CPU_FLAG_SSE2) {
+        accumulate = accumulate_sse2;
+        scramble = scramble_sse2;
+    }
+    if (flags & AV_CPU_FLAG_AVX2) {
+        accumulate = accumulate_avx2;
+        scramble = scramble_avx2;
+    }
+#endif
+    xxh_scramble = scramble;
+    xxh_accumulate = accumulate;
+}
+
+static void xxh3_reset(Xxh3State* state) {
+    state->acc[0] = XXH_PRIME32_3;
+    state->acc[1] = XXH_PRIME64_1;
+    state->acc[2] = XXH_PRIME64_2;
+    state->acc[3] = XXH_PRIME64_3;
+    state->acc[4] = XXH_PRIME64_4;
+    state->acc[5] = XXH_PRIME32_2;
+    state->acc[6] = XXH_PRIME64_5;
+    state->acc[7] = XXH_PRIME32_1;
+    state->buffered = 0;
+    state->nb_stripes_acc = 0;
+    state->total_len = 0;
+    if (xxh_accumulate == NULL) {
+        select_xxh3_kernels();
+    }
+}
+
+// stripe 를 누적하다가 블록(16 stripe)이 찰 때마다 scramble, 블록 안의 위치를 반환
+static size_t xxh3_consume_stripes(uint64_t* acc, size_t nb_stripes_acc, const uint8_t* input, size_t nb_stripes) {
+    while (nb_stripes_acc + nb_stripes >= XXH_STRIPES_PER_BLOCK) {
+        size_t stripes_to_end = XXH_STRIPES_PER_BLOCK - nb_stripes_acc;
+
+        xxh_accumulate(acc, input, xxh_secret + nb_stripes_acc * XXH_SECRET_CONSUME_RATE, stripes_to_end);
+        xxh_scramble(acc, xxh_secret + XXH_SECRET_SIZE - XXH_STRIPE_LEN);
+        input += stripes_to_end * XXH_STRIPE_LEN;
+        nb_stripes -= stripes_to_end;
+        nb_stripes_acc = 0;
+    }
+    xxh_accumulate(acc, input, xxh_secret + nb_stripes_acc * XXH_SECRET_CONSUME_RATE, nb_stripes);
+    return nb_stripes_acc + nb_stripes;
+}
+
+static void xxh3_update(Xxh3State* state, const uint8_t* input, size_t len) {
+    if (len == 0) {
+        return;
+    }
+    state->total_len += len;
+
+    if (state->buffered + len <= XXH_BUFFER_SIZE) {
+        memcpy(state->buffer + state->buffered, input, len);
+        state->buffered += len;
+        return;
+    }
+
+    if (state->buffered > 0) {
+        size_t fill = XXH_BUFFER_SIZE - state->buffered;
+
+        memcpy(state->buffer + state->buffered, input, fill);
+        input += fill;
+        len -= fill;
+        state->nb_stripes_acc = xxh3_consume_stripes(state->acc, state->nb_stripes_acc, state->buffer,
+                                                     XXH_BUFFER_SIZE / XXH_STRIPE_LEN);
+        state->buffered = 0;
+    }
+
+    // 마지막 stripe 는 digest 에서 처리하므로 항상 1바이트 이상을 남김
+    if (len > XXH_BUFFER_SIZE) {
+        size_t nb_stripes = (len - 1) / XXH_STRIPE_LEN;
+
+        state->nb_stripes_acc = xxh3_consume_stripes(state->acc, state->nb_stripes_acc, input, nb_stripes);
+        input += nb_stripes * XXH_STRIPE_LEN;
+        len -= nb_stripes * XXH_STRIPE_LEN;
+        memcpy(state->buffer + XXH_BUFFER_SIZE - XXH_STRIPE_LEN, input - XXH_STRIPE_LEN, XXH_STRIPE_LEN);
+    }
+
+    memcpy(state->buffer, input, len);
+    state->buffered = len;
+}
+
+static uint64_t xxh3_digest(const Xxh3State* state) {
+    DECLARE_ALIGNED(64, uint64_t, acc)[XXH_ACC_NB];
+    const uint8_t* last_secret = xxh_secret + XXH_SECRET_SIZE - XXH_STRIPE_LEN - XXH_SECRET_LASTACC_START;
+    uint64_t result;
+    int i;
+
+    if (state->total_len <= XXH_MID_SIZE_MAX) {
+        return xxh3_hash_short(state->buffer, (size_t)state->total_len);
+    }
+
+    memcpy(acc, state->acc, sizeof(acc));
+    if (state->buffered >= XXH_STRIPE_LEN) {
+        xxh3_consume_stripes(acc, state->nb_stripes_acc, state->buffer, (state->buffered - 1) / XXH_STRIPE_LEN);
+        xxh_accumulate(acc, state->buffer + state->buffered - XXH_STRIPE_LEN, last_secret, 1);
+    } else {
+        // 남은 데이터가 stripe 하나보다 짧으면 직전에 처리한 데이터로 앞을 채움
+        uint8_t last_stripe[XXH_STRIPE_LEN];
+        size_t catchup = XXH_STRIPE_LEN - state->buffered;
+
+        memcpy(last_stripe, state->buffer + XXH_BUFFER_SIZE - catchup, catchup);
+        memcpy(last_stripe + catchup, state->buffer, state->buffered);
+        xxh_accumulate(acc, last_stripe, last_secret, 1);
+    }
+
+    result = state->total_len * XXH_PRIME64_1;
+    for (i = 0; i < XXH_ACC_NB; i += 2) {
+        const uint8_t* secret = xxh_secret + XXH_SECRET_MERGEACCS_START + 8 * i;
+        result += mul128_fold64(acc[i] ^ AV_RL64(secret), acc[i + 1] ^ AV_RL64(secret + 8));
+    }
+    return xxh3_avalanche(result);
+}
+
+// 평면마다 (행 바이트 수, 행 수, 평면 수)를 구함, linesize 패딩은 제외
+static int get_plane_layout(const AVFrame* frame, enum AVMediaType type, int row_bytes[FRAME_HASH_MAX_PLANES],
+                            int rows[FRAME_HASH_MAX_PLANES]) {
+    int nb_planes, i;
+
+    if (type == AVMEDIA_TYPE_VIDEO) {
+        const AVPixFmtDescriptor* desc = av_pix_fmt_desc_get(frame->format);
+
+        if (desc == NULL || (desc->flags & AV_PIX_FMT_FLAG_HWACCEL)) {
+            return AVERROR(EINVAL);
+        }
+        if (av_image_fill_linesizes(row_bytes, frame->format, frame->width) < 0) {
+            return AVERROR(EINVAL);
+        }
+        nb_planes = av_pix_fmt_count_planes(frame->format);
+        for (i = 0; i < nb_planes; i++) {
+            rows[i] = (i == 1 || i == 2) ? AV_CEIL_RSHIFT(frame->height, desc->log2_chroma_h) : frame->height;
+        }
+        return nb_planes;
+    }
+
+    if (type == AVMEDIA_TYPE_AUDIO) {
+        int bytes_per_sample = av_get_bytes_per_sample(frame->format);
+        int planar = av_sample_fmt_is_planar(frame->format);
+
+        if (bytes_per_sample <= 0) {
+            return AVERROR(EINVAL);
+        }
+        nb_planes = planar ? frame->channels : 1;
+        if (nb_planes > FRAME_HASH_MAX_PLANES) {
+            return AVERROR(EINVAL);
+        }
+        for (i = 0; i < nb_planes; i++) {
+            row_bytes[i] = frame->nb_samples * bytes_per_sample * (planar ? 1 : frame->channels);
+            rows[i] = 1;
+        }
+        return nb_planes;
+    }
+
+    return AVERROR(EINVAL);
+}
+
+static const uint8_t* plane_row(const AVFrame* frame, int plane, int row) {
+    return frame->extended_data[plane] + (ptrdiff_t)row * frame->linesize[plane];
+}
+
+int hash_frame_planes(const AVFrame* frame, enum AVMediaType type, uint64_t hashes[FRAME_HASH_MAX_PLANES]) {
+    Xxh3State state;
+    int row_bytes[FRAME_HASH_MAX_PLANES], rows[FRAME_HASH_MAX_PLANES];
+    int nb_planes, plane, row;
+
+    nb_planes = get_plane_layout(frame, type, row_bytes, rows);
+    for (plane = 0; plane < nb_planes; plane++) {
+        xxh3_reset(&state);
+        for (row = 0; row < rows[plane]; row++) {
+            xxh3_update(&state, plane_row(frame, plane, row), row_bytes[plane]);
+        }
+        hashes[plane] = xxh3_digest(&state);
+    }
+    return nb_planes;
+}
+
+// ffmpeg framemd5 의 rawvideo / pcm 패킷과 같은 바이트열을 MD5에 넣고 그 크기를 반환
+static int md5_frame(struct AVMD5* md5, const AVFrame* frame, enum AVMediaType type) {
+    int row_bytes[FRAME_HASH_MAX_PLANES], rows[FRAME_HASH_MAX_PLANES];
+    int nb_planes, plane, row, size = 0;
+
+    nb_planes = get_plane_layout(frame, type, row_bytes, rows);
+    if (nb_planes < 0) {
+        return nb_planes;
+    }
+
+    if (type == AVMEDIA_TYPE_AUDIO && nb_planes > 1) {
+        uint8_t buffer[INTERLEAVE_BUFFER_SIZE];
+        int bytes_per_sample = av_get_bytes_per_sample(frame->format);
+        int used = 0, sample;
+
+        for (sample = 0; sample < frame->nb_samples; sample++) {
+            if (used + bytes_per_sample * nb_planes > INTERLEAVE_BUFFER_SIZE) {
+                av_md5_update(md5, buffer, used);
+                used = 0;
+            }
+            for (plane = 0; plane < nb_planes; plane++) {
+                memcpy(buffer + used, frame->extended_data[plane] + sample * bytes_per_sample, bytes_per_sample);
+                used += bytes_per_sample;
+            }
+        }
+        av_md5_update(md5, buffer, used);
+        return frame->nb_samples * bytes_per_sample * nb_planes;
+    }
+
+    for (plane = 0; plane < nb_planes; plane++) {
+        for (row = 0; row < rows[plane]; row++) {
+            av_md5_update(md5, plane_row(frame, plane, row), row_bytes[plane]);
+        }
+        size += row_bytes[plane] * rows[plane];
+    }
+    return size;
+}
+
+static void write_stream_header(FrameHashContext* ctx, int index) {
+    AVStream* stream = ctx->file->fmt_ctx->streams[index];
+    AVCodecContext* codec_ctx = stream->codec;
+
+    fprintf(ctx->out, "#tb %d: %d/%d\n", index, stream->time_base.num, stream->time_base.den);
+    fprintf(ctx->out, "#media_type %d: %s\n", index, av_get_media_type_string(codec_ctx->codec_type));
+    if (codec_ctx->codec_type == AVMEDIA_TYPE_VIDEO) {
+        fprintf(ctx->out, "#codec_id %d: %s\n", index, avcodec_get_name(AV_CODEC_ID_RAWVIDEO));
+        fprintf(ctx->out, "#dimensions %d: %dx%d\n", index, codec_ctx->width, codec_ctx->height);
+        fprintf(ctx->out, "#sar %d: %d/%d\n", index, stream->sample_aspect_ratio.num, stream->sample_aspect_ratio.den);
+    } else {
+        char layout[128];
+
+        av_get_channel_layout_string(layout, sizeof(layout), codec_ctx->channels, codec_ctx->channel_layout);
+        fprintf(ctx->out, "#codec_id %d: %s\n", index,
+                avcodec_get_name(av_get_pcm_codec(av_get_packed_sample_fmt(codec_ctx->sample_fmt), 0)));
+        fprintf(ctx->out, "#sample_rate %d: %d\n", index, codec_ctx->sample_rate);
+        fprintf(ctx->out, "#channel_layout %d: %"PRIx64"\n", index, codec_ctx->channel_layout);
+        fprintf(ctx->out, "#channel_layout_name %d: %s\n", index, layout);
+    }
+}
+
+int init_frame_hash(FrameHashContext* ctx, FrameHashType type, const FileContext* file, FILE* out) {
+    memset(ctx, 0, sizeof(*ctx));
+    ctx->type = type;
+    ctx->file = file;
+    ctx->out = out;
+
+    if (type == FRAME_HASH_MD5) {
+        ctx->md5 = av_md5_alloc();
+        if (ctx->md5 == NULL) {
+            return -1;
+        }
+    }
+
+    fprintf(out, "#format: frame checksums\n");
+    fprintf(out, "#version: 2\n");
+    fprintf(out, "#hash: %s\n", type == FRAME_HASH_MD5 ? "MD5" : "XXH3-64 per plane");
+    if (file->v_index >= 0) {
+        write_stream_header(ctx, file->v_index);
+    }
+    if (file->a_index >= 0) {
+        write_stream_header(ctx, file->a_index);
+    }
+    fprintf(out, "#stream#, dts,        pts, duration,     size, hash\n");
+    return 0;
+}
+
+void release_frame_hash(FrameHashContext* ctx) {
+    av_freep(&ctx->md5);
+}
+
+static int64_t rescale_ts(int64_t ts, AVRational from, AVRational to) {
+    return ts == AV_NOPTS_VALUE ? ts : av_rescale_q(ts, from, to);
+}
+
+int write_frame_hash(FrameHashContext* ctx, int stream_index, const AVFrame* frame, AVRational time_base) {
+    AVStream* stream = ctx->file->fmt_ctx->streams[stream_index];
+    enum AVMediaType type = stream->codec->codec_type;
+    uint64_t hashes[FRAME_HASH_MAX_PLANES];
+    uint8_t digest[16];
+    int64_t start = av_gettime_relative();
+    int nb_planes = 0, size = 0, i;
+
+    if (ctx->type == FRAME_HASH_MD5) {
+        av_md5_init(ctx->md5);
+        size = md5_frame(ctx->md5, frame, type);
+        if (size < 0) {
+            return size;
+        }
+        av_md5_final(ctx->md5, digest);
+    } else {
+        int row_bytes[FRAME_HASH_MAX_PLANES], rows[FRAME_HASH_MAX_PLANES];
+
+        nb_planes = hash_frame_planes(frame, type, hashes);
+        if (nb_planes < 0) {
+            return nb_planes;
+        }
+        get_plane_layout(frame, type, row_bytes, rows);
+        for (i = 0; i < nb_planes; i++) {
+            size += row_bytes[i] * rows[i];
+        }
+    }
+    ctx->hash_time_us += av_gettime_relative() - start;
+    ctx->bytes += size;
+    ctx->frames++;
+
+    fprintf(ctx->out, "%d, %10"PRId64", %10"PRId64", %8"PRId64", %8d, ", stream_index,
+            rescale_ts(frame->pkt_dts, time_base, stream->time_base),
+            rescale_ts(av_frame_get_best_effort_timestamp(frame), time_base, stream->time_base),
+            rescale_ts(frame->pkt_duration, time_base, stream->time_base), size);
+    if (ctx->type == FRAME_HASH_MD5) {
+        for (i = 0; i < 16; i++) {
+            fprintf(ctx->out, "%02x", digest[i]);
+        }
+    } else {
+        for (i = 0; i < nb_planes; i++) {
+            fprintf(ctx->out, i ? " %016"PRIx64 : "%016"PRIx64, hashes[i]);
+        }
+    }
+    fputc('\n', ctx->out);
+    return 0;
+}
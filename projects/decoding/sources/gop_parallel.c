@@ -0,0 +1,370 @@
+#include <libavformat/avformat.h>
+#include <libavcodec/avcodec.h>
+#include <libavutil/avutil.h>
+#include <libavutil/cpu.h>
+#include <libavutil/time.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "decoder.h"
+#include "gop_parallel.h"
+#include "memory_governor.h"
+
+// 예산을 기다리는 동안 내보낼 차례가 되었는지 확인하는 간격
+#define MEMORY_POLL_MS 50
+
+typedef struct _GopRange {
+    int64_t start_dts;
+    int64_t start_pts;
+    // 다음 GOP의 시작 dts와 키프레임 pts, 마지막 GOP는 AV_NOPTS_VALUE (파일 끝까지)
+    int64_t end_dts;
+    int64_t end_pts;
+    // 키프레임보다 앞서 보이는 leading 프레임은 이전 GOP의 워커가 내보냄 (첫 GOP만 0)
+    int leading_in_previous;
+    AVFrame** frames;
+    int nb_frames;
+    int64_t bytes;
+    int dropped;
+    int done;
+    int failed;
+} GopRange;
+
+typedef struct _GopScheduler {
+    const char* filename;
+    GopRange* gops;
+    int nb_gops;
+    // 다음에 워커가 가져갈 GOP
+    int next_gop;
+    // 다음에 callback으로 내보낼 GOP
+    int next_emit;
+    int max_buffered;
+    // 재정렬 버퍼에 든 프레임을 계산에 넣는 컴포넌트 (NULL 가능)
+    MemoryComponent* memory;
+    // 디코딩을 마친 GOP의 크기 합, 다음 GOP가 차지할 메모리를 평균으로 어림잡음
+    int64_t decoded_bytes;
+    int decoded_gops;
+    pthread_mutex_t mutex;
+    pthread_cond_t gop_done;
+    pthread_cond_t emitted;
+} GopScheduler;
+
+void init_gop_parallel_options(GopParallelOptions* opts) {
+    opts->threads = av_cpu_count();
+    opts->max_buffered_gops = 2 * opts->threads;
+    opts->memory = NULL;
+}
+
+static int64_t packet_ts(const AVPacket* pkt) {
+    return pkt->dts != AV_NOPTS_VALUE ? pkt->dts : pkt->pts;
+}
+
+// 파일을 한 번 훑으며 비디오 키프레임마다 GOP 범위를 만듦
+static int index_gops(const char* filename, GopRange** gops, int* nb_gops) {
+    FileContext file;
+    AVPacket pkt;
+    int capacity = 0;
+
+    *gops = NULL;
+    *nb_gops = 0;
+
+    if (open_input(&file, filename, NULL) < 0 || file.v_index < 0) {
+        release(&file);
+        return -1;
+    }
+
+    while (av_read_frame(file.fmt_ctx, &pkt) >= 0) {
+        if (pkt.stream_index == file.v_index && (pkt.flags & AV_PKT_FLAG_KEY) && packet_ts(&pkt) != AV_NOPTS_VALUE) {
+            if (*nb_gops == capacity) {
+                capacity = capacity ? capacity * 2 : 64;
+                if (av_reallocp_array(gops, capacity, sizeof(GopRange)) < 0) {
+                    av_free_packet(&pkt);
+                    release(&file);
+                    *nb_gops = 0;
+                    return -2;
+                }
+            }
+
+            GopRange* gop = &(*gops)[*nb_gops];
+            memset(gop, 0, sizeof(*gop));
+            gop->start_dts = packet_ts(&pkt);
+            gop->start_pts = pkt.pts != AV_NOPTS_VALUE ? pkt.pts : pkt.dts;
+            gop->end_dts = AV_NOPTS_VALUE;
+            gop->end_pts = AV_NOPTS_VALUE;
+            if (*nb_gops > 0) {
+                (*gops)[*nb_gops - 1].end_dts = gop->start_dts;
+                (*gops)[*nb_gops - 1].end_pts = gop->start_pts;
+                gop->leading_in_previous = 1;
+            }
+            (*nb_gops)++;
+        }
+        av_free_packet(&pkt);
+    }
+
+    release(&file);
+    return 0;
+}
+
+static void collect_frame(GopRange* gop, AVFrame* frame, MemoryComponent* memory) {
+    AVFrame* out;
+    int64_t bytes;
+
+    // open GOP의 leading 프레임은 이전 GOP를 참조하므로 이 디코더에서는 올바르게 나올 수 없음
+    // 이전 GOP의 워커가 대신 내보내고, 파일 첫 GOP의 것만 실제로 버려짐
+    if (frame->pts != AV_NOPTS_VALUE && frame->pts < gop->start_pts) {
+        gop->dropped += !gop->leading_in_previous;
+        av_frame_unref(frame);
+        return;
+    }
+    // 다음 GOP의 leading 프레임을 꺼내려고 함께 디코딩한 다음 키프레임은 다음 GOP의 워커가 내보냄
+    if (gop->end_pts != AV_NOPTS_VALUE && frame->pts != AV_NOPTS_VALUE && frame->pts >= gop->end_pts) {
+        av_frame_unref(frame);
+        return;
+    }
+
+    out = av_frame_alloc();
+    if (out == NULL) {
+        gop->dropped++;
+        av_frame_unref(frame);
+        return;
+    }
+    av_frame_move_ref(out, frame);
+    av_dynarray_add(&gop->frames, &gop->nb_frames, out);
+    if (gop->frames == NULL) {
+        av_frame_free(&out);
+        gop->failed = 1;
+        return;
+    }
+    bytes = memory_frame_bytes(out);
+    gop->bytes += bytes;
+    memory_charge(memory, bytes);
+}
+
+static void decode_and_collect(AVCodecContext* codec_ctx, AVPacket* pkt, GopRange* gop, AVFrame* frame,
+                               MemoryComponent* memory) {
+    int got_frame = 0;
+    int ret;
+
+    ret = decode_packet(codec_ctx, pkt, &frame, &got_frame);
+    av_free_packet(pkt);
+    if (ret >= 0 && got_frame) {
+        collect_frame(gop, frame, memory);
+    }
+}
+
+static int decode_gop(FileContext* file, GopRange* gop, AVFrame* frame, MemoryComponent* memory) {
+    AVCodecContext* codec_ctx = file->fmt_ctx->streams[file->v_index]->codec;
+    AVPacket pkt;
+    // 다음 GOP의 키프레임, 뒤에 leading 프레임이 올 때만 디코딩함 (closed GOP에서는 디코딩하지 않고 버림)
+    AVPacket next_key;
+    int in_next = 0;
+    int got_frame;
+
+    // GOP의 키프레임이나 그보다 앞선 위치로 이동한 뒤 범위 밖의 패킷은 건너뜀
+    if (av_seek_frame(file->fmt_ctx, file->v_index, gop->start_pts, AVSEEK_FLAG_BACKWARD) < 0) {
+        return -1;
+    }
+    avcodec_flush_buffers(codec_ctx);
+    av_init_packet(&next_key);
+    next_key.data = NULL;
+    next_key.size = 0;
+
+    while (av_read_frame(file->fmt_ctx, &pkt) >= 0) {
+        if (pkt.stream_index != file->v_index || packet_ts(&pkt) < gop->start_dts) {
+            av_free_packet(&pkt);
+            continue;
+        }
+        // 다음 GOP에 들어서도 키프레임 뒤의 leading 프레임(pts가 키프레임보다 앞섬)은 이 GOP의 참조 프레임이
+        // 디코더에 남아 있는 여기서만 올바르게 디코딩되므로, leading 프레임이 끝날 때까지 계속 디코딩
+        if (gop->end_dts != AV_NOPTS_VALUE && packet_ts(&pkt) >= gop->end_dts) {
+            if (gop->end_pts == AV_NOPTS_VALUE ||
+                (in_next && (pkt.pts == AV_NOPTS_VALUE || pkt.pts >= gop->end_pts))) {
+                av_free_packet(&pkt);
+                break;
+            }
+            if (!in_next) {
+                av_packet_move_ref(&next_key, &pkt);
+                in_next = 1;
+                continue;
+            }
+            if (next_key.data != NULL) {
+                decode_and_collect(codec_ctx, &next_key, gop, frame, memory);
+            }
+        }
+
+        decode_and_collect(codec_ctx, &pkt, gop, frame, memory);
+    }
+    av_free_packet(&next_key);
+
+    // GOP가 끝나면 디코더에 남은 프레임을 모두 꺼냄
+    av_init_packet(&pkt);
+    pkt.data = NULL;
+    pkt.size = 0;
+    do {
+        got_frame = 0;
+        if (decode_packet(codec_ctx, &pkt, &frame, &got_frame) < 0) {
+            break;
+        }
+        if (got_frame) {
+            collect_frame(gop, frame, memory);
+        }
+    } while (got_frame);
+
+    return 0;
+}
+
+// 전체 예산에 GOP 하나가 들어갈 자리가 없으면 앞선 GOP가 내보내질 때까지 디코딩을 미룸
+// 다음에 내보낼 GOP는 기다리지 않음 (내보내는 쪽이 이 GOP를 기다리고 있으므로 멈추면 교착)
+static void wait_for_memory(GopScheduler* sched, int index) {
+    int64_t estimate;
+
+    while (1) {
+        pthread_mutex_lock(&sched->mutex);
+        if (index <= sched->next_emit) {
+            pthread_mutex_unlock(&sched->mutex);
+            return;
+        }
+        estimate = sched->decoded_gops > 0 ? sched->decoded_bytes / sched->decoded_gops : 0;
+        pthread_mutex_unlock(&sched->mutex);
+
+        if (memory_wait_for_room(sched->memory, estimate, MEMORY_POLL_MS) == 0) {
+            return;
+        }
+    }
+}
+
+static void* gop_worker(void* arg) {
+    GopScheduler* sched = (GopScheduler*)arg;
+    FileContext file;
+    DecodeOptions opts;
+    AVFrame* frame;
+    int opened;
+
+    // GOP 단위로 병렬화하므로 디코더 하나는 스레드 하나만 사용
+    init_decode_options(&opts);
+    opts.thread_count = 1;
+    opened = open_input(&file, sched->filename, &opts) >= 0 && file.v_index >= 0;
+    frame = av_frame_alloc();
+
+    while (1) {
+        int index;
+
+        pthread_mutex_lock(&sched->mutex);
+        // 재정렬 버퍼가 가득 차면 앞선 GOP가 내보내질 때까지 기다림
+        while (sched->next_gop < sched->nb_gops && sched->next_gop >= sched->next_emit + sched->max_buffered) {
+            pthread_cond_wait(&sched->emitted, &sched->mutex);
+        }
+        if (sched->next_gop >= sched->nb_gops) {
+            pthread_mutex_unlock(&sched->mutex);
+            break;
+        }
+        index = sched->next_gop++;
+        pthread_mutex_unlock(&sched->mutex);
+
+        wait_for_memory(sched, index);
+
+        GopRange* gop = &sched->gops[index];
+        if (!opened || frame == NULL || decode_gop(&file, gop, frame, sched->memory) < 0) {
+            gop->failed = 1;
+        }
+
+        pthread_mutex_lock(&sched->mutex);
+        sched->decoded_bytes += gop->bytes;
+        sched->decoded_gops++;
+        gop->done = 1;
+        pthread_cond_broadcast(&sched->gop_done);
+        pthread_mutex_unlock(&sched->mutex);
+    }
+
+    av_frame_free(&frame);
+    release(&file);
+    return NULL;
+}
+
+int decode_gop_parallel(const char* filename, const GopParallelOptions* opts,
+                        GopFrameCallback callback, void* opaque, GopParallelStats* stats) {
+    GopScheduler sched;
+    pthread_t* workers;
+    int nb_workers = 0;
+    int64_t start = av_gettime_relative();
+    int ret = 0;
+    int i, j;
+
+    memset(stats, 0, sizeof(*stats));
+    memset(&sched, 0, sizeof(sched));
+    sched.filename = filename;
+    sched.max_buffered = FFMAX(opts->max_buffered_gops, 1);
+
+    if (index_gops(filename, &sched.gops, &sched.nb_gops) < 0) {
+        av_freep(&sched.gops);
+        return -1;
+    }
+
+    workers = av_malloc_array(FFMAX(opts->threads, 1), sizeof(pthread_t));
+    if (workers == NULL) {
+        av_freep(&sched.gops);
+        return -2;
+    }
+
+    pthread_mutex_init(&sched.mutex, NULL);
+    pthread_cond_init(&sched.gop_done, NULL);
+    pthread_cond_init(&sched.emitted, NULL);
+    sched.memory = memory_register(opts->memory, "gop reorder buffer", NULL, NULL);
+
+    for (i = 0; i < FFMAX(opts->threads, 1); i++) {
+        if (pthread_create(&workers[nb_workers], NULL, gop_worker, &sched) != 0) {
+            break;
+        }
+        nb_workers++;
+    }
+    if (nb_workers == 0) {
+        ret = -3;
+        sched.nb_gops = 0;
+    }
+
+    // 재정렬 버퍼: GOP를 순서대로 기다렸다가 그 안의 프레임을 pts 순서로 내보냄
+    for (i = 0; i < sched.nb_gops; i++) {
+        GopRange* gop = &sched.gops[i];
+
+        pthread_mutex_lock(&sched.mutex);
+        while (!gop->done) {
+            pthread_cond_wait(&sched.gop_done, &sched.mutex);
+        }
+        pthread_mutex_unlock(&sched.mutex);
+
+        if (gop->failed) {
+            ret = -4;
+        }
+        for (j = 0; j < gop->nb_frames; j++) {
+            int64_t bytes = memory_frame_bytes(gop->frames[j]);
+
+            callback(gop->frames[j], opaque);
+            av_frame_free(&gop->frames[j]);
+            memory_release(sched.memory, bytes);
+        }
+        stats->frames += gop->nb_frames;
+        stats->dropped_frames += gop->dropped;
+        av_freep(&gop->frames);
+
+        pthread_mutex_lock(&sched.mutex);
+        sched.next_emit = i + 1;
+        pthread_cond_broadcast(&sched.emitted);
+        pthread_mutex_unlock(&sched.mutex);
+    }
+
+    for (i = 0; i < nb_workers; i++) {
+        pthread_join(workers[i], NULL);
+    }
+
+    stats->gops = sched.nb_gops;
+    stats->elapsed_sec = (av_gettime_relative() - start) / 1000000.0;
+
+    memory_unregister(&sched.memory);
+    pthread_cond_destroy(&sched.emitted);
+    pthread_cond_destroy(&sched.gop_done);
+    pthread_mutex_destroy(&sched.mutex);
+    av_free(workers);
+    av_freep(&sched.gops);
+
+    return ret;
+}
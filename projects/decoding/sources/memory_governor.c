@@ -0,0 +1,317 @@
+#include <libavutil/avstring.h>
+#include <libavutil/common.h>
+#include <libavutil/error.h>
+#include <libavutil/mem.h>
+#include <errno.h>
+#include <pthread.h>
+#include <string.h>
+#include <sys/time.h>
+#include <time.h>
+
+#include "memory_governor.h"
+
+struct _MemoryComponent {
+    MemoryGovernor* governor;
+    char name[MEMORY_NAME_SIZE];
+    MemoryShrinkCallback shrink;
+    void* opaque;
+    int64_t bytes;
+    int64_t peak_bytes;
+    struct _MemoryComponent* next;
+};
+
+struct _MemoryGovernor {
+    int64_t budget_bytes;
+    int64_t bytes;
+    int64_t peak_bytes;
+    int64_t waits;
+    int64_t shrunk_bytes;
+    int64_t refused;
+    MemoryComponent* components;
+    // 사용량과 컴포넌트 목록을 보호
+    pthread_mutex_t mutex;
+    // 사용량이 줄어들 때마다 알림
+    pthread_cond_t released;
+    // shrink 콜백을 부르는 동안 잡음, 등록/해제도 이 잠금을 잡으므로 콜백 중에 컴포넌트가 사라지지 않음
+    pthread_mutex_t shrink_mutex;
+};
+
+MemoryGovernor* memory_governor_create(int64_t budget_bytes) {
+    MemoryGovernor* governor = av_mallocz(sizeof(MemoryGovernor));
+
+    if (governor == NULL) {
+        return NULL;
+    }
+    governor->budget_bytes = budget_bytes;
+    pthread_mutex_init(&governor->mutex, NULL);
+    pthread_cond_init(&governor->released, NULL);
+    pthread_mutex_init(&governor->shrink_mutex, NULL);
+    return governor;
+}
+
+void memory_governor_destroy(MemoryGovernor** governor_ptr) {
+    MemoryGovernor* governor = *governor_ptr;
+
+    if (governor == NULL) {
+        return;
+    }
+    pthread_mutex_destroy(&governor->shrink_mutex);
+    pthread_cond_destroy(&governor->released);
+    pthread_mutex_destroy(&governor->mutex);
+    av_freep(governor_ptr);
+}
+
+MemoryComponent* memory_register(MemoryGovernor* governor, const char* name, MemoryShrinkCallback shrink, void* opaque) {
+    MemoryComponent* component;
+
+    if (governor == NULL) {
+        return NULL;
+    }
+    component = av_mallocz(sizeof(MemoryComponent));
+    if (component == NULL) {
+        return NULL;
+    }
+    component->governor = governor;
+    av_strlcpy(component->name, name, sizeof(component->name));
+    component->shrink = shrink;
+    component->opaque = opaque;
+
+    pthread_mutex_lock(&governor->shrink_mutex);
+    pthread_mutex_lock(&governor->mutex);
+    component->next = governor->components;
+    governor->components = component;
+    pthread_mutex_unlock(&governor->mutex);
+    pthread_mutex_unlock(&governor->shrink_mutex);
+    return component;
+}
+
+void memory_unregister(MemoryComponent** component_ptr) {
+    MemoryComponent* component = *component_ptr;
+    MemoryGovernor* governor;
+    MemoryComponent** link;
+
+    if (component == NULL) {
+        return;
+    }
+    governor = component->governor;
+
+    pthread_mutex_lock(&governor->shrink_mutex);
+    pthread_mutex_lock(&governor->mutex);
+    for (link = &governor->components; *link != NULL; link = &(*link)->next) {
+        if (*link == component) {
+            *link = component->next;
+            break;
+        }
+    }
+    governor->bytes -= component->bytes;
+    pthread_cond_broadcast(&governor->released);
+    pthread_mutex_unlock(&governor->mutex);
+    pthread_mutex_unlock(&governor->shrink_mutex);
+
+    av_freep(component_ptr);
+}
+
+// governor->mutex를 잡은 상태에서 호출
+static void charge_locked(MemoryComponent* component, int64_t bytes) {
+    MemoryGovernor* governor = component->governor;
+
+    component->bytes += bytes;
+    component->peak_bytes = FFMAX(component->peak_bytes, component->bytes);
+    governor->bytes += bytes;
+    governor->peak_bytes = FFMAX(governor->peak_bytes, governor->bytes);
+}
+
+void memory_charge(MemoryComponent* component, int64_t bytes) {
+    if (component == NULL || bytes <= 0) {
+        return;
+    }
+    pthread_mutex_lock(&component->governor->mutex);
+    charge_locked(component, bytes);
+    pthread_mutex_unlock(&component->governor->mutex);
+}
+
+void memory_release(MemoryComponent* component, int64_t bytes) {
+    MemoryGovernor* governor;
+
+    if (component == NULL || bytes <= 0) {
+        return;
+    }
+    governor = component->governor;
+
+    pthread_mutex_lock(&governor->mutex);
+    component->bytes -= bytes;
+    governor->bytes -= bytes;
+    pthread_cond_broadcast(&governor->released);
+    pthread_mutex_unlock(&governor->mutex);
+}
+
+static int64_t shortage(MemoryGovernor* governor, int64_t bytes) {
+    int64_t needed;
+
+    pthread_mutex_lock(&governor->mutex);
+    needed = governor->bytes + bytes - governor->budget_bytes;
+    pthread_mutex_unlock(&governor->mutex);
+    return needed;
+}
+
+// bytes를 더 쓰기에 모자란 만큼 requester가 아닌 컴포넌트의 캐시를 줄임
+static void shrink_others(MemoryGovernor* governor, const MemoryComponent* requester, int64_t bytes) {
+    MemoryComponent* component;
+    int64_t needed;
+    int64_t freed = 0;
+
+    pthread_mutex_lock(&governor->shrink_mutex);
+    needed = shortage(governor, bytes);
+    for (component = governor->components; component != NULL && freed < needed; component = component->next) {
+        if (component != requester && component->shrink != NULL) {
+            freed += component->shrink(component->opaque, needed - freed);
+        }
+    }
+    pthread_mutex_unlock(&governor->shrink_mutex);
+
+    if (freed > 0) {
+        pthread_mutex_lock(&governor->mutex);
+        governor->shrunk_bytes += freed;
+        pthread_mutex_unlock(&governor->mutex);
+    }
+}
+
+int memory_try_charge(MemoryComponent* component, int64_t bytes) {
+    MemoryGovernor* governor;
+    int ret = 0;
+
+    if (component == NULL) {
+        return 0;
+    }
+    governor = component->governor;
+
+    if (shortage(governor, bytes) > 0) {
+        shrink_others(governor, component, bytes);
+    }
+
+    pthread_mutex_lock(&governor->mutex);
+    if (governor->bytes + bytes > governor->budget_bytes) {
+        governor->refused++;
+        ret = AVERROR(EAGAIN);
+    } else {
+        charge_locked(component, bytes);
+    }
+    pthread_mutex_unlock(&governor->mutex);
+    return ret;
+}
+
+int memory_over_budget(const MemoryComponent* component) {
+    MemoryGovernor* governor;
+    int over;
+
+    if (component == NULL) {
+        return 0;
+    }
+    governor = component->governor;
+
+    pthread_mutex_lock(&governor->mutex);
+    over = governor->bytes > governor->budget_bytes;
+    pthread_mutex_unlock(&governor->mutex);
+    return over;
+}
+
+int memory_wait_for_room(MemoryComponent* component, int64_t bytes, int timeout_ms) {
+    MemoryGovernor* governor;
+    struct timespec deadline;
+    struct timeval now;
+    int waited = 0;
+    int ret = 0;
+
+    if (component == NULL) {
+        return 0;
+    }
+    governor = component->governor;
+
+    if (shortage(governor, bytes) > 0) {
+        shrink_others(governor, component, bytes);
+    }
+
+    gettimeofday(&now, NULL);
+    deadline.tv_sec = now.tv_sec + timeout_ms / 1000;
+    deadline.tv_nsec = now.tv_usec * 1000 + (timeout_ms % 1000) * 1000000L;
+    if (deadline.tv_nsec >= 1000000000L) {
+        deadline.tv_sec++;
+        deadline.tv_nsec -= 1000000000L;
+    }
+
+    pthread_mutex_lock(&governor->mutex);
+    // 자기가 잡은 메모리가 없으면 기다려도 스스로 풀 수 있는 것이 없으므로 그냥 진행
+    while (governor->bytes + bytes > governor->budget_bytes && component->bytes > 0) {
+        waited = 1;
+        if (timeout_ms < 0) {
+            pthread_cond_wait(&governor->released, &governor->mutex);
+        } else if (pthread_cond_timedwait(&governor->released, &governor->mutex, &deadline) == ETIMEDOUT) {
+            ret = AVERROR(EAGAIN);
+            break;
+        }
+    }
+    governor->waits += waited;
+    pthread_mutex_unlock(&governor->mutex);
+    return ret;
+}
+
+int memory_governor_usage(MemoryGovernor* governor, MemoryUsage* usage, int max) {
+    MemoryComponent* component;
+    int count = 0;
+
+    pthread_mutex_lock(&governor->mutex);
+    for (component = governor->components; component != NULL; component = component->next) {
+        if (count < max) {
+            av_strlcpy(usage[count].name, component->name, sizeof(usage[count].name));
+            usage[count].bytes = component->bytes;
+            usage[count].peak_bytes = component->peak_bytes;
+        }
+        count++;
+    }
+    pthread_mutex_unlock(&governor->mutex);
+    return count;
+}
+
+void memory_governor_stats(MemoryGovernor* governor, MemoryGovernorStats* stats) {
+    pthread_mutex_lock(&governor->mutex);
+    stats->budget_bytes = governor->budget_bytes;
+    stats->bytes = governor->bytes;
+    stats->peak_bytes = governor->peak_bytes;
+    stats->waits = governor->waits;
+    stats->shrunk_bytes = governor->shrunk_bytes;
+    stats->refused = governor->refused;
+    pthread_mutex_unlock(&governor->mutex);
+}
+
+void memory_governor_print(FILE* out, MemoryGovernor* governor) {
+    MemoryGovernorStats stats;
+    MemoryUsage usage[16];
+    int count;
+    int i;
+
+    memory_governor_stats(governor, &stats);
+    fprintf(out, "Memory: budget(%.1fMB), used(%.1fMB), peak(%.1fMB), waits(%lld), shrunk(%.1fMB), refused(%lld)\n",
+            stats.budget_bytes / 1048576.0, stats.bytes / 1048576.0, stats.peak_bytes / 1048576.0,
+            (long long)stats.waits, stats.shrunk_bytes / 1048576.0, (long long)stats.refused);
+
+    count = FFMIN(memory_governor_usage(governor, usage, 16), 16);
+    for (i = 0; i < count; i++) {
+        fprintf(out, "Memory: %s used(%.1fMB), peak(%.1fMB)\n", usage[i].name,
+                usage[i].bytes / 1048576.0, usage[i].peak_bytes / 1048576.0);
+    }
+}
+
+int64_t memory_frame_bytes(const AVFrame* frame) {
+    int64_t bytes = 0;
+    int i;
+
+    for (i = 0; i < AV_NUM_DATA_POINTERS; i++) {
+        if (frame->buf[i] != NULL) {
+            bytes += frame->buf[i]->size;
+        }
+    }
+    for (i = 0; i < frame->nb_extended_buf; i++) {
+        bytes += frame->extended_buf[i]->size;
+    }
+    return bytes;
+}
@@ -0,0 +1,131 @@
+#include <libavformat/avformat.h>
+#include <libavcodec/avcodec.h>
+#include <libavutil/avutil.h>
+#include <libavutil/pixdesc.h>
+#include <libavutil/time.h>
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "decoder.h"
+#include "preview.h"
+
+// 두 프레임이 완전히 같을 때 보고할 PSNR 상한 (dB)
+#define PSNR_MAX 100.0
+
+static int luma_sample(const AVFrame* frame, int depth, int x, int y) {
+    const uint8_t* row = frame->data[0] + y * frame->linesize[0];
+    return depth > 8 ? ((const uint16_t*)row)[x] : row[x];
+}
+
+// 원본 luma를 미리보기 크기로 박스 평균해 미리보기 luma와 비교
+static double luma_psnr(const AVFrame* full, const AVFrame* preview, int lowres) {
+    const AVPixFmtDescriptor* desc = av_pix_fmt_desc_get(full->format);
+    int depth = desc->comp[0].depth;
+    int factor = 1 << lowres;
+    double peak = (double)((1 << depth) - 1);
+    double sse = 0.0;
+    int x, y, bx, by;
+
+    for (y = 0; y < preview->height; y++) {
+        for (x = 0; x < preview->width; x++) {
+            int sum = 0, count = 0;
+            for (by = y * factor; by < (y + 1) * factor && by < full->height; by++) {
+                for (bx = x * factor; bx < (x + 1) * factor && bx < full->width; bx++) {
+                    sum += luma_sample(full, depth, bx, by);
+                    count++;
+                }
+            }
+            if (count > 0) {
+                double diff = (double)sum / count - luma_sample(preview, depth, x, y);
+                sse += diff * diff;
+            }
+        }
+    }
+
+    if (sse == 0.0) {
+        return PSNR_MAX;
+    }
+    return FFMIN(PSNR_MAX, 10.0 * log10(peak * peak * preview->width * preview->height / sse));
+}
+
+// 프레임 하나를 디코딩하면서 걸린 시간을 누적
+static int timed_read_video_frame(FileContext* file, AVFrame* frame, int64_t* elapsed) {
+    int64_t start = av_gettime_relative();
+    int ret = read_video_frame(file, frame);
+    *elapsed += av_gettime_relative() - start;
+    return ret;
+}
+
+int measure_preview_quality(const char* filename, int max_frames, PreviewReport* report) {
+    FileContext full_file, preview_file;
+    DecodeOptions full_opts, preview_opts;
+    AVFrame* full_frame = NULL;
+    AVFrame* preview_frame = NULL;
+    int64_t full_time = 0, preview_time = 0;
+    double psnr_sum = 0.0;
+    int ret = 0;
+
+    memset(report, 0, sizeof(*report));
+    report->psnr_min = PSNR_MAX;
+
+    init_decode_options(&full_opts);
+    init_decode_options(&preview_opts);
+    preview_opts.quality = DECODE_QUALITY_PREVIEW;
+
+    if (open_input(&full_file, filename, &full_opts) < 0) {
+        release(&full_file);
+        return -1;
+    }
+    if (open_input(&preview_file, filename, &preview_opts) < 0 || preview_file.v_index < 0) {
+        release(&preview_file);
+        release(&full_file);
+        return -1;
+    }
+    report->lowres = preview_file.fmt_ctx->streams[preview_file.v_index]->codec->lowres;
+
+    full_frame = av_frame_alloc();
+    preview_frame = av_frame_alloc();
+    if (full_frame == NULL || preview_frame == NULL) {
+        ret = -2;
+        goto end;
+    }
+
+    // skip_idct, skip_loop_filter는 프레임을 버리지 않으므로 두 디코더의 출력은 순서대로 짝이 맞음
+    while (max_frames <= 0 || report->frames < max_frames) {
+        if (timed_read_video_frame(&full_file, full_frame, &full_time) < 0) {
+            break;
+        }
+        if (timed_read_video_frame(&preview_file, preview_frame, &preview_time) < 0) {
+            av_frame_unref(full_frame);
+            break;
+        }
+
+        double psnr = luma_psnr(full_frame, preview_frame, report->lowres);
+        psnr_sum += psnr;
+        report->psnr_min = FFMIN(report->psnr_min, psnr);
+        report->frames++;
+
+        av_frame_unref(full_frame);
+        av_frame_unref(preview_frame);
+    }
+
+    report->full_decode_sec = full_time / 1000000.0;
+    report->preview_decode_sec = preview_time / 1000000.0;
+    if (preview_time > 0) {
+        report->speedup = (double)full_time / preview_time;
+    }
+    if (report->frames > 0) {
+        report->psnr_avg = psnr_sum / report->frames;
+    } else {
+        report->psnr_min = 0.0;
+    }
+
+end:
+    av_frame_free(&full_frame);
+    av_frame_free(&preview_frame);
+    release(&preview_file);
+    release(&full_file);
+
+    return ret;
+}
@@ -0,0 +1,360 @@
+#include <libavformat/avformat.h>
+#include <libavcodec/avcodec.h>
+#include <libavutil/avutil.h>
+#include <libavutil/time.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "decoder.h"
+#include "seek.h"
+#include "reverse.h"
+#include "memory_governor.h"
+
+// 예산을 기다리는 동안 종료 요청을 확인하는 간격
+#define MEMORY_POLL_MS 100
+
+typedef struct _ReverseGop {
+    // pts 순서로 쌓는 원형 버퍼, 가득 차면 가장 앞선 프레임을 버림
+    AVFrame** frames;
+    int capacity;
+    int first;
+    int count;
+    int64_t start_pts;
+    int64_t end_pts;
+    int overflowed;
+    int failed;
+    double decode_sec;
+    // 버퍼에 든 프레임을 계산에 넣는 컴포넌트 (NULL 가능)
+    MemoryComponent* memory;
+    int64_t bytes;
+} ReverseGop;
+
+typedef struct _ReverseReader {
+    FileContext file;
+    int max_frames;
+    // 다음에 디코딩할 GOP가 내보낼 프레임의 pts 상한 (이 값은 포함하지 않음)
+    int64_t end_pts;
+    // 디코딩이 끝나 내보내기를 기다리는 GOP, 한 번에 하나만 둠
+    ReverseGop* ready;
+    // 내보내는 쪽이 GOP 하나를 넘기는 중 (해제할 때까지)
+    int emitting;
+    // 마지막 GOP(빈 GOP 또는 NULL)를 넘겼음
+    int finished;
+    int quit;
+    MemoryComponent* memory;
+    pthread_mutex_t mutex;
+    pthread_cond_t cond;
+} ReverseReader;
+
+void init_reverse_options(ReverseOptions* opts) {
+    opts->start_seconds = -1.0;
+    opts->max_gop_frames = 300;
+    opts->memory = NULL;
+}
+
+static int64_t packet_ts(const AVPacket* pkt) {
+    return pkt->dts != AV_NOPTS_VALUE ? pkt->dts : pkt->pts;
+}
+
+static void free_gop(ReverseGop** gop_ptr) {
+    ReverseGop* gop = *gop_ptr;
+    int i;
+
+    if (gop == NULL) {
+        return;
+    }
+    for (i = 0; i < gop->count; i++) {
+        av_frame_free(&gop->frames[(gop->first + i) % gop->capacity]);
+    }
+    memory_release(gop->memory, gop->bytes);
+    av_free(gop->frames);
+    av_freep(gop_ptr);
+}
+
+static void collect_frame(ReverseGop* gop, AVFrame* frame) {
+    int64_t bytes;
+    int index;
+
+    // 이 GOP의 키프레임보다 앞선 leading 프레임은 앞 GOP에서 내보내고, 상한 이후 프레임은 이미 내보냈음
+    if (frame->pts == AV_NOPTS_VALUE || frame->pts < gop->start_pts || frame->pts >= gop->end_pts) {
+        av_frame_unref(frame);
+        return;
+    }
+
+    if (gop->count == gop->capacity) {
+        bytes = memory_frame_bytes(gop->frames[gop->first]);
+        memory_release(gop->memory, bytes);
+        gop->bytes -= bytes;
+        av_frame_free(&gop->frames[gop->first]);
+        gop->first = (gop->first + 1) % gop->capacity;
+        gop->count--;
+        gop->overflowed = 1;
+    }
+    index = (gop->first + gop->count) % gop->capacity;
+    gop->frames[index] = av_frame_alloc();
+    if (gop->frames[index] == NULL) {
+        gop->failed = 1;
+        av_frame_unref(frame);
+        return;
+    }
+    av_frame_move_ref(gop->frames[index], frame);
+    gop->count++;
+    bytes = memory_frame_bytes(gop->frames[index]);
+    gop->bytes += bytes;
+    memory_charge(gop->memory, bytes);
+}
+
+// 파일 끝에서부터 재생할 때 탐색할 위치 (마지막 키프레임을 찾기 위함)
+static int64_t stream_end_pts(const FileContext* file) {
+    AVStream* stream = file->fmt_ctx->streams[file->v_index];
+    int64_t start = stream->start_time != AV_NOPTS_VALUE ? stream->start_time : 0;
+
+    if (stream->duration != AV_NOPTS_VALUE) {
+        return start + stream->duration;
+    }
+    if (file->fmt_ctx->duration != AV_NOPTS_VALUE) {
+        return start + av_rescale_q(file->fmt_ctx->duration, AV_TIME_BASE_Q, stream->time_base);
+    }
+    return INT64_MAX;
+}
+
+// end_pts 바로 앞의 키프레임으로 이동해 [키프레임 pts, end_pts) 구간의 프레임을 모두 디코딩
+static int decode_gop_before(ReverseReader* reader, ReverseGop* gop, AVFrame* frame) {
+    FileContext* file = &reader->file;
+    AVCodecContext* codec_ctx = file->fmt_ctx->streams[file->v_index]->codec;
+    AVPacket pkt;
+    int64_t start = av_gettime_relative();
+    int64_t target;
+    int got_frame;
+    int ret;
+
+    gop->end_pts = reader->end_pts;
+    gop->start_pts = AV_NOPTS_VALUE;
+    target = reader->end_pts == INT64_MAX ? stream_end_pts(file) : reader->end_pts - 1;
+    if (av_seek_frame(file->fmt_ctx, file->v_index, target, AVSEEK_FLAG_BACKWARD) < 0) {
+        return -1;
+    }
+    avcodec_flush_buffers(codec_ctx);
+
+    while (av_read_frame(file->fmt_ctx, &pkt) >= 0) {
+        if (pkt.stream_index != file->v_index) {
+            av_free_packet(&pkt);
+            continue;
+        }
+        // 탐색 직후 키프레임이 나올 때까지는 디코딩할 수 없는 패킷
+        if (gop->start_pts == AV_NOPTS_VALUE) {
+            if (!(pkt.flags & AV_PKT_FLAG_KEY)) {
+                av_free_packet(&pkt);
+                continue;
+            }
+            gop->start_pts = pkt.pts != AV_NOPTS_VALUE ? pkt.pts : pkt.dts;
+        }
+        // dts가 상한을 넘으면 그 뒤의 패킷은 모두 pts >= dts >= 상한 이므로 필요 없음
+        // 다음 GOP의 leading B 프레임처럼 상한보다 앞서 보이는 프레임은 여기까지 모두 디코딩됨
+        if (packet_ts(&pkt) != AV_NOPTS_VALUE && packet_ts(&pkt) >= reader->end_pts) {
+            av_free_packet(&pkt);
+            break;
+        }
+
+        got_frame = 0;
+        ret = decode_packet(codec_ctx, &pkt, &frame, &got_frame);
+        av_free_packet(&pkt);
+        if (ret >= 0 && got_frame) {
+            collect_frame(gop, frame);
+        }
+    }
+
+    av_init_packet(&pkt);
+    pkt.data = NULL;
+    pkt.size = 0;
+    do {
+        got_frame = 0;
+        if (decode_packet(codec_ctx, &pkt, &frame, &got_frame) < 0) {
+            break;
+        }
+        if (got_frame) {
+            collect_frame(gop, frame);
+        }
+    } while (got_frame);
+
+    gop->decode_sec = (av_gettime_relative() - start) / 1000000.0;
+    return gop->failed ? -2 : 0;
+}
+
+static int reader_quit(ReverseReader* reader) {
+    int quit;
+
+    pthread_mutex_lock(&reader->mutex);
+    quit = reader->quit;
+    pthread_mutex_unlock(&reader->mutex);
+    return quit;
+}
+
+// 더 앞선 GOP를 차례로 디코딩해 ready에 넘김, 내보내는 쪽이 가져갈 때까지 다음 GOP는 기다림
+// 넘긴 GOP와 내보내는 중인 GOP가 모두 살아있으면 다음 GOP를 디코딩하지 않아 한 번에 GOP 두 개만 메모리에 둠
+static void* reverse_worker(void* arg) {
+    ReverseReader* reader = (ReverseReader*)arg;
+    AVFrame* frame = av_frame_alloc();
+    ReverseGop* gop;
+    int64_t last_bytes = 0;
+    int last;
+
+    while (1) {
+        pthread_mutex_lock(&reader->mutex);
+        while (reader->ready != NULL && reader->emitting && !reader->quit) {
+            pthread_cond_wait(&reader->cond, &reader->mutex);
+        }
+        if (reader->quit) {
+            pthread_mutex_unlock(&reader->mutex);
+            break;
+        }
+        pthread_mutex_unlock(&reader->mutex);
+
+        // 전체 예산에 직전 GOP 만큼의 자리가 없으면 내보내는 쪽이 프레임을 넘겨 메모리를 풀 때까지 미리 읽지 않음
+        while (memory_wait_for_room(reader->memory, last_bytes, MEMORY_POLL_MS) < 0 && !reader_quit(reader)) {
+        }
+
+        gop = av_mallocz(sizeof(ReverseGop));
+        if (gop != NULL) {
+            gop->frames = av_mallocz_array(reader->max_frames, sizeof(AVFrame*));
+            gop->capacity = reader->max_frames;
+            gop->memory = reader->memory;
+        }
+        if (gop == NULL || gop->frames == NULL || frame == NULL || decode_gop_before(reader, gop, frame) < 0) {
+            if (gop != NULL) {
+                gop->failed = 1;
+            }
+        }
+
+        // 프레임이 하나도 없으면 파일 앞까지 온 것 (또는 실패), 빈 GOP로 끝을 알림
+        last = gop == NULL || gop->failed || gop->count == 0;
+        if (!last) {
+            // 버퍼에 남은 가장 앞선 프레임 이전이 다음 GOP의 범위
+            // GOP가 max_frames 보다 길어 앞쪽을 버렸다면 같은 키프레임에서 다시 디코딩하게 됨
+            reader->end_pts = gop->frames[gop->first]->pts;
+            last_bytes = gop->bytes;
+        }
+
+        pthread_mutex_lock(&reader->mutex);
+        while (reader->ready != NULL && !reader->quit) {
+            pthread_cond_wait(&reader->cond, &reader->mutex);
+        }
+        if (reader->quit) {
+            pthread_mutex_unlock(&reader->mutex);
+            free_gop(&gop);
+            break;
+        }
+        reader->ready = gop;
+        reader->finished = last;
+        pthread_cond_broadcast(&reader->cond);
+        pthread_mutex_unlock(&reader->mutex);
+
+        if (last) {
+            break;
+        }
+    }
+
+    av_frame_free(&frame);
+    return NULL;
+}
+
+int decode_reverse(const char* filename, const ReverseOptions* opts,
+                   GopFrameCallback callback, void* opaque, ReverseStats* stats) {
+    ReverseReader reader;
+    pthread_t worker;
+    AVStream* stream;
+    int64_t start = av_gettime_relative();
+    int ret = 0;
+    int i;
+
+    memset(stats, 0, sizeof(*stats));
+    memset(&reader, 0, sizeof(reader));
+    reader.max_frames = FFMAX(opts->max_gop_frames, 1);
+
+    if (open_input(&reader.file, filename, NULL) < 0 || reader.file.v_index < 0) {
+        release(&reader.file);
+        return -1;
+    }
+    stream = reader.file.fmt_ctx->streams[reader.file.v_index];
+    reader.end_pts = opts->start_seconds < 0 ? INT64_MAX : seconds_to_pts(stream, opts->start_seconds) + 1;
+
+    pthread_mutex_init(&reader.mutex, NULL);
+    pthread_cond_init(&reader.cond, NULL);
+    reader.memory = memory_register(opts->memory, "reverse gops", NULL, NULL);
+    if (pthread_create(&worker, NULL, reverse_worker, &reader) != 0) {
+        memory_unregister(&reader.memory);
+        pthread_cond_destroy(&reader.cond);
+        pthread_mutex_destroy(&reader.mutex);
+        release(&reader.file);
+        return -2;
+    }
+
+    while (1) {
+        ReverseGop* gop;
+        double duration;
+
+        pthread_mutex_lock(&reader.mutex);
+        while (reader.ready == NULL && !reader.finished) {
+            pthread_cond_wait(&reader.cond, &reader.mutex);
+        }
+        gop = reader.ready;
+        reader.ready = NULL;
+        reader.emitting = gop != NULL;
+        // 워커가 이 GOP를 내보내는 동안 다음 GOP를 디코딩하도록 깨움
+        pthread_cond_broadcast(&reader.cond);
+        pthread_mutex_unlock(&reader.mutex);
+
+        if (gop == NULL || gop->count == 0) {
+            // 첫 키프레임보다 앞으로 탐색하면 실패하는 포맷이 있으므로 GOP를 하나라도 내보냈다면 정상 종료로 봄
+            if (gop == NULL || (gop->failed && stats->gops == 0)) {
+                ret = -3;
+            }
+            free_gop(&gop);
+            break;
+        }
+
+        stats->frames += gop->count;
+        for (i = gop->count - 1; i >= 0; i--) {
+            AVFrame** frame = &gop->frames[(gop->first + i) % gop->capacity];
+            int64_t bytes = memory_frame_bytes(*frame);
+
+            callback(*frame, opaque);
+            av_frame_free(frame);
+            memory_release(gop->memory, bytes);
+            gop->bytes -= bytes;
+        }
+        gop->count = 0;
+
+        stats->gops++;
+        stats->redecoded_gops += gop->overflowed;
+        stats->max_gop_decode_sec = FFMAX(stats->max_gop_decode_sec, gop->decode_sec);
+        duration = (gop->end_pts == INT64_MAX ? 0 : gop->end_pts - gop->start_pts) * av_q2d(stream->time_base);
+        if (duration > 0 && gop->decode_sec > duration) {
+            stats->slow_gops++;
+        }
+        free_gop(&gop);
+
+        // 이 GOP가 해제되었으니 워커가 그 다음 GOP를 디코딩해도 됨
+        pthread_mutex_lock(&reader.mutex);
+        reader.emitting = 0;
+        pthread_cond_broadcast(&reader.cond);
+        pthread_mutex_unlock(&reader.mutex);
+    }
+
+    pthread_mutex_lock(&reader.mutex);
+    reader.quit = 1;
+    pthread_cond_broadcast(&reader.cond);
+    pthread_mutex_unlock(&reader.mutex);
+    pthread_join(worker, NULL);
+    free_gop(&reader.ready);
+
+    stats->elapsed_sec = (av_gettime_relative() - start) / 1000000.0;
+
+    memory_unregister(&reader.memory);
+    pthread_cond_destroy(&reader.cond);
+    pthread_mutex_destroy(&reader.mutex);
+    release(&reader.file);
+
+    return ret;
+}
@@ -0,0 +1,156 @@
+#include <libavformat/avformat.h>
+#include <libavcodec/avcodec.h>
+#include <libavutil/avutil.h>
+#include <libavutil/time.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "decoder.h"
+#include "seek.h"
+
+// 탐색 이후에는 디코더 안에 남아있는 이전 위치의 데이터를 비워야 함
+static void flush_decoders(FileContext* file) {
+    unsigned int index;
+
+    for (index = 0; index < file->fmt_ctx->nb_streams; index++) {
+        if (index == file->v_index || index == file->a_index) {
+            avcodec_flush_buffers(file->fmt_ctx->streams[index]->codec);
+        }
+    }
+}
+
+// 목표 시각 이전에 표시가 끝나는 프레임은 결과가 될 수 없으므로
+// 다른 프레임이 참조하지 않는 프레임이면 디코딩 자체를 생략해도 됨
+static int ends_before(const AVPacket* pkt, int64_t target_pts) {
+    return pkt->pts != AV_NOPTS_VALUE && pkt->duration > 0 && pkt->pts + pkt->duration <= target_pts;
+}
+
+// 디코딩된 프레임 하나를 보고 목표 프레임을 찾았으면 1을 반환
+// 목표 이하의 프레임은 result에 후보로 남겨두고, 이전 후보는 변환 없이 버림
+static int take_frame(AVFrame* decoded, AVFrame* result, int* have_result, int64_t target_pts, SeekStats* stats) {
+    int64_t pts = decoded->pts;
+
+    if (pts != AV_NOPTS_VALUE && pts > target_pts) {
+        if (*have_result) {
+            av_frame_unref(decoded);
+        } else {
+            // 첫 프레임부터 목표보다 늦으면 (파일 시작보다 앞선 목표) 그 프레임을 씀
+            av_frame_move_ref(result, decoded);
+            *have_result = 1;
+        }
+        return 1;
+    }
+
+    if (*have_result) {
+        av_frame_unref(result);
+        stats->preroll_frames++;
+    }
+    av_frame_move_ref(result, decoded);
+    *have_result = 1;
+
+    // 목표 시각이 이 프레임의 표시 구간 안이면 다음 프레임을 볼 필요가 없음
+    return pts != AV_NOPTS_VALUE && (pts == target_pts || (result->pkt_duration > 0 && pts + result->pkt_duration > target_pts));
+}
+
+int seek_frame_at_pts(FileContext* file, int64_t target_pts, AVFrame* frame, SeekStats* stats) {
+    AVCodecContext* codec_ctx;
+    AVFrame* decoded;
+    AVPacket pkt;
+    enum AVDiscard skip_frame;
+    int64_t start, decode_start;
+    int have_result = 0, found = 0;
+    int got_frame;
+    int ret;
+
+    memset(stats, 0, sizeof(*stats));
+    stats->target_pts = target_pts;
+    stats->frame_pts = AV_NOPTS_VALUE;
+    if (file->v_index < 0) {
+        return AVERROR_STREAM_NOT_FOUND;
+    }
+    codec_ctx = file->fmt_ctx->streams[file->v_index]->codec;
+
+    decoded = av_frame_alloc();
+    if (decoded == NULL) {
+        return AVERROR(ENOMEM);
+    }
+
+    start = av_gettime_relative();
+    // 목표 이하의 가장 가까운 키프레임으로 이동, 지원하지 않는 포맷은 av_seek_frame으로 대신함
+    if (avformat_seek_file(file->fmt_ctx, file->v_index, INT64_MIN, target_pts, target_pts, 0) < 0 &&
+        av_seek_frame(file->fmt_ctx, file->v_index, target_pts, AVSEEK_FLAG_BACKWARD) < 0) {
+        av_frame_free(&decoded);
+        return -1;
+    }
+    flush_decoders(file);
+    decode_start = av_gettime_relative();
+    stats->seek_sec = (decode_start - start) / 1000000.0;
+
+    skip_frame = codec_ctx->skip_frame;
+    av_frame_unref(frame);
+
+    while (!found && av_read_frame(file->fmt_ctx, &pkt) >= 0) {
+        if (pkt.stream_index != file->v_index || !should_decode_packet(file, &pkt)) {
+            av_free_packet(&pkt);
+            continue;
+        }
+
+        if (ends_before(&pkt, target_pts)) {
+            codec_ctx->skip_frame = FFMAX(skip_frame, AVDISCARD_NONREF);
+            stats->skipped_packets++;
+        } else {
+            codec_ctx->skip_frame = skip_frame;
+        }
+
+        got_frame = 0;
+        ret = decode_packet(codec_ctx, &pkt, &decoded, &got_frame);
+        av_free_packet(&pkt);
+        stats->decoded_packets++;
+        if (ret >= 0 && got_frame) {
+            found = take_frame(decoded, frame, &have_result, target_pts, stats);
+        }
+    }
+    codec_ctx->skip_frame = skip_frame;
+
+    // 파일 끝까지 왔으면 디코더에 남은 프레임 중에서 찾음
+    if (!found) {
+        av_init_packet(&pkt);
+        pkt.data = NULL;
+        pkt.size = 0;
+        do {
+            got_frame = 0;
+            if (decode_packet(codec_ctx, &pkt, &decoded, &got_frame) < 0) {
+                break;
+            }
+            if (got_frame) {
+                found = take_frame(decoded, frame, &have_result, target_pts, stats);
+            }
+        } while (got_frame && !found);
+    }
+
+    av_frame_free(&decoded);
+    stats->decode_sec = (av_gettime_relative() - decode_start) / 1000000.0;
+    stats->total_sec = (av_gettime_relative() - start) / 1000000.0;
+
+    if (!have_result) {
+        return AVERROR_EOF;
+    }
+    stats->frame_pts = frame->pts;
+    return 0;
+}
+
+int64_t seconds_to_pts(const AVStream* stream, double seconds) {
+    int64_t pts = (int64_t)(seconds / av_q2d(stream->time_base) + 0.5);
+
+    if (stream->start_time != AV_NOPTS_VALUE) {
+        pts += stream->start_time;
+    }
+    return pts;
+}
+
+int seek_frame_at(FileContext* file, double seconds, AVFrame* frame, SeekStats* stats) {
+    if (file->v_index < 0) {
+        return AVERROR_STREAM_NOT_FOUND;
+    }
+    return seek_frame_at_pts(file, seconds_to_pts(file->fmt_ctx->streams[file->v_index], seconds), frame, stats);
+}